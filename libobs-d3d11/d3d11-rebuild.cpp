@@ -161,6 +161,8 @@ void gs_stage_surface::Rebuild(ID3D11Device *dev)
 	HRESULT hr = dev->CreateTexture2D(&td, nullptr, &texture);
 	if (FAILED(hr))
 		throw HRError("Failed to create staging surface", hr);
+
+	InitQuery(dev);
 }
 
 void gs_sampler_state::Rebuild(ID3D11Device *dev)
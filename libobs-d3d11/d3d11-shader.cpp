@@ -22,6 +22,9 @@
 #include <graphics/matrix3.h>
 #include <graphics/matrix4.h>
 
+/* part of the shader cache id, cached shaders are recompiled if changed */
+#define SHADER_COMPILE_FLAGS D3D10_SHADER_OPTIMIZATION_LEVEL1
+
 void gs_vertex_shader::GetBuffersExpected(
 	const vector<D3D11_INPUT_ELEMENT_DESC> &inputs)
 {
@@ -47,7 +50,6 @@ gs_vertex_shader::gs_vertex_shader(gs_device_t *device, const char *file,
 	  nTexUnits(0)
 {
 	ShaderProcessor processor(device);
-	ComPtr<ID3D10Blob> shaderBlob;
 	string outputString;
 	HRESULT hr;
 
@@ -58,13 +60,16 @@ gs_vertex_shader::gs_vertex_shader(gs_device_t *device, const char *file,
 	GetBuffersExpected(layoutData);
 	BuildConstantBuffer();
 
-	Compile(outputString.c_str(), file, "vs_4_0", shaderBlob.Assign());
-
-	data.resize(shaderBlob->GetBufferSize());
-	memcpy(&data[0], shaderBlob->GetBufferPointer(), data.size());
+	bool cached = CompileCached(outputString.c_str(), file, "vs_4_0");
 
 	hr = device->device->CreateVertexShader(data.data(), data.size(), NULL,
 						shader.Assign());
+	if (FAILED(hr) && cached) {
+		/* the runtime rejected the cached bytecode, replace it */
+		CompileAndCache(outputString.c_str(), file, "vs_4_0");
+		hr = device->device->CreateVertexShader(
+			data.data(), data.size(), NULL, shader.Assign());
+	}
 	if (FAILED(hr))
 		throw HRError("Failed to create vertex shader", hr);
 
@@ -87,7 +92,6 @@ gs_pixel_shader::gs_pixel_shader(gs_device_t *device, const char *file,
 	: gs_shader(device, gs_type::gs_pixel_shader, GS_SHADER_PIXEL)
 {
 	ShaderProcessor processor(device);
-	ComPtr<ID3D10Blob> shaderBlob;
 	string outputString;
 	HRESULT hr;
 
@@ -97,13 +101,16 @@ gs_pixel_shader::gs_pixel_shader(gs_device_t *device, const char *file,
 	processor.BuildSamplers(samplers);
 	BuildConstantBuffer();
 
-	Compile(outputString.c_str(), file, "ps_4_0", shaderBlob.Assign());
-
-	data.resize(shaderBlob->GetBufferSize());
-	memcpy(&data[0], shaderBlob->GetBufferPointer(), data.size());
+	bool cached = CompileCached(outputString.c_str(), file, "ps_4_0");
 
 	hr = device->device->CreatePixelShader(data.data(), data.size(), NULL,
 					       shader.Assign());
+	if (FAILED(hr) && cached) {
+		/* the runtime rejected the cached bytecode, replace it */
+		CompileAndCache(outputString.c_str(), file, "ps_4_0");
+		hr = device->device->CreatePixelShader(
+			data.data(), data.size(), NULL, shader.Assign());
+	}
 	if (FAILED(hr))
 		throw HRError("Failed to create pixel shader", hr);
 }
@@ -210,9 +217,8 @@ void gs_shader::Compile(const char *shaderString, const char *file,
 		throw "No shader string specified";
 
 	hr = device->d3dCompile(shaderString, strlen(shaderString), file, NULL,
-				NULL, "main", target,
-				D3D10_SHADER_OPTIMIZATION_LEVEL1, 0, shader,
-				errorsBlob.Assign());
+				NULL, "main", target, SHADER_COMPILE_FLAGS, 0,
+				shader, errorsBlob.Assign());
 	if (FAILED(hr)) {
 		if (errorsBlob != NULL && errorsBlob->GetBufferSize())
 			throw ShaderError(errorsBlob, hr);
@@ -438,3 +444,44 @@ void gs_shader_set_next_sampler(gs_sparam_t *param, gs_samplerstate_t *sampler)
 {
 	param->nextSampler = sampler;
 }
+
+static inline string shader_cache_id(gs_device_t *device, const char *target)
+{
+	return device->shaderCacheId + " " + target + " " +
+	       to_string(SHADER_COMPILE_FLAGS);
+}
+
+/* compiles into data and writes it to the shader cache, replacing any
+ * existing entry */
+void gs_shader::CompileAndCache(const char *shaderString, const char *file,
+				const char *target)
+{
+	ComPtr<ID3D10Blob> shaderBlob;
+
+	Compile(shaderString, file, target, shaderBlob.Assign());
+
+	data.resize(shaderBlob->GetBufferSize());
+	memcpy(&data[0], shaderBlob->GetBufferPointer(), data.size());
+
+	gs_shader_cache_save(shader_cache_id(device, target).c_str(),
+			     shaderString, data.data(), data.size());
+}
+
+/* fills data from the shader cache, or compiles and adds to it.  returns
+ * true if data came from the cache. */
+bool gs_shader::CompileCached(const char *shaderString, const char *file,
+			      const char *target)
+{
+	string id = shader_cache_id(device, target);
+	uint8_t *cached;
+	size_t size;
+
+	if (gs_shader_cache_load(id.c_str(), shaderString, &cached, &size)) {
+		data.assign(cached, cached + size);
+		bfree(cached);
+		return true;
+	}
+
+	CompileAndCache(shaderString, file, target);
+	return false;
+}
@@ -40,6 +40,8 @@ gs_stage_surface::gs_stage_surface(gs_device_t *device, uint32_t width,
 	hr = device->device->CreateTexture2D(&td, NULL, texture.Assign());
 	if (FAILED(hr))
 		throw HRError("Failed to create staging surface", hr);
+
+	InitQuery(device->device);
 }
 
 gs_stage_surface::gs_stage_surface(gs_device_t *device, uint32_t width,
@@ -65,4 +67,20 @@ gs_stage_surface::gs_stage_surface(gs_device_t *device, uint32_t width,
 	hr = device->device->CreateTexture2D(&td, NULL, texture.Assign());
 	if (FAILED(hr))
 		throw HRError("Failed to create staging surface", hr);
+
+	InitQuery(device->device);
+}
+
+void gs_stage_surface::InitQuery(ID3D11Device *dev)
+{
+	D3D11_QUERY_DESC qd = {};
+	qd.Query = D3D11_QUERY_EVENT;
+
+	/* not fatal, the surface is simply always reported as ready */
+	HRESULT hr = dev->CreateQuery(&qd, query.Assign());
+	if (FAILED(hr))
+		blog(LOG_WARNING, "Failed to create staging surface query (%08lX)",
+		     hr);
+
+	queryIssued = false;
 }
@@ -181,6 +181,21 @@ gs_swap_chain::gs_swap_chain(gs_device *device, const gs_init_data *data)
 	Init();
 }
 
+/* compiled shaders only depend on the compiler, not on the driver */
+void gs_device::InitShaderCacheId(const char *compiler)
+{
+	wchar_t compilerW[40];
+	struct win_version_info ver = {};
+	char id[128];
+
+	os_utf8_to_wcs(compiler, 0, compilerW, _countof(compilerW));
+	get_dll_ver(compilerW, &ver);
+
+	snprintf(id, sizeof(id), "d3d11 %s %d.%d.%d.%d", compiler, ver.major,
+		 ver.minor, ver.build, ver.revis);
+	shaderCacheId = id;
+}
+
 void gs_device::InitCompiler()
 {
 	char d3dcompiler[40] = {};
@@ -199,6 +214,7 @@ void gs_device::InitCompiler()
 				module, "D3DDisassemble");
 #endif
 			if (d3dCompile) {
+				InitShaderCacheId(d3dcompiler);
 				return;
 			}
 
@@ -1744,6 +1760,11 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 
 		device->CopyTex(dst->texture, 0, 0, src, 0, 0, 0, 0);
 
+		if (dst->query) {
+			device->context->End(dst->query);
+			dst->queryIssued = true;
+		}
+
 	} catch (const char *error) {
 		blog(LOG_ERROR, "device_copy_texture (D3D11): %s", error);
 	}
@@ -2339,6 +2360,16 @@ void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 	stagesurf->device->context->Unmap(stagesurf->texture, 0);
 }
 
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	if (!stagesurf->query || !stagesurf->queryIssued)
+		return true;
+
+	HRESULT hr = stagesurf->device->context->GetData(
+		stagesurf->query, nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	return hr != S_FALSE;
+}
+
 void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
 	delete zstencil;
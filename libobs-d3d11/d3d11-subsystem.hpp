@@ -569,15 +569,23 @@ struct gs_zstencil_buffer : gs_obj {
 
 struct gs_stage_surface : gs_obj {
 	ComPtr<ID3D11Texture2D> texture;
+	ComPtr<ID3D11Query> query;
 	D3D11_TEXTURE2D_DESC td = {};
+	bool queryIssued = false;
 
 	uint32_t width, height;
 	gs_color_format format;
 	DXGI_FORMAT dxgiFormat;
 
+	void InitQuery(ID3D11Device *dev);
 	void Rebuild(ID3D11Device *dev);
 
-	inline void Release() { texture.Release(); }
+	inline void Release()
+	{
+		texture.Release();
+		query.Release();
+		queryIssued = false;
+	}
 
 	gs_stage_surface(gs_device_t *device, uint32_t width, uint32_t height,
 			 gs_color_format colorFormat);
@@ -640,6 +648,10 @@ struct gs_shader : gs_obj {
 	void BuildConstantBuffer();
 	void Compile(const char *shaderStr, const char *file,
 		     const char *target, ID3D10Blob **shader);
+	bool CompileCached(const char *shaderStr, const char *file,
+			   const char *target);
+	void CompileAndCache(const char *shaderStr, const char *file,
+			     const char *target);
 
 	inline gs_shader(gs_device_t *device, gs_type obj_type,
 			 gs_shader_type type)
@@ -934,6 +946,7 @@ struct gs_device {
 	D3D11_PRIMITIVE_TOPOLOGY curToplogy;
 
 	pD3DCompile d3dCompile = nullptr;
+	string shaderCacheId;
 #ifdef DISASSEMBLE_SHADERS
 	pD3DDisassemble d3dDisassemble = nullptr;
 #endif
@@ -949,6 +962,7 @@ struct gs_device {
 	vector<gs_device_loss> loss_callbacks;
 	gs_obj *first_obj = nullptr;
 
+	void InitShaderCacheId(const char *compiler);
 	void InitCompiler();
 	void InitFactory(uint32_t adapterIdx);
 	void InitDevice(uint32_t adapterIdx);
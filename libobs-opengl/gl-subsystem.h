@@ -555,6 +555,7 @@ struct gs_stage_surface {
 	GLint gl_internal_format;
 	GLenum gl_type;
 	GLuint pack_buffer;
+	GLsync fence;
 };
 
 struct gs_zstencil_buffer {
@@ -545,6 +545,22 @@ EXPORT gs_effect_t *gs_effect_create_from_file(const char *file,
 EXPORT gs_effect_t *gs_effect_create(const char *effect_string,
 				     const char *filename, char **error_string);
 
+struct gs_shader_cache_stats {
+	long hits;
+	long misses;
+};
+
+/** Directory compiled shaders are cached in, NULL to disable the cache */
+EXPORT void gs_set_shader_cache_path(const char *path);
+EXPORT void gs_get_shader_cache_stats(struct gs_shader_cache_stats *stats);
+
+/* used by graphics modules: id identifies everything besides the shader
+ * text that the compiled output depends on */
+EXPORT bool gs_shader_cache_load(const char *id, const char *shader_string,
+				 uint8_t **data, size_t *size);
+EXPORT void gs_shader_cache_save(const char *id, const char *shader_string,
+				 const void *data, size_t size);
+
 EXPORT gs_shader_t *gs_vertexshader_create_from_file(const char *file,
 						     char **error_string);
 EXPORT gs_shader_t *gs_pixelshader_create_from_file(const char *file,
@@ -765,6 +781,7 @@ gs_stagesurface_get_color_format(const gs_stagesurf_t *stagesurf);
 EXPORT bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 				uint32_t *linesize);
 EXPORT void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf);
+EXPORT bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf);
 
 EXPORT void gs_zstencil_destroy(gs_zstencil_t *zstencil);
 
@@ -0,0 +1,344 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ *   On-disk cache of compiled shaders, so graphics modules don't have to run
+ * the shader compiler for every effect on every launch.
+ *
+ *   Entries are keyed on the final shader text handed to the compiler along
+ * with an id the graphics module builds from whatever else the output
+ * depends on (compiler version, target profile, flags).  The shader text is
+ * what the effect parser generates from the effect file and everything it
+ * includes, so any change to those changes the key.  Both are stored in the
+ * entry and compared in full when loading, the file name hash only picks the
+ * file.
+ *
+ *   Entries that don't match when loaded are deleted, and entries left over
+ * from other compilers or old effects are trimmed, oldest written first,
+ * when the directory grows past SHADER_CACHE_MAX_SIZE.
+ */
+
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../util/bmem.h"
+#include "../util/darray.h"
+#include "../util/dstr.h"
+#include "../util/platform.h"
+#include "graphics-internal.h"
+
+#define SHADER_CACHE_MAGIC 0x4353424f /* "OBSC" */
+#define SHADER_CACHE_VERSION 1
+
+#define SHADER_CACHE_MAX_SIZE (64LL * 1024 * 1024)
+#define SHADER_CACHE_TRIM_SIZE (SHADER_CACHE_MAX_SIZE / 4 * 3)
+
+/* temporary files this old were left behind by a crash */
+#define SHADER_CACHE_STALE_TEMP_SEC (60 * 60)
+
+struct shader_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t id_size;
+	uint32_t shader_size;
+	uint64_t data_size;
+};
+
+static inline uint64_t hash_string(uint64_t hash, const char *str)
+{
+	while (*str) {
+		hash ^= (uint8_t)*(str++);
+		hash *= 0x100000001b3ULL;
+	}
+
+	/* so "ab" + "c" and "a" + "bc" differ */
+	hash ^= 0xff;
+	hash *= 0x100000001b3ULL;
+	return hash;
+}
+
+static bool get_entry_path(struct dstr *path, const char *id,
+			   const char *shader_string)
+{
+	graphics_t *graphics = gs_get_context();
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	if (!graphics || !graphics->shader_cache_path)
+		return false;
+
+	hash = hash_string(hash, id);
+	hash = hash_string(hash, shader_string);
+
+	dstr_printf(path, "%s/%016llx.bin", graphics->shader_cache_path,
+		    (unsigned long long)hash);
+	return true;
+}
+
+static bool read_matches(FILE *file, const char *str, size_t size)
+{
+	char buf[1024];
+
+	while (size) {
+		size_t chunk = size < sizeof(buf) ? size : sizeof(buf);
+
+		if (fread(buf, 1, chunk, file) != chunk)
+			return false;
+		if (memcmp(buf, str, chunk) != 0)
+			return false;
+
+		str += chunk;
+		size -= chunk;
+	}
+
+	return true;
+}
+
+static uint8_t *read_entry(FILE *file, const char *id,
+			   const char *shader_string, size_t *size)
+{
+	struct shader_cache_header header;
+	size_t id_size = strlen(id);
+	size_t shader_size = strlen(shader_string);
+	int64_t file_size = os_fgetsize(file);
+	uint8_t *data;
+
+	if (fread(&header, 1, sizeof(header), file) != sizeof(header))
+		return NULL;
+	if (header.magic != SHADER_CACHE_MAGIC ||
+	    header.version != SHADER_CACHE_VERSION ||
+	    header.id_size != id_size || header.shader_size != shader_size)
+		return NULL;
+	if (file_size != (int64_t)(sizeof(header) + id_size + shader_size +
+				   header.data_size))
+		return NULL;
+
+	if (!read_matches(file, id, id_size) ||
+	    !read_matches(file, shader_string, shader_size))
+		return NULL;
+
+	data = bmalloc((size_t)header.data_size);
+	if (fread(data, 1, (size_t)header.data_size, file) !=
+	    (size_t)header.data_size) {
+		bfree(data);
+		return NULL;
+	}
+
+	*size = (size_t)header.data_size;
+	return data;
+}
+
+bool gs_shader_cache_load(const char *id, const char *shader_string,
+			  uint8_t **data, size_t *size)
+{
+	graphics_t *graphics = gs_get_context();
+	struct dstr path = {0};
+	FILE *file;
+
+	if (!id || !shader_string || !get_entry_path(&path, id, shader_string))
+		return false;
+
+	*data = NULL;
+
+	file = os_fopen(path.array, "rb");
+	if (file) {
+		*data = read_entry(file, id, shader_string, size);
+		fclose(file);
+
+		/* corrupt, from an older version or a hash collision, it
+		 * would never be loaded again */
+		if (!*data)
+			os_unlink(path.array);
+	}
+
+	if (*data)
+		graphics->shader_cache_hits++;
+	else
+		graphics->shader_cache_misses++;
+
+	dstr_free(&path);
+	return *data != NULL;
+}
+
+void gs_shader_cache_save(const char *id, const char *shader_string,
+			  const void *data, size_t size)
+{
+	struct shader_cache_header header = {0};
+	struct dstr path = {0};
+	struct dstr temp = {0};
+	bool success = false;
+	FILE *file;
+
+	if (!id || !shader_string || !data || !size)
+		return;
+	if (!get_entry_path(&path, id, shader_string))
+		return;
+
+	header.magic = SHADER_CACHE_MAGIC;
+	header.version = SHADER_CACHE_VERSION;
+	header.id_size = (uint32_t)strlen(id);
+	header.shader_size = (uint32_t)strlen(shader_string);
+	header.data_size = size;
+
+	/* written to the side and renamed, so a crash or another instance
+	 * never leaves a partial entry behind */
+	dstr_printf(&temp, "%s.%llu.tmp", path.array,
+		    (unsigned long long)os_gettime_ns());
+
+	file = os_fopen(temp.array, "wb");
+	if (file) {
+		success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			  fwrite(id, 1, header.id_size, file) ==
+				  header.id_size &&
+			  fwrite(shader_string, 1, header.shader_size, file) ==
+				  header.shader_size &&
+			  fwrite(data, 1, size, file) == size;
+		success = fclose(file) == 0 && success;
+	}
+
+	if (success)
+		success = os_rename(temp.array, path.array) == 0;
+	if (!success) {
+		blog(LOG_DEBUG, "Failed to write shader cache entry '%s'",
+		     path.array);
+		os_unlink(temp.array);
+	}
+
+	dstr_free(&temp);
+	dstr_free(&path);
+}
+
+struct cache_file {
+	char *path;
+	time_t mtime;
+	int64_t size;
+};
+
+static int cmp_cache_file(const void *a, const void *b)
+{
+	const struct cache_file *file_a = a;
+	const struct cache_file *file_b = b;
+
+	if (file_a->mtime == file_b->mtime)
+		return 0;
+	return file_a->mtime < file_b->mtime ? -1 : 1;
+}
+
+static void trim_cache(const char *dir_path)
+{
+	DARRAY(struct cache_file) files;
+	struct dstr path = {0};
+	struct os_dirent *ent;
+	time_t now = time(NULL);
+	int64_t total = 0;
+	size_t removed = 0;
+	os_dir_t *dir;
+
+	dir = os_opendir(dir_path);
+	if (!dir)
+		return;
+
+	da_init(files);
+
+	while ((ent = os_readdir(dir)) != NULL) {
+		const char *ext = os_get_path_extension(ent->d_name);
+		struct cache_file file;
+		struct stat st;
+
+		if (ent->directory || !ext)
+			continue;
+
+		dstr_printf(&path, "%s/%s", dir_path, ent->d_name);
+		if (os_stat(path.array, &st) != 0)
+			continue;
+
+		if (strcmp(ext, ".tmp") == 0) {
+			if (now - st.st_mtime > SHADER_CACHE_STALE_TEMP_SEC)
+				os_unlink(path.array);
+			continue;
+		}
+
+		if (strcmp(ext, ".bin") != 0)
+			continue;
+
+		file.path = bstrdup(path.array);
+		file.mtime = st.st_mtime;
+		file.size = (int64_t)st.st_size;
+		total += file.size;
+		da_push_back(files, &file);
+	}
+
+	os_closedir(dir);
+
+	if (total > SHADER_CACHE_MAX_SIZE) {
+		qsort(files.array, files.num, sizeof(*files.array),
+		      cmp_cache_file);
+
+		for (size_t i = 0; i < files.num; i++) {
+			if (total <= SHADER_CACHE_TRIM_SIZE)
+				break;
+			if (os_unlink(files.array[i].path) == 0) {
+				total -= files.array[i].size;
+				removed++;
+			}
+		}
+
+		blog(LOG_INFO, "Removed %d old entries from the shader cache",
+		     (int)removed);
+	}
+
+	for (size_t i = 0; i < files.num; i++)
+		bfree(files.array[i].path);
+	da_free(files);
+	dstr_free(&path);
+}
+
+void gs_set_shader_cache_path(const char *path)
+{
+	graphics_t *graphics = gs_get_context();
+
+	if (!graphics) {
+		blog(LOG_DEBUG, "gs_set_shader_cache_path: called while not "
+				"in a graphics context");
+		return;
+	}
+
+	bfree(graphics->shader_cache_path);
+	graphics->shader_cache_path = NULL;
+
+	if (!path || !*path)
+		return;
+
+	if (os_mkdirs(path) == MKDIR_ERROR) {
+		blog(LOG_WARNING,
+		     "Failed to create shader cache directory '%s'", path);
+		return;
+	}
+
+	graphics->shader_cache_path = bstrdup(path);
+	trim_cache(path);
+}
+
+void gs_get_shader_cache_stats(struct gs_shader_cache_stats *stats)
+{
+	graphics_t *graphics = gs_get_context();
+
+	if (!stats)
+		return;
+
+	stats->hits = graphics ? graphics->shader_cache_hits : 0;
+	stats->misses = graphics ? graphics->shader_cache_misses : 0;
+}
@@ -25,6 +25,7 @@
 #include "../util/profiler.h"
 
 #include "audio-io.h"
+#include "audio-mix.h"
 #include "audio-resampler.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
@@ -56,6 +57,7 @@ struct audio_mix {
 
 struct audio_output {
 	struct audio_output_info info;
+	size_t tick_frames;
 	size_t block_size;
 	size_t channels;
 	size_t planes;
@@ -177,24 +179,15 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		if (!mix->inputs.num)
 			continue;
 
-		for (size_t plane = 0; plane < audio->planes; plane++) {
-			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val > 1.0f) ? 1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
-		}
+		for (size_t plane = 0; plane < audio->planes; plane++)
+			clamp_audio_buffer(mix->buffer[plane], float_size);
 	}
 }
 
 static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 			     uint64_t prev_time)
 {
-	size_t bytes = AUDIO_OUTPUT_FRAMES * audio->block_size;
+	size_t bytes = audio->tick_frames * audio->block_size;
 	struct audio_output_data data[MAX_AUDIO_MIXES];
 	uint32_t active_mixes = 0;
 	uint64_t new_ts = 0;
@@ -238,7 +231,8 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 
 	/* output */
 	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+		do_audio_output(audio, i, new_ts,
+				(uint32_t)audio->tick_frames);
 }
 
 static void *audio_thread(void *param)
@@ -250,7 +244,7 @@ static void *audio_thread(void *param)
 	uint64_t prev_time = start_time;
 	uint64_t audio_time = prev_time;
 	uint32_t audio_wait_time = (uint32_t)(
-		audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES) / 1000000);
+		audio_frames_to_ns(rate, audio->tick_frames) / 1000000);
 
 	os_set_thread_name("audio-io: audio thread");
 
@@ -267,7 +261,7 @@ static void *audio_thread(void *param)
 
 		cur_time = os_gettime_ns();
 		while (audio_time <= cur_time) {
-			samples += AUDIO_OUTPUT_FRAMES;
+			samples += audio->tick_frames;
 			audio_time =
 				start_time + audio_frames_to_ns(rate, samples);
 
@@ -397,6 +391,25 @@ static inline bool valid_audio_params(const struct audio_output_info *info)
 	       info->speakers > 0;
 }
 
+static inline size_t get_tick_frames(uint32_t frames)
+{
+	bool pow2 = (frames & (frames - 1)) == 0;
+
+	if (!frames)
+		return AUDIO_OUTPUT_FRAMES;
+
+	if (!pow2 || frames < AUDIO_OUTPUT_MIN_FRAMES ||
+	    frames > AUDIO_OUTPUT_FRAMES) {
+		blog(LOG_WARNING,
+		     "audio_output_open: Invalid tick size %" PRIu32
+		     ", using %d",
+		     frames, AUDIO_OUTPUT_FRAMES);
+		return AUDIO_OUTPUT_FRAMES;
+	}
+
+	return frames;
+}
+
 int audio_output_open(audio_t **audio, struct audio_output_info *info)
 {
 	struct audio_output *out;
@@ -417,6 +430,8 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 	out->input_param = info->input_param;
 	out->block_size = (planar ? 1 : out->channels) *
 			  get_audio_bytes_per_channel(info->format);
+	out->tick_frames = get_tick_frames(info->tick_frames);
+	out->info.tick_frames = (uint32_t)out->tick_frames;
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
@@ -498,6 +513,11 @@ size_t audio_output_get_channels(const audio_t *audio)
 	return audio ? audio->channels : 0;
 }
 
+uint32_t audio_output_get_tick_frames(const audio_t *audio)
+{
+	return audio ? (uint32_t)audio->tick_frames : 0;
+}
+
 uint32_t audio_output_get_sample_rate(const audio_t *audio)
 {
 	return audio ? audio->info.samples_per_sec : 0;
@@ -27,7 +27,11 @@ extern "C" {
 
 #define MAX_AUDIO_MIXES 6
 #define MAX_AUDIO_CHANNELS 8
+
+/* maximum (and default) number of frames per audio tick, audio buffers are
+ * always sized for this many frames */
 #define AUDIO_OUTPUT_FRAMES 1024
+#define AUDIO_OUTPUT_MIN_FRAMES 128
 
 #define TOTAL_AUDIO_SIZE                                              \
 	(MAX_AUDIO_MIXES * MAX_AUDIO_CHANNELS * AUDIO_OUTPUT_FRAMES * \
@@ -99,6 +103,10 @@ struct audio_output_info {
 
 	audio_input_callback_t input_callback;
 	void *input_param;
+
+	/* frames per tick, a power of two from AUDIO_OUTPUT_MIN_FRAMES to
+	 * AUDIO_OUTPUT_FRAMES.  0 uses AUDIO_OUTPUT_FRAMES */
+	uint32_t tick_frames;
 };
 
 struct audio_convert_info {
@@ -232,6 +240,7 @@ EXPORT size_t audio_output_get_block_size(const audio_t *audio);
 EXPORT size_t audio_output_get_planes(const audio_t *audio);
 EXPORT size_t audio_output_get_channels(const audio_t *audio);
 EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
+EXPORT uint32_t audio_output_get_tick_frames(const audio_t *audio);
 EXPORT const struct audio_output_info *
 audio_output_get_info(const audio_t *audio);
 
@@ -0,0 +1,67 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "../util/sse-intrin.h"
+
+/*
+ * Float kernels used by the audio mixer.  They go through util/sse-intrin.h,
+ * so ARM builds get them as NEON through simde, and produce the same results
+ * as the plain loops they replaced, NaNs included.
+ */
+
+static inline void mix_audio_buffer(float *mix, const float *aud,
+				    size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 mix0 = _mm_loadu_ps(mix + i);
+		__m128 mix1 = _mm_loadu_ps(mix + i + 4);
+		__m128 aud0 = _mm_loadu_ps(aud + i);
+		__m128 aud1 = _mm_loadu_ps(aud + i + 4);
+
+		_mm_storeu_ps(mix + i, _mm_add_ps(mix0, aud0));
+		_mm_storeu_ps(mix + i + 4, _mm_add_ps(mix1, aud1));
+	}
+
+	for (; i < count; i++)
+		mix[i] += aud[i];
+}
+
+static inline void clamp_audio_buffer(float *data, size_t count)
+{
+	const __m128 min_val = _mm_set1_ps(-1.0f);
+	const __m128 max_val = _mm_set1_ps(1.0f);
+	size_t i = 0;
+
+	/* operand order keeps NaNs as they are, like the scalar loop */
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		val = _mm_min_ps(max_val, _mm_max_ps(min_val, val));
+		_mm_storeu_ps(data + i, val);
+	}
+
+	for (; i < count; i++) {
+		float val = data[i];
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
@@ -200,6 +200,28 @@ void convert_uyvx_to_i444(const uint8_t *input, uint32_t in_linesize,
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+/* decompression: every kernel below handles 16 (420/nv12) or 8 (422) pixels
+ * per iteration with SSE2, which simde maps to NEON on ARM, and finishes the
+ * remainder of each line with the scalar version */
+
+static FORCE_INLINE void store_420_pixels(uint32_t *output, __m128i lum,
+					  __m128i uv_lo, __m128i uv_hi,
+					  __m128i zero)
+{
+	__m128i lum_lo = _mm_unpacklo_epi8(lum, zero);
+	__m128i lum_hi = _mm_unpackhi_epi8(lum, zero);
+
+	_mm_storeu_si128((__m128i *)output + 0,
+			 _mm_unpacklo_epi16(uv_lo, lum_lo));
+	_mm_storeu_si128((__m128i *)output + 1,
+			 _mm_unpackhi_epi16(uv_lo, lum_lo));
+	_mm_storeu_si128((__m128i *)output + 2,
+			 _mm_unpacklo_epi16(uv_hi, lum_hi));
+	_mm_storeu_si128((__m128i *)output + 3,
+			 _mm_unpackhi_epi16(uv_hi, lum_hi));
+}
+
 void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 		    uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize)
@@ -209,6 +231,8 @@ void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 	uint32_t height_d2 = end_y / 2;
 	uint32_t y;
 
+	__m128i zero = _mm_setzero_si128();
+
 	for (y = start_y_d2; y < height_d2; y++) {
 		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
 		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
@@ -221,7 +245,29 @@ void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
+		for (x = 0; x + 8 <= width_d2; x += 8) {
+			__m128i u = _mm_loadl_epi64((const __m128i *)chroma0);
+			__m128i v = _mm_loadl_epi64((const __m128i *)chroma1);
+			__m128i uv = _mm_unpacklo_epi8(v, u);
+			__m128i uv_lo = _mm_unpacklo_epi16(uv, uv);
+			__m128i uv_hi = _mm_unpackhi_epi16(uv, uv);
+
+			store_420_pixels(output0,
+					 _mm_loadu_si128((const __m128i *)lum0),
+					 uv_lo, uv_hi, zero);
+			store_420_pixels(output1,
+					 _mm_loadu_si128((const __m128i *)lum1),
+					 uv_lo, uv_hi, zero);
+
+			chroma0 += 8;
+			chroma1 += 8;
+			lum0 += 16;
+			lum1 += 16;
+			output0 += 16;
+			output1 += 16;
+		}
+
+		for (; x < width_d2; x++) {
 			uint32_t out;
 			out = (*(chroma0++) << 8) | *(chroma1++);
 
@@ -234,6 +280,31 @@ void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 	}
 }
 
+/* chroma values are zero-extended to 32 bits and shifted into bytes 1-2 */
+#define nv12_chroma_lo(uv, zero) _mm_slli_epi32(_mm_unpacklo_epi16(uv, zero), 8)
+#define nv12_chroma_hi(uv, zero) _mm_slli_epi32(_mm_unpackhi_epi16(uv, zero), 8)
+
+static FORCE_INLINE void store_nv12_pixels(uint32_t *output, __m128i lum,
+					   __m128i uv_lo, __m128i uv_hi,
+					   __m128i zero)
+{
+	__m128i lum_lo = _mm_unpacklo_epi8(lum, zero);
+	__m128i lum_hi = _mm_unpackhi_epi8(lum, zero);
+
+	_mm_storeu_si128((__m128i *)output + 0,
+			 _mm_or_si128(_mm_unpacklo_epi16(lum_lo, zero),
+				      nv12_chroma_lo(uv_lo, zero)));
+	_mm_storeu_si128((__m128i *)output + 1,
+			 _mm_or_si128(_mm_unpackhi_epi16(lum_lo, zero),
+				      nv12_chroma_hi(uv_lo, zero)));
+	_mm_storeu_si128((__m128i *)output + 2,
+			 _mm_or_si128(_mm_unpacklo_epi16(lum_hi, zero),
+				      nv12_chroma_lo(uv_hi, zero)));
+	_mm_storeu_si128((__m128i *)output + 3,
+			 _mm_or_si128(_mm_unpackhi_epi16(lum_hi, zero),
+				      nv12_chroma_hi(uv_hi, zero)));
+}
+
 void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		     uint32_t start_y, uint32_t end_y, uint8_t *output,
 		     uint32_t out_linesize)
@@ -243,6 +314,8 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 	uint32_t height_d2 = end_y / 2;
 	uint32_t y;
 
+	__m128i zero = _mm_setzero_si128();
+
 	for (y = start_y_d2; y < height_d2; y++) {
 		const uint16_t *chroma;
 		register const uint8_t *lum0, *lum1;
@@ -255,7 +328,27 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
+		for (x = 0; x + 8 <= width_d2; x += 8) {
+			/* each chroma pair is shared by two pixels */
+			__m128i uv = _mm_loadu_si128((const __m128i *)chroma);
+			__m128i uv_lo = _mm_unpacklo_epi16(uv, uv);
+			__m128i uv_hi = _mm_unpackhi_epi16(uv, uv);
+
+			store_nv12_pixels(output0,
+					  _mm_loadu_si128((const __m128i *)lum0),
+					  uv_lo, uv_hi, zero);
+			store_nv12_pixels(output1,
+					  _mm_loadu_si128((const __m128i *)lum1),
+					  uv_lo, uv_hi, zero);
+
+			chroma += 8;
+			lum0 += 16;
+			lum1 += 16;
+			output0 += 16;
+			output1 += 16;
+		}
+
+		for (; x < width_d2; x++) {
 			uint32_t out = *(chroma++) << 8;
 
 			*(output0++) = *(lum0++) | out;
@@ -267,6 +360,21 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 	}
 }
 
+/* the second pixel of each pair is the first with its luma byte replaced by
+ * the second luma byte */
+static FORCE_INLINE void store_422_pixels(uint32_t *output, __m128i in,
+					  __m128i keep_mask, __m128i lum_mask)
+{
+	__m128i second = _mm_or_si128(
+		_mm_and_si128(in, keep_mask),
+		_mm_and_si128(_mm_srli_epi32(in, 16), lum_mask));
+
+	_mm_storeu_si128((__m128i *)output + 0,
+			 _mm_unpacklo_epi32(in, second));
+	_mm_storeu_si128((__m128i *)output + 1,
+			 _mm_unpackhi_epi32(in, second));
+}
+
 void decompress_422(const uint8_t *input, uint32_t in_linesize,
 		    uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize, bool leading_lum)
@@ -279,11 +387,25 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize,
 	register uint32_t *output32;
 
 	if (leading_lum) {
+		__m128i keep_mask = _mm_set1_epi32(0xFFFFFF00);
+		__m128i lum_mask = _mm_set1_epi32(0x000000FF);
+
 		for (y = start_y; y < end_y; y++) {
 			input32 = (const uint32_t *)(input + y * in_linesize);
 			input32_end = input32 + width_d2;
 			output32 = (uint32_t *)(output + y * out_linesize);
 
+			while (input32 + 4 <= input32_end) {
+				store_422_pixels(
+					output32,
+					_mm_loadu_si128(
+						(const __m128i *)input32),
+					keep_mask, lum_mask);
+
+				output32 += 8;
+				input32 += 4;
+			}
+
 			while (input32 < input32_end) {
 				register uint32_t dw = *input32;
 
@@ -297,11 +419,25 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize,
 			}
 		}
 	} else {
+		__m128i keep_mask = _mm_set1_epi32(0xFFFF00FF);
+		__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+
 		for (y = start_y; y < end_y; y++) {
 			input32 = (const uint32_t *)(input + y * in_linesize);
 			input32_end = input32 + width_d2;
 			output32 = (uint32_t *)(output + y * out_linesize);
 
+			while (input32 + 4 <= input32_end) {
+				store_422_pixels(
+					output32,
+					_mm_loadu_si128(
+						(const __m128i *)input32),
+					keep_mask, lum_mask);
+
+				output32 += 8;
+				input32 += 4;
+			}
+
 			while (input32 < input32_end) {
 				register uint32_t dw = *input32;
 
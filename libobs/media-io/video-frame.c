@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include "../util/threading.h"
 #include "video-frame.h"
 
 #define ALIGN_SIZE(size, align) size = (((size) + (align - 1)) & (~(align - 1)))
@@ -195,22 +196,190 @@ void video_frame_init(struct video_frame *frame, enum video_format format,
 	}
 }
 
+/* copies below this size are cheaper to do than to hand out to workers */
+#define PARALLEL_COPY_MIN_SIZE (8 * 1024 * 1024)
+#define MAX_BANDS_PER_COPY 32
+#define MAX_COPY_BANDS (MAX_BANDS_PER_COPY + MAX_AV_PLANES)
+
+struct copy_band {
+	const struct video_plane_copy *plane;
+	uint32_t start_row;
+	uint32_t end_row;
+};
+
+static void copy_plane_rows(const struct video_plane_copy *plane,
+			    uint32_t start_row, uint32_t end_row)
+{
+	const uint8_t *src = plane->src + (size_t)start_row * plane->src_linesize;
+	uint8_t *dst = plane->dst + (size_t)start_row * plane->dst_linesize;
+
+	if (plane->row_size == plane->src_linesize &&
+	    plane->row_size == plane->dst_linesize) {
+		memcpy(dst, src, (size_t)plane->row_size * (end_row - start_row));
+		return;
+	}
+
+	for (uint32_t y = start_row; y < end_row; y++) {
+		memcpy(dst, src, plane->row_size);
+		dst += plane->dst_linesize;
+		src += plane->src_linesize;
+	}
+}
+
+static void copy_band_task(void *param, size_t idx)
+{
+	const struct copy_band *bands = param;
+	const struct copy_band *band = &bands[idx];
+
+	copy_plane_rows(band->plane, band->start_row, band->end_row);
+}
+
+void video_copy_planes(const struct video_plane_copy *planes,
+		       size_t num_planes, task_pool_t *pool)
+{
+	struct copy_band bands[MAX_COPY_BANDS];
+	size_t num_bands = 0;
+	size_t total = 0;
+	size_t threads = task_pool_get_thread_count(pool);
+	size_t band_size;
+
+	for (size_t i = 0; i < num_planes; i++)
+		total += (size_t)planes[i].row_size * planes[i].rows;
+
+	if (!threads || total < PARALLEL_COPY_MIN_SIZE) {
+		for (size_t i = 0; i < num_planes; i++)
+			copy_plane_rows(&planes[i], 0, planes[i].rows);
+		return;
+	}
+
+	/* aim for a couple of bands per thread so that threads finishing
+	 * early can pick up the remainder */
+	num_bands = (threads + 1) * 2;
+	if (num_bands > MAX_BANDS_PER_COPY)
+		num_bands = MAX_BANDS_PER_COPY;
+	band_size = total / num_bands;
+	num_bands = 0;
+
+	for (size_t i = 0; i < num_planes && num_bands < MAX_COPY_BANDS; i++) {
+		const struct video_plane_copy *plane = &planes[i];
+		size_t band_rows;
+
+		if (!plane->row_size || !plane->rows)
+			continue;
+
+		band_rows = band_size / plane->row_size;
+		if (!band_rows)
+			band_rows = 1;
+		else if (band_rows > plane->rows)
+			band_rows = plane->rows;
+
+		for (uint32_t y = 0; y < plane->rows; y += (uint32_t)band_rows) {
+			struct copy_band *band;
+
+			if (num_bands == MAX_COPY_BANDS) {
+				copy_plane_rows(plane, y, plane->rows);
+				break;
+			}
+
+			band = &bands[num_bands++];
+			band->plane = plane;
+			band->start_row = y;
+			band->end_row = plane->rows - y > band_rows
+						? y + (uint32_t)band_rows
+						: plane->rows;
+		}
+	}
+
+	task_pool_run(pool, num_bands, copy_band_task, bands);
+}
+
+static inline void set_plane(struct video_plane_copy *plane,
+			     struct video_frame *dst,
+			     const struct video_frame *src, size_t idx,
+			     uint32_t rows)
+{
+	plane->dst = dst->data[idx];
+	plane->src = src->data[idx];
+	plane->dst_linesize = src->linesize[idx];
+	plane->src_linesize = src->linesize[idx];
+	plane->row_size = src->linesize[idx];
+	plane->rows = rows;
+}
+
+/* frame copies are bound by memory bandwidth, more threads rarely help */
+#define MAX_COPY_THREADS 4
+
+static pthread_mutex_t copy_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static task_pool_t *copy_pool = NULL;
+static long copy_pool_refs = 0;
+
+task_pool_t *video_copy_pool_acquire(void)
+{
+	task_pool_t *pool;
+
+	pthread_mutex_lock(&copy_pool_mutex);
+	if (!copy_pool)
+		copy_pool = task_pool_create(
+			"media-io: frame copy",
+			task_pool_default_thread_count(MAX_COPY_THREADS));
+	if (copy_pool)
+		copy_pool_refs++;
+	pool = copy_pool;
+	pthread_mutex_unlock(&copy_pool_mutex);
+
+	return pool;
+}
+
+/* references the pool only if something else keeps it alive */
+static task_pool_t *copy_pool_get(void)
+{
+	task_pool_t *pool;
+
+	pthread_mutex_lock(&copy_pool_mutex);
+	pool = copy_pool;
+	if (pool)
+		copy_pool_refs++;
+	pthread_mutex_unlock(&copy_pool_mutex);
+
+	return pool;
+}
+
+void video_copy_pool_release(task_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&copy_pool_mutex);
+	if (--copy_pool_refs == 0)
+		copy_pool = NULL;
+	else
+		pool = NULL;
+	pthread_mutex_unlock(&copy_pool_mutex);
+
+	task_pool_destroy(pool);
+}
+
 void video_frame_copy(struct video_frame *dst, const struct video_frame *src,
 		      enum video_format format, uint32_t cy)
 {
+	struct video_plane_copy planes[MAX_AV_PLANES];
+	size_t num_planes = 0;
+
 	switch (format) {
 	case VIDEO_FORMAT_NONE:
 		return;
 
 	case VIDEO_FORMAT_I420:
-		memcpy(dst->data[0], src->data[0], src->linesize[0] * cy);
-		memcpy(dst->data[1], src->data[1], src->linesize[1] * cy / 2);
-		memcpy(dst->data[2], src->data[2], src->linesize[2] * cy / 2);
+		set_plane(&planes[0], dst, src, 0, cy);
+		set_plane(&planes[1], dst, src, 1, cy / 2);
+		set_plane(&planes[2], dst, src, 2, cy / 2);
+		num_planes = 3;
 		break;
 
 	case VIDEO_FORMAT_NV12:
-		memcpy(dst->data[0], src->data[0], src->linesize[0] * cy);
-		memcpy(dst->data[1], src->data[1], src->linesize[1] * cy / 2);
+		set_plane(&planes[0], dst, src, 0, cy);
+		set_plane(&planes[1], dst, src, 1, cy / 2);
+		num_planes = 2;
 		break;
 
 	case VIDEO_FORMAT_Y800:
@@ -222,29 +391,37 @@ void video_frame_copy(struct video_frame *dst, const struct video_frame *src,
 	case VIDEO_FORMAT_BGRX:
 	case VIDEO_FORMAT_BGR3:
 	case VIDEO_FORMAT_AYUV:
-		memcpy(dst->data[0], src->data[0], src->linesize[0] * cy);
+		set_plane(&planes[0], dst, src, 0, cy);
+		num_planes = 1;
 		break;
 
 	case VIDEO_FORMAT_I444:
 	case VIDEO_FORMAT_I422:
-		memcpy(dst->data[0], src->data[0], src->linesize[0] * cy);
-		memcpy(dst->data[1], src->data[1], src->linesize[1] * cy);
-		memcpy(dst->data[2], src->data[2], src->linesize[2] * cy);
+		set_plane(&planes[0], dst, src, 0, cy);
+		set_plane(&planes[1], dst, src, 1, cy);
+		set_plane(&planes[2], dst, src, 2, cy);
+		num_planes = 3;
 		break;
 
 	case VIDEO_FORMAT_I40A:
-		memcpy(dst->data[0], src->data[0], src->linesize[0] * cy);
-		memcpy(dst->data[1], src->data[1], src->linesize[1] * cy / 2);
-		memcpy(dst->data[2], src->data[2], src->linesize[2] * cy / 2);
-		memcpy(dst->data[3], src->data[3], src->linesize[3] * cy);
+		set_plane(&planes[0], dst, src, 0, cy);
+		set_plane(&planes[1], dst, src, 1, cy / 2);
+		set_plane(&planes[2], dst, src, 2, cy / 2);
+		set_plane(&planes[3], dst, src, 3, cy);
+		num_planes = 4;
 		break;
 
 	case VIDEO_FORMAT_I42A:
 	case VIDEO_FORMAT_YUVA:
-		memcpy(dst->data[0], src->data[0], src->linesize[0] * cy);
-		memcpy(dst->data[1], src->data[1], src->linesize[1] * cy);
-		memcpy(dst->data[2], src->data[2], src->linesize[2] * cy);
-		memcpy(dst->data[3], src->data[3], src->linesize[3] * cy);
+		set_plane(&planes[0], dst, src, 0, cy);
+		set_plane(&planes[1], dst, src, 1, cy);
+		set_plane(&planes[2], dst, src, 2, cy);
+		set_plane(&planes[3], dst, src, 3, cy);
+		num_planes = 4;
 		break;
 	}
+
+	task_pool_t *pool = copy_pool_get();
+	video_copy_planes(planes, num_planes, pool);
+	video_copy_pool_release(pool);
 }
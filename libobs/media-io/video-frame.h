@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../util/bmem.h"
+#include "../util/task-pool.h"
 #include "video-io.h"
 
 struct video_frame {
@@ -55,6 +56,36 @@ static inline void video_frame_destroy(struct video_frame *frame)
 	}
 }
 
+/**
+ * Copies a frame.  Large frames are split across the shared copy pool while
+ * anything holds a reference to it (libobs does while video is running),
+ * otherwise the copy runs on the calling thread.
+ */
 EXPORT void video_frame_copy(struct video_frame *dst,
 			     const struct video_frame *src,
 			     enum video_format format, uint32_t height);
+
+/** Describes a single plane for video_copy_planes */
+struct video_plane_copy {
+	uint8_t *dst;
+	const uint8_t *src;
+	uint32_t dst_linesize;
+	uint32_t src_linesize;
+	uint32_t row_size;
+	uint32_t rows;
+};
+
+/**
+ * Copies a set of planes row by row.  Large copies are split into bands of
+ * rows and distributed over the task pool; small copies, or a NULL pool, are
+ * done on the calling thread.
+ */
+EXPORT void video_copy_planes(const struct video_plane_copy *planes,
+			      size_t num_planes, task_pool_t *pool);
+
+/**
+ * References the shared frame copy pool, creating it if needed.  The pool is
+ * destroyed when the last reference is released.
+ */
+EXPORT task_pool_t *video_copy_pool_acquire(void);
+EXPORT void video_copy_pool_release(task_pool_t *pool);
@@ -31,52 +31,104 @@
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define MAX_CONVERT_BUFFERS 3
-#define MAX_CACHE_SIZE 16
 
+/*
+ * Frames handed to raw callbacks live in refcounted buffers.  A consumer may
+ * retain the buffer of the frame it is being given (video_output_retain_frame)
+ * and keep using the data after the callback returns.  Whenever the video
+ * output goes to reuse a buffer that is still retained elsewhere, it swaps in
+ * a fresh one from the pool instead; released buffers go back to the pool.
+ */
+struct video_buffer_pool;
+
+struct video_buffer {
+	struct video_frame frame;
+	volatile long refs;
+	struct video_buffer_pool *pool;
+};
+
+struct video_buffer_pool {
+	enum video_format format;
+	uint32_t width;
+	uint32_t height;
+
+	pthread_mutex_t mutex;
+	DARRAY(struct video_buffer *) free_buffers;
+
+	/* one for the owner plus one for each buffer in use */
+	volatile long refs;
+};
+
+/*
+ * The frame cache is a single-producer/single-consumer ring: the graphics
+ * thread fills frames (video_output_lock_frame/unlock_frame) and the video
+ * thread drains them (video_output_cur_frame).  The producer owns next_write
+ * and last_added, the consumer owns first_added, and the two only meet on the
+ * atomic available_frames counter and the per-frame repeat count, so neither
+ * side ever blocks on the other.
+ */
 struct cached_frame_info {
 	struct video_data frame;
-	int skipped;
-	int count;
+	struct video_buffer *buffer;
+	volatile long count;
 };
 
-struct video_input {
-	struct video_scale_info conversion;
+/*
+ * Inputs that ask for the same conversion share a single scaler, so each
+ * distinct conversion only runs once per frame no matter how many inputs use
+ * it.  Conversions are only touched with the input mutex held.
+ */
+struct video_conversion {
+	struct video_scale_info info;
 	video_scaler_t *scaler;
-	struct video_frame frame[MAX_CONVERT_BUFFERS];
+	struct video_buffer_pool *pool;
+	struct video_buffer *frame[MAX_CONVERT_BUFFERS];
 	int cur_frame;
+	long refs;
+
+	/* result for the frame currently being delivered */
+	uint64_t scaled_serial;
+	bool success;
+	struct video_data output;
+};
+
+struct video_input {
+	struct video_scale_info conversion;
+	struct video_conversion *conv;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
-
 struct video_output {
 	struct video_output_info info;
 
 	pthread_t thread;
-	pthread_mutex_t data_mutex;
 	bool stop;
 
 	os_sem_t *update_semaphore;
 	uint64_t frame_time;
 	volatile long skipped_frames;
 	volatile long total_frames;
+	volatile long cache_full;
+	volatile long shared_scales;
 
 	bool initialized;
 
 	pthread_mutex_t input_mutex;
 	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_conversion *) conversions;
+	uint64_t frame_serial;
 
-	size_t available_frames;
+	volatile long available_frames;
 	size_t first_added;
 	size_t last_added;
-	struct cached_frame_info cache[MAX_CACHE_SIZE];
+	size_t next_write;
+	struct cached_frame_info *cache;
+	struct video_buffer_pool *cache_pool;
+
+	/* buffer of the frame currently being delivered, video thread only */
+	struct video_buffer *cur_buffer;
 
 	volatile bool raw_active;
 	volatile long gpu_refs;
@@ -84,86 +136,225 @@ struct video_output {
 
 /* ------------------------------------------------------------------------- */
 
-static inline bool scale_video_output(struct video_input *input,
-				      struct video_data *data)
+static struct video_buffer_pool *
+video_buffer_pool_create(enum video_format format, uint32_t width,
+			 uint32_t height)
+{
+	struct video_buffer_pool *pool =
+		bzalloc(sizeof(struct video_buffer_pool));
+
+	pool->format = format;
+	pool->width = width;
+	pool->height = height;
+	pool->refs = 1;
+	pthread_mutex_init(&pool->mutex, NULL);
+	return pool;
+}
+
+static void video_buffer_pool_release(struct video_buffer_pool *pool)
 {
-	bool success = true;
+	if (!pool || os_atomic_dec_long(&pool->refs) != 0)
+		return;
 
-	if (input->scaler) {
-		struct video_frame *frame;
+	for (size_t i = 0; i < pool->free_buffers.num; i++) {
+		struct video_buffer *buffer = pool->free_buffers.array[i];
+		video_frame_free(&buffer->frame);
+		bfree(buffer);
+	}
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+	da_free(pool->free_buffers);
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool);
+}
 
-		frame = &input->frame[input->cur_frame];
+static struct video_buffer *
+video_buffer_pool_get(struct video_buffer_pool *pool)
+{
+	struct video_buffer *buffer = NULL;
 
-		success = video_scaler_scale(input->scaler, frame->data,
-					     frame->linesize,
-					     (const uint8_t *const *)data->data,
-					     data->linesize);
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->free_buffers.num) {
+		buffer = pool->free_buffers.array[pool->free_buffers.num - 1];
+		da_pop_back(pool->free_buffers);
+	}
+	pthread_mutex_unlock(&pool->mutex);
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i] = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
-		} else {
-			blog(LOG_WARNING, "video-io: Could not scale frame!");
+	if (!buffer) {
+		buffer = bzalloc(sizeof(struct video_buffer));
+		buffer->pool = pool;
+		video_frame_init(&buffer->frame, pool->format, pool->width,
+				 pool->height);
+	}
+
+	os_atomic_inc_long(&pool->refs);
+	buffer->refs = 1;
+	return buffer;
+}
+
+void video_buffer_addref(video_buffer_t *buffer)
+{
+	if (buffer)
+		os_atomic_inc_long(&buffer->refs);
+}
+
+void video_buffer_release(video_buffer_t *buffer)
+{
+	struct video_buffer_pool *pool;
+
+	if (!buffer || os_atomic_dec_long(&buffer->refs) != 0)
+		return;
+
+	pool = buffer->pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	da_push_back(pool->free_buffers, &buffer);
+	pthread_mutex_unlock(&pool->mutex);
+
+	video_buffer_pool_release(pool);
+}
+
+/* swaps out a buffer that is still retained by a consumer before reusing it,
+ * returns true if the buffer was replaced */
+static inline bool video_buffer_make_unique(struct video_buffer **buffer)
+{
+	struct video_buffer *old = *buffer;
+
+	if (os_atomic_load_long(&old->refs) == 1)
+		return false;
+
+	*buffer = video_buffer_pool_get(old->pool);
+	video_buffer_release(old);
+	return true;
+}
+
+static inline void set_frame_buffer(struct video_data *frame,
+				    const struct video_buffer *buffer)
+{
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		frame->data[i] = buffer->frame.data[i];
+		frame->linesize[i] = buffer->frame.linesize[i];
+	}
+}
+
+static void video_conversion_release(struct video_output *video,
+				    struct video_conversion *conv)
+{
+	if (!conv || --conv->refs != 0)
+		return;
+
+	da_erase_item(video->conversions, &conv);
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_buffer_release(conv->frame[i]);
+	video_buffer_pool_release(conv->pool);
+	video_scaler_destroy(conv->scaler);
+	bfree(conv);
+}
+
+static inline void video_input_free(struct video_output *video,
+				    struct video_input *input)
+{
+	video_conversion_release(video, input->conv);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool scale_conversion(struct video_conversion *conv,
+			     const struct video_data *data)
+{
+	struct video_buffer **frame_buffer;
+	struct video_frame *frame;
+
+	if (++conv->cur_frame == MAX_CONVERT_BUFFERS)
+		conv->cur_frame = 0;
+
+	frame_buffer = &conv->frame[conv->cur_frame];
+	video_buffer_make_unique(frame_buffer);
+	frame = &(*frame_buffer)->frame;
+
+	if (!video_scaler_scale(conv->scaler, frame->data, frame->linesize,
+				(const uint8_t *const *)data->data,
+				data->linesize)) {
+		blog(LOG_WARNING, "video-io: Could not scale frame!");
+		return false;
+	}
+
+	set_frame_buffer(&conv->output, *frame_buffer);
+	return true;
+}
+
+static inline bool scale_video_output(struct video_output *video,
+				      struct video_input *input,
+				      struct video_data *data,
+				      struct video_buffer **buffer)
+{
+	struct video_conversion *conv = input->conv;
+
+	if (!conv)
+		return true;
+
+	if (conv->scaled_serial != video->frame_serial) {
+		conv->scaled_serial = video->frame_serial;
+		conv->success = scale_conversion(conv, data);
+	} else {
+		os_atomic_inc_long(&video->shared_scales);
+	}
+
+	if (conv->success) {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			data->data[i] = conv->output.data[i];
+			data->linesize[i] = conv->output.linesize[i];
 		}
+		*buffer = conv->frame[conv->cur_frame];
 	}
 
-	return success;
+	return conv->success;
 }
 
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
 	bool complete;
-	bool skipped;
-
-	/* -------------------------------- */
-
-	pthread_mutex_lock(&video->data_mutex);
 
 	frame_info = &video->cache[video->first_added];
 
-	pthread_mutex_unlock(&video->data_mutex);
-
 	/* -------------------------------- */
 
 	pthread_mutex_lock(&video->input_mutex);
 
+	video->frame_serial++;
+
 	for (size_t i = 0; i < video->inputs.num; i++) {
 		struct video_input *input = video->inputs.array + i;
 		struct video_data frame = frame_info->frame;
+		struct video_buffer *buffer = frame_info->buffer;
 
-		if (scale_video_output(input, &frame))
+		if (scale_video_output(video, input, &frame, &buffer)) {
+			video->cur_buffer = buffer;
 			input->callback(input->param, &frame);
+		}
 	}
 
+	video->cur_buffer = NULL;
+
 	pthread_mutex_unlock(&video->input_mutex);
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
-
 	frame_info->frame.timestamp += video->frame_time;
-	complete = --frame_info->count == 0;
-	skipped = frame_info->skipped > 0;
+	complete = os_atomic_dec_long(&frame_info->count) == 0;
 
 	if (complete) {
+		if (video_buffer_make_unique(&frame_info->buffer))
+			set_frame_buffer(&frame_info->frame,
+					 frame_info->buffer);
+
 		if (++video->first_added == video->info.cache_size)
 			video->first_added = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
-	} else if (skipped) {
-		--frame_info->skipped;
-		os_atomic_inc_long(&video->skipped_frames);
+		os_atomic_inc_long(&video->available_frames);
 	}
 
-	pthread_mutex_unlock(&video->data_mutex);
-
 	/* -------------------------------- */
 
 	return complete;
@@ -207,18 +398,22 @@ static inline bool valid_video_params(const struct video_output_info *info)
 
 static inline void init_cache(struct video_output *video)
 {
-	if (video->info.cache_size > MAX_CACHE_SIZE)
-		video->info.cache_size = MAX_CACHE_SIZE;
+	if (video->info.cache_size == 0)
+		video->info.cache_size = 1;
+
+	video->cache = bzalloc(sizeof(struct cached_frame_info) *
+			       video->info.cache_size);
+	video->cache_pool = video_buffer_pool_create(
+		video->info.format, video->info.width, video->info.height);
 
 	for (size_t i = 0; i < video->info.cache_size; i++) {
-		struct video_frame *frame;
-		frame = (struct video_frame *)&video->cache[i];
+		struct cached_frame_info *cfi = &video->cache[i];
 
-		video_frame_init(frame, video->info.format, video->info.width,
-				 video->info.height);
+		cfi->buffer = video_buffer_pool_get(video->cache_pool);
+		set_frame_buffer(&cfi->frame, cfi->buffer);
 	}
 
-	video->available_frames = video->info.cache_size;
+	video->available_frames = (long)video->info.cache_size;
 }
 
 int video_output_open(video_t **video, struct video_output_info *info)
@@ -242,17 +437,16 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		goto fail;
 	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
 		goto fail;
-	if (pthread_mutex_init(&out->data_mutex, &attr) != 0)
-		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, &attr) != 0)
 		goto fail;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail;
-	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
-		goto fail;
 
 	init_cache(out);
 
+	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
+		goto fail;
+
 	out->initialized = true;
 	*video = out;
 	return VIDEO_OUTPUT_SUCCESS;
@@ -270,14 +464,18 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_free(video, &video->inputs.array[i]);
 	da_free(video->inputs);
+	da_free(video->conversions);
 
-	for (size_t i = 0; i < video->info.cache_size; i++)
-		video_frame_free((struct video_frame *)&video->cache[i]);
+	if (video->cache) {
+		for (size_t i = 0; i < video->info.cache_size; i++)
+			video_buffer_release(video->cache[i].buffer);
+		bfree(video->cache);
+	}
+	video_buffer_pool_release(video->cache_pool);
 
 	os_sem_destroy(video->update_semaphore);
-	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
 	bfree(video);
 }
@@ -296,38 +494,71 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
+static inline bool scale_info_equal(const struct video_scale_info *a,
+				    const struct video_scale_info *b)
+{
+	return a->format == b->format && a->width == b->width &&
+	       a->height == b->height && a->range == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+static struct video_conversion *
+video_conversion_get(struct video_output *video,
+		     const struct video_scale_info *info)
+{
+	struct video_conversion *conv;
+
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		conv = video->conversions.array[i];
+		if (scale_info_equal(&conv->info, info)) {
+			conv->refs++;
+			return conv;
+		}
+	}
+
+	struct video_scale_info from = {.format = video->info.format,
+					.width = video->info.width,
+					.height = video->info.height,
+					.range = video->info.range,
+					.colorspace = video->info.colorspace};
+
+	conv = bzalloc(sizeof(struct video_conversion));
+	conv->info = *info;
+	conv->refs = 1;
+
+	int ret = video_scaler_create(&conv->scaler, info, &from,
+				      VIDEO_SCALE_FAST_BILINEAR);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+					"scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+					"create scaler");
+
+		bfree(conv);
+		return NULL;
+	}
+
+	conv->pool = video_buffer_pool_create(info->format, info->width,
+					      info->height);
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		conv->frame[i] = video_buffer_pool_get(conv->pool);
+
+	da_push_back(video->conversions, &conv);
+	return conv;
+}
+
 static inline bool video_input_init(struct video_input *input,
 				    struct video_output *video)
 {
 	if (input->conversion.width != video->info.width ||
 	    input->conversion.height != video->info.height ||
 	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {.format = video->info.format,
-						.width = video->info.width,
-						.height = video->info.height,
-						.range = video->info.range,
-						.colorspace =
-							video->info.colorspace};
-
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-						"scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-						"create scaler");
-
+		input->conv = video_conversion_get(video, &input->conversion);
+		if (!input->conv)
 			return false;
-		}
-
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					 input->conversion.format,
-					 input->conversion.width,
-					 input->conversion.height);
 	}
 
 	return true;
@@ -337,6 +568,8 @@ static inline void reset_frames(video_t *video)
 {
 	os_atomic_set_long(&video->skipped_frames, 0);
 	os_atomic_set_long(&video->total_frames, 0);
+	os_atomic_set_long(&video->cache_full, 0);
+	os_atomic_set_long(&video->shared_scales, 0);
 }
 
 bool video_output_connect(
@@ -416,20 +649,43 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		video_input_free(video, video->inputs.array + idx);
 		da_erase(video->inputs, idx);
 
 		if (video->inputs.num == 0) {
+			long shared = os_atomic_load_long(&video->shared_scales);
+
 			os_atomic_set_bool(&video->raw_active, false);
 			if (!os_atomic_load_long(&video->gpu_refs)) {
 				log_skipped(video);
 			}
+			if (shared)
+				blog(LOG_INFO,
+				     "Video stopped, number of scaled "
+				     "frames shared between outputs: %ld",
+				     shared);
 		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
 }
 
+video_buffer_t *video_output_retain_frame(video_t *video,
+					  const struct video_data *frame)
+{
+	struct video_buffer *buffer;
+
+	if (!video || !frame)
+		return NULL;
+
+	buffer = video->cur_buffer;
+	if (!buffer || buffer->frame.data[0] != frame->data[0])
+		return NULL;
+
+	video_buffer_addref(buffer);
+	return buffer;
+}
+
 bool video_output_active(const video_t *video)
 {
 	if (!video)
@@ -442,41 +698,54 @@ const struct video_output_info *video_output_get_info(const video_t *video)
 	return video ? &video->info : NULL;
 }
 
+static inline void atomic_add_long(volatile long *val, long add)
+{
+	long cur = os_atomic_load_long(val);
+	while (!os_atomic_compare_swap_long(val, cur, cur + add))
+		cur = os_atomic_load_long(val);
+}
+
+/* adds repeats to a queued frame, fails if the consumer has already finished
+ * with it (its slot is about to become available again) */
+static inline bool add_frame_repeats(struct cached_frame_info *cfi, int count)
+{
+	long cur = os_atomic_load_long(&cfi->count);
+
+	while (cur > 0) {
+		if (os_atomic_compare_swap_long(&cfi->count, cur, cur + count))
+			return true;
+		cur = os_atomic_load_long(&cfi->count);
+	}
+
+	return false;
+}
+
 bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 			     int count, uint64_t timestamp)
 {
 	struct cached_frame_info *cfi;
-	bool locked;
 
 	if (!video)
 		return false;
 
-	pthread_mutex_lock(&video->data_mutex);
-
-	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
-		locked = false;
-
-	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
-
-		cfi = &video->cache[video->last_added];
-		cfi->frame.timestamp = timestamp;
-		cfi->count = count;
-		cfi->skipped = 0;
-
-		memcpy(frame, &cfi->frame, sizeof(*frame));
+	if (os_atomic_load_long(&video->available_frames) == 0) {
+		/* repeat the last queued frame.  if the video thread has
+		 * already finished it, it is still releasing the slot, and
+		 * the graphics thread must not wait for that, so the frame
+		 * is just skipped */
+		add_frame_repeats(&video->cache[video->last_added], count);
 
-		locked = true;
+		os_atomic_inc_long(&video->cache_full);
+		atomic_add_long(&video->skipped_frames, count);
+		return false;
 	}
 
-	pthread_mutex_unlock(&video->data_mutex);
+	cfi = &video->cache[video->next_write];
+	cfi->frame.timestamp = timestamp;
+	os_atomic_set_long(&cfi->count, count);
 
-	return locked;
+	memcpy(frame, &cfi->frame, sizeof(*frame));
+	return true;
 }
 
 void video_output_unlock_frame(video_t *video)
@@ -484,12 +753,12 @@ void video_output_unlock_frame(video_t *video)
 	if (!video)
 		return;
 
-	pthread_mutex_lock(&video->data_mutex);
+	video->last_added = video->next_write;
+	if (++video->next_write == video->info.cache_size)
+		video->next_write = 0;
 
-	video->available_frames--;
+	os_atomic_dec_long(&video->available_frames);
 	os_sem_post(video->update_semaphore);
-
-	pthread_mutex_unlock(&video->data_mutex);
 }
 
 uint64_t video_output_get_frame_time(const video_t *video)
@@ -553,6 +822,16 @@ uint32_t video_output_get_total_frames(const video_t *video)
 	return (uint32_t)os_atomic_load_long(&video->total_frames);
 }
 
+uint32_t video_output_get_cache_full_count(const video_t *video)
+{
+	return (uint32_t)os_atomic_load_long(&video->cache_full);
+}
+
+uint32_t video_output_get_shared_scale_count(const video_t *video)
+{
+	return (uint32_t)os_atomic_load_long(&video->shared_scales);
+}
+
 /* Note: These four functions below are a very slight bit of a hack.  If the
  * texture encoder thread is active while the raw encoder thread is active, the
  * total frame count will just be doubled while they're both active.  Which is
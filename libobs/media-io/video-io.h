@@ -30,6 +30,9 @@ struct video_frame;
 struct video_output;
 typedef struct video_output video_t;
 
+struct video_buffer;
+typedef struct video_buffer video_buffer_t;
+
 enum video_format {
 	VIDEO_FORMAT_NONE,
 
@@ -241,6 +244,16 @@ EXPORT void video_output_disconnect(video_t *video,
 						     struct video_data *frame),
 				    void *param);
 
+/**
+ * Takes a reference on the buffer backing a frame passed to a raw video
+ * callback, keeping the frame data valid after the callback returns.  Must be
+ * called from within the callback; returns NULL otherwise.
+ */
+EXPORT video_buffer_t *
+video_output_retain_frame(video_t *video, const struct video_data *frame);
+EXPORT void video_buffer_addref(video_buffer_t *buffer);
+EXPORT void video_buffer_release(video_buffer_t *buffer);
+
 EXPORT bool video_output_active(const video_t *video);
 
 EXPORT const struct video_output_info *
@@ -260,6 +273,10 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
 
+/** Number of times a frame was submitted while the frame cache was full */
+EXPORT uint32_t video_output_get_cache_full_count(const video_t *video);
+EXPORT uint32_t video_output_get_shared_scale_count(const video_t *video);
+
 extern void video_output_inc_texture_encoders(video_t *video);
 extern void video_output_dec_texture_encoders(video_t *video);
 extern void video_output_inc_texture_frames(video_t *video);
@@ -16,6 +16,7 @@
 ******************************************************************************/
 
 #include <inttypes.h>
+#include "media-io/audio-mix.h"
 #include "obs-internal.h"
 
 struct ts_info {
@@ -24,8 +25,16 @@ struct ts_info {
 };
 
 #define DEBUG_AUDIO 0
+
+/* buffering limit in ticks of AUDIO_OUTPUT_FRAMES, scaled for smaller ticks */
 #define MAX_BUFFERING_TICKS 45
 
+static inline int max_buffering_ticks(const struct obs_core_audio *audio)
+{
+	return (int)(MAX_BUFFERING_TICKS * AUDIO_OUTPUT_FRAMES /
+		     audio->tick_frames);
+}
+
 static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 {
 	struct obs_core_audio *audio = p;
@@ -48,7 +57,7 @@ static inline void mix_audio(struct audio_output_data *mixes,
 			     obs_source_t *source, size_t channels,
 			     size_t sample_rate, struct ts_info *ts)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = obs->audio.tick_frames;
 	size_t start_point = 0;
 
 	if (source->audio_ts < ts->start || ts->end <= source->audio_ts)
@@ -57,7 +66,7 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	if (source->audio_ts != ts->start) {
 		start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - ts->start);
-		if (start_point == AUDIO_OUTPUT_FRAMES)
+		if (start_point == obs->audio.tick_frames)
 			return;
 
 		total_floats -= start_point;
@@ -65,16 +74,11 @@ static inline void mix_audio(struct audio_output_data *mixes,
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
+			float *mix = mixes[mix_idx].data[ch] + start_point;
+			const float *aud =
 				source->audio_output_buf[mix_idx][ch];
-			register float *end;
 
-			mix += start_point;
-			end = aud + total_floats;
-
-			while (aud < end)
-				*(mix++) += *(aud++);
+			mix_audio_buffer(mix, aud, total_floats);
 		}
 	}
 }
@@ -136,13 +140,12 @@ static bool discard_if_stopped(obs_source_t *source, size_t channels)
 	}
 }
 
-#define MAX_AUDIO_SIZE (AUDIO_OUTPUT_FRAMES * sizeof(float))
-
 static inline void discard_audio(struct obs_core_audio *audio,
 				 obs_source_t *source, size_t channels,
 				 size_t sample_rate, struct ts_info *ts)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = audio->tick_frames;
+	size_t max_size = audio->tick_frames * sizeof(float);
 	size_t size;
 
 #if DEBUG_AUDIO == 1
@@ -167,7 +170,7 @@ static inline void discard_audio(struct obs_core_audio *audio,
 
 	if (source->audio_ts < (ts->start - 1)) {
 		if (source->audio_pending &&
-		    source->audio_input_buf[0].size < MAX_AUDIO_SIZE &&
+		    source->audio_input_buf[0].size < max_size &&
 		    discard_if_stopped(source, channels))
 			return;
 
@@ -180,7 +183,7 @@ static inline void discard_audio(struct obs_core_audio *audio,
 			     source->audio_ts, ts->start);
 		}
 #endif
-		if (audio->total_buffering_ticks == MAX_BUFFERING_TICKS)
+		if (audio->total_buffering_ticks == max_buffering_ticks(audio))
 			ignore_audio(source, channels, sample_rate);
 		return;
 	}
@@ -189,7 +192,7 @@ static inline void discard_audio(struct obs_core_audio *audio,
 	    source->audio_ts != (ts->start - 1)) {
 		size_t start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - ts->start);
-		if (start_point == AUDIO_OUTPUT_FRAMES) {
+		if (start_point == audio->tick_frames) {
 #if DEBUG_AUDIO == 1
 			if (is_audio_source)
 				blog(LOG_DEBUG, "can't discard, start point is "
@@ -233,6 +236,8 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 				size_t sample_rate, struct ts_info *ts,
 				uint64_t min_ts, const char *buffering_name)
 {
+	const size_t tick_frames = audio->tick_frames;
+	const int max_ticks = max_buffering_ticks(audio);
 	struct ts_info new_ts;
 	uint64_t offset;
 	uint64_t frames;
@@ -240,7 +245,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 	size_t ms;
 	int ticks;
 
-	if (audio->total_buffering_ticks == MAX_BUFFERING_TICKS)
+	if (audio->total_buffering_ticks == max_ticks)
 		return;
 
 	if (!audio->buffering_wait_ticks)
@@ -248,18 +253,18 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 
 	offset = ts->start - min_ts;
 	frames = ns_to_audio_frames(sample_rate, offset);
-	ticks = (int)((frames + AUDIO_OUTPUT_FRAMES - 1) / AUDIO_OUTPUT_FRAMES);
+	ticks = (int)((frames + tick_frames - 1) / tick_frames);
 
 	audio->total_buffering_ticks += ticks;
 
-	if (audio->total_buffering_ticks >= MAX_BUFFERING_TICKS) {
-		ticks -= audio->total_buffering_ticks - MAX_BUFFERING_TICKS;
-		audio->total_buffering_ticks = MAX_BUFFERING_TICKS;
+	if (audio->total_buffering_ticks >= max_ticks) {
+		ticks -= audio->total_buffering_ticks - max_ticks;
+		audio->total_buffering_ticks = max_ticks;
 		blog(LOG_WARNING, "Max audio buffering reached!");
 	}
 
-	ms = ticks * AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
-	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
+	ms = ticks * tick_frames * 1000 / sample_rate;
+	total_ms = audio->total_buffering_ticks * tick_frames * 1000 /
 		   sample_rate;
 
 	blog(LOG_INFO,
@@ -278,8 +283,8 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 
 	new_ts.start =
 		audio->buffered_ts -
-		audio_frames_to_ns(sample_rate, audio->buffering_wait_ticks *
-							AUDIO_OUTPUT_FRAMES);
+		audio_frames_to_ns(sample_rate,
+				   audio->buffering_wait_ticks * tick_frames);
 
 	while (ticks--) {
 		int cur_ticks = ++audio->buffering_wait_ticks;
@@ -288,7 +293,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 		new_ts.start =
 			audio->buffered_ts -
 			audio_frames_to_ns(sample_rate,
-					   cur_ticks * AUDIO_OUTPUT_FRAMES);
+					   cur_ticks * tick_frames);
 
 #if DEBUG_AUDIO == 1
 		blog(LOG_DEBUG, "add buffered ts: %" PRIu64 "-%" PRIu64,
@@ -305,7 +310,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 static bool audio_buffer_insuffient(struct obs_source *source,
 				    size_t sample_rate, uint64_t min_ts)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = obs->audio.tick_frames;
 	size_t size;
 
 	if (source->info.audio_render || source->audio_pending ||
@@ -316,7 +321,7 @@ static bool audio_buffer_insuffient(struct obs_source *source,
 	if (source->audio_ts != min_ts && source->audio_ts != (min_ts - 1)) {
 		size_t start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - min_ts);
-		if (start_point >= AUDIO_OUTPUT_FRAMES)
+		if (start_point >= total_floats)
 			return false;
 
 		total_floats -= start_point;
@@ -373,6 +378,68 @@ static inline const char *calc_min_ts(struct obs_core_data *data,
 	return buffering_name;
 }
 
+#define MAX_AUDIO_RENDER_THREADS 4
+
+struct audio_render_job {
+	struct obs_source **sources;
+	uint32_t mixers;
+	size_t channels;
+	size_t sample_rate;
+	size_t size;
+};
+
+static void audio_render_job(void *param, size_t idx)
+{
+	struct audio_render_job *job = param;
+	obs_source_audio_render(job->sources[idx], job->mixers, job->channels,
+				job->sample_rate, job->size);
+}
+
+/*
+ * Parallel audio render: sources with a custom audio_render callback (scenes,
+ * transitions) mix the output of their children, so they are rendered
+ * afterwards on the audio thread, in render order.  All other sources only
+ * touch their own buffers and are rendered on the pool.  Each source writes
+ * the same data either way, so the final mix does not change.
+ */
+static void render_audio_sources_parallel(struct obs_core_audio *audio,
+					  uint32_t mixers, size_t channels,
+					  size_t sample_rate, size_t size)
+{
+	struct audio_render_job job = {
+		.mixers = mixers,
+		.channels = channels,
+		.sample_rate = sample_rate,
+		.size = size,
+	};
+
+	if (!audio->render_pool) {
+		size_t threads = task_pool_default_thread_count(
+			MAX_AUDIO_RENDER_THREADS);
+		audio->render_pool =
+			task_pool_create("libobs: audio render worker", threads);
+	}
+
+	da_resize(audio->render_leaves, 0);
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+		if (!source->info.audio_render)
+			da_push_back(audio->render_leaves, &source);
+	}
+
+	job.sources = audio->render_leaves.array;
+	task_pool_run(audio->render_pool, audio->render_leaves.num,
+		      audio_render_job, &job);
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+		if (source->info.audio_render)
+			obs_source_audio_render(source, mixers, channels,
+						sample_rate, size);
+	}
+}
+
 static inline void release_audio_sources(struct obs_core_audio *audio)
 {
 	for (size_t i = 0; i < audio->render_order.num; i++)
@@ -399,7 +466,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	circlebuf_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
 	min_ts = ts.start;
 
-	audio_size = AUDIO_OUTPUT_FRAMES * sizeof(float);
+	audio_size = audio->tick_frames * sizeof(float);
 
 #if DEBUG_AUDIO == 1
 	blog(LOG_DEBUG, "ts %llu-%llu", ts.start, ts.end);
@@ -431,10 +498,15 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	/* ------------------------------------------------ */
 	/* render audio data */
-	for (size_t i = 0; i < audio->render_order.num; i++) {
-		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate,
-					audio_size);
+	if (os_atomic_load_bool(&audio->parallel_render)) {
+		render_audio_sources_parallel(audio, mixers, channels,
+					      sample_rate, audio_size);
+	} else {
+		for (size_t i = 0; i < audio->render_order.num; i++) {
+			obs_source_t *source = audio->render_order.array[i];
+			obs_source_audio_render(source, mixers, channels,
+						sample_rate, audio_size);
+		}
 	}
 
 	/* ------------------------------------------------ */
@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <inttypes.h>
 #include "obs.h"
 #include "obs-internal.h"
 
@@ -49,6 +50,7 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
 	pthread_mutex_init_value(&encoder->pause.mutex);
+	pthread_mutex_init_value(&encoder->frame_queue_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -65,6 +67,8 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->pause.mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->frame_queue_mutex, NULL) != 0)
+		return false;
 
 	if (encoder->orig_info.get_defaults) {
 		encoder->orig_info.get_defaults(encoder->context.settings);
@@ -90,6 +94,7 @@ create_encoder(const char *id, enum obs_encoder_type type, const char *name,
 
 	encoder = bzalloc(sizeof(struct obs_encoder));
 	encoder->mixer_idx = mixer_idx;
+	encoder->frame_queue_depth = DEFAULT_FRAME_QUEUE_DEPTH;
 
 	if (!ei) {
 		blog(LOG_ERROR, "Encoder ID '%s' not found", id);
@@ -142,6 +147,9 @@ obs_encoder_t *obs_audio_encoder_create(const char *id, const char *name,
 
 static void receive_video(void *param, struct video_data *frame);
 static void receive_audio(void *param, size_t mix_idx, struct audio_data *data);
+static void start_encode_thread(struct obs_encoder *encoder);
+static void unblock_encode_thread(struct obs_encoder *encoder);
+static void stop_encode_thread(struct obs_encoder *encoder);
 
 static inline void get_audio_info(const struct obs_encoder *encoder,
 				  struct audio_convert_info *info)
@@ -210,6 +218,7 @@ static void add_connection(struct obs_encoder *encoder)
 		if (gpu_encode_available(encoder)) {
 			start_gpu_encode(encoder);
 		} else {
+			start_encode_thread(encoder);
 			start_raw_video(encoder->media, &info, receive_video,
 					encoder);
 		}
@@ -227,7 +236,9 @@ static void remove_connection(struct obs_encoder *encoder, bool shutdown)
 		if (gpu_encode_available(encoder)) {
 			stop_gpu_encode(encoder);
 		} else {
+			unblock_encode_thread(encoder);
 			stop_raw_video(encoder->media, receive_video, encoder);
+			stop_encode_thread(encoder);
 		}
 	}
 
@@ -266,6 +277,10 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 
 		free_audio_buffers(encoder);
 
+		/* only still around if the thread stopped itself on an
+		 * encode error */
+		stop_encode_thread(encoder);
+
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
 		da_free(encoder->callbacks);
@@ -273,6 +288,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
 		pthread_mutex_destroy(&encoder->pause.mutex);
+		pthread_mutex_destroy(&encoder->frame_queue_mutex);
 		obs_context_data_free(&encoder->context);
 		if (encoder->owns_info_id)
 			bfree((void *)encoder->info.id);
@@ -694,6 +710,53 @@ void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 	encoder->scaled_height = height;
 }
 
+void obs_encoder_set_frame_queue_depth(obs_encoder_t *encoder, uint32_t depth)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_set_frame_queue_depth"))
+		return;
+	if (encoder->info.type != OBS_ENCODER_VIDEO) {
+		blog(LOG_WARNING,
+		     "obs_encoder_set_frame_queue_depth: "
+		     "encoder '%s' is not a video encoder",
+		     obs_encoder_get_name(encoder));
+		return;
+	}
+	if (encoder_active(encoder)) {
+		blog(LOG_WARNING,
+		     "encoder '%s': Cannot set the frame queue "
+		     "depth while the encoder is active",
+		     obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->frame_queue_depth = depth;
+}
+
+uint32_t obs_encoder_get_frame_queue_depth(const obs_encoder_t *encoder)
+{
+	return obs_encoder_valid(encoder, "obs_encoder_get_frame_queue_depth")
+		       ? encoder->frame_queue_depth
+		       : 0;
+}
+
+bool obs_encoder_get_frame_stats(const obs_encoder_t *encoder,
+				 struct obs_encoder_frame_stats *stats)
+{
+	struct obs_encoder *enc = (struct obs_encoder *)encoder;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_frame_stats"))
+		return false;
+	if (!obs_ptr_valid(stats, "obs_encoder_get_frame_stats"))
+		return false;
+	if (encoder->info.type != OBS_ENCODER_VIDEO)
+		return false;
+
+	pthread_mutex_lock(&enc->frame_queue_mutex);
+	*stats = enc->frame_stats;
+	pthread_mutex_unlock(&enc->frame_queue_mutex);
+	return true;
+}
+
 bool obs_encoder_scaling_enabled(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_scaling_enabled"))
@@ -838,6 +901,165 @@ bool obs_encoder_active(const obs_encoder_t *encoder)
 		       : false;
 }
 
+#define PACKET_SIZE_CLASS_NONE ((size_t)-1)
+
+struct packet_size_class {
+	size_t size;
+	size_t max_cached;
+};
+
+static const struct packet_size_class packet_size_classes[] = {
+	{4 * 1024, 128},      /* audio */
+	{32 * 1024, 64},      /* low bitrate video */
+	{128 * 1024, 64},     /* high bitrate video */
+	{512 * 1024, 32},     /* keyframes */
+	{2 * 1024 * 1024, 8}, /* high bitrate keyframes */
+	{8 * 1024 * 1024, 4},
+};
+
+#define NUM_PACKET_SIZE_CLASSES \
+	(sizeof(packet_size_classes) / sizeof(packet_size_classes[0]))
+
+struct packet_pool {
+	struct encoder_packet_buffer *free_buffers[NUM_PACKET_SIZE_CLASSES];
+	size_t num_free[NUM_PACKET_SIZE_CLASSES];
+	bool closed;
+
+	struct obs_encoder_packet_pool_stats stats;
+};
+
+static pthread_mutex_t packet_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct packet_pool packet_pool = {0};
+
+static inline struct encoder_packet_buffer *get_packet_buffer(uint8_t *data)
+{
+	return (struct encoder_packet_buffer *)(data -
+						ENCODER_PACKET_HEADER_SIZE);
+}
+
+static inline uint8_t *packet_buffer_data(struct encoder_packet_buffer *buf)
+{
+	return (uint8_t *)buf + ENCODER_PACKET_HEADER_SIZE;
+}
+
+static inline size_t get_packet_size_class(size_t size)
+{
+	for (size_t i = 0; i < NUM_PACKET_SIZE_CLASSES; i++) {
+		if (size <= packet_size_classes[i].size)
+			return i;
+	}
+
+	return PACKET_SIZE_CLASS_NONE;
+}
+
+uint8_t *encoder_packet_buffer_alloc(size_t size)
+{
+	struct encoder_packet_buffer *buf = NULL;
+	size_t idx = get_packet_size_class(size);
+
+	pthread_mutex_lock(&packet_pool_mutex);
+	if (idx != PACKET_SIZE_CLASS_NONE) {
+		buf = packet_pool.free_buffers[idx];
+		if (buf) {
+			packet_pool.free_buffers[idx] = buf->next;
+			packet_pool.num_free[idx]--;
+		}
+	}
+	if (buf)
+		packet_pool.stats.hits++;
+	else
+		packet_pool.stats.misses++;
+	pthread_mutex_unlock(&packet_pool_mutex);
+
+	if (!buf) {
+		if (idx != PACKET_SIZE_CLASS_NONE)
+			size = packet_size_classes[idx].size;
+		buf = bmalloc(ENCODER_PACKET_HEADER_SIZE + size);
+	}
+
+	buf->next = NULL;
+	buf->size_class = idx;
+	buf->refs = 1;
+	return packet_buffer_data(buf);
+}
+
+uint8_t *encoder_packet_buffer_adopt(void *mem)
+{
+	struct encoder_packet_buffer *buf = mem;
+
+	buf->next = NULL;
+	buf->size_class = PACKET_SIZE_CLASS_NONE;
+	buf->refs = 1;
+	return packet_buffer_data(buf);
+}
+
+static void packet_buffer_free(struct encoder_packet_buffer *buf)
+{
+	size_t idx = buf->size_class;
+
+	if (idx != PACKET_SIZE_CLASS_NONE) {
+		pthread_mutex_lock(&packet_pool_mutex);
+		/* packets can outlive the pool (e.g. still queued in an
+		 * output on shutdown), those are freed on their last release */
+		if (!packet_pool.closed &&
+		    packet_pool.num_free[idx] <
+		    packet_size_classes[idx].max_cached) {
+			buf->next = packet_pool.free_buffers[idx];
+			packet_pool.free_buffers[idx] = buf;
+			packet_pool.num_free[idx]++;
+			buf = NULL;
+		}
+		pthread_mutex_unlock(&packet_pool_mutex);
+	}
+
+	bfree(buf);
+}
+
+void obs_encoder_packet_pool_init(void)
+{
+	pthread_mutex_lock(&packet_pool_mutex);
+	packet_pool.closed = false;
+	pthread_mutex_unlock(&packet_pool_mutex);
+}
+
+void obs_encoder_packet_pool_free(void)
+{
+	pthread_mutex_lock(&packet_pool_mutex);
+	packet_pool.closed = true;
+	for (size_t i = 0; i < NUM_PACKET_SIZE_CLASSES; i++) {
+		struct encoder_packet_buffer *buf =
+			packet_pool.free_buffers[i];
+
+		while (buf) {
+			struct encoder_packet_buffer *next = buf->next;
+			bfree(buf);
+			buf = next;
+		}
+
+		packet_pool.free_buffers[i] = NULL;
+		packet_pool.num_free[i] = 0;
+	}
+	pthread_mutex_unlock(&packet_pool_mutex);
+}
+
+void obs_encoder_packet_pool_get_stats(
+	struct obs_encoder_packet_pool_stats *stats)
+{
+	if (!obs_ptr_valid(stats, "obs_encoder_packet_pool_get_stats"))
+		return;
+
+	pthread_mutex_lock(&packet_pool_mutex);
+	*stats = packet_pool.stats;
+	pthread_mutex_unlock(&packet_pool_mutex);
+}
+
+static inline void add_bytes_copied(size_t size)
+{
+	pthread_mutex_lock(&packet_pool_mutex);
+	packet_pool.stats.bytes_copied += size;
+	pthread_mutex_unlock(&packet_pool_mutex);
+}
+
 static inline bool get_sei(const struct obs_encoder *encoder, uint8_t **sei,
 			   size_t *size)
 {
@@ -852,7 +1074,6 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 				    struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
-	DARRAY(uint8_t) data;
 	uint8_t *sei;
 	size_t size;
 
@@ -860,25 +1081,23 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	if (!packet->keyframe)
 		return;
 
-	da_init(data);
-
 	if (!get_sei(encoder, &sei, &size) || !sei || !size) {
 		cb->new_packet(cb->param, packet);
 		cb->sent_first_packet = true;
 		return;
 	}
 
-	da_push_back_array(data, sei, size);
-	da_push_back_array(data, packet->data, packet->size);
-
 	first_packet = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	first_packet.size = size + packet->size;
+	first_packet.data = encoder_packet_buffer_alloc(first_packet.size);
+	memcpy(first_packet.data, sei, size);
+	memcpy(first_packet.data + size, packet->data, packet->size);
+	add_bytes_copied(first_packet.size);
 
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -915,17 +1134,31 @@ void full_stop(struct obs_encoder *encoder)
 	}
 }
 
+static inline void release_unsent_packet_data(struct obs_encoder *encoder)
+{
+	if (encoder->pooled_packet_data) {
+		struct encoder_packet pkt = {0};
+
+		pkt.data = encoder->pooled_packet_data;
+		obs_encoder_packet_release(&pkt);
+		encoder->pooled_packet_data = NULL;
+	}
+}
+
 void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 			     bool received, struct encoder_packet *pkt)
 {
 	if (!success) {
 		blog(LOG_ERROR, "Error encoding with encoder '%s'",
 		     encoder->context.name);
+		release_unsent_packet_data(encoder);
 		full_stop(encoder);
 		return;
 	}
 
 	if (received) {
+		struct encoder_packet out;
+
 		if (!encoder->first_received) {
 			encoder->offset_usec = packet_dts_usec(pkt);
 			encoder->first_received = true;
@@ -941,16 +1174,30 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 		pkt->sys_dts_usec += encoder->pause.ts_offset / 1000;
 		pthread_mutex_unlock(&encoder->pause.mutex);
 
+		/* outputs share a single reference counted instance of the
+		 * packet.  if the encoder wrote into a buffer from
+		 * obs_encoder_packet_alloc, that buffer is used as-is */
+		if (pkt->data && pkt->data == encoder->pooled_packet_data) {
+			out = *pkt;
+			encoder->pooled_packet_data = NULL;
+		} else {
+			obs_encoder_packet_create_instance(&out, pkt);
+		}
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array + (i - 1);
-			send_packet(encoder, cb, pkt);
+			send_packet(encoder, cb, &out);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&out);
 	}
+
+	release_unsent_packet_data(encoder);
 }
 
 static const char *do_encode_name = "do_encode";
@@ -1011,6 +1258,242 @@ bool video_pause_check(struct pause_data *pause, uint64_t timestamp)
 	return ignore_frame;
 }
 
+/* ------------------------------------------------------------------------- */
+/* encode thread
+ *
+ * Raw video encoders get their own thread so that a slow encoder doesn't hold
+ * up the video thread, and with it every other encoder and raw output
+ * connected to the same video output.  Frames are queued by reference: the
+ * video thread retains the frame's buffer and the encode thread releases it
+ * once encode() is done with it.  If the queue is full, the video thread
+ * waits for the encoder, which makes video-io skip frames the same way it
+ * would if the encoder was called directly. */
+
+struct queued_frame {
+	struct encoder_frame frame;
+	video_buffer_t *buffer;
+};
+
+static void encode_video_frame(struct obs_encoder *encoder,
+			       struct encoder_frame *frame)
+{
+	uint64_t start = os_gettime_ns();
+	uint64_t elapsed;
+	bool success;
+
+	frame->pts = encoder->cur_pts;
+	success = do_encode(encoder, frame);
+	if (success)
+		encoder->cur_pts += encoder->timebase_num;
+
+	elapsed = os_gettime_ns() - start;
+
+	pthread_mutex_lock(&encoder->frame_queue_mutex);
+	encoder->frame_stats.frames++;
+	encoder->frame_stats.encode_time_ns += elapsed;
+	if (elapsed > encoder->frame_stats.max_encode_time_ns)
+		encoder->frame_stats.max_encode_time_ns = elapsed;
+	pthread_mutex_unlock(&encoder->frame_queue_mutex);
+}
+
+static inline size_t queued_frames(const struct obs_encoder *encoder)
+{
+	return encoder->frame_queue.size / sizeof(struct queued_frame);
+}
+
+static void queue_video_frame(struct obs_encoder *encoder,
+			      struct video_data *frame,
+			      struct encoder_frame *enc_frame)
+{
+	struct queued_frame qf;
+	bool waited = false;
+	size_t num;
+
+	/* frames always come from video-io, so this can't really fail */
+	qf.buffer = video_output_retain_frame(encoder->media, frame);
+	if (!qf.buffer)
+		return;
+
+	qf.frame = *enc_frame;
+
+	pthread_mutex_lock(&encoder->frame_queue_mutex);
+
+	while (queued_frames(encoder) >= encoder->cur_frame_queue_depth) {
+		/* stopping, the encoder won't get to this frame anyway */
+		if (os_atomic_load_bool(&encoder->frame_queue_unblocked)) {
+			pthread_mutex_unlock(&encoder->frame_queue_mutex);
+			video_buffer_release(qf.buffer);
+			return;
+		}
+
+		pthread_mutex_unlock(&encoder->frame_queue_mutex);
+		os_event_wait(encoder->frame_queue_space_event);
+		pthread_mutex_lock(&encoder->frame_queue_mutex);
+		waited = true;
+	}
+
+	circlebuf_push_back(&encoder->frame_queue, &qf, sizeof(qf));
+
+	num = queued_frames(encoder);
+	encoder->frame_stats.queued = (uint32_t)num;
+	if (num > encoder->frame_stats.max_queued)
+		encoder->frame_stats.max_queued = (uint32_t)num;
+	if (waited)
+		encoder->frame_stats.waited++;
+
+	pthread_mutex_unlock(&encoder->frame_queue_mutex);
+
+	os_sem_post(encoder->frame_queue_sem);
+}
+
+static void free_queued_frames(struct obs_encoder *encoder)
+{
+	struct queued_frame qf;
+
+	while (encoder->frame_queue.size) {
+		circlebuf_pop_front(&encoder->frame_queue, &qf, sizeof(qf));
+		video_buffer_release(qf.buffer);
+	}
+	circlebuf_free(&encoder->frame_queue);
+}
+
+static void *encode_thread(void *data)
+{
+	struct obs_encoder *encoder = data;
+	struct queued_frame qf;
+	char name[64];
+
+	snprintf(name, sizeof(name), "encode: %s", encoder->context.name);
+	os_set_thread_name(name);
+
+	for (;;) {
+		bool popped = false;
+
+		os_sem_wait(encoder->frame_queue_sem);
+
+		if (os_atomic_load_bool(&encoder->encode_thread_aborted))
+			break;
+
+		pthread_mutex_lock(&encoder->frame_queue_mutex);
+		if (encoder->frame_queue.size) {
+			circlebuf_pop_front(&encoder->frame_queue, &qf,
+					    sizeof(qf));
+			encoder->frame_stats.queued =
+				(uint32_t)queued_frames(encoder);
+			popped = true;
+		}
+		pthread_mutex_unlock(&encoder->frame_queue_mutex);
+
+		if (!popped) {
+			if (os_atomic_load_bool(
+				    &encoder->encode_thread_exiting))
+				break;
+			continue;
+		}
+
+		os_event_signal(encoder->frame_queue_space_event);
+
+		encode_video_frame(encoder, &qf.frame);
+		video_buffer_release(qf.buffer);
+	}
+
+	return NULL;
+}
+
+static void start_encode_thread(struct obs_encoder *encoder)
+{
+	/* the thread of a previous session may have stopped itself */
+	stop_encode_thread(encoder);
+
+	memset(&encoder->frame_stats, 0, sizeof(encoder->frame_stats));
+
+	if (!encoder->frame_queue_depth)
+		return;
+
+	encoder->cur_frame_queue_depth = encoder->frame_queue_depth;
+	os_atomic_set_bool(&encoder->frame_queue_unblocked, false);
+	os_atomic_set_bool(&encoder->encode_thread_exiting, false);
+	os_atomic_set_bool(&encoder->encode_thread_aborted, false);
+
+	if (os_sem_init(&encoder->frame_queue_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&encoder->frame_queue_space_event,
+			  OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (pthread_create(&encoder->encode_thread, NULL, encode_thread,
+			   encoder) != 0)
+		goto fail;
+
+	os_atomic_set_bool(&encoder->encode_thread_active, true);
+	return;
+
+fail:
+	blog(LOG_WARNING,
+	     "encoder '%s': Failed to start encode thread, "
+	     "encoding on the video thread",
+	     encoder->context.name);
+	os_sem_destroy(encoder->frame_queue_sem);
+	os_event_destroy(encoder->frame_queue_space_event);
+	encoder->frame_queue_sem = NULL;
+	encoder->frame_queue_space_event = NULL;
+}
+
+static void unblock_encode_thread(struct obs_encoder *encoder)
+{
+	if (!os_atomic_load_bool(&encoder->encode_thread_active))
+		return;
+
+	os_atomic_set_bool(&encoder->frame_queue_unblocked, true);
+	os_event_signal(encoder->frame_queue_space_event);
+}
+
+static void log_frame_stats(const struct obs_encoder *encoder)
+{
+	const struct obs_encoder_frame_stats *stats = &encoder->frame_stats;
+
+	if (!stats->frames)
+		return;
+
+	blog(LOG_INFO,
+	     "encoder '%s': %" PRIu64 " frames, encode time "
+	     "avg %.2f ms, max %.2f ms, queued frames max %" PRIu32
+	     "/%" PRIu32 ", waited for the encoder %" PRIu64 " times",
+	     encoder->context.name, stats->frames,
+	     (double)stats->encode_time_ns / (double)stats->frames / 1e6,
+	     (double)stats->max_encode_time_ns / 1e6, stats->max_queued,
+	     encoder->cur_frame_queue_depth, stats->waited);
+}
+
+static void stop_encode_thread(struct obs_encoder *encoder)
+{
+	if (!os_atomic_load_bool(&encoder->encode_thread_active))
+		return;
+
+	/* an encode error stops the encoder from the encode thread itself,
+	 * the thread is joined the next time the encoder starts or when
+	 * it's destroyed */
+	if (pthread_equal(pthread_self(), encoder->encode_thread)) {
+		os_atomic_set_bool(&encoder->encode_thread_aborted, true);
+		os_sem_post(encoder->frame_queue_sem);
+		return;
+	}
+
+	/* video is disconnected at this point, so the thread encodes
+	 * whatever is left and exits */
+	os_atomic_set_bool(&encoder->encode_thread_exiting, true);
+	os_sem_post(encoder->frame_queue_sem);
+	pthread_join(encoder->encode_thread, NULL);
+
+	free_queued_frames(encoder);
+	os_sem_destroy(encoder->frame_queue_sem);
+	os_event_destroy(encoder->frame_queue_space_event);
+	encoder->frame_queue_sem = NULL;
+	encoder->frame_queue_space_event = NULL;
+
+	log_frame_stats(encoder);
+	os_atomic_set_bool(&encoder->encode_thread_active, false);
+}
+
 static const char *receive_video_name = "receive_video";
 static void receive_video(void *param, struct video_data *frame)
 {
@@ -1041,10 +1524,11 @@ static void receive_video(void *param, struct video_data *frame)
 		encoder->start_ts = frame->timestamp;
 
 	enc_frame.frames = 1;
-	enc_frame.pts = encoder->cur_pts;
 
-	if (do_encode(encoder, &enc_frame))
-		encoder->cur_pts += encoder->timebase_num;
+	if (os_atomic_load_bool(&encoder->encode_thread_active))
+		queue_video_frame(encoder, frame, &enc_frame);
+	else
+		encode_video_frame(encoder, &enc_frame);
 
 wait_for_audio:
 	profile_end(receive_video_name);
@@ -1305,16 +1789,29 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
+uint8_t *obs_encoder_packet_alloc(obs_encoder_t *encoder,
+				  struct encoder_packet *packet, size_t size)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_packet_alloc"))
+		return NULL;
+	if (!obs_ptr_valid(packet, "obs_encoder_packet_alloc"))
+		return NULL;
+
+	release_unsent_packet_data(encoder);
+
+	packet->data = encoder_packet_buffer_alloc(size);
+	packet->size = size;
+	encoder->pooled_packet_data = packet->data;
+	return packet->data;
+}
+
 void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 					const struct encoder_packet *src)
 {
-	long *p_refs;
-
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void *)(p_refs + 1);
-	*p_refs = 1;
+	dst->data = encoder_packet_buffer_alloc(src->size);
 	memcpy(dst->data, src->data, src->size);
+	add_bytes_copied(src->size);
 }
 
 /* OBS_DEPRECATED */
@@ -1337,8 +1834,8 @@ void obs_encoder_packet_ref(struct encoder_packet *dst,
 		return;
 
 	if (src->data) {
-		long *p_refs = ((long *)src->data) - 1;
-		os_atomic_inc_long(p_refs);
+		struct encoder_packet_buffer *buf = get_packet_buffer(src->data);
+		os_atomic_inc_long(&buf->refs);
 	}
 
 	*dst = *src;
@@ -1350,9 +1847,9 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 		return;
 
 	if (pkt->data) {
-		long *p_refs = ((long *)pkt->data) - 1;
-		if (os_atomic_dec_long(p_refs) == 0)
-			bfree(p_refs);
+		struct encoder_packet_buffer *buf = get_packet_buffer(pkt->data);
+		if (os_atomic_dec_long(&buf->refs) == 0)
+			packet_buffer_free(buf);
 	}
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
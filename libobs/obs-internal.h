@@ -24,6 +24,7 @@
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/profiler.h"
+#include "util/task-pool.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
 
@@ -35,12 +36,15 @@
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-output-interleave.h"
 
-#define NUM_TEXTURES 2
+#define MAX_STAGE_TEXTURES 8
+#define DEFAULT_STAGE_TEXTURES 3
 #define NUM_CHANNELS 3
 #define MICROSECOND_DEN 1000000
 #define NUM_ENCODE_TEXTURES 3
 #define NUM_ENCODE_TEXTURE_FRAMES_TO_WAIT 1
+#define DEFAULT_FRAME_QUEUE_DEPTH 3
 
 static inline int64_t packet_dts_usec(struct encoder_packet *packet)
 {
@@ -241,12 +245,15 @@ struct obs_task_info {
 
 struct obs_core_video {
 	graphics_t *graphics;
-	gs_stagesurf_t *copy_surfaces[NUM_TEXTURES][NUM_CHANNELS];
+	/* bumped when the device is rebuilt and render targets lose what
+	 * was drawn into them */
+	volatile long device_epoch;
+	gs_stagesurf_t *copy_surfaces[MAX_STAGE_TEXTURES][NUM_CHANNELS];
 	gs_texture_t *render_texture;
 	gs_texture_t *output_texture;
 	gs_texture_t *convert_textures[NUM_CHANNELS];
 	bool texture_rendered;
-	bool textures_copied[NUM_TEXTURES];
+	bool textures_copied[MAX_STAGE_TEXTURES];
 	bool texture_converted;
 	bool using_nv12_tex;
 	struct circlebuf vframe_info_buffer;
@@ -265,6 +272,9 @@ struct obs_core_video {
 	gs_samplerstate_t *point_sampler;
 	gs_stagesurf_t *mapped_surfaces[NUM_CHANNELS];
 	int cur_texture;
+	int stage_read;
+	int stage_depth;
+	int requested_stage_depth;
 	long raw_active;
 	long gpu_encoder_active;
 	pthread_mutex_t gpu_encoder_mutex;
@@ -314,16 +324,28 @@ struct obs_core_video {
 
 	pthread_mutex_t task_mutex;
 	struct circlebuf tasks;
+
+	volatile bool parallel_tick;
+	task_pool_t *tick_pool;
+	DARRAY(struct obs_source *) tick_sources;
+
+	task_pool_t *copy_pool;
 };
 
 struct audio_monitor;
 
 struct obs_core_audio {
 	audio_t *audio;
+	size_t tick_frames;
+	uint32_t requested_tick_frames;
 
 	DARRAY(struct obs_source *) render_order;
 	DARRAY(struct obs_source *) root_nodes;
 
+	volatile bool parallel_render;
+	task_pool_t *render_pool;
+	DARRAY(struct obs_source *) render_leaves;
+
 	uint64_t buffered_ts;
 	struct circlebuf buffered_timestamps;
 	int buffering_wait_ticks;
@@ -338,6 +360,14 @@ struct obs_core_audio {
 };
 
 /* user sources, output channels, and displays */
+/* hash index of context names, chained through obs_context_data::hash_next */
+struct obs_context_index {
+	struct obs_context_data **buckets;
+	size_t num_buckets;
+	size_t count;
+	uint64_t next_order;
+};
+
 struct obs_core_data {
 	struct obs_source *first_source;
 	struct obs_source *first_audio_source;
@@ -353,6 +383,18 @@ struct obs_core_data {
 	pthread_mutex_t services_mutex;
 	pthread_mutex_t audio_sources_mutex;
 	pthread_mutex_t draw_callbacks_mutex;
+
+	/* public contexts by name, each protected by its list's mutex */
+	struct obs_context_index source_index;
+	struct obs_context_index output_index;
+	struct obs_context_index encoder_index;
+	struct obs_context_index service_index;
+
+	/* bumped whenever something scene transforms depend on changes
+	 * (item transforms, source sizes, removed sources), scenes only
+	 * look at their items when it differs from what they last saw */
+	volatile long transform_generation;
+
 	DARRAY(struct draw_callback) draw_callbacks;
 	DARRAY(struct tick_callback) tick_callbacks;
 
@@ -419,6 +461,7 @@ struct obs_core {
 
 	char *locale;
 	char *module_config_path;
+	char *shader_cache_path;
 	bool name_store_owned;
 	profiler_name_store_t *name_store;
 
@@ -473,6 +516,11 @@ struct obs_context_data {
 	struct obs_context_data *next;
 	struct obs_context_data **prev_next;
 
+	struct obs_context_data *hash_next;
+	uint64_t index_order;
+	uint32_t name_hash;
+	bool indexed;
+
 	bool private;
 };
 
@@ -533,12 +581,24 @@ static inline bool obs_weak_ref_get_ref(struct obs_weak_ref *ref)
 /* ------------------------------------------------------------------------- */
 /* sources  */
 
+#define ASYNC_RING_SIZE 64
+
 struct async_frame {
-	struct obs_source_frame *frame;
-	long unused_count;
+	/* first, so pool frames can be freed with obs_source_frame_destroy */
+	struct obs_source_frame frame;
+	uint32_t generation;
 	bool used;
 };
 
+/* single producer, single consumer ring of frames.  each side owns its own
+ * index, and the two only meet on the atomic count */
+struct async_frame_ring {
+	struct async_frame *frames[ASYNC_RING_SIZE];
+	size_t write;
+	size_t read;
+	volatile long count;
+};
+
 enum audio_action_type {
 	AUDIO_ACTION_VOL,
 	AUDIO_ACTION_MUTE,
@@ -592,6 +652,15 @@ struct obs_source {
 	 * to handle things but it's the best option) */
 	bool removed;
 
+	/* size as of the last tick, changes bump transform_generation */
+	uint32_t tick_width;
+	uint32_t tick_height;
+
+	/* bumped on anything libobs knows changes the video of sources that
+	 * declare when their content changes (see
+	 * obs_source_get_content_generation) */
+	volatile long content_generation;
+
 	bool active;
 	bool showing;
 
@@ -648,7 +717,6 @@ struct obs_source {
 	enum video_format async_format;
 	bool async_full_range;
 	enum video_format async_cache_format;
-	bool async_cache_full_range;
 	enum gs_color_format async_texture_formats[MAX_AV_PLANES];
 	int async_channel_count;
 	long async_rotation;
@@ -658,9 +726,25 @@ struct obs_source {
 	bool async_unbuffered;
 	bool async_decoupled;
 	struct obs_source_frame *async_preload_frame;
-	DARRAY(struct async_frame) async_cache;
 	DARRAY(struct obs_source_frame *) async_frames;
 	pthread_mutex_t async_mutex;
+
+	/* async frame pool.  the thread outputting video owns the pool and
+	 * hands frames to the graphics thread through async_queue, which
+	 * gives them back through async_returned.  async_output_mutex only
+	 * keeps outputting threads apart, the graphics thread never takes
+	 * it */
+	DARRAY(struct async_frame *) async_cache;
+	DARRAY(struct async_frame *) async_spare;
+	struct async_frame_ring async_queue;
+	struct async_frame_ring async_returned;
+	pthread_mutex_t async_output_mutex;
+	uint32_t async_generation;
+	long async_unused_count;
+	volatile bool async_flush;
+	volatile long async_frames_output;
+	volatile long async_copies_avoided;
+	volatile long async_frames_dropped;
 	uint32_t async_width;
 	uint32_t async_height;
 	uint32_t async_cache_width;
@@ -814,6 +898,18 @@ convert_video_format(enum video_format format)
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern void obs_source_video_tick_frames(obs_source_t *source);
+extern void obs_source_video_tick_serial(obs_source_t *source, float seconds);
+extern void obs_source_video_tick_threaded(obs_source_t *source,
+					   float seconds);
+extern void obs_source_check_size(obs_source_t *source);
+extern bool obs_source_get_content_generation(obs_source_t *source,
+					      uint64_t *generation);
+
+static inline void obs_transforms_changed(void)
+{
+	os_atomic_inc_long(&obs->data.transform_generation);
+}
 extern float obs_source_get_target_volume(obs_source_t *source,
 					  obs_source_t *target);
 
@@ -905,7 +1001,7 @@ struct obs_output {
 	pthread_t end_data_capture_thread;
 	os_event_t *stopping_event;
 	pthread_mutex_t interleaved_mutex;
-	DARRAY(struct encoder_packet) interleaved_packets;
+	struct interleave_queue interleaved;
 	int stop_code;
 
 	int reconnect_retry_sec;
@@ -968,6 +1064,22 @@ struct obs_output {
 	volatile bool delay_active;
 	volatile bool delay_capturing;
 
+	encoded_callback_t delivery_callback;
+	struct circlebuf delivery_packets; /* struct encoder_packet */
+	pthread_mutex_t delivery_mutex;
+	os_sem_t *delivery_sem;
+	os_event_t *delivery_space_event;
+	pthread_t delivery_thread;
+	uint32_t delivery_max_ms;
+	enum obs_output_overflow delivery_overflow;
+	int64_t delivery_cur_max_usec;
+	enum obs_output_overflow delivery_cur_overflow;
+	bool delivery_drop_to_keyframe;
+	int delivery_dropped_frames;
+	volatile bool delivery_active;
+	volatile bool delivery_stopping;
+	volatile bool delivery_exiting;
+
 	char *last_error_message;
 
 	float audio_data[MAX_AUDIO_CHANNELS][AUDIO_OUTPUT_FRAMES];
@@ -986,6 +1098,11 @@ extern void process_delay(void *data, struct encoder_packet *packet);
 extern void obs_output_cleanup_delay(obs_output_t *output);
 extern bool obs_output_delay_start(obs_output_t *output);
 extern void obs_output_delay_stop(obs_output_t *output);
+extern void process_delivery(void *data, struct encoder_packet *packet);
+extern bool obs_output_delivery_start(obs_output_t *output,
+				      encoded_callback_t callback);
+extern void obs_output_delivery_unblock(obs_output_t *output);
+extern void obs_output_delivery_stop(obs_output_t *output);
 extern bool obs_output_actual_start(obs_output_t *output);
 extern void obs_output_actual_stop(obs_output_t *output, bool force,
 				   uint64_t ts);
@@ -998,6 +1115,24 @@ extern void obs_output_remove_encoder(struct obs_output *output,
 extern void
 obs_encoder_packet_create_instance(struct encoder_packet *dst,
 				   const struct encoder_packet *src);
+
+/* reference counted packet data is always preceded by this header */
+struct encoder_packet_buffer {
+	struct encoder_packet_buffer *next;
+	size_t size_class;
+	long refs;
+};
+
+#define ENCODER_PACKET_HEADER_SIZE \
+	(offsetof(struct encoder_packet_buffer, refs) + sizeof(long))
+
+extern uint8_t *encoder_packet_buffer_alloc(size_t size);
+
+/* takes ownership of bmalloc'd memory that starts with
+ * ENCODER_PACKET_HEADER_SIZE reserved bytes, returns the packet data */
+extern uint8_t *encoder_packet_buffer_adopt(void *mem);
+extern void obs_encoder_packet_pool_init(void);
+extern void obs_encoder_packet_pool_free(void);
 void obs_output_destroy(obs_output_t *output);
 
 /* ------------------------------------------------------------------------- */
@@ -1076,6 +1211,23 @@ struct obs_encoder {
 	struct pause_data pause;
 
 	const char *profile_encoder_encode_name;
+
+	/* buffer from obs_encoder_packet_alloc not yet sent off */
+	uint8_t *pooled_packet_data;
+
+	/* raw video frames waiting for the encode thread */
+	struct circlebuf frame_queue; /* struct queued_frame */
+	pthread_mutex_t frame_queue_mutex;
+	os_sem_t *frame_queue_sem;
+	os_event_t *frame_queue_space_event;
+	pthread_t encode_thread;
+	uint32_t frame_queue_depth;
+	uint32_t cur_frame_queue_depth;
+	struct obs_encoder_frame_stats frame_stats;
+	volatile bool encode_thread_active;
+	volatile bool encode_thread_exiting;
+	volatile bool encode_thread_aborted;
+	volatile bool frame_queue_unblocked;
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
@@ -0,0 +1,280 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+
+/* Encoders call every connected output back in turn on their own thread, so
+ * an output that takes a while to handle a packet would hold up all the other
+ * outputs on the same encoder.  Each encoded output therefore gets its own
+ * packet queue which is drained by a delivery thread, and the encoder only
+ * ever waits on an output when that output's queue is full and the output
+ * asked for blocking behavior. */
+
+static inline bool delivery_stopping(const struct obs_output *output)
+{
+	return os_atomic_load_bool(&output->delivery_stopping);
+}
+
+static inline int64_t queued_usec(struct obs_output *output,
+				  const struct encoder_packet *packet)
+{
+	struct encoder_packet *front;
+
+	if (!output->delivery_packets.size)
+		return 0;
+
+	front = circlebuf_data(&output->delivery_packets, 0);
+	return packet->dts_usec - front->dts_usec;
+}
+
+static inline bool queue_full(struct obs_output *output,
+			      const struct encoder_packet *packet)
+{
+	return queued_usec(output, packet) > output->delivery_cur_max_usec;
+}
+
+static inline void drop_packet(struct obs_output *output,
+			       struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		output->delivery_dropped_frames++;
+	obs_encoder_packet_release(packet);
+}
+
+/* drops all queued video (audio is small and can still be delivered) and
+ * then the oldest audio if that isn't enough */
+static void drop_queued_packets(struct obs_output *output,
+				const struct encoder_packet *packet)
+{
+	size_t count = output->delivery_packets.size / sizeof(*packet);
+	struct encoder_packet pkt;
+
+	for (size_t i = 0; i < count; i++) {
+		circlebuf_pop_front(&output->delivery_packets, &pkt,
+				    sizeof(pkt));
+		if (pkt.type == OBS_ENCODER_VIDEO)
+			drop_packet(output, &pkt);
+		else
+			circlebuf_push_back(&output->delivery_packets, &pkt,
+					    sizeof(pkt));
+	}
+
+	while (queue_full(output, packet)) {
+		circlebuf_pop_front(&output->delivery_packets, &pkt,
+				    sizeof(pkt));
+		drop_packet(output, &pkt);
+	}
+}
+
+void process_delivery(void *data, struct encoder_packet *packet)
+{
+	struct obs_output *output = data;
+	bool drop_mode = output->delivery_cur_overflow ==
+			 OBS_OUTPUT_OVERFLOW_DROP_TO_KEYFRAME;
+	struct encoder_packet pkt;
+
+	pthread_mutex_lock(&output->delivery_mutex);
+
+	if (drop_mode) {
+		if (queue_full(output, packet)) {
+			drop_queued_packets(output, packet);
+			output->delivery_drop_to_keyframe = true;
+		}
+
+		/* any video dropped leaves the next frames undecodable */
+		if (output->delivery_drop_to_keyframe &&
+		    packet->type == OBS_ENCODER_VIDEO) {
+			if (!packet->keyframe) {
+				output->delivery_dropped_frames++;
+				pthread_mutex_unlock(&output->delivery_mutex);
+				return;
+			}
+
+			output->delivery_drop_to_keyframe = false;
+		}
+
+	} else {
+		/* the event is manual reset so that every encoder waiting
+		 * here wakes up on unblock, not just one of them */
+		while (queue_full(output, packet) &&
+		       !delivery_stopping(output)) {
+			os_event_reset(output->delivery_space_event);
+			pthread_mutex_unlock(&output->delivery_mutex);
+			os_event_wait(output->delivery_space_event);
+			pthread_mutex_lock(&output->delivery_mutex);
+		}
+	}
+
+	obs_encoder_packet_ref(&pkt, packet);
+	circlebuf_push_back(&output->delivery_packets, &pkt, sizeof(pkt));
+
+	pthread_mutex_unlock(&output->delivery_mutex);
+
+	os_sem_post(output->delivery_sem);
+}
+
+static void *delivery_thread(void *data)
+{
+	struct obs_output *output = data;
+	struct encoder_packet pkt;
+	char name[64];
+
+	snprintf(name, sizeof(name), "output delivery: %s",
+		 output->context.name);
+	os_set_thread_name(name);
+
+	for (;;) {
+		bool popped = false;
+
+		os_sem_wait(output->delivery_sem);
+
+		pthread_mutex_lock(&output->delivery_mutex);
+		if (output->delivery_packets.size) {
+			circlebuf_pop_front(&output->delivery_packets, &pkt,
+					    sizeof(pkt));
+			os_event_signal(output->delivery_space_event);
+			popped = true;
+		}
+		pthread_mutex_unlock(&output->delivery_mutex);
+
+		if (!popped) {
+			/* dropped packets leave posts behind, so an empty
+			 * queue alone doesn't mean the thread is done */
+			if (os_atomic_load_bool(&output->delivery_exiting))
+				break;
+			continue;
+		}
+
+		output->delivery_callback(output, &pkt);
+		obs_encoder_packet_release(&pkt);
+	}
+
+	return NULL;
+}
+
+static void free_delivery_packets(struct obs_output *output)
+{
+	struct encoder_packet pkt;
+
+	while (output->delivery_packets.size) {
+		circlebuf_pop_front(&output->delivery_packets, &pkt,
+				    sizeof(pkt));
+		obs_encoder_packet_release(&pkt);
+	}
+	circlebuf_free(&output->delivery_packets);
+}
+
+bool obs_output_delivery_start(obs_output_t *output,
+			       encoded_callback_t callback)
+{
+	output->delivery_callback = callback;
+	output->delivery_cur_max_usec =
+		(int64_t)output->delivery_max_ms * 1000LL;
+	output->delivery_cur_overflow = output->delivery_overflow;
+	output->delivery_drop_to_keyframe = false;
+	output->delivery_dropped_frames = 0;
+	os_atomic_set_bool(&output->delivery_stopping, false);
+	os_atomic_set_bool(&output->delivery_exiting, false);
+
+	if (os_sem_init(&output->delivery_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&output->delivery_space_event,
+			  OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+	if (pthread_create(&output->delivery_thread, NULL, delivery_thread,
+			   output) != 0)
+		goto fail;
+
+	os_atomic_set_bool(&output->delivery_active, true);
+	return true;
+
+fail:
+	blog(LOG_WARNING,
+	     "Output '%s': Failed to start delivery thread, "
+	     "packets will be sent from the encoder thread",
+	     output->context.name);
+	os_sem_destroy(output->delivery_sem);
+	os_event_destroy(output->delivery_space_event);
+	output->delivery_sem = NULL;
+	output->delivery_space_event = NULL;
+	return false;
+}
+
+void obs_output_delivery_unblock(obs_output_t *output)
+{
+	if (!os_atomic_load_bool(&output->delivery_active))
+		return;
+
+	/* set under the lock so a waiter can't reset the event between
+	 * checking the flag and waiting */
+	pthread_mutex_lock(&output->delivery_mutex);
+	os_atomic_set_bool(&output->delivery_stopping, true);
+	os_event_signal(output->delivery_space_event);
+	pthread_mutex_unlock(&output->delivery_mutex);
+}
+
+void obs_output_delivery_stop(obs_output_t *output)
+{
+	if (!os_atomic_load_bool(&output->delivery_active))
+		return;
+
+	/* the encoders are disconnected at this point, so the thread
+	 * delivers whatever is left and exits */
+	obs_output_delivery_unblock(output);
+	os_atomic_set_bool(&output->delivery_exiting, true);
+	os_sem_post(output->delivery_sem);
+	pthread_join(output->delivery_thread, NULL);
+
+	free_delivery_packets(output);
+	os_sem_destroy(output->delivery_sem);
+	os_event_destroy(output->delivery_space_event);
+	output->delivery_sem = NULL;
+	output->delivery_space_event = NULL;
+
+	if (output->delivery_dropped_frames)
+		blog(LOG_INFO,
+		     "Output '%s': %d frames dropped because the output "
+		     "fell behind",
+		     output->context.name, output->delivery_dropped_frames);
+
+	os_atomic_set_bool(&output->delivery_active, false);
+}
+
+void obs_output_set_delivery_buffer(obs_output_t *output, uint32_t max_ms,
+				    enum obs_output_overflow overflow)
+{
+	if (!obs_output_valid(output, "obs_output_set_delivery_buffer"))
+		return;
+
+	if ((output->info.flags & OBS_OUTPUT_ENCODED) == 0) {
+		blog(LOG_WARNING,
+		     "Output '%s': Tried to set a delivery "
+		     "buffer on a non-encoded output",
+		     output->context.name);
+		return;
+	}
+
+	output->delivery_max_ms = max_ms;
+	output->delivery_overflow = overflow;
+}
+
+uint32_t obs_output_get_delivery_buffer(const obs_output_t *output)
+{
+	return obs_output_valid(output, "obs_output_get_delivery_buffer")
+		       ? output->delivery_max_ms
+		       : 0;
+}
@@ -0,0 +1,128 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-output-interleave.h"
+
+static inline bool heap_track_before(struct interleave_queue *queue, size_t a,
+				     size_t b)
+{
+	return interleaved_packet_before(
+		interleave_queue_track_first(queue, queue->heap[a]),
+		interleave_queue_track_first(queue, queue->heap[b]));
+}
+
+static inline void heap_swap(struct interleave_queue *queue, size_t a,
+			     size_t b)
+{
+	size_t track = queue->heap[a];
+	queue->heap[a] = queue->heap[b];
+	queue->heap[b] = track;
+}
+
+static void heap_sift_up(struct interleave_queue *queue, size_t idx)
+{
+	while (idx > 0) {
+		size_t parent = (idx - 1) / 2;
+		if (!heap_track_before(queue, idx, parent))
+			break;
+
+		heap_swap(queue, idx, parent);
+		idx = parent;
+	}
+}
+
+static void heap_sift_down(struct interleave_queue *queue, size_t idx)
+{
+	size_t size = queue->heap_size;
+
+	while (true) {
+		size_t left = idx * 2 + 1;
+		size_t right = left + 1;
+		size_t first = idx;
+
+		if (left < size && heap_track_before(queue, left, first))
+			first = left;
+		if (right < size && heap_track_before(queue, right, first))
+			first = right;
+		if (first == idx)
+			break;
+
+		heap_swap(queue, idx, first);
+		idx = first;
+	}
+}
+
+void interleave_queue_push(struct interleave_queue *queue,
+			   const struct encoder_packet *packet)
+{
+	size_t track = interleave_queue_track(packet);
+	struct interleaved_packet entry;
+	bool was_empty = !interleave_queue_count(queue, track);
+
+	entry.packet = *packet;
+	entry.seq = queue->seq++;
+
+	/* each track stays sorted, so only a track's first packet needs to be
+	 * in the heap */
+	circlebuf_push_back(&queue->tracks[track], &entry, sizeof(entry));
+
+	if (was_empty) {
+		size_t idx = queue->heap_size++;
+		queue->heap[idx] = track;
+		heap_sift_up(queue, idx);
+	}
+}
+
+void interleave_queue_pop(struct interleave_queue *queue,
+			  struct encoder_packet *packet)
+{
+	size_t track = queue->heap[0];
+	struct interleaved_packet entry;
+
+	circlebuf_pop_front(&queue->tracks[track], &entry, sizeof(entry));
+	*packet = entry.packet;
+
+	if (!interleave_queue_count(queue, track)) {
+		size_t last = --queue->heap_size;
+		queue->heap[0] = queue->heap[last];
+	}
+
+	heap_sift_down(queue, 0);
+}
+
+void interleave_queue_rebuild(struct interleave_queue *queue)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++) {
+		if (interleave_queue_count(queue, i))
+			queue->heap[size++] = i;
+	}
+
+	queue->heap_size = size;
+
+	for (size_t i = size / 2; i > 0; i--)
+		heap_sift_down(queue, i - 1);
+}
+
+void interleave_queue_free(struct interleave_queue *queue)
+{
+	for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++)
+		circlebuf_free(&queue->tracks[i]);
+
+	queue->heap_size = 0;
+}
@@ -0,0 +1,113 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "util/circlebuf.h"
+#include "obs.h"
+
+/*
+ * Output packet interleaving queue
+ *
+ *   One packet queue per audio track plus one for video, merged in timestamp
+ * order through a min-heap of the queues' first packets.  Encoders output
+ * packets in dts order, so each track stays sorted and pushing or popping a
+ * packet is O(log tracks).
+ */
+
+struct interleaved_packet {
+	struct encoder_packet packet;
+	uint64_t seq;
+};
+
+#define INTERLEAVED_VIDEO_TRACK MAX_AUDIO_MIXES
+#define MAX_INTERLEAVED_TRACKS (MAX_AUDIO_MIXES + 1)
+
+struct interleave_queue {
+	struct circlebuf tracks[MAX_INTERLEAVED_TRACKS];
+	size_t heap[MAX_INTERLEAVED_TRACKS];
+	size_t heap_size;
+	uint64_t seq;
+};
+
+static inline size_t
+interleave_queue_track(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? INTERLEAVED_VIDEO_TRACK
+						 : packet->track_idx;
+}
+
+static inline size_t
+interleave_queue_count(const struct interleave_queue *queue, size_t track)
+{
+	return queue->tracks[track].size / sizeof(struct interleaved_packet);
+}
+
+static inline struct interleaved_packet *
+interleave_queue_packet(struct interleave_queue *queue, size_t track,
+			size_t idx)
+{
+	return circlebuf_data(&queue->tracks[track],
+			      idx * sizeof(struct interleaved_packet));
+}
+
+static inline struct interleaved_packet *
+interleave_queue_track_first(struct interleave_queue *queue, size_t track)
+{
+	return interleave_queue_count(queue, track)
+		       ? interleave_queue_packet(queue, track, 0)
+		       : NULL;
+}
+
+static inline struct interleaved_packet *
+interleave_queue_track_last(struct interleave_queue *queue, size_t track)
+{
+	size_t count = interleave_queue_count(queue, track);
+	return count ? interleave_queue_packet(queue, track, count - 1) : NULL;
+}
+
+/* packets are sent in dts order.  on equal timestamps video goes first,
+ * otherwise packets go in the order they were received */
+static inline bool interleaved_packet_before(const struct interleaved_packet *a,
+					     const struct interleaved_packet *b)
+{
+	if (a->packet.dts_usec != b->packet.dts_usec)
+		return a->packet.dts_usec < b->packet.dts_usec;
+	if (a->packet.type != b->packet.type)
+		return a->packet.type == OBS_ENCODER_VIDEO;
+	return a->seq < b->seq;
+}
+
+/** Returns the packet that goes out next, or NULL if the queue is empty */
+static inline struct interleaved_packet *
+interleave_queue_first(struct interleave_queue *queue)
+{
+	return queue->heap_size
+		       ? interleave_queue_track_first(queue, queue->heap[0])
+		       : NULL;
+}
+
+extern void interleave_queue_push(struct interleave_queue *queue,
+				  const struct encoder_packet *packet);
+extern void interleave_queue_pop(struct interleave_queue *queue,
+				 struct encoder_packet *packet);
+
+/** Re-sorts the tracks after their first packets were modified in place */
+extern void interleave_queue_rebuild(struct interleave_queue *queue);
+
+/** Frees the queue's memory, the packets in it have to be released first */
+extern void interleave_queue_free(struct interleave_queue *queue);
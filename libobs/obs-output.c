@@ -106,6 +106,7 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 	output = bzalloc(sizeof(struct obs_output));
 	pthread_mutex_init_value(&output->interleaved_mutex);
 	pthread_mutex_init_value(&output->delay_mutex);
+	pthread_mutex_init_value(&output->delivery_mutex);
 	pthread_mutex_init_value(&output->caption_mutex);
 	pthread_mutex_init_value(&output->pause.mutex);
 
@@ -113,6 +114,8 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 		goto fail;
 	if (pthread_mutex_init(&output->delay_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&output->delivery_mutex, NULL) != 0)
+		goto fail;
 	if (pthread_mutex_init(&output->caption_mutex, NULL) != 0)
 		goto fail;
 	if (pthread_mutex_init(&output->pause.mutex, NULL) != 0)
@@ -144,6 +147,8 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 
 	output->reconnect_retry_sec = 2;
 	output->reconnect_retry_max = 20;
+	output->delivery_max_ms = 2000;
+	output->delivery_overflow = OBS_OUTPUT_OVERFLOW_BLOCK;
 	output->valid = true;
 
 	output->control = bzalloc(sizeof(obs_weak_output_t));
@@ -168,10 +173,13 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array +
-					   i);
-	da_free(output->interleaved_packets);
+	while (interleave_queue_first(&output->interleaved)) {
+		struct encoder_packet packet;
+		interleave_queue_pop(&output->interleaved, &packet);
+		obs_encoder_packet_release(&packet);
+	}
+
+	interleave_queue_free(&output->interleaved);
 }
 
 static inline void clear_audio_buffers(obs_output_t *output)
@@ -223,6 +231,7 @@ void obs_output_destroy(obs_output_t *output)
 		pthread_mutex_destroy(&output->caption_mutex);
 		pthread_mutex_destroy(&output->interleaved_mutex);
 		pthread_mutex_destroy(&output->delay_mutex);
+		pthread_mutex_destroy(&output->delivery_mutex);
 		os_event_destroy(output->reconnect_stop_event);
 		obs_context_data_free(&output->context);
 		circlebuf_free(&output->delay_data);
@@ -308,7 +317,7 @@ static void log_frame_info(struct obs_output *output)
 	uint32_t lagged = video->lagged_frames - output->starting_lagged_count;
 
 	int dropped = obs_output_get_frames_dropped(output);
-	int total = output->total_frames;
+	int total = obs_output_get_total_frames(output);
 
 	double percentage_lagged = 0.0f;
 	double percentage_dropped = 0.0f;
@@ -925,15 +934,16 @@ int obs_output_get_frames_dropped(const obs_output_t *output)
 	if (!obs_output_valid(output, "obs_output_get_frames_dropped"))
 		return 0;
 	if (!output->info.get_dropped_frames)
-		return 0;
+		return output->delivery_dropped_frames;
 
-	return output->info.get_dropped_frames(output->context.data);
+	return output->info.get_dropped_frames(output->context.data) +
+	       output->delivery_dropped_frames;
 }
 
 int obs_output_get_total_frames(const obs_output_t *output)
 {
 	return obs_output_valid(output, "obs_output_get_total_frames")
-		       ? output->total_frames
+		       ? output->total_frames + output->delivery_dropped_frames
 		       : 0;
 }
 
@@ -1213,7 +1223,7 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	sei_t sei;
 	uint8_t *data;
 	size_t size;
-	long ref = 1;
+	uint8_t header[ENCODER_PACKET_HEADER_SIZE] = {0};
 
 	DARRAY(uint8_t) out_data;
 
@@ -1223,7 +1233,7 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	sei_init(&sei, 0.0);
 
 	da_init(out_data);
-	da_push_back_array(out_data, &ref, sizeof(ref));
+	da_push_back_array(out_data, header, sizeof(header));
 	da_push_back_array(out_data, out->data, out->size);
 
 	caption_frame_init(&cf);
@@ -1241,8 +1251,8 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	obs_encoder_packet_release(out);
 
 	*out = backup;
-	out->data = (uint8_t *)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	out->data = encoder_packet_buffer_adopt(out_data.array);
+	out->size = out_data.num - sizeof(header);
 
 	sei_free(&sei);
 
@@ -1253,17 +1263,59 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 }
 #endif
 
+static inline size_t get_track_count(struct obs_output *output, size_t track)
+{
+	return interleave_queue_count(&output->interleaved, track);
+}
+
+static inline struct interleaved_packet *
+get_track_packet(struct obs_output *output, size_t track, size_t idx)
+{
+	return interleave_queue_packet(&output->interleaved, track, idx);
+}
+
+static inline struct interleaved_packet *
+get_track_first(struct obs_output *output, size_t track)
+{
+	return interleave_queue_track_first(&output->interleaved, track);
+}
+
+static inline struct interleaved_packet *
+get_track_last(struct obs_output *output, size_t track)
+{
+	return interleave_queue_track_last(&output->interleaved, track);
+}
+
+static inline bool packet_before(const struct interleaved_packet *a,
+				 const struct interleaved_packet *b)
+{
+	return interleaved_packet_before(a, b);
+}
+
+static inline struct interleaved_packet *
+get_first_interleaved_packet(struct obs_output *output)
+{
+	return interleave_queue_first(&output->interleaved);
+}
+
+static inline void pop_interleaved_packet(struct obs_output *output,
+					  struct encoder_packet *out)
+{
+	interleave_queue_pop(&output->interleaved, out);
+}
+
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct interleaved_packet *first = get_first_interleaved_packet(output);
+	struct encoder_packet out;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
 	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
+	if (!first || !has_higher_opposing_ts(output, &first->packet))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	pop_interleaved_packet(output, &out);
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1308,113 +1360,125 @@ static inline void set_higher_ts(struct obs_output *output,
 	}
 }
 
-static inline struct encoder_packet *
-find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		       size_t audio_idx);
-static int find_first_packet_type_idx(struct obs_output *output,
-				      enum obs_encoder_type type,
-				      size_t audio_idx);
-
 /* gets the point where audio and video are closest together */
-static size_t get_interleaved_start_idx(struct obs_output *output)
+static struct interleaved_packet *
+get_interleaved_start(struct obs_output *output)
 {
 	int64_t closest_diff = 0x7FFFFFFFFFFFFFFFLL;
-	struct encoder_packet *first_video =
-		find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
-	size_t video_idx = DARRAY_INVALID;
-	size_t idx = 0;
-
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		int64_t diff;
-
-		if (packet->type != OBS_ENCODER_AUDIO) {
-			if (packet == first_video)
-				video_idx = i;
-			continue;
-		}
+	struct interleaved_packet *first_video =
+		get_track_first(output, INTERLEAVED_VIDEO_TRACK);
+	struct interleaved_packet *closest = NULL;
 
-		diff = llabs(packet->dts_usec - first_video->dts_usec);
-		if (diff < closest_diff) {
-			closest_diff = diff;
-			idx = i;
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		size_t count = get_track_count(output, i);
+
+		for (size_t j = 0; j < count; j++) {
+			struct interleaved_packet *packet =
+				get_track_packet(output, i, j);
+			int64_t diff = llabs(packet->packet.dts_usec -
+					     first_video->packet.dts_usec);
+
+			if (diff < closest_diff ||
+			    (diff == closest_diff &&
+			     packet_before(packet, closest))) {
+				closest_diff = diff;
+				closest = packet;
+			}
 		}
 	}
 
-	return video_idx < idx ? video_idx : idx;
+	if (!closest)
+		return NULL;
+
+	return packet_before(first_video, closest) ? first_video : closest;
 }
 
-static int prune_premature_packets(struct obs_output *output)
+static int prune_premature_packets(struct obs_output *output,
+				   struct interleaved_packet **end)
 {
 	size_t audio_mixes = num_audio_mixes(output);
-	struct encoder_packet *video;
-	int video_idx;
-	int max_idx;
+	struct interleaved_packet *video;
+	struct interleaved_packet *last;
 	int64_t duration_usec;
 	int64_t max_diff = 0;
 	int64_t diff = 0;
 
-	video_idx = find_first_packet_type_idx(output, OBS_ENCODER_VIDEO, 0);
-	if (video_idx == -1) {
+	video = get_track_first(output, INTERLEAVED_VIDEO_TRACK);
+	if (!video) {
 		output->received_video = false;
 		return -1;
 	}
 
-	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
-	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
+	last = video;
+	duration_usec = video->packet.timebase_num * 1000000LL /
+			video->packet.timebase_den;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
-		struct encoder_packet *audio;
-		int audio_idx;
+		struct interleaved_packet *audio = get_track_first(output, i);
 
-		audio_idx = find_first_packet_type_idx(output,
-						       OBS_ENCODER_AUDIO, i);
-		if (audio_idx == -1) {
+		if (!audio) {
 			output->received_audio = false;
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
-		if (audio_idx > max_idx)
-			max_idx = audio_idx;
+		if (packet_before(last, audio))
+			last = audio;
 
-		diff = audio->dts_usec - video->dts_usec;
+		diff = audio->packet.dts_usec - video->packet.dts_usec;
 		if (diff > max_diff)
 			max_diff = diff;
 	}
 
-	return diff > duration_usec ? max_idx + 1 : 0;
+	*end = last;
+	return diff > duration_usec ? 1 : 0;
 }
 
-static void discard_to_idx(struct obs_output *output, size_t idx)
+/* discards all packets sent before end, and end itself if inclusive */
+static void discard_interleaved_packets(struct obs_output *output,
+					const struct interleaved_packet *end,
+					bool inclusive)
 {
-	for (size_t i = 0; i < idx; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		obs_encoder_packet_release(packet);
-	}
+	struct interleaved_packet limit = *end;
+	struct interleaved_packet *first;
+
+	while ((first = get_first_interleaved_packet(output)) != NULL) {
+		struct encoder_packet packet;
 
-	da_erase_range(output->interleaved_packets, 0, idx);
+		if (inclusive ? packet_before(&limit, first)
+			      : !packet_before(first, &limit))
+			break;
+
+		pop_interleaved_packet(output, &packet);
+		obs_encoder_packet_release(&packet);
+	}
 }
 
 #define DEBUG_STARTING_PACKETS 0
 
 static bool prune_interleaved_packets(struct obs_output *output)
 {
-	size_t start_idx = 0;
-	int prune_start = prune_premature_packets(output);
+	struct interleaved_packet *end = NULL;
+	int prune_start = prune_premature_packets(output, &end);
 
 #if DEBUG_STARTING_PACKETS == 1
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
-		     packet->type == OBS_ENCODER_AUDIO ? "audio" : "video",
-		     (int)packet->track_idx, packet->dts_usec,
-		     (int)i < prune_start ? "true" : "false");
+	for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++) {
+		size_t count = get_track_count(output, i);
+
+		for (size_t j = 0; j < count; j++) {
+			struct interleaved_packet *packet =
+				get_track_packet(output, i, j);
+			bool pruned = prune_start == 1 &&
+				      !packet_before(end, packet);
+
+			blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
+			     packet->packet.type == OBS_ENCODER_AUDIO
+				     ? "audio"
+				     : "video",
+			     (int)packet->packet.track_idx,
+			     packet->packet.dts_usec,
+			     pruned ? "true" : "false");
+		}
 	}
 #endif
 
@@ -1422,89 +1486,33 @@ static bool prune_interleaved_packets(struct obs_output *output)
 	if (prune_start == -1)
 		return false;
 	else if (prune_start != 0)
-		start_idx = (size_t)prune_start;
-	else
-		start_idx = get_interleaved_start_idx(output);
-
-	if (start_idx)
-		discard_to_idx(output, start_idx);
+		discard_interleaved_packets(output, end, true);
+	else if ((end = get_interleaved_start(output)) != NULL)
+		discard_interleaved_packets(output, end, false);
 
 	return true;
 }
 
-static int find_first_packet_type_idx(struct obs_output *output,
-				      enum obs_encoder_type type,
-				      size_t audio_idx)
-{
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)i;
-		}
-	}
-
-	return -1;
-}
-
-static int find_last_packet_type_idx(struct obs_output *output,
-				     enum obs_encoder_type type,
-				     size_t audio_idx)
-{
-	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)(i - 1);
-		}
-	}
-
-	return -1;
-}
-
-static inline struct encoder_packet *
-find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		       size_t audio_idx)
-{
-	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
-static inline struct encoder_packet *
-find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		      size_t audio_idx)
-{
-	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
 static bool get_audio_and_video_packets(struct obs_output *output,
 					struct encoder_packet **video,
 					struct encoder_packet **audio,
 					size_t audio_mixes)
 {
-	*video = find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
+	struct interleaved_packet *packet;
+
+	packet = get_track_first(output, INTERLEAVED_VIDEO_TRACK);
+	*video = packet ? &packet->packet : NULL;
 	if (!*video)
 		output->received_video = false;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
-		audio[i] = find_first_packet_type(output, OBS_ENCODER_AUDIO, i);
-		if (!audio[i]) {
+		packet = get_track_first(output, i);
+		if (!packet) {
 			output->received_audio = false;
 			return false;
 		}
+
+		audio[i] = &packet->packet;
 	}
 
 	if (!*video) {
@@ -1514,33 +1522,61 @@ static bool get_audio_and_video_packets(struct obs_output *output,
 	return true;
 }
 
+static void renumber_interleaved_packets(struct obs_output *output)
+{
+	size_t pos[MAX_INTERLEAVED_TRACKS] = {0};
+
+	while (true) {
+		struct interleaved_packet *first = NULL;
+		size_t first_track = 0;
+
+		for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++) {
+			struct interleaved_packet *packet;
+
+			if (pos[i] == get_track_count(output, i))
+				continue;
+
+			packet = get_track_packet(output, i, pos[i]);
+			if (!first || packet_before(packet, first)) {
+				first = packet;
+				first_track = i;
+			}
+		}
+
+		if (!first)
+			break;
+
+		first->seq = output->interleaved.seq++;
+		pos[first_track]++;
+	}
+}
+
 static bool initialize_interleaved_packets(struct obs_output *output)
 {
 	struct encoder_packet *video;
 	struct encoder_packet *audio[MAX_AUDIO_MIXES];
-	struct encoder_packet *last_audio[MAX_AUDIO_MIXES];
+	struct interleaved_packet *last_audio[MAX_AUDIO_MIXES];
+	struct interleaved_packet *start;
 	size_t audio_mixes = num_audio_mixes(output);
-	size_t start_idx;
 
 	if (!get_audio_and_video_packets(output, &video, audio, audio_mixes))
 		return false;
 
 	for (size_t i = 0; i < audio_mixes; i++)
-		last_audio[i] =
-			find_last_packet_type(output, OBS_ENCODER_AUDIO, i);
+		last_audio[i] = get_track_last(output, i);
 
 	/* ensure that there is audio past the first video packet */
 	for (size_t i = 0; i < audio_mixes; i++) {
-		if (last_audio[i]->dts_usec < video->dts_usec) {
+		if (last_audio[i]->packet.dts_usec < video->dts_usec) {
 			output->received_audio = false;
 			return false;
 		}
 	}
 
 	/* clear out excess starting audio if it hasn't been already */
-	start_idx = get_interleaved_start_idx(output);
-	if (start_idx) {
-		discard_to_idx(output, start_idx);
+	start = get_interleaved_start(output);
+	if (start && start != get_first_interleaved_packet(output)) {
+		discard_interleaved_packets(output, start, false);
 		if (!get_audio_and_video_packets(output, &video, audio,
 						 audio_mixes))
 			return false;
@@ -1566,11 +1602,19 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_audio_ts -= audio[0]->dts_usec;
 	output->highest_video_ts -= video->dts_usec;
 
+	/* packets that end up with equal timestamps keep their current order */
+	renumber_interleaved_packets(output);
+
 	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
+	for (size_t i = 0; i < MAX_INTERLEAVED_TRACKS; i++) {
+		size_t count = get_track_count(output, i);
+
+		for (size_t j = 0; j < count; j++) {
+			struct interleaved_packet *packet =
+				get_track_packet(output, i, j);
+			apply_interleaved_packet_offset(output,
+							&packet->packet);
+		}
 	}
 
 	return true;
@@ -1579,51 +1623,30 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 static inline void insert_interleaved_packet(struct obs_output *output,
 					     struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
-	}
-
-	da_insert(output->interleaved_packets, idx, out);
+	interleave_queue_push(&output->interleaved, out);
 }
 
-static void resort_interleaved_packets(struct obs_output *output)
+/* offsets are applied per track, which keeps every track sorted but can
+ * change which track's first packet comes first */
+static inline void resort_interleaved_packets(struct obs_output *output)
 {
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-	       sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
+	interleave_queue_rebuild(&output->interleaved);
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
 					 int64_t dts_usec)
 {
-	size_t idx = 0;
+	struct interleaved_packet *first;
 
-	for (; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+	while ((first = get_first_interleaved_packet(output)) != NULL) {
+		struct encoder_packet packet;
 
-		if (p->dts_usec >= dts_usec)
+		if (first->packet.dts_usec >= dts_usec)
 			break;
-	}
 
-	if (idx)
-		discard_to_idx(output, idx);
+		pop_interleaved_packet(output, &packet);
+		obs_encoder_packet_release(&packet);
+	}
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -1656,7 +1679,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_encoder_packet_create_instance(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
@@ -1885,6 +1908,9 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 			     preserve_active(output) ? "on" : "off");
 		}
 
+		if (obs_output_delivery_start(output, encoded_callback))
+			encoded_callback = process_delivery;
+
 		if (has_audio)
 			start_audio_encoders(output, encoded_callback);
 		if (has_video)
@@ -2192,18 +2218,26 @@ static void *end_data_capture_thread(void *data)
 		      &has_service);
 
 	if (encoded) {
-		if (output->active_delay_ns)
+		if (os_atomic_load_bool(&output->delivery_active))
+			encoded_callback = process_delivery;
+		else if (output->active_delay_ns)
 			encoded_callback = process_delay;
 		else
 			encoded_callback = (has_video && has_audio)
 						   ? interleave_packets
 						   : default_encoded_callback;
 
+		/* an encoder waiting on a full queue holds its callback
+		 * mutex, which obs_encoder_stop needs */
+		obs_output_delivery_unblock(output);
+
 		if (has_video)
 			obs_encoder_stop(output->video_encoder,
 					 encoded_callback, output);
 		if (has_audio)
 			stop_audio_encoders(output, encoded_callback);
+
+		obs_output_delivery_stop(output);
 	} else {
 		if (has_video)
 			stop_raw_video(output->video,
@@ -86,6 +86,10 @@ static void *scene_create(obs_data_t *settings, struct obs_source *source)
 	struct obs_scene *scene = bzalloc(sizeof(struct obs_scene));
 	scene->source = source;
 
+	/* make sure the first render looks at the items */
+	scene->transform_generation =
+		os_atomic_load_long(&obs->data.transform_generation) - 1;
+
 	if (strcmp(source->info.id, group_info.id) == 0) {
 		scene->is_group = true;
 		scene->custom_size = true;
@@ -140,6 +144,13 @@ static inline void full_unlock(struct obs_scene *scene)
 static void set_visibility(struct obs_scene_item *item, bool vis);
 static inline void detach_sceneitem(struct obs_scene_item *item);
 
+/* the transform is recomputed the next time the scene is rendered */
+static inline void set_update_transform(struct obs_scene_item *item)
+{
+	os_atomic_set_bool(&item->update_transform, true);
+	obs_transforms_changed();
+}
+
 static inline void remove_without_release(struct obs_scene_item *item)
 {
 	item->removed = true;
@@ -182,6 +193,7 @@ static void scene_destroy(void *data)
 
 	pthread_mutex_destroy(&scene->video_mutex);
 	pthread_mutex_destroy(&scene->audio_mutex);
+	bfree(scene->id_index);
 	bfree(scene);
 }
 
@@ -225,6 +237,8 @@ static void scene_enum_all_sources(void *data,
 
 static inline void detach_sceneitem(struct obs_scene_item *item)
 {
+	item->parent->id_index_dirty = true;
+
 	if (item->prev)
 		item->prev->next = item->next;
 	else
@@ -242,6 +256,7 @@ static inline void attach_sceneitem(struct obs_scene *parent,
 {
 	item->prev = prev;
 	item->parent = parent;
+	parent->id_index_dirty = true;
 
 	if (prev) {
 		item->next = prev->next;
@@ -348,6 +363,9 @@ static void update_item_transform(struct obs_scene_item *item, bool update_tex)
 	if (os_atomic_load_long(&item->defer_update) > 0)
 		return;
 
+	/* crop may have changed */
+	item->cache_valid = false;
+
 	width = obs_source_get_width(item->source);
 	height = obs_source_get_height(item->source);
 	cx = calc_cx(item, width);
@@ -455,10 +473,56 @@ static inline bool item_is_scene(const struct obs_scene_item *item)
 	return item->source && item->source->info.type == OBS_SOURCE_TYPE_SCENE;
 }
 
+/* drawing a plain source is about as cheap as drawing a cached copy of it,
+ * so a texture is only added for caching if the source has filters */
+static inline bool item_content_cacheable(const struct obs_scene_item *item)
+{
+	uint64_t generation;
+
+	if (!item->source->filters.num)
+		return false;
+
+	return obs_source_get_content_generation(item->source, &generation);
+}
+
 static inline bool item_texture_enabled(const struct obs_scene_item *item)
 {
 	return crop_enabled(&item->crop) || scale_filter_enabled(item) ||
-	       (item_is_scene(item) && !item->is_group);
+	       (item_is_scene(item) && !item->is_group) ||
+	       item_content_cacheable(item);
+}
+
+/* sources that say when their video changes are only redrawn into
+ * item_render when it does */
+static bool item_render_cached(struct obs_scene_item *item, uint32_t width,
+			       uint32_t height)
+{
+	long device_epoch = os_atomic_load_long(&obs->video.device_epoch);
+	uint64_t generation;
+
+	/* a rebuilt device leaves item_render with undefined contents */
+	if (item->cache_device_epoch != device_epoch) {
+		item->cache_device_epoch = device_epoch;
+		item->cache_valid = false;
+	}
+
+	if (!obs_source_get_content_generation(item->source, &generation)) {
+		/* never matches, the render that follows can't be reused */
+		item->cache_width = 0;
+		item->cache_height = 0;
+		return false;
+	}
+
+	if (item->cache_valid && item->cache_generation == generation &&
+	    item->cache_width == width && item->cache_height == height)
+		return true;
+
+	/* marked valid again once the new render has succeeded */
+	item->cache_valid = false;
+	item->cache_generation = generation;
+	item->cache_width = width;
+	item->cache_height = height;
+	return false;
 }
 
 static void render_item_texture(struct obs_scene_item *item)
@@ -533,11 +597,20 @@ static void render_item_texture(struct obs_scene_item *item)
 	GS_DEBUG_MARKER_END();
 }
 
+static const char *render_item_cached_name = "render_item(cached)";
+
 static inline void render_item(struct obs_scene_item *item)
 {
+	bool cached = false;
+
 	GS_DEBUG_MARKER_BEGIN_FORMAT(GS_DEBUG_COLOR_ITEM, "Item: %s",
 				     obs_source_get_name(item->source));
 
+	/* the source may have become cacheable since the last transform
+	 * update */
+	if (!item->item_render && item_content_cacheable(item))
+		item->item_render = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+
 	if (item->item_render) {
 		uint32_t width = obs_source_get_width(item->source);
 		uint32_t height = obs_source_get_height(item->source);
@@ -549,7 +622,10 @@ static inline void render_item(struct obs_scene_item *item)
 		uint32_t cx = calc_cx(item, width);
 		uint32_t cy = calc_cy(item, height);
 
-		if (cx && cy && gs_texrender_begin(item->item_render, cx, cy)) {
+		cached = item_render_cached(item, width, height);
+
+		if (cx && cy && !cached &&
+		    gs_texrender_begin(item->item_render, cx, cy)) {
 			float cx_scale = (float)width / (float)cx;
 			float cy_scale = (float)height / (float)cy;
 			struct vec4 clear_color;
@@ -566,12 +642,18 @@ static inline void render_item(struct obs_scene_item *item)
 			obs_source_video_render(item->source);
 
 			gs_texrender_end(item->item_render);
+			item->cache_valid = true;
 		}
 	}
 
 	gs_matrix_push();
 	gs_matrix_mul(&item->draw_transform);
-	if (item->item_render) {
+	if (cached) {
+		/* counts the renders skipped in profiler output */
+		profile_start(render_item_cached_name);
+		render_item_texture(item);
+		profile_end(render_item_cached_name);
+	} else if (item->item_render) {
 		render_item_texture(item);
 	} else {
 		obs_source_video_render(item->source);
@@ -603,7 +685,8 @@ static void scene_video_tick(void *data, float seconds)
 static void
 update_transforms_and_prune_sources(obs_scene_t *scene,
 				    struct darray *remove_items,
-				    obs_sceneitem_t *group_sceneitem)
+				    obs_sceneitem_t *group_sceneitem,
+				    obs_scene_t *root)
 {
 	struct obs_scene_item *item = scene->first_item;
 	bool rebuild_group =
@@ -611,6 +694,8 @@ update_transforms_and_prune_sources(obs_scene_t *scene,
 		os_atomic_load_bool(&group_sceneitem->update_group_resize);
 
 	while (item) {
+		root->items_checked++;
+
 		if (obs_source_removed(item->source)) {
 			struct obs_scene_item *del_item = item;
 			item = item->next;
@@ -626,8 +711,8 @@ update_transforms_and_prune_sources(obs_scene_t *scene,
 			obs_scene_t *group_scene = item->source->context.data;
 
 			video_lock(group_scene);
-			update_transforms_and_prune_sources(group_scene,
-							    remove_items, item);
+			update_transforms_and_prune_sources(
+				group_scene, remove_items, item, root);
 			video_unlock(group_scene);
 		}
 
@@ -635,6 +720,7 @@ update_transforms_and_prune_sources(obs_scene_t *scene,
 		    source_size_changed(item)) {
 
 			update_item_transform(item, true);
+			root->transforms_updated++;
 			rebuild_group = true;
 		}
 
@@ -645,6 +731,31 @@ update_transforms_and_prune_sources(obs_scene_t *scene,
 		resize_group(group_sceneitem);
 }
 
+/* assumes video lock, called from the graphics thread.  items are only
+ * looked at if something transforms depend on has changed since the last
+ * update */
+static void update_transforms(obs_scene_t *scene, struct darray *remove_items)
+{
+	long generation = os_atomic_load_long(&obs->data.transform_generation);
+	uint64_t frame_time = obs->video.video_time;
+	uint32_t updated;
+
+	if (scene->stats_frame_time != frame_time) {
+		scene->stats_frame_time = frame_time;
+		scene->items_checked = 0;
+		scene->transforms_updated = 0;
+	}
+
+	if (scene->transform_generation == generation)
+		return;
+
+	scene->transform_generation = generation;
+
+	updated = scene->transforms_updated;
+	update_transforms_and_prune_sources(scene, remove_items, NULL, scene);
+	scene->total_transforms_updated += scene->transforms_updated - updated;
+}
+
 static void scene_video_render(void *data, gs_effect_t *effect)
 {
 	DARRAY(struct obs_scene_item *) remove_items;
@@ -655,10 +766,8 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 
 	video_lock(scene);
 
-	if (!scene->is_group) {
-		update_transforms_and_prune_sources(scene, &remove_items.da,
-						    NULL);
-	}
+	if (!scene->is_group)
+		update_transforms(scene, &remove_items.da);
 
 	gs_blend_state_push();
 	gs_reset_blend_state();
@@ -742,8 +851,12 @@ static void scene_load_item(struct obs_scene *scene, obs_data_t *item_data)
 	obs_data_set_default_int(item_data, "align",
 				 OBS_ALIGN_TOP | OBS_ALIGN_LEFT);
 
-	if (obs_data_has_user_value(item_data, "id"))
+	if (obs_data_has_user_value(item_data, "id")) {
+		full_lock(scene);
 		item->id = obs_data_get_int(item_data, "id");
+		scene->id_index_dirty = true;
+		full_unlock(scene);
+	}
 
 	item->rot = (float)obs_data_get_double(item_data, "rot");
 	item->align = (uint32_t)obs_data_get_int(item_data, "align");
@@ -977,7 +1090,7 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 		new_frame_num = (timestamp - ts) * (uint64_t)sample_rate /
 				1000000000ULL;
 
-		if (ts && new_frame_num >= AUDIO_OUTPUT_FRAMES)
+		if (ts && new_frame_num >= obs->audio.tick_frames)
 			break;
 
 		da_erase(item->audio_actions, i--);
@@ -995,7 +1108,7 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 	}
 
 	if (buf) {
-		for (; frame_num < AUDIO_OUTPUT_FRAMES; frame_num++)
+		for (; frame_num < obs->audio.tick_frames; frame_num++)
 			buf[frame_num] = cur_visible ? 1.0f : 0.0f;
 	}
 
@@ -1024,7 +1137,7 @@ static bool apply_scene_item_volume(struct obs_scene_item *item, float **buf,
 	pthread_mutex_unlock(&item->actions_mutex);
 
 	if (actions_pending) {
-		uint64_t duration = (uint64_t)AUDIO_OUTPUT_FRAMES *
+		uint64_t duration = (uint64_t)obs->audio.tick_frames *
 				    1000000000ULL / (uint64_t)sample_rate;
 
 		if (!ts || action.timestamp < (ts + duration)) {
@@ -1128,7 +1241,7 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 
 		pos = (size_t)ns_to_audio_frames(sample_rate,
 						 source_ts - timestamp);
-		count = AUDIO_OUTPUT_FRAMES - pos;
+		count = obs->audio.tick_frames - pos;
 
 		if (!apply_buf && !item->visible) {
 			item = item->next;
@@ -1301,7 +1414,7 @@ static inline void duplicate_item_data(struct obs_scene_item *dst,
 	obs_sceneitem_set_crop(dst, &src->crop);
 
 	if (defer_texture_update) {
-		os_atomic_set_bool(&dst->update_transform, true);
+		set_update_transform(dst);
 	} else {
 		if (!dst->item_render && item_texture_enabled(dst)) {
 			obs_enter_graphics();
@@ -1479,21 +1592,68 @@ obs_sceneitem_t *obs_scene_find_source_recursive(obs_scene_t *scene,
 	return item;
 }
 
+static inline size_t id_index_slot(const struct obs_scene *scene, int64_t id)
+{
+	uint64_t hash = (uint64_t)id * 0x9E3779B97F4A7C15ULL;
+	return (size_t)(hash >> 32) & (scene->id_index_size - 1);
+}
+
+static void rebuild_id_index(struct obs_scene *scene)
+{
+	struct obs_scene_item *item;
+	size_t count = 0;
+	size_t size = 16;
+
+	for (item = scene->first_item; item; item = item->next)
+		count++;
+
+	/* keep the table at most half full */
+	while (size < count * 2)
+		size *= 2;
+
+	if (size != scene->id_index_size) {
+		bfree(scene->id_index);
+		scene->id_index = bmalloc(size * sizeof(*scene->id_index));
+		scene->id_index_size = size;
+	}
+
+	memset(scene->id_index, 0, size * sizeof(*scene->id_index));
+
+	for (item = scene->first_item; item; item = item->next) {
+		size_t slot = id_index_slot(scene, item->id);
+
+		while (scene->id_index[slot]) {
+			/* first item with a duplicate id wins, as before */
+			if (scene->id_index[slot]->id == item->id)
+				break;
+			slot = (slot + 1) & (size - 1);
+		}
+
+		if (!scene->id_index[slot])
+			scene->id_index[slot] = item;
+	}
+
+	scene->id_index_dirty = false;
+}
+
 obs_sceneitem_t *obs_scene_find_sceneitem_by_id(obs_scene_t *scene, int64_t id)
 {
 	struct obs_scene_item *item;
+	size_t slot;
 
 	if (!scene)
 		return NULL;
 
 	full_lock(scene);
 
-	item = scene->first_item;
-	while (item) {
+	if (scene->id_index_dirty || !scene->id_index)
+		rebuild_id_index(scene);
+
+	slot = id_index_slot(scene, id);
+	while ((item = scene->id_index[slot]) != NULL) {
 		if (item->id == id)
 			break;
-
-		item = item->next;
+		slot = (slot + 1) & (scene->id_index_size - 1);
 	}
 
 	full_unlock(scene);
@@ -1501,6 +1661,23 @@ obs_sceneitem_t *obs_scene_find_sceneitem_by_id(obs_scene_t *scene, int64_t id)
 	return item;
 }
 
+void obs_scene_get_transform_stats(obs_scene_t *scene,
+				   struct obs_scene_transform_stats *stats)
+{
+	if (!obs_ptr_valid(scene, "obs_scene_get_transform_stats"))
+		return;
+	if (!obs_ptr_valid(stats, "obs_scene_get_transform_stats"))
+		return;
+
+	/* video_time belongs to the graphics thread, so this reports the last
+	 * frame the scene was rendered on rather than comparing against it */
+	video_lock(scene);
+	stats->items_checked = scene->items_checked;
+	stats->transforms_updated = scene->transforms_updated;
+	stats->total_transforms_updated = scene->total_transforms_updated;
+	video_unlock(scene);
+}
+
 void obs_scene_enum_items(obs_scene_t *scene,
 			  bool (*callback)(obs_scene_t *, obs_sceneitem_t *,
 					   void *),
@@ -1716,6 +1893,9 @@ static obs_sceneitem_t *obs_scene_add_internal(obs_scene_t *scene,
 
 	full_lock(scene);
 
+	scene->id_index_dirty = true;
+	obs_transforms_changed();
+
 	if (insert_after) {
 		obs_sceneitem_t *next = insert_after->next;
 		if (next)
@@ -1871,12 +2051,12 @@ bool obs_sceneitem_selected(const obs_sceneitem_t *item)
 	return item ? item->selected : false;
 }
 
-#define do_update_transform(item)                                          \
-	do {                                                               \
-		if (!item->parent || item->parent->is_group)               \
-			os_atomic_set_bool(&item->update_transform, true); \
-		else                                                       \
-			update_item_transform(item, false);                \
+#define do_update_transform(item)                            \
+	do {                                                 \
+		if (!item->parent || item->parent->is_group) \
+			set_update_transform(item);          \
+		else                                         \
+			update_item_transform(item, false);  \
 	} while (false)
 
 void obs_sceneitem_set_pos(obs_sceneitem_t *item, const struct vec2 *pos)
@@ -2313,7 +2493,7 @@ void obs_sceneitem_set_crop(obs_sceneitem_t *item,
 	if (item->crop.bottom < 0)
 		item->crop.bottom = 0;
 
-	os_atomic_set_bool(&item->update_transform, true);
+	set_update_transform(item);
 }
 
 void obs_sceneitem_get_crop(const obs_sceneitem_t *item,
@@ -2335,7 +2515,7 @@ void obs_sceneitem_set_scale_filter(obs_sceneitem_t *item,
 
 	item->scale_filter = filter;
 
-	os_atomic_set_bool(&item->update_transform, true);
+	set_update_transform(item);
 }
 
 enum obs_scale_type obs_sceneitem_get_scale_filter(obs_sceneitem_t *item)
@@ -2375,8 +2555,10 @@ void obs_sceneitem_defer_group_resize_end(obs_sceneitem_t *item)
 	if (!obs_ptr_valid(item, "obs_sceneitem_defer_group_resize_end"))
 		return;
 
-	if (os_atomic_dec_long(&item->defer_group_resize) == 0)
+	if (os_atomic_dec_long(&item->defer_group_resize) == 0) {
 		os_atomic_set_bool(&item->update_group_resize, true);
+		obs_transforms_changed();
+	}
 }
 
 int64_t obs_sceneitem_get_id(const obs_sceneitem_t *item)
@@ -2567,6 +2749,9 @@ static void resize_group(obs_sceneitem_t *group)
 	os_atomic_set_bool(&group->update_group_resize, false);
 
 	update_item_transform(group, false);
+
+	/* the group's size has likely changed */
+	obs_transforms_changed();
 }
 
 obs_sceneitem_t *obs_scene_add_group(obs_scene_t *scene, const char *name)
@@ -2609,6 +2794,7 @@ obs_sceneitem_t *obs_scene_insert_group(obs_scene_t *scene, const char *name,
 	full_lock(scene);
 	full_lock(sub_scene);
 	sub_scene->first_item = items[0];
+	sub_scene->id_index_dirty = true;
 
 	for (size_t i = count; i > 0; i--) {
 		size_t idx = i - 1;
@@ -2906,6 +3092,7 @@ bool obs_scene_reorder_items2(obs_scene_t *scene,
 	}
 
 	scene->first_item = item_order[0].item;
+	scene->id_index_dirty = true;
 
 	obs_sceneitem_t *prev = NULL;
 	for (size_t i = 0; i < item_order_size; i++) {
@@ -2917,11 +3104,12 @@ bool obs_scene_reorder_items2(obs_scene_t *scene,
 			obs_scene_t *sub_scene =
 				info->item->source->context.data;
 
-			sub_scene->first_item = NULL;
-
 			obs_scene_addref(sub_scene);
 			full_lock(sub_scene);
 
+			sub_scene->first_item = NULL;
+			sub_scene->id_index_dirty = true;
+
 			for (i++; i < item_order_size; i++) {
 				struct obs_sceneitem_order_info *sub_info =
 					&item_order[i];
@@ -51,6 +51,14 @@ struct obs_scene_item {
 	gs_texrender_t *item_render;
 	struct obs_sceneitem_crop crop;
 
+	/* what item_render holds, so it's only redrawn when the source's
+	 * content has changed */
+	bool cache_valid;
+	long cache_device_epoch;
+	uint64_t cache_generation;
+	uint32_t cache_width;
+	uint32_t cache_height;
+
 	struct vec2 pos;
 	struct vec2 scale;
 	float rot;
@@ -97,4 +105,20 @@ struct obs_scene {
 	pthread_mutex_t video_mutex;
 	pthread_mutex_t audio_mutex;
 	struct obs_scene_item *first_item;
+
+	/* items by id, rebuilt on the next lookup after items are added,
+	 * removed or moved between scenes */
+	struct obs_scene_item **id_index;
+	size_t id_index_size;
+	bool id_index_dirty;
+
+	/* obs_core_data::transform_generation as of the last item update */
+	long transform_generation;
+
+	/* counts for the last frame the scene was rendered on, including the
+	 * items of groups in the scene */
+	uint64_t stats_frame_time;
+	uint32_t items_checked;
+	uint32_t transforms_updated;
+	uint64_t total_transforms_updated;
 };
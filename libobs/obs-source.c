@@ -178,6 +178,7 @@ static bool obs_source_init(struct obs_source *source)
 	source->audio_active = true;
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->async_mutex);
+	pthread_mutex_init_value(&source->async_output_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
 	pthread_mutex_init_value(&source->audio_buf_mutex);
 	pthread_mutex_init_value(&source->audio_cb_mutex);
@@ -198,6 +199,8 @@ static bool obs_source_init(struct obs_source *source)
 		return false;
 	if (pthread_mutex_init(&source->async_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&source->async_output_mutex, NULL) != 0)
+		return false;
 
 	if (is_audio_source(source) || is_composite_source(source))
 		allocate_audio_output_buffer(source);
@@ -620,7 +623,7 @@ void obs_source_destroy(struct obs_source *source)
 	obs_hotkey_pair_unregister(source->mute_unmute_key);
 
 	for (i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+		obs_source_frame_decref(&source->async_cache.array[i]->frame);
 
 	gs_enter_context(obs->video.graphics);
 	if (source->async_texrender)
@@ -651,6 +654,7 @@ void obs_source_destroy(struct obs_source *source)
 	da_free(source->audio_actions);
 	da_free(source->audio_cb_list);
 	da_free(source->async_cache);
+	da_free(source->async_spare);
 	da_free(source->async_frames);
 	da_free(source->filters);
 	pthread_mutex_destroy(&source->filter_mutex);
@@ -659,6 +663,7 @@ void obs_source_destroy(struct obs_source *source)
 	pthread_mutex_destroy(&source->audio_cb_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
+	pthread_mutex_destroy(&source->async_output_mutex);
 	obs_data_release(source->private_settings);
 	obs_context_data_free(&source->context);
 
@@ -755,6 +760,7 @@ void obs_source_remove(obs_source_t *source)
 
 	if (!source->removed) {
 		source->removed = true;
+		obs_transforms_changed();
 		obs_source_dosignal(source, "source_remove", "remove");
 	}
 }
@@ -860,6 +866,7 @@ static void obs_source_deferred_update(obs_source_t *source)
 				    source->context.settings);
 
 	source->defer_update = false;
+	os_atomic_inc_long(&source->content_generation);
 }
 
 void obs_source_update(obs_source_t *source, obs_data_t *settings)
@@ -875,6 +882,7 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data,
 				    source->context.settings);
+		os_atomic_inc_long(&source->content_generation);
 	}
 }
 
@@ -1058,12 +1066,16 @@ static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
 bool set_async_texture_size(struct obs_source *source,
 			    const struct obs_source_frame *frame);
 
-static void async_tick(obs_source_t *source)
+static void drain_async_queue(obs_source_t *source);
+
+static void async_select_frame(obs_source_t *source)
 {
 	uint64_t sys_time = obs->video.video_time;
 
 	pthread_mutex_lock(&source->async_mutex);
 
+	drain_async_queue(source);
+
 	if (deinterlacing_enabled(source)) {
 		deinterlace_process_last_frame(source, sys_time);
 	} else {
@@ -1077,24 +1089,24 @@ static void async_tick(obs_source_t *source)
 
 	source->last_sys_timestamp = sys_time;
 	pthread_mutex_unlock(&source->async_mutex);
+}
 
+static inline void async_update_texture_size(obs_source_t *source)
+{
 	if (source->cur_async_frame)
 		source->async_update_texture =
 			set_async_texture_size(source, source->cur_async_frame);
 }
 
-void obs_source_video_tick(obs_source_t *source, float seconds)
+static void async_tick(obs_source_t *source)
 {
-	bool now_showing, now_active;
-
-	if (!obs_source_valid(source, "obs_source_video_tick"))
-		return;
-
-	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
-		obs_transition_tick(source, seconds);
+	async_select_frame(source);
+	async_update_texture_size(source);
+}
 
-	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0)
-		async_tick(source);
+static void tick_source_state(obs_source_t *source)
+{
+	bool now_showing, now_active;
 
 	if (source->defer_update)
 		obs_source_deferred_update(source);
@@ -1150,7 +1162,10 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 
 		source->active = now_active;
 	}
+}
 
+static inline void call_video_tick(obs_source_t *source, float seconds)
+{
 	if (source->context.data && source->info.video_tick)
 		source->info.video_tick(source->context.data, seconds);
 
@@ -1158,6 +1173,132 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 	source->deinterlace_rendered = false;
 }
 
+static inline bool threaded_tick(const obs_source_t *source)
+{
+	return (source->info.output_flags & OBS_SOURCE_THREADED_TICK) != 0;
+}
+
+void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	if (!obs_source_valid(source, "obs_source_video_tick"))
+		return;
+
+	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
+		obs_transition_tick(source, seconds);
+
+	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0)
+		async_tick(source);
+
+	tick_source_state(source);
+	call_video_tick(source, seconds);
+	obs_source_check_size(source);
+}
+
+/* parallel tick phases, see tick_sources() in obs-video.c */
+
+void obs_source_video_tick_frames(obs_source_t *source)
+{
+	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0)
+		async_select_frame(source);
+}
+
+void obs_source_video_tick_serial(obs_source_t *source, float seconds)
+{
+	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
+		obs_transition_tick(source, seconds);
+
+	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0)
+		async_update_texture_size(source);
+
+	tick_source_state(source);
+
+	if (!threaded_tick(source))
+		call_video_tick(source, seconds);
+}
+
+void obs_source_video_tick_threaded(obs_source_t *source, float seconds)
+{
+	if (threaded_tick(source))
+		call_video_tick(source, seconds);
+}
+
+static inline bool content_generation_known(const obs_source_t *source)
+{
+	uint32_t flags = source->info.output_flags;
+
+	if ((flags & OBS_SOURCE_ASYNC) != 0)
+		return false;
+
+	return (flags & OBS_SOURCE_STATIC_VIDEO) != 0 ||
+	       source->info.video_get_generation;
+}
+
+static inline uint64_t mix_generation(uint64_t hash, uint64_t val)
+{
+	return (hash ^ val) * 1099511628211ULL;
+}
+
+static inline uint64_t content_generation(obs_source_t *source)
+{
+	uint64_t gen = (uint64_t)os_atomic_load_long(
+		&source->content_generation);
+
+	if (source->info.video_get_generation && source->context.data)
+		gen = mix_generation(gen, source->info.video_get_generation(
+						  source->context.data));
+	return gen;
+}
+
+/* gets a value that changes whenever the rendered video of the source,
+ * filters included, may have changed.  returns false if the source or one
+ * of its enabled filters doesn't say when its video changes */
+bool obs_source_get_content_generation(obs_source_t *source,
+				       uint64_t *generation)
+{
+	uint64_t gen = 14695981039346656037ULL;
+	bool known = content_generation_known(source);
+
+	if (!known)
+		return false;
+
+	gen = mix_generation(gen, content_generation(source));
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; i < source->filters.num; i++) {
+		obs_source_t *filter = source->filters.array[i];
+
+		if (!filter->enabled)
+			continue;
+		if (!content_generation_known(filter)) {
+			known = false;
+			break;
+		}
+
+		gen = mix_generation(gen, content_generation(filter));
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	*generation = gen;
+	return known;
+}
+
+/* lets scenes know about size changes instead of them asking every item's
+ * source for its size every frame.  called on the graphics thread after
+ * the source has ticked */
+void obs_source_check_size(obs_source_t *source)
+{
+	uint32_t width = obs_source_get_width(source);
+	uint32_t height = obs_source_get_height(source);
+
+	if (width != source->tick_width || height != source->tick_height) {
+		source->tick_width = width;
+		source->tick_height = height;
+		obs_transforms_changed();
+	}
+}
+
 /* unless the value is 3+ hours worth of frames, this won't overflow */
 static inline uint64_t conv_frames_to_time(const size_t sample_rate,
 					   const size_t frames)
@@ -2380,6 +2521,7 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 						     : source->filters.array[0];
 
 	da_insert(source->filters, 0, &filter);
+	os_atomic_inc_long(&source->content_generation);
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
@@ -2414,6 +2556,7 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 	}
 
 	da_erase(source->filters, idx);
+	os_atomic_inc_long(&source->content_generation);
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
@@ -2542,6 +2685,8 @@ void obs_source_filter_set_order(obs_source_t *source, obs_source_t *filter,
 
 	pthread_mutex_lock(&source->filter_mutex);
 	success = move_filter_dir(source, filter, movement);
+	if (success)
+		os_atomic_inc_long(&source->content_generation);
 	pthread_mutex_unlock(&source->filter_mutex);
 
 	if (success)
@@ -2677,111 +2822,215 @@ void obs_source_frame_copy(struct obs_source_frame *dst,
 	copy_frame_data(dst, src);
 }
 
-static inline bool async_texture_changed(struct obs_source *source,
-					 const struct obs_source_frame *frame)
+/* ------------------------------------------------------------------------- */
+/* async frame pool */
+
+static inline bool async_ring_push(struct async_frame_ring *ring,
+				   struct async_frame *af)
 {
-	enum convert_type prev, cur;
-	prev = get_convert_type(source->async_cache_format,
-				source->async_cache_full_range);
-	cur = get_convert_type(frame->format, frame->full_range);
+	if (os_atomic_load_long(&ring->count) == ASYNC_RING_SIZE)
+		return false;
 
-	return source->async_cache_width != frame->width ||
-	       source->async_cache_height != frame->height || prev != cur;
+	ring->frames[ring->write] = af;
+	ring->write = (ring->write + 1) % ASYNC_RING_SIZE;
+	os_atomic_inc_long(&ring->count);
+	return true;
 }
 
-static inline void free_async_cache(struct obs_source *source)
+static inline struct async_frame *async_ring_pop(struct async_frame_ring *ring)
 {
-	for (size_t i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+	struct async_frame *af;
 
-	da_resize(source->async_cache, 0);
-	da_resize(source->async_frames, 0);
-	source->cur_async_frame = NULL;
-	source->prev_async_frame = NULL;
+	if (!os_atomic_load_long(&ring->count))
+		return NULL;
+
+	af = ring->frames[ring->read];
+	ring->read = (ring->read + 1) % ASYNC_RING_SIZE;
+	os_atomic_dec_long(&ring->count);
+	return af;
 }
 
-#define MAX_UNUSED_FRAME_DURATION 5
+static inline bool async_frame_stale(const struct obs_source *source,
+				     const struct async_frame *af)
+{
+	return af->generation != source->async_generation;
+}
 
-/* frees frame allocations if they haven't been used for a specific period
- * of time */
-static void clean_cache(obs_source_t *source)
+static void destroy_pool_frame(struct obs_source *source,
+			       struct async_frame *af)
 {
-	for (size_t i = source->async_cache.num; i > 0; i--) {
-		struct async_frame *af = &source->async_cache.array[i - 1];
-		if (!af->used) {
-			if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
-				obs_source_frame_destroy(af->frame);
-				da_erase(source->async_cache, i - 1);
-			}
-		}
-	}
+	da_erase_item(source->async_cache, &af);
+	obs_source_frame_decref(&af->frame);
 }
 
-#define MAX_ASYNC_FRAMES 30
-//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
-static inline struct obs_source_frame *
-cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+static struct async_frame *create_pool_frame(struct obs_source *source)
 {
-	struct obs_source_frame *new_frame = NULL;
+	struct async_frame *af = bzalloc(sizeof(*af));
 
-	pthread_mutex_lock(&source->async_mutex);
+	obs_source_frame_init(&af->frame, source->async_cache_format,
+			      source->async_cache_width,
+			      source->async_cache_height);
+	af->frame.refs = 1;
+	af->generation = source->async_generation;
 
-	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
-		free_async_cache(source);
-		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
-		return NULL;
-	}
+	da_push_back(source->async_cache, &af);
+	return af;
+}
+
+/* the graphics thread hands frames back once it's done with them.  frames
+ * from before the last format/size change are freed rather than reused */
+static void reclaim_returned_frames(struct obs_source *source)
+{
+	struct async_frame *af;
 
-	if (async_texture_changed(source, frame)) {
-		free_async_cache(source);
-		source->async_cache_width = frame->width;
-		source->async_cache_height = frame->height;
+	while ((af = async_ring_pop(&source->async_returned)) != NULL) {
+		if (async_frame_stale(source, af))
+			destroy_pool_frame(source, af);
+		else
+			da_push_back(source->async_spare, &af);
 	}
+}
+
+#define ASYNC_POOL_PRESIZE 4
+#define MAX_UNUSED_FRAME_DURATION 5
 
-	const enum video_format format = frame->format;
+static void reset_frame_pool(struct obs_source *source,
+			     enum video_format format, uint32_t width,
+			     uint32_t height)
+{
+	for (size_t i = 0; i < source->async_spare.num; i++)
+		destroy_pool_frame(source, source->async_spare.array[i]);
+	da_resize(source->async_spare, 0);
+
+	source->async_generation++;
 	source->async_cache_format = format;
-	source->async_cache_full_range = frame->full_range;
-
-	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *af = &source->async_cache.array[i];
-		if (!af->used) {
-			new_frame = af->frame;
-			new_frame->format = format;
-			af->used = true;
-			af->unused_count = 0;
+	source->async_cache_width = width;
+	source->async_cache_height = height;
+	source->async_unused_count = 0;
+
+	/* frames still held by the graphics thread count against the pool
+	 * size until they come back */
+	for (size_t i = 0; i < ASYNC_POOL_PRESIZE; i++) {
+		if (source->async_cache.num >= ASYNC_RING_SIZE)
 			break;
-		}
+
+		struct async_frame *af = create_pool_frame(source);
+		da_push_back(source->async_spare, &af);
+	}
+}
+
+/* frees spare frames if more than the preallocated amount have gone unused
+ * for a while */
+static void trim_frame_pool(struct obs_source *source)
+{
+	if (source->async_spare.num <= ASYNC_POOL_PRESIZE) {
+		source->async_unused_count = 0;
+		return;
 	}
 
-	clean_cache(source);
+	if (++source->async_unused_count == MAX_UNUSED_FRAME_DURATION) {
+		size_t last = source->async_spare.num - 1;
+		destroy_pool_frame(source, source->async_spare.array[last]);
+		da_pop_back(source->async_spare);
+		source->async_unused_count = 0;
+	}
+}
+
+/* must be called with async_output_mutex held */
+static struct async_frame *get_pool_frame(struct obs_source *source,
+					  enum video_format format,
+					  uint32_t width, uint32_t height)
+{
+	struct async_frame *af = NULL;
+
+	reclaim_returned_frames(source);
+
+	if (source->async_cache_format != format ||
+	    source->async_cache_width != width ||
+	    source->async_cache_height != height || !source->async_cache.num)
+		reset_frame_pool(source, format, width, height);
+
+	trim_frame_pool(source);
 
-	if (!new_frame) {
-		struct async_frame new_af;
+	if (source->async_spare.num) {
+		af = source->async_spare.array[source->async_spare.num - 1];
+		da_pop_back(source->async_spare);
 
-		new_frame = obs_source_frame_create(format, frame->width,
-						    frame->height);
-		new_af.frame = new_frame;
-		new_af.used = true;
-		new_af.unused_count = 0;
-		new_frame->refs = 1;
+	} else if (source->async_cache.num < ASYNC_RING_SIZE) {
+		af = create_pool_frame(source);
 
-		da_push_back(source->async_cache, &new_af);
+	} else {
+		os_atomic_inc_long(&source->async_frames_dropped);
+		return NULL;
 	}
 
-	os_atomic_inc_long(&new_frame->refs);
+	af->frame.prev_frame = false;
+	return af;
+}
 
-	pthread_mutex_unlock(&source->async_mutex);
+static inline void return_pool_frame(struct obs_source *source,
+				     struct async_frame *af)
+{
+	if (async_frame_stale(source, af))
+		destroy_pool_frame(source, af);
+	else
+		da_push_back(source->async_spare, &af);
+}
+
+#define MAX_ASYNC_FRAMES 30
 
-	copy_frame_data(new_frame, frame);
+/* must be called with async_output_mutex held */
+static void queue_async_frame(struct obs_source *source,
+			      struct async_frame *af)
+{
+	struct async_frame_ring *queue = &source->async_queue;
+
+	/* the graphics thread isn't keeping up (or the source is hidden),
+	 * so have it drop everything it has */
+	if (os_atomic_load_long(&queue->count) >= MAX_ASYNC_FRAMES) {
+		os_atomic_set_bool(&source->async_flush, true);
+		os_atomic_inc_long(&source->async_frames_dropped);
+		return_pool_frame(source, af);
+		return;
+	}
 
-	return new_frame;
+	af->used = true;
+	async_ring_push(queue, af);
+	os_atomic_inc_long(&source->async_frames_output);
+	source->async_active = true;
+}
+
+/* moves newly output frames over to async_frames, must be called on the
+ * graphics thread with async_mutex held */
+static void drain_async_queue(obs_source_t *source)
+{
+	struct async_frame *af;
+	bool flush;
+
+	while ((af = async_ring_pop(&source->async_queue)) != NULL) {
+		struct obs_source_frame *frame = &af->frame;
+		da_push_back(source->async_frames, &frame);
+	}
+
+	flush = os_atomic_set_bool(&source->async_flush, false);
+	if (!flush && source->async_frames.num < MAX_ASYNC_FRAMES)
+		return;
+
+	for (size_t i = 0; i < source->async_frames.num; i++) {
+		remove_async_frame(source, source->async_frames.array[i]);
+		os_atomic_inc_long(&source->async_frames_dropped);
+	}
+
+	da_resize(source->async_frames, 0);
+	source->last_frame_ts = 0;
 }
 
 static void
 obs_source_output_video_internal(obs_source_t *source,
 				 const struct obs_source_frame *frame)
 {
+	struct async_frame *af;
+
 	if (!obs_source_valid(source, "obs_source_output_video"))
 		return;
 
@@ -2790,21 +3039,16 @@ obs_source_output_video_internal(obs_source_t *source,
 		return;
 	}
 
-	struct obs_source_frame *output = !!frame ? cache_video(source, frame)
-						  : NULL;
+	pthread_mutex_lock(&source->async_output_mutex);
 
-	/* ------------------------------------------- */
-	pthread_mutex_lock(&source->async_mutex);
-	if (output) {
-		if (os_atomic_dec_long(&output->refs) == 0) {
-			obs_source_frame_destroy(output);
-			output = NULL;
-		} else {
-			da_push_back(source->async_frames, &output);
-			source->async_active = true;
-		}
+	af = get_pool_frame(source, frame->format, frame->width,
+			    frame->height);
+	if (af) {
+		copy_frame_data(&af->frame, frame);
+		queue_async_frame(source, af);
 	}
-	pthread_mutex_unlock(&source->async_mutex);
+
+	pthread_mutex_unlock(&source->async_output_mutex);
 }
 
 void obs_source_output_video(obs_source_t *source,
@@ -2856,6 +3100,81 @@ void obs_source_output_video2(obs_source_t *source,
 	obs_source_output_video_internal(source, &new_frame);
 }
 
+struct obs_source_frame *
+obs_source_acquire_output_frame(obs_source_t *source, enum video_format format,
+				uint32_t width, uint32_t height)
+{
+	struct async_frame *af;
+
+	if (!obs_source_valid(source, "obs_source_acquire_output_frame"))
+		return NULL;
+	if (format == VIDEO_FORMAT_NONE || !width || !height)
+		return NULL;
+
+	pthread_mutex_lock(&source->async_output_mutex);
+	af = get_pool_frame(source, format, width, height);
+	pthread_mutex_unlock(&source->async_output_mutex);
+
+	if (!af)
+		return NULL;
+
+	af->frame.timestamp = 0;
+	af->frame.flip = false;
+	af->frame.full_range = false;
+	return &af->frame;
+}
+
+void obs_source_output_acquired_frame(obs_source_t *source,
+				      struct obs_source_frame *frame)
+{
+	struct async_frame *af = (struct async_frame *)frame;
+
+	if (!obs_source_valid(source, "obs_source_output_acquired_frame"))
+		return;
+	if (!obs_ptr_valid(frame, "obs_source_output_acquired_frame"))
+		return;
+
+	if (!format_is_yuv(frame->format))
+		frame->full_range = true;
+
+	pthread_mutex_lock(&source->async_output_mutex);
+	os_atomic_inc_long(&source->async_copies_avoided);
+	queue_async_frame(source, af);
+	pthread_mutex_unlock(&source->async_output_mutex);
+}
+
+void obs_source_discard_acquired_frame(obs_source_t *source,
+				       struct obs_source_frame *frame)
+{
+	if (!obs_source_valid(source, "obs_source_discard_acquired_frame"))
+		return;
+	if (!frame)
+		return;
+
+	pthread_mutex_lock(&source->async_output_mutex);
+	return_pool_frame(source, (struct async_frame *)frame);
+	pthread_mutex_unlock(&source->async_output_mutex);
+}
+
+bool obs_source_get_async_stats(const obs_source_t *source,
+				struct obs_source_async_stats *stats)
+{
+	if (!obs_source_valid(source, "obs_source_get_async_stats"))
+		return false;
+	if (!obs_ptr_valid(stats, "obs_source_get_async_stats"))
+		return false;
+	if ((source->info.output_flags & OBS_SOURCE_ASYNC) == 0)
+		return false;
+
+	stats->frames = (uint64_t)os_atomic_load_long(
+		&source->async_frames_output);
+	stats->copies_avoided = (uint64_t)os_atomic_load_long(
+		&source->async_copies_avoided);
+	stats->frames_dropped = (uint64_t)os_atomic_load_long(
+		&source->async_frames_dropped);
+	return true;
+}
+
 void obs_source_set_async_rotation(obs_source_t *source, long rotation)
 {
 	if (source)
@@ -3175,18 +3494,20 @@ void obs_source_output_audio(obs_source_t *source,
 	pthread_mutex_unlock(&source->filter_mutex);
 }
 
+/* hands a frame back to the thread outputting video.  every frame that
+ * reaches async_frames comes from the frame pool */
 void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 {
-	if (frame)
-		frame->prev_frame = false;
+	struct async_frame *af = (struct async_frame *)frame;
+
+	if (!frame)
+		return;
 
-	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *f = &source->async_cache.array[i];
+	frame->prev_frame = false;
 
-		if (f->frame == frame) {
-			f->used = false;
-			break;
-		}
+	if (af->used) {
+		af->used = false;
+		async_ring_push(&source->async_returned, af);
 	}
 }
 
@@ -4108,6 +4429,7 @@ void obs_source_set_enabled(obs_source_t *source, bool enabled)
 		return;
 
 	source->enabled = enabled;
+	os_atomic_inc_long(&source->content_generation);
 
 	calldata_init_fixed(&data, stack, sizeof(stack));
 	calldata_set_ptr(&data, "source", source);
@@ -4337,7 +4659,7 @@ static inline void multiply_vol_data(obs_source_t *source, size_t mix,
 {
 	for (size_t ch = 0; ch < channels; ch++) {
 		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
+		register float *end = out + obs->audio.tick_frames;
 		register float *vol = vol_data;
 
 		while (out < end)
@@ -4367,7 +4689,8 @@ static inline void apply_audio_action(obs_source_t *source,
 static void apply_audio_actions(obs_source_t *source, size_t channels,
 				size_t sample_rate)
 {
-	float *vol_data = malloc(sizeof(float) * AUDIO_OUTPUT_FRAMES);
+	const size_t tick_frames = obs->audio.tick_frames;
+	float *vol_data = malloc(sizeof(float) * tick_frames);
 	float cur_vol = get_source_volume(source, source->audio_ts);
 	size_t frame_num = 0;
 
@@ -4384,7 +4707,7 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 		new_frame_num = conv_time_to_frames(
 			sample_rate, timestamp - source->audio_ts);
 
-		if (new_frame_num >= AUDIO_OUTPUT_FRAMES)
+		if (new_frame_num >= tick_frames)
 			break;
 
 		da_erase(source->audio_actions, i--);
@@ -4399,7 +4722,7 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 		cur_vol = get_source_volume(source, timestamp);
 	}
 
-	for (; frame_num < AUDIO_OUTPUT_FRAMES; frame_num++)
+	for (; frame_num < tick_frames; frame_num++)
 		vol_data[frame_num] = cur_vol;
 
 	pthread_mutex_unlock(&source->audio_actions_mutex);
@@ -4428,8 +4751,8 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 	pthread_mutex_unlock(&source->audio_actions_mutex);
 
 	if (actions_pending) {
-		uint64_t duration =
-			conv_frames_to_time(sample_rate, AUDIO_OUTPUT_FRAMES);
+		uint64_t duration = conv_frames_to_time(
+			sample_rate, obs->audio.tick_frames);
 
 		if (action.timestamp < (source->audio_ts + duration)) {
 			apply_audio_actions(source, channels, sample_rate);
@@ -4524,7 +4847,7 @@ static void audio_submix(obs_source_t *source, size_t channels,
 		audio.data[i] = (const uint8_t *)audio_data.data[i];
 
 	audio.samples_per_sec = (uint32_t)sample_rate;
-	audio.frames = AUDIO_OUTPUT_FRAMES;
+	audio.frames = (uint32_t)obs->audio.tick_frames;
 	audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	audio.speakers = (enum speaker_layout)channels;
 	audio.timestamp = ts;
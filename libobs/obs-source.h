@@ -186,6 +186,20 @@ enum obs_media_state {
  */
 #define OBS_SOURCE_CONTROLLABLE_MEDIA (1 << 13)
 
+/**
+ * Source's video_tick callback does not touch the graphics context or other
+ * sources, and can be called from a tick worker thread when parallel ticking
+ * is enabled (see obs_set_parallel_tick).
+ */
+#define OBS_SOURCE_THREADED_TICK (1 << 14)
+
+/**
+ * Source's video only changes when its settings are updated, so scenes can
+ * reuse the last render of it.  Sources whose video changes otherwise can
+ * implement video_get_generation instead.
+ */
+#define OBS_SOURCE_STATIC_VIDEO (1 << 15)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
@@ -527,6 +541,16 @@ struct obs_source_info {
 	/* version-related stuff */
 	uint32_t version; /* increment if needed to specify a new version */
 	const char *unversioned_id; /* set internally, don't set manually */
+
+	/**
+	 * Returns a value that changes whenever the source's video changes,
+	 * so scenes can reuse the last render of the source while it stays
+	 * the same.  Changes to settings don't need to be reported.
+	 *
+	 * @param  data  Source data
+	 * @return       Content generation of the source
+	 */
+	uint64_t (*video_get_generation)(void *data);
 };
 
 EXPORT void obs_register_source_s(const struct obs_source_info *info,
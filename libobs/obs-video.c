@@ -29,7 +29,92 @@
 #include <windows.h>
 #endif
 
-static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
+#define MAX_TICK_THREADS 8
+
+struct tick_job {
+	struct obs_source **sources;
+	float seconds;
+};
+
+static void tick_job_frames(void *param, size_t idx)
+{
+	struct tick_job *job = param;
+	obs_source_video_tick_frames(job->sources[idx]);
+}
+
+static void tick_job_threaded(void *param, size_t idx)
+{
+	struct tick_job *job = param;
+	obs_source_video_tick_threaded(job->sources[idx], job->seconds);
+}
+
+static const char *tick_frames_name = "tick_async_frames";
+static const char *tick_serial_name = "tick_serial";
+static const char *tick_threaded_name = "tick_threaded";
+
+/*
+ * Parallel tick: async frame selection and video_tick callbacks of sources
+ * flagged with OBS_SOURCE_THREADED_TICK run on the tick pool, everything that
+ * may need the graphics context or touches other sources (texture resizing,
+ * transitions, deferred updates, show/hide, regular video_tick) stays on the
+ * graphics thread.  References are released here on the graphics thread so a
+ * source can never be destroyed from a worker.
+ */
+static void tick_sources_parallel(float seconds)
+{
+	struct obs_core_video *video = &obs->video;
+	struct obs_core_data *data = &obs->data;
+	struct obs_source *source;
+	struct tick_job job;
+	size_t num;
+
+	if (!video->tick_pool) {
+		size_t threads =
+			task_pool_default_thread_count(MAX_TICK_THREADS);
+		video->tick_pool =
+			task_pool_create("libobs: tick worker", threads);
+	}
+
+	pthread_mutex_lock(&data->sources_mutex);
+
+	source = data->first_source;
+	while (source) {
+		struct obs_source *cur_source = obs_source_get_ref(source);
+		if (cur_source)
+			da_push_back(video->tick_sources, &cur_source);
+
+		source = (struct obs_source *)source->context.next;
+	}
+
+	pthread_mutex_unlock(&data->sources_mutex);
+
+	num = video->tick_sources.num;
+	job.sources = video->tick_sources.array;
+	job.seconds = seconds;
+
+	profile_start(tick_frames_name);
+	task_pool_run(video->tick_pool, num, tick_job_frames, &job);
+	profile_end(tick_frames_name);
+
+	profile_start(tick_serial_name);
+	for (size_t i = 0; i < num; i++)
+		obs_source_video_tick_serial(job.sources[i], seconds);
+	profile_end(tick_serial_name);
+
+	profile_start(tick_threaded_name);
+	task_pool_run(video->tick_pool, num, tick_job_threaded, &job);
+	profile_end(tick_threaded_name);
+
+	for (size_t i = 0; i < num; i++) {
+		obs_source_check_size(job.sources[i]);
+		obs_source_release(job.sources[i]);
+	}
+
+	da_resize(video->tick_sources, 0);
+}
+
+static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time,
+			     bool parallel)
 {
 	struct obs_core_data *data = &obs->data;
 	struct obs_source *source;
@@ -59,6 +144,11 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	/* ------------------------------------- */
 	/* call the tick function of each source */
 
+	if (parallel) {
+		tick_sources_parallel(seconds);
+		return cur_time;
+	}
+
 	pthread_mutex_lock(&data->sources_mutex);
 
 	source = data->first_source;
@@ -513,44 +603,57 @@ static inline void render_video(struct obs_core_video *video, bool raw_active,
 	gs_end_scene();
 }
 
-static inline bool download_frame(struct obs_core_video *video,
-				  int prev_texture, struct video_data *frame)
+static inline bool stage_surfaces_ready(struct obs_core_video *video,
+					int texture)
 {
-	if (!video->textures_copied[prev_texture])
-		return false;
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+		gs_stagesurf_t *surface =
+			video->copy_surfaces[texture][channel];
+		if (surface && !gs_stagesurface_ready(surface))
+			return false;
+	}
+
+	return true;
+}
+
+static const char *download_frame_map_name = "gs_stagesurface_map";
+static inline bool download_frame(struct obs_core_video *video, int texture,
+				  struct video_data *frame)
+{
+	bool success = true;
+
+	profile_start(download_frame_map_name);
 
 	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
 		gs_stagesurf_t *surface =
-			video->copy_surfaces[prev_texture][channel];
+			video->copy_surfaces[texture][channel];
 		if (surface) {
 			if (!gs_stagesurface_map(surface, &frame->data[channel],
-						 &frame->linesize[channel]))
-				return false;
+						 &frame->linesize[channel])) {
+				success = false;
+				break;
+			}
 
 			video->mapped_surfaces[channel] = surface;
 		}
 	}
-	return true;
+
+	profile_end(download_frame_map_name);
+	return success;
 }
 
-static const uint8_t *set_gpu_converted_plane(uint32_t width, uint32_t height,
-					      uint32_t linesize_input,
-					      uint32_t linesize_output,
-					      const uint8_t *in, uint8_t *out)
+static inline void set_gpu_converted_plane(struct video_plane_copy *plane,
+					   uint32_t width, uint32_t height,
+					   uint32_t linesize_input,
+					   uint32_t linesize_output,
+					   const uint8_t *in, uint8_t *out)
 {
-	if ((width == linesize_input) && (width == linesize_output)) {
-		size_t total = width * height;
-		memcpy(out, in, total);
-		in += total;
-	} else {
-		for (size_t y = 0; y < height; y++) {
-			memcpy(out, in, width);
-			out += linesize_output;
-			in += linesize_input;
-		}
-	}
-
-	return in;
+	plane->dst = out;
+	plane->src = in;
+	plane->dst_linesize = linesize_output;
+	plane->src_linesize = linesize_input;
+	plane->row_size = width;
+	plane->rows = height;
 }
 
 static void set_gpu_converted_data(struct obs_core_video *video,
@@ -558,25 +661,31 @@ static void set_gpu_converted_data(struct obs_core_video *video,
 				   const struct video_data *input,
 				   const struct video_output_info *info)
 {
+	struct video_plane_copy planes[3];
+	size_t num_planes = 0;
+
 	if (video->using_nv12_tex) {
 		const uint32_t width = info->width;
 		const uint32_t height = info->height;
 
-		const uint8_t *const in_uv = set_gpu_converted_plane(
-			width, height, input->linesize[0], output->linesize[0],
-			input->data[0], output->data[0]);
+		set_gpu_converted_plane(&planes[0], width, height,
+					input->linesize[0], output->linesize[0],
+					input->data[0], output->data[0]);
 
+		const uint8_t *const in_uv =
+			input->data[0] + (size_t)input->linesize[0] * height;
 		const uint32_t height_d2 = height / 2;
-		set_gpu_converted_plane(width, height_d2, input->linesize[0],
-					output->linesize[1], in_uv,
-					output->data[1]);
+		set_gpu_converted_plane(&planes[1], width, height_d2,
+					input->linesize[0], output->linesize[1],
+					in_uv, output->data[1]);
+		num_planes = 2;
 	} else {
 		switch (info->format) {
 		case VIDEO_FORMAT_I420: {
 			const uint32_t width = info->width;
 			const uint32_t height = info->height;
 
-			set_gpu_converted_plane(width, height,
+			set_gpu_converted_plane(&planes[0], width, height,
 						input->linesize[0],
 						output->linesize[0],
 						input->data[0],
@@ -585,61 +694,64 @@ static void set_gpu_converted_data(struct obs_core_video *video,
 			const uint32_t width_d2 = width / 2;
 			const uint32_t height_d2 = height / 2;
 
-			set_gpu_converted_plane(width_d2, height_d2,
-						input->linesize[1],
+			set_gpu_converted_plane(&planes[1], width_d2,
+						height_d2, input->linesize[1],
 						output->linesize[1],
 						input->data[1],
 						output->data[1]);
 
-			set_gpu_converted_plane(width_d2, height_d2,
-						input->linesize[2],
+			set_gpu_converted_plane(&planes[2], width_d2,
+						height_d2, input->linesize[2],
 						output->linesize[2],
 						input->data[2],
 						output->data[2]);
 
+			num_planes = 3;
 			break;
 		}
 		case VIDEO_FORMAT_NV12: {
 			const uint32_t width = info->width;
 			const uint32_t height = info->height;
 
-			set_gpu_converted_plane(width, height,
+			set_gpu_converted_plane(&planes[0], width, height,
 						input->linesize[0],
 						output->linesize[0],
 						input->data[0],
 						output->data[0]);
 
 			const uint32_t height_d2 = height / 2;
-			set_gpu_converted_plane(width, height_d2,
+			set_gpu_converted_plane(&planes[1], width, height_d2,
 						input->linesize[1],
 						output->linesize[1],
 						input->data[1],
 						output->data[1]);
 
+			num_planes = 2;
 			break;
 		}
 		case VIDEO_FORMAT_I444: {
 			const uint32_t width = info->width;
 			const uint32_t height = info->height;
 
-			set_gpu_converted_plane(width, height,
+			set_gpu_converted_plane(&planes[0], width, height,
 						input->linesize[0],
 						output->linesize[0],
 						input->data[0],
 						output->data[0]);
 
-			set_gpu_converted_plane(width, height,
+			set_gpu_converted_plane(&planes[1], width, height,
 						input->linesize[1],
 						output->linesize[1],
 						input->data[1],
 						output->data[1]);
 
-			set_gpu_converted_plane(width, height,
+			set_gpu_converted_plane(&planes[2], width, height,
 						input->linesize[2],
 						output->linesize[2],
 						input->data[2],
 						output->data[2]);
 
+			num_planes = 3;
 			break;
 		}
 
@@ -661,25 +773,29 @@ static void set_gpu_converted_data(struct obs_core_video *video,
 			;
 		}
 	}
+
+	video_copy_planes(planes, num_planes, video->copy_pool);
 }
 
-static inline void copy_rgbx_frame(struct video_frame *output,
+static inline void copy_rgbx_frame(struct obs_core_video *video,
+				   struct video_frame *output,
 				   const struct video_data *input,
 				   const struct video_output_info *info)
 {
-	uint8_t *in_ptr = input->data[0];
-	uint8_t *out_ptr = output->data[0];
+	struct video_plane_copy plane = {
+		.dst = output->data[0],
+		.src = input->data[0],
+		.dst_linesize = output->linesize[0],
+		.src_linesize = input->linesize[0],
+		.row_size = info->width * 4,
+		.rows = info->height,
+	};
 
 	/* if the line sizes match, do a single copy */
-	if (input->linesize[0] == output->linesize[0]) {
-		memcpy(out_ptr, in_ptr, input->linesize[0] * info->height);
-	} else {
-		for (size_t y = 0; y < info->height; y++) {
-			memcpy(out_ptr, in_ptr, info->width * 4);
-			in_ptr += input->linesize[0];
-			out_ptr += output->linesize[0];
-		}
-	}
+	if (input->linesize[0] == output->linesize[0])
+		plane.row_size = input->linesize[0];
+
+	video_copy_planes(&plane, 1, video->copy_pool);
 }
 
 static inline void output_video_data(struct obs_core_video *video,
@@ -698,7 +814,8 @@ static inline void output_video_data(struct obs_core_video *video,
 			set_gpu_converted_data(video, &output_frame,
 					       input_frame, info);
 		} else {
-			copy_rgbx_frame(&output_frame, input_frame, info);
+			copy_rgbx_frame(video, &output_frame, input_frame,
+					info);
 		}
 
 		video_output_unlock_frame(video->video);
@@ -741,16 +858,72 @@ static const char *output_frame_render_video_name = "render_video";
 static const char *output_frame_download_frame_name = "download_frame";
 static const char *output_frame_gs_flush_name = "gs_flush";
 static const char *output_frame_output_video_data_name = "output_video_data";
+
+/*
+ * Downloads and outputs the oldest staged frame.  If wait is false and the GPU
+ * hasn't finished copying it yet, the frame is left staged and picked up on a
+ * later frame instead of stalling on the map.
+ */
+static bool output_staged_frame(struct obs_core_video *video, bool wait)
+{
+	const int texture = video->stage_read;
+	struct obs_vframe_info vframe_info;
+	struct video_data frame;
+	bool frame_ready;
+
+	if (!video->textures_copied[texture])
+		return false;
+
+	memset(&frame, 0, sizeof(struct video_data));
+
+	profile_start(output_frame_download_frame_name);
+	gs_enter_context(video->graphics);
+
+	unmap_last_surface(video);
+
+	if (!wait && !stage_surfaces_ready(video, texture)) {
+		gs_leave_context();
+		profile_end(output_frame_download_frame_name);
+		return false;
+	}
+
+	frame_ready = download_frame(video, texture, &frame);
+
+	gs_leave_context();
+	profile_end(output_frame_download_frame_name);
+
+	video->textures_copied[texture] = false;
+	if (++video->stage_read == video->stage_depth)
+		video->stage_read = 0;
+
+	circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
+			    sizeof(vframe_info));
+
+	if (frame_ready) {
+		frame.timestamp = vframe_info.timestamp;
+		profile_start(output_frame_output_video_data_name);
+		output_video_data(video, &frame, vframe_info.count);
+		profile_end(output_frame_output_video_data_name);
+	}
+
+	return true;
+}
+
 static inline void output_frame(bool raw_active, const bool gpu_active)
 {
 	struct obs_core_video *video = &obs->video;
 	int cur_texture = video->cur_texture;
-	int prev_texture = cur_texture == 0 ? NUM_TEXTURES - 1
-					    : cur_texture - 1;
-	struct video_data frame;
-	bool frame_ready = 0;
 
-	memset(&frame, 0, sizeof(struct video_data));
+	if (raw_active) {
+		/* output every frame the GPU has already finished copying */
+		while (output_staged_frame(video, false))
+			;
+
+		/* only wait on the GPU when every staging surface is in
+		 * use and the oldest has to be freed up for this frame */
+		if (video->textures_copied[cur_texture])
+			output_staged_frame(video, true);
+	}
 
 	profile_start(output_frame_gs_context_name);
 	gs_enter_context(video->graphics);
@@ -762,12 +935,6 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 	GS_DEBUG_MARKER_END();
 	profile_end(output_frame_render_video_name);
 
-	if (raw_active) {
-		profile_start(output_frame_download_frame_name);
-		frame_ready = download_frame(video, prev_texture, &frame);
-		profile_end(output_frame_download_frame_name);
-	}
-
 	profile_start(output_frame_gs_flush_name);
 	gs_flush();
 	profile_end(output_frame_gs_flush_name);
@@ -775,19 +942,10 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 	gs_leave_context();
 	profile_end(output_frame_gs_context_name);
 
-	if (raw_active && frame_ready) {
-		struct obs_vframe_info vframe_info;
-		circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
-				    sizeof(vframe_info));
-
-		frame.timestamp = vframe_info.timestamp;
-		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
-		profile_end(output_frame_output_video_data_name);
+	if (video->textures_copied[cur_texture]) {
+		if (++video->cur_texture == video->stage_depth)
+			video->cur_texture = 0;
 	}
-
-	if (++video->cur_texture == NUM_TEXTURES)
-		video->cur_texture = 0;
 }
 
 #define NBSP "\xC2\xA0"
@@ -799,6 +957,7 @@ static void clear_base_frame_data(void)
 	video->texture_converted = false;
 	circlebuf_free(&video->vframe_info_buffer);
 	video->cur_texture = 0;
+	video->stage_read = 0;
 }
 
 static void clear_raw_frame_data(void)
@@ -806,6 +965,7 @@ static void clear_raw_frame_data(void)
 	struct obs_core_video *video = &obs->video;
 	memset(video->textures_copied, 0, sizeof(video->textures_copied));
 	circlebuf_free(&video->vframe_info_buffer);
+	video->stage_read = video->cur_texture;
 }
 
 #ifdef _WIN32
@@ -836,6 +996,7 @@ static void execute_graphics_tasks(void)
 }
 
 static const char *tick_sources_name = "tick_sources";
+static const char *tick_sources_parallel_name = "tick_sources(parallel)";
 static const char *render_displays_name = "render_displays";
 static const char *output_frame_name = "output_frame";
 void *obs_graphics_thread(void *param)
@@ -900,9 +1061,16 @@ void *obs_graphics_thread(void *param)
 		gs_begin_frame();
 		gs_leave_context();
 
-		profile_start(tick_sources_name);
-		last_time = tick_sources(obs->video.video_time, last_time);
-		profile_end(tick_sources_name);
+		const bool parallel_tick =
+			os_atomic_load_bool(&obs->video.parallel_tick);
+		const char *tick_name = parallel_tick
+						? tick_sources_parallel_name
+						: tick_sources_name;
+
+		profile_start(tick_name);
+		last_time = tick_sources(obs->video.video_time, last_time,
+					 parallel_tick);
+		profile_end(tick_name);
 
 		execute_graphics_tasks();
 
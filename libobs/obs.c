@@ -19,6 +19,7 @@
 
 #include "graphics/matrix4.h"
 #include "callback/calldata.h"
+#include "media-io/video-frame.h"
 
 #include "obs.h"
 #include "obs-internal.h"
@@ -203,7 +204,11 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
 
-	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+	video->stage_depth = video->requested_stage_depth
+				     ? video->requested_stage_depth
+				     : DEFAULT_STAGE_TEXTURES;
+
+	for (size_t i = 0; i < (size_t)video->stage_depth; i++) {
 #ifdef _WIN32
 		if (video->using_nv12_tex) {
 			video->copy_surfaces[i][0] =
@@ -258,13 +263,41 @@ gs_effect_t *obs_load_effect(gs_effect_t **effect, const char *file)
 	return *effect;
 }
 
+#ifdef _WIN32
+static void device_loss_release(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static void device_loss_rebuild(void *device, void *data)
+{
+	struct obs_core_video *video = data;
+	os_atomic_inc_long(&video->device_epoch);
+	UNUSED_PARAMETER(device);
+}
+
+static void register_device_loss(struct obs_core_video *video)
+{
+	struct gs_device_loss callbacks = {0};
+
+	callbacks.device_loss_release = device_loss_release;
+	callbacks.device_loss_rebuild = device_loss_rebuild;
+	callbacks.data = video;
+	gs_register_loss_callbacks(&callbacks);
+}
+#endif
+
 static int obs_init_graphics(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
 	uint8_t transparent_tex_data[2 * 2 * 4] = {0};
 	const uint8_t *transparent_tex = transparent_tex_data;
 	struct gs_sampler_info point_sampler = {0};
+	struct gs_shader_cache_stats cache_stats;
+	const char *cache_state;
 	bool success = true;
+	uint64_t start_time;
+	double load_ms;
 	int errorcode;
 
 	errorcode =
@@ -281,6 +314,13 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 	}
 
 	gs_enter_context(video->graphics);
+	gs_set_shader_cache_path(obs->shader_cache_path);
+
+#ifdef _WIN32
+	register_device_loss(video);
+#endif
+
+	start_time = os_gettime_ns();
 
 	char *filename = obs_find_data_file("default.effect");
 	video->default_effect = gs_effect_create_from_file(filename, NULL);
@@ -331,6 +371,32 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 		gs_effect_create_from_file(filename, NULL);
 	bfree(filename);
 
+	gs_get_shader_cache_stats(&cache_stats);
+	load_ms = (double)(os_gettime_ns() - start_time) / 1000000.0;
+
+	if (!obs->shader_cache_path) {
+		blog(LOG_INFO, "Loaded effects in %.1f ms (no shader cache)",
+		     load_ms);
+	} else if (!cache_stats.hits && !cache_stats.misses) {
+		blog(LOG_INFO,
+		     "Loaded effects in %.1f ms (shader cache not used "
+		     "by this renderer)",
+		     load_ms);
+	} else {
+		if (!cache_stats.hits)
+			cache_state = "cold";
+		else if (cache_stats.misses)
+			cache_state = "partly warm";
+		else
+			cache_state = "warm";
+
+		blog(LOG_INFO,
+		     "Loaded effects in %.1f ms (%s shader cache, "
+		     "%ld shaders loaded from it, %ld compiled)",
+		     load_ms, cache_state, cache_stats.hits,
+		     cache_stats.misses);
+	}
+
 	point_sampler.max_anisotropy = 1;
 	video->point_sampler = gs_samplerstate_create(&point_sampler);
 
@@ -411,6 +477,8 @@ static int obs_init_video(struct obs_video_info *ovi)
 		return OBS_VIDEO_FAIL;
 	}
 
+	video->copy_pool = video_copy_pool_acquire();
+
 	gs_enter_context(video->graphics);
 
 	if (ovi->gpu_conversion && !obs_init_gpu_conversion(ovi))
@@ -474,7 +542,7 @@ static void obs_free_video(void)
 			}
 		}
 
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t i = 0; i < MAX_STAGE_TEXTURES; i++) {
 			for (size_t c = 0; c < NUM_CHANNELS; c++) {
 				if (video->copy_surfaces[i][c]) {
 					gs_stagesurface_destroy(
@@ -493,7 +561,7 @@ static void obs_free_video(void)
 			}
 		}
 
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t i = 0; i < MAX_STAGE_TEXTURES; i++) {
 			for (size_t c = 0; c < NUM_CHANNELS; c++) {
 				if (video->copy_surfaces[i][c]) {
 					gs_stagesurface_destroy(
@@ -525,8 +593,16 @@ static void obs_free_video(void)
 		pthread_mutex_init_value(&video->task_mutex);
 		circlebuf_free(&video->tasks);
 
+		task_pool_destroy(video->tick_pool);
+		video->tick_pool = NULL;
+		da_free(video->tick_sources);
+
+		video_copy_pool_release(video->copy_pool);
+		video->copy_pool = NULL;
+
 		video->gpu_encoder_active = 0;
 		video->cur_texture = 0;
+		video->stage_read = 0;
 	}
 }
 
@@ -537,6 +613,10 @@ static void obs_free_graphics(void)
 	if (video->graphics) {
 		gs_enter_context(video->graphics);
 
+#ifdef _WIN32
+		gs_unregister_loss_callbacks(video);
+#endif
+
 		gs_texture_destroy(video->transparent_texture);
 
 		gs_samplerstate_destroy(video->point_sampler);
@@ -582,9 +662,10 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	audio->monitoring_device_id = bstrdup("default");
 
 	errorcode = audio_output_open(&audio->audio, ai);
-	if (errorcode == AUDIO_OUTPUT_SUCCESS)
+	if (errorcode == AUDIO_OUTPUT_SUCCESS) {
+		audio->tick_frames = audio_output_get_tick_frames(audio->audio);
 		return true;
-	else if (errorcode == AUDIO_OUTPUT_INVALIDPARAM)
+	} else if (errorcode == AUDIO_OUTPUT_INVALIDPARAM)
 		blog(LOG_ERROR, "Invalid audio parameters specified");
 	else
 		blog(LOG_ERROR, "Could not open audio output");
@@ -595,6 +676,9 @@ static bool obs_init_audio(struct audio_output_info *ai)
 static void obs_free_audio(void)
 {
 	struct obs_core_audio *audio = &obs->audio;
+	bool parallel_render = os_atomic_load_bool(&audio->parallel_render);
+	uint32_t requested_tick_frames = audio->requested_tick_frames;
+
 	if (audio->audio)
 		audio_output_close(audio->audio);
 
@@ -602,12 +686,19 @@ static void obs_free_audio(void)
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
 
+	task_pool_destroy(audio->render_pool);
+	da_free(audio->render_leaves);
+
 	da_free(audio->monitors);
 	bfree(audio->monitoring_device_name);
 	bfree(audio->monitoring_device_id);
 	pthread_mutex_destroy(&audio->monitoring_mutex);
 
 	memset(audio, 0, sizeof(struct obs_core_audio));
+
+	/* user settings, kept across audio resets */
+	audio->parallel_render = parallel_render;
+	audio->requested_tick_frames = requested_tick_frames;
 }
 
 static bool obs_init_data(void)
@@ -698,6 +789,10 @@ static void obs_free_data(void)
 	pthread_mutex_destroy(&data->draw_callbacks_mutex);
 	da_free(data->draw_callbacks);
 	da_free(data->tick_callbacks);
+	bfree(data->source_index.buckets);
+	bfree(data->output_index.buckets);
+	bfree(data->encoder_index.buckets);
+	bfree(data->service_index.buckets);
 	obs_data_release(data->private_data);
 }
 
@@ -865,6 +960,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	if (!obs_init_hotkeys())
 		return false;
 
+	obs_encoder_packet_pool_init();
+
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
 	obs->locale = bstrdup(locale);
@@ -1031,6 +1128,7 @@ void obs_shutdown(void)
 	obs_free_audio();
 	obs_free_data();
 	obs_free_video();
+	obs_encoder_packet_pool_free();
 	obs_free_hotkeys();
 	obs_free_graphics();
 	proc_handler_destroy(obs->procs);
@@ -1057,6 +1155,7 @@ void obs_shutdown(void)
 		profiler_name_store_free(core->name_store);
 
 	bfree(core->module_config_path);
+	bfree(core->shader_cache_path);
 	bfree(core->locale);
 	bfree(core);
 	bfree(cmdline_args.argv);
@@ -1106,6 +1205,21 @@ const char *obs_get_locale(void)
 	return obs ? obs->locale : NULL;
 }
 
+void obs_set_shader_cache_path(const char *path)
+{
+	if (!obs)
+		return;
+
+	bfree(obs->shader_cache_path);
+	obs->shader_cache_path = path && *path ? bstrdup(path) : NULL;
+
+	if (obs->video.graphics) {
+		gs_enter_context(obs->video.graphics);
+		gs_set_shader_cache_path(obs->shader_cache_path);
+		gs_leave_context();
+	}
+}
+
 #define OBS_SIZE_MIN 2
 #define OBS_SIZE_MAX (32 * 1024)
 
@@ -1209,13 +1323,16 @@ bool obs_reset_audio(const struct obs_audio_info *oai)
 	ai.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	ai.speakers = oai->speakers;
 	ai.input_callback = audio_callback;
+	ai.tick_frames = obs->audio.requested_tick_frames;
 
 	blog(LOG_INFO, "---------------------------------");
 	blog(LOG_INFO,
 	     "audio settings reset:\n"
 	     "\tsamples per sec: %d\n"
-	     "\tspeakers:        %d",
-	     (int)ai.samples_per_sec, (int)ai.speakers);
+	     "\tspeakers:        %d\n"
+	     "\tframes per tick: %d",
+	     (int)ai.samples_per_sec, (int)ai.speakers,
+	     ai.tick_frames ? (int)ai.tick_frames : AUDIO_OUTPUT_FRAMES);
 
 	return obs_init_audio(&ai);
 }
@@ -1596,23 +1713,161 @@ void obs_enum_services(bool (*enum_proc)(void *, obs_service_t *), void *param)
 		 param);
 }
 
-static inline void *get_context_by_name(void *vfirst, const char *name,
+/* ------------------------------------------------------------------------- */
+/* context name index */
+
+#define CONTEXT_INDEX_MIN_BUCKETS 64
+
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static inline struct obs_context_data **
+context_index_bucket(struct obs_context_index *index, uint32_t hash)
+{
+	return &index->buckets[hash & (index->num_buckets - 1)];
+}
+
+/* chains are kept in list order (newest insert first), so duplicate names
+ * resolve the same way as the list walk did, renamed contexts included */
+static void context_index_link(struct obs_context_index *index,
+			       struct obs_context_data *context)
+{
+	struct obs_context_data **next =
+		context_index_bucket(index, context->name_hash);
+
+	while (*next && (*next)->index_order > context->index_order)
+		next = &(*next)->hash_next;
+
+	context->hash_next = *next;
+	*next = context;
+}
+
+static void context_index_grow(struct obs_context_index *index)
+{
+	struct obs_context_data **old_buckets = index->buckets;
+	size_t old_num = index->num_buckets;
+
+	index->num_buckets = old_num ? old_num * 2 : CONTEXT_INDEX_MIN_BUCKETS;
+	index->buckets =
+		bzalloc(index->num_buckets * sizeof(*index->buckets));
+
+	/* walk the old chains from the back so every link is at the head */
+	for (size_t i = 0; i < old_num; i++) {
+		DARRAY(struct obs_context_data *) chain;
+		struct obs_context_data *context = old_buckets[i];
+
+		da_init(chain);
+		for (; context; context = context->hash_next)
+			da_push_back(chain, &context);
+		for (size_t j = chain.num; j > 0; j--)
+			context_index_link(index, chain.array[j - 1]);
+		da_free(chain);
+	}
+
+	bfree(old_buckets);
+}
+
+static void context_index_add(struct obs_context_index *index,
+			      struct obs_context_data *context)
+{
+	if (context->private || !context->name)
+		return;
+
+	if (index->count >= index->num_buckets)
+		context_index_grow(index);
+
+	context->name_hash = hash_name(context->name);
+	context_index_link(index, context);
+	context->indexed = true;
+	index->count++;
+}
+
+static void context_index_remove(struct obs_context_index *index,
+				 struct obs_context_data *context)
+{
+	struct obs_context_data **next;
+
+	if (!context->indexed)
+		return;
+
+	next = context_index_bucket(index, context->name_hash);
+	while (*next) {
+		if (*next == context) {
+			*next = context->hash_next;
+			break;
+		}
+		next = &(*next)->hash_next;
+	}
+
+	context->hash_next = NULL;
+	context->indexed = false;
+	index->count--;
+}
+
+static struct obs_context_data *
+context_index_find(struct obs_context_index *index, const char *name)
+{
+	struct obs_context_data *context;
+	uint32_t hash;
+
+	if (!index->count)
+		return NULL;
+
+	hash = hash_name(name);
+	context = *context_index_bucket(index, hash);
+
+	while (context) {
+		if (context->name_hash == hash &&
+		    strcmp(context->name, name) == 0)
+			return context;
+		context = context->hash_next;
+	}
+
+	return NULL;
+}
+
+static struct obs_context_index *get_context_index(enum obs_obj_type type)
+{
+	switch (type) {
+	case OBS_OBJ_TYPE_SOURCE:
+		return &obs->data.source_index;
+	case OBS_OBJ_TYPE_OUTPUT:
+		return &obs->data.output_index;
+	case OBS_OBJ_TYPE_ENCODER:
+		return &obs->data.encoder_index;
+	case OBS_OBJ_TYPE_SERVICE:
+		return &obs->data.service_index;
+	case OBS_OBJ_TYPE_INVALID:
+		break;
+	}
+
+	return NULL;
+}
+
+static inline void *get_context_by_name(struct obs_context_index *index,
+					const char *name,
 					pthread_mutex_t *mutex,
 					void *(*addref)(void *))
 {
-	struct obs_context_data **first = vfirst;
 	struct obs_context_data *context;
 
+	if (!name)
+		return NULL;
+
 	pthread_mutex_lock(mutex);
 
-	context = *first;
-	while (context) {
-		if (!context->private && strcmp(context->name, name) == 0) {
-			context = addref(context);
-			break;
-		}
-		context = context->next;
-	}
+	context = context_index_find(index, name);
+	if (context)
+		context = addref(context);
 
 	pthread_mutex_unlock(mutex);
 	return context;
@@ -1647,7 +1902,7 @@ obs_source_t *obs_get_source_by_name(const char *name)
 {
 	if (!obs)
 		return NULL;
-	return get_context_by_name(&obs->data.first_source, name,
+	return get_context_by_name(&obs->data.source_index, name,
 				   &obs->data.sources_mutex,
 				   obs_source_addref_safe_);
 }
@@ -1656,7 +1911,7 @@ obs_output_t *obs_get_output_by_name(const char *name)
 {
 	if (!obs)
 		return NULL;
-	return get_context_by_name(&obs->data.first_output, name,
+	return get_context_by_name(&obs->data.output_index, name,
 				   &obs->data.outputs_mutex,
 				   obs_output_addref_safe_);
 }
@@ -1665,7 +1920,7 @@ obs_encoder_t *obs_get_encoder_by_name(const char *name)
 {
 	if (!obs)
 		return NULL;
-	return get_context_by_name(&obs->data.first_encoder, name,
+	return get_context_by_name(&obs->data.encoder_index, name,
 				   &obs->data.encoders_mutex,
 				   obs_encoder_addref_safe_);
 }
@@ -1674,7 +1929,7 @@ obs_service_t *obs_get_service_by_name(const char *name)
 {
 	if (!obs)
 		return NULL;
-	return get_context_by_name(&obs->data.first_service, name,
+	return get_context_by_name(&obs->data.service_index, name,
 				   &obs->data.services_mutex,
 				   obs_service_addref_safe_);
 }
@@ -2217,6 +2472,7 @@ void obs_context_data_insert(struct obs_context_data *context,
 			     pthread_mutex_t *mutex, void *pfirst)
 {
 	struct obs_context_data **first = pfirst;
+	struct obs_context_index *index;
 
 	assert(context);
 	assert(mutex);
@@ -2230,6 +2486,9 @@ void obs_context_data_insert(struct obs_context_data *context,
 	*first = context;
 	if (context->next)
 		context->next->prev_next = &context->next;
+	index = get_context_index(context->type);
+	context->index_order = ++index->next_order;
+	context_index_add(index, context);
 	pthread_mutex_unlock(mutex);
 }
 
@@ -2241,6 +2500,8 @@ void obs_context_data_remove(struct obs_context_data *context)
 			*context->prev_next = context->next;
 		if (context->next)
 			context->next->prev_next = context->prev_next;
+		context_index_remove(get_context_index(context->type),
+				     context);
 		pthread_mutex_unlock(context->mutex);
 
 		context->mutex = NULL;
@@ -2250,13 +2511,26 @@ void obs_context_data_remove(struct obs_context_data *context)
 void obs_context_data_setname(struct obs_context_data *context,
 			      const char *name)
 {
+	pthread_mutex_t *list_mutex = context->mutex;
+	struct obs_context_index *index = get_context_index(context->type);
+
+	/* the list mutex also protects the name index */
+	if (list_mutex)
+		pthread_mutex_lock(list_mutex);
 	pthread_mutex_lock(&context->rename_cache_mutex);
 
+	context_index_remove(index, context);
+
 	if (context->name)
 		da_push_back(context->rename_cache, &context->name);
 	context->name = dup_name(name, context->private);
 
+	if (list_mutex)
+		context_index_add(index, context);
+
 	pthread_mutex_unlock(&context->rename_cache_mutex);
+	if (list_mutex)
+		pthread_mutex_unlock(list_mutex);
 }
 
 profiler_name_store_t *obs_get_profiler_name_store(void)
@@ -2440,6 +2714,55 @@ uint32_t obs_get_lagged_frames(void)
 	return obs ? obs->video.lagged_frames : 0;
 }
 
+void obs_set_video_stage_depth(uint32_t depth)
+{
+	if (!obs)
+		return;
+
+	if (depth > MAX_STAGE_TEXTURES)
+		depth = MAX_STAGE_TEXTURES;
+
+	obs->video.requested_stage_depth = (int)depth;
+}
+
+uint32_t obs_get_video_stage_depth(void)
+{
+	return obs ? (uint32_t)obs->video.stage_depth : 0;
+}
+
+void obs_set_parallel_tick(bool enable)
+{
+	if (obs)
+		os_atomic_set_bool(&obs->video.parallel_tick, enable);
+}
+
+bool obs_parallel_tick_enabled(void)
+{
+	return obs ? os_atomic_load_bool(&obs->video.parallel_tick) : false;
+}
+
+void obs_set_audio_tick_frames(uint32_t frames)
+{
+	if (obs)
+		obs->audio.requested_tick_frames = frames;
+}
+
+uint32_t obs_get_audio_tick_frames(void)
+{
+	return obs ? (uint32_t)obs->audio.tick_frames : 0;
+}
+
+void obs_set_parallel_audio_render(bool enable)
+{
+	if (obs)
+		os_atomic_set_bool(&obs->audio.parallel_render, enable);
+}
+
+bool obs_parallel_audio_render_enabled(void)
+{
+	return obs ? os_atomic_load_bool(&obs->audio.parallel_render) : false;
+}
+
 void start_raw_video(video_t *v, const struct video_scale_info *conversion,
 		     void (*callback)(void *param, struct video_data *frame),
 		     void *param)
@@ -383,6 +383,13 @@ EXPORT int obs_reset_video(struct obs_video_info *ovi);
  */
 EXPORT bool obs_reset_audio(const struct obs_audio_info *oai);
 
+/**
+ * Sets the directory compiled shaders are cached in across launches, NULL to
+ * disable the cache.  Call before obs_reset_video to cover the effects loaded
+ * at startup.
+ */
+EXPORT void obs_set_shader_cache_path(const char *path);
+
 /** Gets the current video settings, returns false if no video */
 EXPORT bool obs_get_video_info(struct obs_video_info *ovi);
 
@@ -739,6 +746,41 @@ EXPORT uint64_t obs_get_frame_interval_ns(void);
 EXPORT uint32_t obs_get_total_frames(void);
 EXPORT uint32_t obs_get_lagged_frames(void);
 
+/**
+ * Sets how many frames of raw video readback can be in flight on the GPU
+ * (1-8, 0 for the default).  Frames that the GPU hasn't finished copying are
+ * deferred instead of stalling the graphics thread, so deeper staging trades
+ * memory for fewer stalls.  Takes effect on the next obs_reset_video.
+ */
+EXPORT void obs_set_video_stage_depth(uint32_t depth);
+EXPORT uint32_t obs_get_video_stage_depth(void);
+
+/**
+ * Enables or disables parallel source ticking.  When enabled, async frame
+ * selection and the video_tick callbacks of sources with the
+ * OBS_SOURCE_THREADED_TICK flag run on a pool of worker threads instead of
+ * the graphics thread.
+ */
+EXPORT void obs_set_parallel_tick(bool enable);
+EXPORT bool obs_parallel_tick_enabled(void);
+
+/**
+ * Sets the number of audio frames processed per audio tick (128, 256, 512 or
+ * 1024).  Smaller ticks lower audio latency at the cost of more overhead.
+ * Takes effect on the next call to obs_reset_audio.
+ */
+EXPORT void obs_set_audio_tick_frames(uint32_t frames);
+EXPORT uint32_t obs_get_audio_tick_frames(void);
+
+/**
+ * Enables or disables parallel audio rendering.  When enabled, sources
+ * without a custom audio_render callback are rendered on a pool of worker
+ * threads; scenes and transitions are still rendered on the audio thread
+ * once their children are done.
+ */
+EXPORT void obs_set_parallel_audio_render(bool enable);
+EXPORT bool obs_parallel_audio_render_enabled(void);
+
 EXPORT bool obs_nv12_tex_active(void);
 
 EXPORT void obs_apply_private_data(obs_data_t *settings);
@@ -1193,6 +1235,33 @@ EXPORT void obs_source_output_video(obs_source_t *source,
 EXPORT void obs_source_output_video2(obs_source_t *source,
 				     const struct obs_source_frame2 *frame);
 
+/**
+ * Gets a frame from the source's frame pool for the caller to fill in
+ * directly, avoiding the copy made by obs_source_output_video.  Returns NULL
+ * if the pool is exhausted.  Only the format, size and plane pointers are
+ * set, everything else must be filled in before the frame is output with
+ * obs_source_output_acquired_frame or handed back with
+ * obs_source_discard_acquired_frame.
+ */
+EXPORT struct obs_source_frame *
+obs_source_acquire_output_frame(obs_source_t *source, enum video_format format,
+				uint32_t width, uint32_t height);
+EXPORT void obs_source_output_acquired_frame(obs_source_t *source,
+					     struct obs_source_frame *frame);
+EXPORT void obs_source_discard_acquired_frame(obs_source_t *source,
+					      struct obs_source_frame *frame);
+
+struct obs_source_async_stats {
+	uint64_t frames;
+	uint64_t copies_avoided;
+	uint64_t frames_dropped;
+};
+
+/** Gets the async video counters of a source, returns false if the source
+ * isn't async */
+EXPORT bool obs_source_get_async_stats(const obs_source_t *source,
+				       struct obs_source_async_stats *stats);
+
 EXPORT void obs_source_set_async_rotation(obs_source_t *source, long rotation);
 
 /**
@@ -1489,6 +1558,20 @@ EXPORT obs_sceneitem_t *obs_scene_find_source_recursive(obs_scene_t *scene,
 EXPORT obs_sceneitem_t *obs_scene_find_sceneitem_by_id(obs_scene_t *scene,
 						       int64_t id);
 
+struct obs_scene_transform_stats {
+	uint32_t items_checked;
+	uint32_t transforms_updated;
+	uint64_t total_transforms_updated;
+};
+
+/**
+ * Gets how much transform work the scene did on the last frame it was
+ * rendered on
+ */
+EXPORT void
+obs_scene_get_transform_stats(obs_scene_t *scene,
+			      struct obs_scene_transform_stats *stats);
+
 /** Enumerates sources within a scene */
 EXPORT void obs_scene_enum_items(obs_scene_t *scene,
 				 bool (*callback)(obs_scene_t *,
@@ -1721,6 +1804,27 @@ EXPORT uint32_t obs_output_get_delay(const obs_output_t *output);
 /** If delay is active, gets the currently active delay value, in seconds. */
 EXPORT uint32_t obs_output_get_active_delay(const obs_output_t *output);
 
+enum obs_output_overflow {
+	OBS_OUTPUT_OVERFLOW_BLOCK,
+	OBS_OUTPUT_OVERFLOW_DROP_TO_KEYFRAME,
+};
+
+/**
+ * Sets how much encoded data, in milliseconds, can be queued for the output
+ * before it's considered to have fallen behind, and what happens then.
+ *
+ * OBS_OUTPUT_OVERFLOW_BLOCK makes the encoder wait for the output (and with
+ * it every other output using the same encoder), while
+ * OBS_OUTPUT_OVERFLOW_DROP_TO_KEYFRAME drops the queued video and skips
+ * ahead to the next keyframe.  Takes effect the next time the output starts.
+ */
+EXPORT void obs_output_set_delivery_buffer(obs_output_t *output,
+					   uint32_t max_ms,
+					   enum obs_output_overflow overflow);
+
+/** Gets the currently set delivery buffer size, in milliseconds. */
+EXPORT uint32_t obs_output_get_delivery_buffer(const obs_output_t *output);
+
 /** Forces the output to stop.  Usually only used with delay. */
 EXPORT void obs_output_force_stop(obs_output_t *output);
 
@@ -2003,6 +2107,34 @@ EXPORT enum obs_encoder_type obs_encoder_get_type(const obs_encoder_t *encoder);
 EXPORT void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 					uint32_t height);
 
+/**
+ * Sets how many raw frames can be queued for a video encoder's encode thread
+ * before the video thread has to wait for it.  Set to 0 to encode on the
+ * video thread instead.  If the encoder is active, this function will trigger
+ * a warning, and do nothing.
+ */
+EXPORT void obs_encoder_set_frame_queue_depth(obs_encoder_t *encoder,
+					      uint32_t depth);
+
+/** For video encoders, returns the frame queue depth */
+EXPORT uint32_t obs_encoder_get_frame_queue_depth(const obs_encoder_t *encoder);
+
+struct obs_encoder_frame_stats {
+	uint64_t frames;             /**< frames encoded */
+	uint64_t encode_time_ns;     /**< total time spent encoding */
+	uint64_t max_encode_time_ns; /**< longest single encode call */
+	uint32_t queued;             /**< frames currently queued */
+	uint32_t max_queued;         /**< most frames queued at once */
+	uint64_t waited; /**< frames the video thread had to wait to queue */
+};
+
+/**
+ * For video encoders, gets encode timing and frame queue statistics for the
+ * current (or last) time the encoder was active.
+ */
+EXPORT bool obs_encoder_get_frame_stats(const obs_encoder_t *encoder,
+					struct obs_encoder_frame_stats *stats);
+
 /** For video encoders, returns true if pre-encode scaling is enabled */
 EXPORT bool obs_encoder_scaling_enabled(const obs_encoder_t *encoder);
 
@@ -2096,6 +2228,30 @@ EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
 				   struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+/**
+ * Allocates reference counted packet data from the packet pool.  Intended to
+ * be called by an encoder from within its encode/encode_texture callback:
+ * sets packet->data and packet->size, and the encoder then writes the encoded
+ * data directly into the returned buffer (packet->size may be lowered
+ * afterward).  libobs takes ownership of the buffer and passes it to outputs
+ * without copying it.
+ */
+EXPORT uint8_t *obs_encoder_packet_alloc(obs_encoder_t *encoder,
+					 struct encoder_packet *packet,
+					 size_t size);
+
+struct obs_encoder_packet_pool_stats {
+	/** Packet buffers reused from the pool */
+	uint64_t hits;
+	/** Packet buffers that had to be newly allocated */
+	uint64_t misses;
+	/** Total bytes copied from encoders into packet buffers */
+	uint64_t bytes_copied;
+};
+
+EXPORT void obs_encoder_packet_pool_get_stats(
+	struct obs_encoder_packet_pool_stats *stats);
+
 EXPORT void *obs_encoder_create_rerouted(obs_encoder_t *encoder,
 					 const char *reroute_id);
 
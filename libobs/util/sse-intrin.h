@@ -54,6 +54,18 @@
 #define _mm_srai_epi16 simde_mm_srai_epi16
 #define _mm_shufflelo_epi16 simde_mm_shufflelo_epi16
 #define _mm_storeu_si128 simde_mm_storeu_si128
+#define _mm_loadu_si128 simde_mm_loadu_si128
+#define _mm_loadl_epi64 simde_mm_loadl_epi64
+#define _mm_setzero_si128 simde_mm_setzero_si128
+#define _mm_or_si128 simde_mm_or_si128
+#define _mm_slli_epi32 simde_mm_slli_epi32
+#define _mm_srli_epi32 simde_mm_srli_epi32
+#define _mm_unpacklo_epi8 simde_mm_unpacklo_epi8
+#define _mm_unpackhi_epi8 simde_mm_unpackhi_epi8
+#define _mm_unpacklo_epi16 simde_mm_unpacklo_epi16
+#define _mm_unpackhi_epi16 simde_mm_unpackhi_epi16
+#define _mm_unpacklo_epi32 simde_mm_unpacklo_epi32
+#define _mm_unpackhi_epi32 simde_mm_unpackhi_epi32
 
 #define _MM_SHUFFLE SIMDE_MM_SHUFFLE
 #define _MM_TRANSPOSE4_PS SIMDE_MM_TRANSPOSE4_PS
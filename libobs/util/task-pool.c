@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2020 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "task-pool.h"
+#include "threading.h"
+#include "platform.h"
+#include "darray.h"
+#include "bmem.h"
+#include "base.h"
+
+/* each task_pool_run call keeps its own job on its stack, so several
+ * threads can run batches on the same pool at once */
+struct task_pool_job {
+	task_pool_func_t func;
+	void *param;
+	long count;
+	volatile long next_idx;
+
+	/* workers currently running items of this job, protected by the pool
+	 * mutex.  the caller waits for this to reach zero before returning */
+	long active;
+
+	struct task_pool_job *next;
+	struct task_pool_job **prev_next;
+};
+
+struct task_pool {
+	char *name;
+	DARRAY(pthread_t) threads;
+
+	os_sem_t *start_sem;
+	pthread_mutex_t mutex;
+	pthread_cond_t done_cond;
+	volatile bool stop;
+
+	struct task_pool_job *first_job;
+};
+
+static void run_items(struct task_pool_job *job)
+{
+	for (;;) {
+		long idx = os_atomic_inc_long(&job->next_idx) - 1;
+		if (idx >= job->count)
+			break;
+
+		job->func(job->param, (size_t)idx);
+	}
+}
+
+static inline bool job_has_items(struct task_pool_job *job)
+{
+	return os_atomic_load_long(&job->next_idx) < job->count;
+}
+
+/* a wakeup can outlive the job it was posted for (the caller may have
+ * already run every item itself), in which case there's nothing to take */
+static struct task_pool_job *take_job(struct task_pool *pool)
+{
+	struct task_pool_job *job;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	job = pool->first_job;
+	while (job && !job_has_items(job))
+		job = job->next;
+	if (job)
+		job->active++;
+
+	pthread_mutex_unlock(&pool->mutex);
+	return job;
+}
+
+static void release_job(struct task_pool *pool, struct task_pool_job *job)
+{
+	pthread_mutex_lock(&pool->mutex);
+	if (--job->active == 0)
+		pthread_cond_broadcast(&pool->done_cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static void *task_pool_thread(void *data)
+{
+	struct task_pool *pool = data;
+
+	os_set_thread_name(pool->name);
+
+	for (;;) {
+		struct task_pool_job *job;
+
+		if (os_sem_wait(pool->start_sem) != 0)
+			break;
+		if (os_atomic_load_bool(&pool->stop))
+			break;
+
+		job = take_job(pool);
+		if (job) {
+			run_items(job);
+			release_job(pool, job);
+		}
+	}
+
+	return NULL;
+}
+
+task_pool_t *task_pool_create(const char *name, size_t threads)
+{
+	struct task_pool *pool = bzalloc(sizeof(struct task_pool));
+	pool->name = bstrdup(name ? name : "libobs: task pool");
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		goto fail0;
+	if (pthread_cond_init(&pool->done_cond, NULL) != 0)
+		goto fail1;
+	if (os_sem_init(&pool->start_sem, 0) != 0)
+		goto fail2;
+
+	for (size_t i = 0; i < threads; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, task_pool_thread, pool) !=
+		    0) {
+			blog(LOG_WARNING,
+			     "task_pool_create: '%s' could only create "
+			     "%d of %d threads",
+			     pool->name, (int)i, (int)threads);
+			break;
+		}
+
+		da_push_back(pool->threads, &thread);
+	}
+
+	return pool;
+
+fail2:
+	pthread_cond_destroy(&pool->done_cond);
+fail1:
+	pthread_mutex_destroy(&pool->mutex);
+fail0:
+	bfree(pool->name);
+	bfree(pool);
+	return NULL;
+}
+
+void task_pool_destroy(task_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	os_atomic_set_bool(&pool->stop, true);
+	for (size_t i = 0; i < pool->threads.num; i++)
+		os_sem_post(pool->start_sem);
+	for (size_t i = 0; i < pool->threads.num; i++)
+		pthread_join(pool->threads.array[i], NULL);
+
+	da_free(pool->threads);
+	os_sem_destroy(pool->start_sem);
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool->name);
+	bfree(pool);
+}
+
+size_t task_pool_get_thread_count(const task_pool_t *pool)
+{
+	return pool ? pool->threads.num : 0;
+}
+
+void task_pool_run(task_pool_t *pool, size_t count, task_pool_func_t func,
+		   void *param)
+{
+	struct task_pool_job job = {0};
+	size_t wake;
+
+	if (!count || !func)
+		return;
+
+	if (!pool || !pool->threads.num || count == 1) {
+		for (size_t i = 0; i < count; i++)
+			func(param, i);
+		return;
+	}
+
+	wake = count - 1;
+	if (wake > pool->threads.num)
+		wake = pool->threads.num;
+
+	job.func = func;
+	job.param = param;
+	job.count = (long)count;
+
+	pthread_mutex_lock(&pool->mutex);
+	job.next = pool->first_job;
+	job.prev_next = &pool->first_job;
+	if (job.next)
+		job.next->prev_next = &job.next;
+	pool->first_job = &job;
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (size_t i = 0; i < wake; i++)
+		os_sem_post(pool->start_sem);
+
+	run_items(&job);
+
+	/* every item has been taken at this point, unlink the job so no
+	 * further worker picks it up and wait for the ones still on it */
+	pthread_mutex_lock(&pool->mutex);
+	*job.prev_next = job.next;
+	if (job.next)
+		job.next->prev_next = job.prev_next;
+
+	while (job.active)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+size_t task_pool_default_thread_count(size_t max_threads)
+{
+	int cores = os_get_logical_cores();
+	size_t threads = cores > 1 ? (size_t)(cores - 1) : 0;
+
+	return threads > max_threads ? max_threads : threads;
+}
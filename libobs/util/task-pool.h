@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Task pool
+ *
+ *   A fixed set of worker threads used to split a batch of independent work
+ *   items across cores.  task_pool_run blocks until every item has been
+ *   processed; the calling thread takes items alongside the workers, so a
+ *   pool created with zero threads simply runs the batch serially.
+ *
+ *   Items are handed out through a shared atomic index, so threads that finish
+ *   early keep taking work from the remaining items.  Several threads may run
+ *   batches on the same pool at once; the workers are shared between them.
+ */
+
+struct task_pool;
+typedef struct task_pool task_pool_t;
+
+typedef void (*task_pool_func_t)(void *param, size_t idx);
+
+EXPORT task_pool_t *task_pool_create(const char *name, size_t threads);
+EXPORT void task_pool_destroy(task_pool_t *pool);
+
+EXPORT size_t task_pool_get_thread_count(const task_pool_t *pool);
+
+EXPORT void task_pool_run(task_pool_t *pool, size_t count,
+			  task_pool_func_t func, void *param);
+
+/** Returns a reasonable worker count for a pool on this machine */
+EXPORT size_t task_pool_default_thread_count(size_t max_threads);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,7 @@
 #include <obs-module.h>
 #include <graphics/image-file.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <util/dstr.h>
 #include <sys/stat.h>
 
@@ -22,6 +23,9 @@ struct image_source {
 	uint64_t last_time;
 	bool active;
 
+	/* bumped whenever the texture changes */
+	volatile long generation;
+
 	gs_image_file2_t if2;
 };
 
@@ -60,6 +64,8 @@ static void image_source_load(struct image_source *context)
 		if (!context->if2.image.loaded)
 			warn("failed to load texture '%s'", file);
 	}
+
+	os_atomic_inc_long(&context->generation);
 }
 
 static void image_source_unload(struct image_source *context)
@@ -67,6 +73,8 @@ static void image_source_unload(struct image_source *context)
 	obs_enter_graphics();
 	gs_image_file2_free(&context->if2);
 	obs_leave_graphics();
+
+	os_atomic_inc_long(&context->generation);
 }
 
 static void image_source_update(void *data, obs_data_t *settings)
@@ -186,6 +194,8 @@ static void image_source_tick(void *data, float seconds)
 				obs_enter_graphics();
 				gs_image_file2_update_texture(&context->if2);
 				obs_leave_graphics();
+
+				os_atomic_inc_long(&context->generation);
 			}
 
 			context->active = false;
@@ -202,6 +212,8 @@ static void image_source_tick(void *data, float seconds)
 			obs_enter_graphics();
 			gs_image_file2_update_texture(&context->if2);
 			obs_leave_graphics();
+
+			os_atomic_inc_long(&context->generation);
 		}
 	}
 
@@ -250,6 +262,12 @@ uint64_t image_source_get_memory_usage(void *data)
 	return s->if2.mem_usage;
 }
 
+static uint64_t image_source_get_generation(void *data)
+{
+	struct image_source *s = data;
+	return (uint64_t)os_atomic_load_long(&s->generation);
+}
+
 static struct obs_source_info image_source_info = {
 	.id = "image_source",
 	.type = OBS_SOURCE_TYPE_INPUT,
@@ -267,6 +285,7 @@ static struct obs_source_info image_source_info = {
 	.video_tick = image_source_tick,
 	.get_properties = image_source_properties,
 	.icon_type = OBS_ICON_TYPE_IMAGE,
+	.video_get_generation = image_source_get_generation,
 };
 
 OBS_DECLARE_MODULE()
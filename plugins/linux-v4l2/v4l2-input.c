@@ -157,6 +157,7 @@ static void *v4l2_thread(void *vptr)
 	struct timeval tv;
 	struct v4l2_buffer buf;
 	struct obs_source_frame out;
+	struct obs_source_frame *frame;
 	size_t plane_offsets[MAX_AV_PLANES];
 
 	if (v4l2_start_capture(data->dev, &data->buffers) < 0)
@@ -201,7 +202,15 @@ static void *v4l2_thread(void *vptr)
 		start = (uint8_t *)data->buffers.info[buf.index].start;
 		for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
 			out.data[i] = start + plane_offsets[i];
-		obs_source_output_video(data->source, &out);
+
+		/* copy the mapped buffer straight into a frame of the source's
+		 * pool, without holding the lock the render thread takes */
+		frame = obs_source_acquire_output_frame(data->source, out.format,
+							out.width, out.height);
+		if (frame) {
+			obs_source_frame_copy(frame, &out);
+			obs_source_output_acquired_frame(data->source, frame);
+		}
 
 		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
 			blog(LOG_DEBUG, "failed to enqueue buffer");
@@ -0,0 +1,279 @@
+#pragma once
+
+/*
+ * Shared memory transport between obs-ffmpeg-mux and its parent.
+ *
+ * The parent creates a memfd holding a single-producer, single-consumer
+ * byte ring and passes the descriptor to the child with --shm-fd. Packets
+ * are written to the ring exactly as they would be to the pipe (an
+ * ffm_packet_info followed by the payload), so the child can hand payloads
+ * that don't straddle the end of the ring straight to libavformat.
+ *
+ * Waiting is done with futexes on the shared mapping, which only cost a
+ * system call when the other side is actually asleep. The stdin pipe stays
+ * open so the child sees EOF if the parent goes away without closing the
+ * ring.
+ *
+ * Only used on Linux, everything else keeps using the pipe.
+ */
+
+#ifdef __linux__
+#define FFM_SHM_SUPPORTED 1
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define FFM_SHM_MAGIC 0x4d534646 /* "FFSM" */
+#define FFM_SHM_VERSION 2
+#define FFM_SHM_DATA_SIZE (32 * 1024 * 1024)
+#define FFM_SHM_WAIT_MS 100
+
+struct ffm_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+
+	/* monotonically increasing byte positions, the ring offset is
+	 * pos % capacity */
+	uint64_t write_pos;
+	uint64_t read_pos;
+
+	/* futex words, bumped whenever the position above changes */
+	uint32_t data_seq;
+	uint32_t space_seq;
+	uint32_t reader_waiting;
+	uint32_t writer_waiting;
+
+	/* set by the parent once everything has been written, and by the
+	 * child when it stops reading */
+	uint32_t writer_closed;
+	uint32_t reader_closed;
+
+	/* bumped by the child while it's idle, so the parent can tell a
+	 * child that died from one that's just slow */
+	uint32_t reader_heartbeat;
+
+	/* bumped by the child whenever it has finished a file because of
+	 * FFM_PACKET_CHANGE_FILE, this is the only way it can answer */
+	uint32_t files_done;
+
+	uint8_t data[];
+};
+
+static inline size_t ffm_shm_total_size(size_t capacity)
+{
+	return sizeof(struct ffm_shm) + capacity;
+}
+
+static inline uint64_t ffm_shm_load(const uint64_t *val)
+{
+	return __atomic_load_n(val, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t ffm_shm_load32(const uint32_t *val)
+{
+	return __atomic_load_n(val, __ATOMIC_SEQ_CST);
+}
+
+static inline void ffm_shm_futex_wait(uint32_t *addr, uint32_t val,
+				      int timeout_ms)
+{
+	struct timespec ts = {.tv_sec = timeout_ms / 1000,
+			      .tv_nsec = (timeout_ms % 1000) * 1000000L};
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static inline void ffm_shm_futex_wake(uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline void ffm_shm_signal(uint32_t *seq, uint32_t *waiting)
+{
+	__atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+	if (ffm_shm_load32(waiting))
+		ffm_shm_futex_wake(seq);
+}
+
+static inline void ffm_shm_init(struct ffm_shm *shm, size_t capacity)
+{
+	memset(shm, 0, sizeof(*shm));
+	shm->magic = FFM_SHM_MAGIC;
+	shm->version = FFM_SHM_VERSION;
+	shm->capacity = capacity;
+}
+
+static inline bool ffm_shm_valid(const struct ffm_shm *shm, size_t size)
+{
+	return size >= sizeof(*shm) && shm->magic == FFM_SHM_MAGIC &&
+	       shm->version == FFM_SHM_VERSION &&
+	       shm->capacity == size - sizeof(*shm);
+}
+
+/* ------------------------------------------------------------------------- */
+/* writer (parent) side */
+
+static inline size_t ffm_shm_free_space(struct ffm_shm *shm)
+{
+	return (size_t)(shm->capacity - (ffm_shm_load(&shm->write_pos) -
+					 ffm_shm_load(&shm->read_pos)));
+}
+
+/* waits up to timeout_ms for free space, returns the amount available */
+static inline size_t ffm_shm_wait_space(struct ffm_shm *shm, int timeout_ms)
+{
+	uint32_t seq = ffm_shm_load32(&shm->space_seq);
+	size_t space = ffm_shm_free_space(shm);
+
+	if (space || ffm_shm_load32(&shm->reader_closed))
+		return space;
+
+	__atomic_store_n(&shm->writer_waiting, 1, __ATOMIC_SEQ_CST);
+
+	space = ffm_shm_free_space(shm);
+	if (!space)
+		ffm_shm_futex_wait(&shm->space_seq, seq, timeout_ms);
+
+	__atomic_store_n(&shm->writer_waiting, 0, __ATOMIC_SEQ_CST);
+	return ffm_shm_free_space(shm);
+}
+
+/* copies as much of data as currently fits, returns the bytes written */
+static inline size_t ffm_shm_write_some(struct ffm_shm *shm,
+					const uint8_t *data, size_t size)
+{
+	uint64_t write_pos = shm->write_pos;
+	size_t space = ffm_shm_free_space(shm);
+	size_t offset = (size_t)(write_pos % shm->capacity);
+	size_t first;
+
+	if (size > space)
+		size = space;
+	if (!size)
+		return 0;
+
+	first = (size_t)shm->capacity - offset;
+	if (first > size)
+		first = size;
+
+	memcpy(shm->data + offset, data, first);
+	memcpy(shm->data, data + first, size - first);
+
+	__atomic_store_n(&shm->write_pos, write_pos + size, __ATOMIC_SEQ_CST);
+	ffm_shm_signal(&shm->data_seq, &shm->reader_waiting);
+	return size;
+}
+
+static inline void ffm_shm_close_writer(struct ffm_shm *shm)
+{
+	__atomic_store_n(&shm->writer_closed, 1, __ATOMIC_SEQ_CST);
+	ffm_shm_signal(&shm->data_seq, &shm->reader_waiting);
+}
+
+/* waits up to timeout_ms for files_done to reach count, returns its value */
+static inline uint32_t ffm_shm_wait_files_done(struct ffm_shm *shm,
+					       uint32_t count, int timeout_ms)
+{
+	uint32_t done = ffm_shm_load32(&shm->files_done);
+
+	if (done != count && !ffm_shm_load32(&shm->reader_closed))
+		ffm_shm_futex_wait(&shm->files_done, done, timeout_ms);
+
+	return ffm_shm_load32(&shm->files_done);
+}
+
+/* ------------------------------------------------------------------------- */
+/* reader (child) side */
+
+static inline size_t ffm_shm_available(struct ffm_shm *shm)
+{
+	return (size_t)(ffm_shm_load(&shm->write_pos) - shm->read_pos);
+}
+
+/* waits up to timeout_ms for at least min_size bytes (capped to the ring
+ * capacity), returns the amount available */
+static inline size_t ffm_shm_wait_data(struct ffm_shm *shm, size_t min_size,
+				       int timeout_ms)
+{
+	uint32_t seq = ffm_shm_load32(&shm->data_seq);
+	size_t available = ffm_shm_available(shm);
+
+	if (min_size > shm->capacity)
+		min_size = (size_t)shm->capacity;
+	if (available >= min_size || ffm_shm_load32(&shm->writer_closed))
+		return available;
+
+	__atomic_store_n(&shm->reader_waiting, 1, __ATOMIC_SEQ_CST);
+
+	available = ffm_shm_available(shm);
+	if (available < min_size && !ffm_shm_load32(&shm->writer_closed))
+		ffm_shm_futex_wait(&shm->data_seq, seq, timeout_ms);
+
+	__atomic_store_n(&shm->reader_waiting, 0, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&shm->reader_heartbeat, 1, __ATOMIC_SEQ_CST);
+	return ffm_shm_available(shm);
+}
+
+/* returns a pointer to the next size bytes if they're available and
+ * contiguous in the ring, NULL otherwise */
+static inline uint8_t *ffm_shm_peek(struct ffm_shm *shm, size_t size)
+{
+	size_t offset = (size_t)(shm->read_pos % shm->capacity);
+
+	if (ffm_shm_available(shm) < size || offset + size > shm->capacity)
+		return NULL;
+	return shm->data + offset;
+}
+
+static inline void ffm_shm_consume(struct ffm_shm *shm, size_t size)
+{
+	__atomic_store_n(&shm->read_pos, shm->read_pos + size,
+			 __ATOMIC_SEQ_CST);
+	ffm_shm_signal(&shm->space_seq, &shm->writer_waiting);
+}
+
+/* copies out as much of the requested data as is available */
+static inline size_t ffm_shm_read_some(struct ffm_shm *shm, uint8_t *data,
+				       size_t size)
+{
+	size_t available = ffm_shm_available(shm);
+	size_t offset = (size_t)(shm->read_pos % shm->capacity);
+	size_t first;
+
+	if (size > available)
+		size = available;
+	if (!size)
+		return 0;
+
+	first = (size_t)shm->capacity - offset;
+	if (first > size)
+		first = size;
+
+	memcpy(data, shm->data + offset, first);
+	memcpy(data + first, shm->data, size - first);
+
+	ffm_shm_consume(shm, size);
+	return size;
+}
+
+static inline void ffm_shm_file_done(struct ffm_shm *shm)
+{
+	__atomic_add_fetch(&shm->files_done, 1, __ATOMIC_SEQ_CST);
+	ffm_shm_futex_wake(&shm->files_done);
+}
+
+static inline void ffm_shm_close_reader(struct ffm_shm *shm)
+{
+	__atomic_store_n(&shm->reader_closed, 1, __ATOMIC_SEQ_CST);
+	ffm_shm_signal(&shm->space_seq, &shm->writer_waiting);
+	ffm_shm_futex_wake(&shm->files_done);
+}
+
+#endif
@@ -25,7 +25,15 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ffmpeg-mux.h"
+#include "ffmpeg-mux-shm.h"
+
+#ifdef FFM_SHM_SUPPORTED
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#endif
 
 #include <libavformat/avformat.h>
 
@@ -81,6 +89,7 @@ struct main_params {
 	int fps_den;
 	char *acodec;
 	char *muxer_settings;
+	int shm_fd;
 };
 
 struct audio_params {
@@ -95,6 +104,20 @@ struct header {
 	int size;
 };
 
+struct ffm_input {
+	struct resize_buf rb;
+#ifdef FFM_SHM_SUPPORTED
+	struct ffm_shm *shm;
+	size_t shm_size;
+	size_t pending_size;
+
+	pthread_t heartbeat_thread;
+	bool heartbeat_active;
+	volatile bool stop_heartbeat;
+	volatile bool parent_lost;
+#endif
+};
+
 struct ffmpeg_mux {
 	AVFormatContext *output;
 	AVStream *video_stream;
@@ -104,6 +127,8 @@ struct ffmpeg_mux {
 	struct header video_header;
 	struct header *audio_header;
 	int num_audio_streams;
+	struct ffm_input *input;
+	char *file; /* params.file once changed with FFM_PACKET_CHANGE_FILE */
 	bool initialized;
 	char error[4096];
 };
@@ -154,6 +179,8 @@ static void ffmpeg_mux_free(struct ffmpeg_mux *ffm)
 		free(ffm->audio);
 	}
 
+	free(ffm->file);
+
 	memset(ffm, 0, sizeof(*ffm));
 }
 
@@ -259,6 +286,14 @@ static bool init_params(int *argc, char ***argv, struct main_params *params,
 
 	get_opt_str(argc, argv, &params->muxer_settings, "muxer settings");
 
+	params->shm_fd = -1;
+	if (*argc && strcmp((*argv)[0], "--shm-fd") == 0) {
+		(*argc)--;
+		(*argv)++;
+		if (!get_opt_int(argc, argv, &params->shm_fd, "shm fd"))
+			return false;
+	}
+
 	return true;
 }
 
@@ -421,22 +456,188 @@ static size_t safe_read(void *vdata, size_t size)
 	return total;
 }
 
-static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
+#ifdef FFM_SHM_SUPPORTED
+/* the parent never writes to stdin when using shared memory, so anything
+ * showing up there is EOF from the parent going away */
+static bool parent_gone(void)
 {
-	struct ffm_packet_info info = {0};
+	struct pollfd pfd = {.fd = 0, .events = POLLIN};
+	char discard[64];
 
-	bool success = safe_read(&info, sizeof(info)) == sizeof(info);
-	if (success) {
-		uint8_t *data = malloc(info.size);
+	if (poll(&pfd, 1, 0) <= 0)
+		return false;
+	return read(0, discard, sizeof(discard)) <= 0;
+}
 
-		if (safe_read(data, info.size) == info.size) {
-			ffmpeg_mux_header(ffm, data, &info);
-		} else {
-			success = false;
+/* keeps ticking while the main thread is busy inside libavformat, which
+ * is how the parent tells a slow muxer from a dead one */
+static void *heartbeat_thread(void *data)
+{
+	struct ffm_input *in = data;
+
+	while (!__atomic_load_n(&in->stop_heartbeat, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&in->shm->reader_heartbeat, 1,
+				   __ATOMIC_SEQ_CST);
+
+		if (parent_gone()) {
+			__atomic_store_n(&in->parent_lost, true,
+					 __ATOMIC_SEQ_CST);
+			ffm_shm_signal(&in->shm->data_seq,
+				       &in->shm->reader_waiting);
+			break;
 		}
 
-		free(data);
+		usleep(FFM_SHM_WAIT_MS * 1000);
+	}
+
+	return NULL;
+}
+
+static bool input_open_shm(struct ffm_input *in, int fd)
+{
+	struct stat st;
+	void *mem;
+
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	mem = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mem == MAP_FAILED)
+		return false;
+
+	if (!ffm_shm_valid(mem, (size_t)st.st_size)) {
+		munmap(mem, (size_t)st.st_size);
+		return false;
+	}
+
+	in->shm = mem;
+	in->shm_size = (size_t)st.st_size;
+	in->heartbeat_active =
+		pthread_create(&in->heartbeat_thread, NULL, heartbeat_thread,
+			       in) == 0;
+	return true;
+}
+
+/* waits until size bytes (or a full ring) can be read, returns false if
+ * the parent closed the ring or went away first */
+static bool shm_wait(struct ffm_input *in, size_t size)
+{
+	size_t target = size < in->shm->capacity ? size
+						 : (size_t)in->shm->capacity;
+
+	for (;;) {
+		if (ffm_shm_wait_data(in->shm, target, FFM_SHM_WAIT_MS) >=
+		    target)
+			return true;
+
+		if (ffm_shm_load32(&in->shm->writer_closed))
+			return ffm_shm_available(in->shm) >= target;
+		if (__atomic_load_n(&in->parent_lost, __ATOMIC_SEQ_CST))
+			return false;
 	}
+}
+
+static bool shm_read(struct ffm_input *in, uint8_t *data, size_t size)
+{
+	while (size) {
+		size_t n;
+
+		if (!shm_wait(in, size))
+			return false;
+
+		n = ffm_shm_read_some(in->shm, data, size);
+		data += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool shm_read_packet(struct ffm_input *in, struct ffm_packet_info *info,
+			    uint8_t **data)
+{
+	/* the previous payload was used in place, release it now that
+	 * libavformat is done with it */
+	if (in->pending_size) {
+		ffm_shm_consume(in->shm, in->pending_size);
+		in->pending_size = 0;
+	}
+
+	if (!shm_read(in, (uint8_t *)info, sizeof(*info)))
+		return false;
+	if (!shm_wait(in, info->size))
+		return false;
+
+	*data = ffm_shm_peek(in->shm, info->size);
+	if (*data) {
+		in->pending_size = info->size;
+		return true;
+	}
+
+	/* wraps around the end of the ring, or is larger than it */
+	resize_buf_resize(&in->rb, info->size);
+	*data = in->rb.buf;
+	return shm_read(in, in->rb.buf, info->size);
+}
+#endif
+
+static bool read_packet(struct ffm_input *in, struct ffm_packet_info *info,
+			uint8_t **data)
+{
+#ifdef FFM_SHM_SUPPORTED
+	if (in->shm)
+		return shm_read_packet(in, info, data);
+#endif
+
+	if (safe_read(info, sizeof(*info)) != sizeof(*info))
+		return false;
+
+	resize_buf_resize(&in->rb, info->size);
+	*data = in->rb.buf;
+	return safe_read(in->rb.buf, info->size) == info->size;
+}
+
+static void input_file_done(struct ffm_input *in)
+{
+#ifdef FFM_SHM_SUPPORTED
+	if (in->shm)
+		ffm_shm_file_done(in->shm);
+#else
+	(void)in;
+#endif
+}
+
+static void input_free(struct ffm_input *in)
+{
+#ifdef FFM_SHM_SUPPORTED
+	if (in->shm) {
+		if (in->heartbeat_active) {
+			__atomic_store_n(&in->stop_heartbeat, true,
+					 __ATOMIC_SEQ_CST);
+			pthread_join(in->heartbeat_thread, NULL);
+		}
+
+		ffm_shm_close_reader(in->shm);
+		munmap(in->shm, in->shm_size);
+		in->shm = NULL;
+	}
+#endif
+	resize_buf_free(&in->rb);
+}
+
+static bool ffmpeg_mux_get_header(struct ffmpeg_mux *ffm)
+{
+	struct ffm_packet_info info = {0};
+	uint8_t *data;
+
+	bool success = read_packet(ffm->input, &info, &data);
+	if (success)
+		ffmpeg_mux_header(ffm, data, &info);
 
 	return success;
 }
@@ -561,6 +762,14 @@ static int ffmpeg_mux_init_internal(struct ffmpeg_mux *ffm, int argc,
 	if (!init_params(&argc, &argv, &ffm->params, &ffm->audio))
 		return FFM_ERROR;
 
+#ifdef FFM_SHM_SUPPORTED
+	if (ffm->params.shm_fd != -1 &&
+	    !input_open_shm(ffm->input, ffm->params.shm_fd)) {
+		fprintf(stderr, "Couldn't map shared memory\n");
+		return FFM_ERROR;
+	}
+#endif
+
 	if (ffm->params.tracks) {
 		ffm->audio_header =
 			calloc(1, sizeof(struct header) * ffm->params.tracks);
@@ -645,6 +854,36 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
 	return av_interleaved_write_frame(ffm->output, &packet) >= 0;
 }
 
+/* the streams and their headers stay the same, only the file changes.  lets
+ * the replay buffer keep one muxer running for all of its saves */
+static int ffmpeg_mux_change_file(struct ffmpeg_mux *ffm, const uint8_t *path,
+				  size_t size)
+{
+	int ret;
+
+	if (ffm->initialized) {
+		av_write_trailer(ffm->output);
+		free_avformat(ffm);
+		ffm->initialized = false;
+		input_file_done(ffm->input);
+	}
+
+	if (!size)
+		return FFM_SUCCESS;
+
+	free(ffm->file);
+	ffm->file = malloc(size + 1);
+	memcpy(ffm->file, path, size);
+	ffm->file[size] = 0;
+	ffm->params.file = ffm->file;
+
+	ret = ffmpeg_mux_init_context(ffm);
+	if (ret == FFM_SUCCESS)
+		ffm->initialized = true;
+
+	return ret;
+}
+
 /* ------------------------------------------------------------------------- */
 
 #ifdef _WIN32
@@ -655,8 +894,8 @@ int main(int argc, char *argv[])
 {
 	struct ffm_packet_info info = {0};
 	struct ffmpeg_mux ffm = {0};
-	struct resize_buf rb = {0};
-	bool fail = false;
+	struct ffm_input input = {0};
+	uint8_t *data;
 	int ret;
 
 #ifdef _WIN32
@@ -681,29 +920,34 @@ int main(int argc, char *argv[])
 #endif
 	setvbuf(stderr, NULL, _IONBF, 0);
 
+	ffm.input = &input;
+
 	ret = ffmpeg_mux_init(&ffm, argc, argv);
 	if (ret != FFM_SUCCESS) {
 		fprintf(stderr, "Couldn't initialize muxer\n");
+		input_free(&input);
 		return ret;
 	}
 
-	while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
-		resize_buf_resize(&rb, info.size);
-
-		if (safe_read(rb.buf, info.size) == info.size) {
-			ffmpeg_mux_packet(&ffm, rb.buf, &info);
+	while (read_packet(&input, &info, &data)) {
+		if (info.type == FFM_PACKET_CHANGE_FILE) {
+			ret = ffmpeg_mux_change_file(&ffm, data, info.size);
+			if (ret != FFM_SUCCESS) {
+				fprintf(stderr, "Couldn't change file\n");
+				break;
+			}
 		} else {
-			fail = true;
+			ffmpeg_mux_packet(&ffm, data, &info);
 		}
 	}
 
 	ffmpeg_mux_free(&ffm);
-	resize_buf_free(&rb);
+	input_free(&input);
 
 #ifdef _WIN32
 	for (int i = 0; i < argc; i++)
 		free(argv[i]);
 	free(argv);
 #endif
-	return 0;
+	return ret;
 }
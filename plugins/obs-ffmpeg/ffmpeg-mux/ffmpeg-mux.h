@@ -21,6 +21,10 @@
 enum ffm_packet_type {
 	FFM_PACKET_VIDEO,
 	FFM_PACKET_AUDIO,
+
+	/* finishes the current file, if any.  the payload is the path of the
+	 * next file to write, or empty to wait for another change */
+	FFM_PACKET_CHANGE_FILE,
 };
 
 #define FFM_SUCCESS 0
@@ -46,8 +46,6 @@ struct enc_encoder {
 	AVFrame *aframe;
 	int64_t total_samples;
 
-	DARRAY(uint8_t) packet_buffer;
-
 	size_t audio_planes;
 	size_t audio_size;
 
@@ -127,7 +125,6 @@ static void enc_destroy(void *data)
 	if (enc->aframe)
 		av_frame_free(&enc->aframe);
 
-	da_free(enc->packet_buffer);
 	bfree(enc);
 }
 
@@ -331,13 +328,11 @@ static bool do_encode(struct enc_encoder *enc, struct encoder_packet *packet,
 	if (!got_packet)
 		return true;
 
-	da_resize(enc->packet_buffer, 0);
-	da_push_back_array(enc->packet_buffer, avpacket.data, avpacket.size);
+	obs_encoder_packet_alloc(enc->encoder, packet, avpacket.size);
+	memcpy(packet->data, avpacket.data, avpacket.size);
 
 	packet->pts = rescale_ts(avpacket.pts, enc->context, time_base);
 	packet->dts = rescale_ts(avpacket.dts, enc->context, time_base);
-	packet->data = enc->packet_buffer.array;
-	packet->size = avpacket.size;
 	packet->type = OBS_ENCODER_AUDIO;
 	packet->timebase_num = 1;
 	packet->timebase_den = (int32_t)enc->context->sample_rate;
@@ -22,14 +22,24 @@
 #include <util/pipe.h>
 #include <util/darray.h>
 #include <util/platform.h>
-#include <util/circlebuf.h>
 #include <util/threading.h>
+#include <inttypes.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-shm.h"
+#include "replay-cache.h"
 
 #ifdef _WIN32
 #include "util/windows/win-version.h"
 #endif
 
+#ifdef FFM_SHM_SUPPORTED
+#include <fcntl.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#endif
+
 #include <libavformat/avformat.h>
 
 #define do_log(level, format, ...)                  \
@@ -39,9 +49,45 @@
 #define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
 
+/* Replay buffer packets are stored in chunks so that a save can hold on to
+ * a range of them without copying or referencing every packet. Each chunk
+ * holds a reference to the next one, so a reference to the first chunk of
+ * a range keeps the whole range alive. */
+#define REPLAY_CHUNK_PACKETS 256
+
+struct replay_packet {
+	struct encoder_packet pkt; /* data is NULL once cached */
+	uint64_t cache_pos;
+	bool cached;
+};
+
+struct replay_chunk {
+	volatile long refs;
+	struct replay_chunk *next;
+	size_t num;
+	struct replay_packet packets[REPLAY_CHUNK_PACKETS];
+};
+
+struct replay_save {
+	struct replay_chunk *chunk;
+	size_t idx;
+	size_t num_packets;
+	struct dstr path;
+
+	uint64_t trigger_ns;
+	uint64_t stall_ns;
+	int64_t ram_bytes;
+	int64_t disk_bytes;
+};
+
 struct ffmpeg_muxer {
 	obs_output_t *output;
 	os_process_pipe_t *pipe;
+#ifdef FFM_SHM_SUPPORTED
+	struct ffm_shm *shm;
+	size_t shm_size;
+	uint32_t files_done;
+#endif
 	int64_t stop_ts;
 	uint64_t total_bytes;
 	struct dstr path;
@@ -51,7 +97,10 @@ struct ffmpeg_muxer {
 	volatile bool capturing;
 
 	/* replay buffer */
-	struct circlebuf packets;
+	struct replay_chunk *head;
+	struct replay_chunk *tail;
+	size_t head_idx;
+	size_t num_packets;
 	int64_t cur_size;
 	int64_t cur_time;
 	int64_t max_size;
@@ -60,10 +109,33 @@ struct ffmpeg_muxer {
 	int keyframes;
 	obs_hotkey_id hotkey;
 
-	DARRAY(struct encoder_packet) mux_packets;
+	/* replay buffer disk tier: once the packets in memory take up more
+	 * than max_ram_size, the oldest GOPs are moved to the cache. packets
+	 * before spill are cached, the ones after it are still in memory. */
+	struct replay_cache *cache;
+	struct replay_chunk *spill;
+	size_t spill_idx;
+	size_t num_cached;
+	int64_t ram_size;
+	int64_t max_ram_size;
+	int ram_keyframes;
+	bool cache_full_warned;
+
+	/* replay buffer saves, written in order by mux_thread */
+	DARRAY(struct replay_save) saves;
+	pthread_mutex_t saves_mutex;
+	os_sem_t *saves_sem;
+	volatile long active_saves;
+	volatile bool stop_saving;
 	pthread_t mux_thread;
 	bool mux_thread_joinable;
 	volatile bool muxing;
+
+	/* what get_buffer_stats reports, it can be called from any thread */
+	pthread_mutex_t stats_mutex;
+	int64_t stats_ram_bytes;
+	int64_t stats_disk_bytes;
+	int64_t last_save_ms;
 };
 
 static const char *ffmpeg_mux_getname(void *type)
@@ -72,21 +144,232 @@ static const char *ffmpeg_mux_getname(void *type)
 	return obs_module_text("FFmpegMuxer");
 }
 
-static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
+#ifdef FFM_SHM_SUPPORTED
+#define SHM_CHILD_TIMEOUT_NS (2000ULL * 1000000ULL)
+
+/* returns the descriptor to hand to the child, or -1 to use the pipe */
+static int create_shm(struct ffmpeg_muxer *stream)
+{
+	size_t size = ffm_shm_total_size(FFM_SHM_DATA_SIZE);
+	void *mem;
+	int fd;
+
+	fd = (int)syscall(SYS_memfd_create, "obs-ffmpeg-mux", MFD_CLOEXEC);
+	if (fd == -1) {
+		info("memfd_create failed (%d), using pipe", errno);
+		return -1;
+	}
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		info("Failed to size shared memory (%d), using pipe", errno);
+		close(fd);
+		return -1;
+	}
+
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED) {
+		info("Failed to map shared memory (%d), using pipe", errno);
+		close(fd);
+		return -1;
+	}
+
+	stream->shm = mem;
+	stream->shm_size = size;
+	stream->files_done = 0;
+	ffm_shm_init(stream->shm, FFM_SHM_DATA_SIZE);
+	return fd;
+}
+
+static void destroy_shm(struct ffmpeg_muxer *stream)
+{
+	if (stream->shm) {
+		munmap(stream->shm, stream->shm_size);
+		stream->shm = NULL;
+	}
+}
+
+/* the muxer's heartbeat keeps moving as long as it's alive, even while it's
+ * busy inside libavformat */
+static bool shm_child_alive(struct ffmpeg_muxer *stream, uint32_t *heartbeat,
+			    uint64_t *last_alive)
+{
+	uint32_t cur_heartbeat =
+		ffm_shm_load32(&stream->shm->reader_heartbeat);
+	uint64_t now = os_gettime_ns();
+
+	if (cur_heartbeat != *heartbeat) {
+		*heartbeat = cur_heartbeat;
+		*last_alive = now;
+	} else if (now - *last_alive > SHM_CHILD_TIMEOUT_NS) {
+		warn("ffmpeg-mux stopped responding");
+		return false;
+	}
+
+	return true;
+}
+
+static bool shm_write(struct ffmpeg_muxer *stream, const uint8_t *data,
+		      size_t size)
+{
+	struct ffm_shm *shm = stream->shm;
+	uint32_t heartbeat = ffm_shm_load32(&shm->reader_heartbeat);
+	uint64_t last_alive = os_gettime_ns();
+
+	while (size) {
+		size_t written = ffm_shm_write_some(shm, data, size);
+		data += written;
+		size -= written;
+
+		if (!size)
+			break;
+		if (ffm_shm_load32(&shm->reader_closed))
+			return false;
+		if (ffm_shm_wait_space(shm, FFM_SHM_WAIT_MS))
+			continue;
+
+		/* the ring is full: make sure the muxer is still there */
+		if (!shm_child_alive(stream, &heartbeat, &last_alive))
+			return false;
+	}
+
+	return true;
+}
+
+/* waits until the muxer has written the trailer of every file it was told
+ * to finish so far */
+static bool shm_wait_files_done(struct ffmpeg_muxer *stream)
+{
+	struct ffm_shm *shm = stream->shm;
+	uint32_t heartbeat = ffm_shm_load32(&shm->reader_heartbeat);
+	uint64_t last_alive = os_gettime_ns();
+
+	while (ffm_shm_wait_files_done(shm, stream->files_done,
+				       FFM_SHM_WAIT_MS) != stream->files_done) {
+		if (ffm_shm_load32(&shm->reader_closed))
+			return false;
+		if (!shm_child_alive(stream, &heartbeat, &last_alive))
+			return false;
+	}
+
+	return true;
+}
+#endif
+
+static bool write_data(struct ffmpeg_muxer *stream, const uint8_t *data,
+		       size_t size)
+{
+#ifdef FFM_SHM_SUPPORTED
+	if (stream->shm)
+		return shm_write(stream, data, size);
+#endif
+	return os_process_pipe_write(stream->pipe, data, size) == size;
+}
+
+static int stop_pipe(struct ffmpeg_muxer *stream)
+{
+	int ret;
+
+#ifdef FFM_SHM_SUPPORTED
+	/* let the muxer drain the ring before waiting for it to exit */
+	if (stream->shm)
+		ffm_shm_close_writer(stream->shm);
+#endif
+
+	ret = os_process_pipe_destroy(stream->pipe);
+	stream->pipe = NULL;
+
+#ifdef FFM_SHM_SUPPORTED
+	destroy_shm(stream);
+#endif
+	return ret;
+}
+
+static void chunk_release(struct replay_chunk *chunk)
+{
+	while (chunk && os_atomic_dec_long(&chunk->refs) == 0) {
+		struct replay_chunk *next = chunk->next;
+
+		for (size_t i = 0; i < chunk->num; i++)
+			obs_encoder_packet_release(&chunk->packets[i].pkt);
+
+		bfree(chunk);
+		chunk = next;
+	}
+}
+
+/* moves to the next packet, stays at the end of the last chunk until a
+ * new one is linked */
+static inline void advance(struct replay_chunk **chunk, size_t *idx)
 {
-	while (stream->packets.size > 0) {
-		struct encoder_packet pkt;
-		circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
-		obs_encoder_packet_release(&pkt);
+	if (++(*idx) == REPLAY_CHUNK_PACKETS && (*chunk)->next) {
+		*chunk = (*chunk)->next;
+		*idx = 0;
 	}
+}
+
+/* the mux thread exits once it has written the saves already queued */
+static inline void replay_buffer_end_saving(struct ffmpeg_muxer *stream)
+{
+	if (stream->mux_thread_joinable) {
+		os_atomic_set_bool(&stream->stop_saving, true);
+		os_sem_post(stream->saves_sem);
+	}
+}
 
-	circlebuf_free(&stream->packets);
+static void replay_buffer_stop_saving(struct ffmpeg_muxer *stream)
+{
+	if (stream->mux_thread_joinable) {
+		replay_buffer_end_saving(stream);
+		pthread_join(stream->mux_thread, NULL);
+		stream->mux_thread_joinable = false;
+	}
+}
+
+static void update_buffer_stats(struct ffmpeg_muxer *stream)
+{
+	pthread_mutex_lock(&stream->stats_mutex);
+	stream->stats_ram_bytes = stream->ram_size;
+	stream->stats_disk_bytes = stream->cur_size - stream->ram_size;
+	pthread_mutex_unlock(&stream->stats_mutex);
+}
+
+static inline void replay_buffer_free_packets(struct ffmpeg_muxer *stream)
+{
+	chunk_release(stream->head);
+	stream->head = NULL;
+	stream->tail = NULL;
+	stream->spill = NULL;
+	stream->head_idx = 0;
+	stream->spill_idx = 0;
+	stream->num_packets = 0;
+	stream->num_cached = 0;
 	stream->cur_size = 0;
 	stream->cur_time = 0;
+	stream->ram_size = 0;
+}
+
+static inline void replay_buffer_reset(struct ffmpeg_muxer *stream)
+{
+	replay_buffer_free_packets(stream);
+
 	stream->max_size = 0;
 	stream->max_time = 0;
 	stream->save_ts = 0;
 	stream->keyframes = 0;
+	stream->max_ram_size = 0;
+	stream->ram_keyframes = 0;
+	stream->cache_full_warned = false;
+}
+
+static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
+{
+	/* queued saves still need the packets and the cache */
+	replay_buffer_stop_saving(stream);
+	da_free(stream->saves);
+
+	replay_buffer_reset(stream);
+	replay_cache_destroy(stream->cache);
+	stream->cache = NULL;
 }
 
 static void ffmpeg_mux_destroy(void *data)
@@ -94,11 +377,7 @@ static void ffmpeg_mux_destroy(void *data)
 	struct ffmpeg_muxer *stream = data;
 
 	replay_buffer_clear(stream);
-	if (stream->mux_thread_joinable)
-		pthread_join(stream->mux_thread, NULL);
-	da_free(stream->mux_packets);
-
-	os_process_pipe_destroy(stream->pipe);
+	stop_pipe(stream);
 	dstr_free(&stream->path);
 	bfree(stream);
 }
@@ -260,7 +539,38 @@ static inline void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 {
 	struct dstr cmd;
 	build_command_line(stream, &cmd, path);
+
+#ifdef FFM_SHM_SUPPORTED
+	int shm_fd = create_shm(stream);
+
+	/* the descriptor is created close-on-exec, and only made inheritable
+	 * for as long as it takes to start this muxer */
+	if (shm_fd != -1 && fcntl(shm_fd, F_SETFD, 0) == -1) {
+		info("Failed to share memory with the muxer (%d), using pipe",
+		     errno);
+		close(shm_fd);
+		destroy_shm(stream);
+		shm_fd = -1;
+	}
+
+	if (shm_fd != -1)
+		dstr_catf(&cmd, "--shm-fd %d", shm_fd);
+#endif
+
 	stream->pipe = os_process_pipe_create(cmd.array, "w");
+
+#ifdef FFM_SHM_SUPPORTED
+	/* the muxer inherited its own copy of the descriptor, and the mapping
+	 * stays valid without ours */
+	if (shm_fd != -1) {
+		close(shm_fd);
+		if (!stream->pipe)
+			destroy_shm(stream);
+		else
+			info("Using shared memory transport");
+	}
+#endif
+
 	dstr_free(&cmd);
 }
 
@@ -330,8 +640,7 @@ static int deactivate(struct ffmpeg_muxer *stream, int code)
 	int ret = -1;
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		ret = stop_pipe(stream);
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
@@ -395,7 +704,6 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 			 struct encoder_packet *packet)
 {
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
-	size_t ret;
 
 	struct ffm_packet_info info = {.pts = packet->pts,
 				       .dts = packet->dts,
@@ -405,17 +713,14 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 							: FFM_PACKET_AUDIO,
 				       .keyframe = packet->keyframe};
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
-				    sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
+	if (!write_data(stream, (const uint8_t *)&info, sizeof(info))) {
+		warn("Writing packet info structure failed");
 		signal_failure(stream);
 		return false;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
-	if (ret != packet->size) {
-		warn("os_process_pipe_write for packet data failed");
+	if (!write_data(stream, packet->data, packet->size)) {
+		warn("Writing packet data failed");
 		signal_failure(stream);
 		return false;
 	}
@@ -572,12 +877,39 @@ static void get_last_replay(void *data, calldata_t *cd)
 		calldata_set_string(cd, "path", stream->path.array);
 }
 
+static void get_buffer_stats(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	calldata_set_int(cd, "ram_bytes", stream->stats_ram_bytes);
+	calldata_set_int(cd, "disk_bytes", stream->stats_disk_bytes);
+	calldata_set_int(cd, "last_save_ms", stream->last_save_ms);
+	pthread_mutex_unlock(&stream->stats_mutex);
+}
+
 static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 {
 	UNUSED_PARAMETER(settings);
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
 
+	if (pthread_mutex_init(&stream->saves_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+	if (pthread_mutex_init(&stream->stats_mutex, NULL) != 0) {
+		pthread_mutex_destroy(&stream->saves_mutex);
+		bfree(stream);
+		return NULL;
+	}
+	if (os_sem_init(&stream->saves_sem, 0) != 0) {
+		pthread_mutex_destroy(&stream->stats_mutex);
+		pthread_mutex_destroy(&stream->saves_mutex);
+		bfree(stream);
+		return NULL;
+	}
+
 	stream->hotkey =
 		obs_hotkey_register_output(output, "ReplayBuffer.Save",
 					   obs_module_text("ReplayBuffer.Save"),
@@ -587,6 +919,10 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	proc_handler_add(ph, "void save()", save_replay_proc, stream);
 	proc_handler_add(ph, "void get_last_replay(out string path)",
 			 get_last_replay, stream);
+	proc_handler_add(ph,
+			 "void get_buffer_stats(out int ram_bytes, "
+			 "out int disk_bytes, out int last_save_ms)",
+			 get_buffer_stats, stream);
 
 	return stream;
 }
@@ -596,9 +932,16 @@ static void replay_buffer_destroy(void *data)
 	struct ffmpeg_muxer *stream = data;
 	if (stream->hotkey)
 		obs_hotkey_unregister(stream->hotkey);
+
+	replay_buffer_clear(stream);
+	pthread_mutex_destroy(&stream->stats_mutex);
+	pthread_mutex_destroy(&stream->saves_mutex);
+	os_sem_destroy(stream->saves_sem);
 	ffmpeg_mux_destroy(data);
 }
 
+static void *replay_buffer_mux_thread(void *data);
+
 static bool replay_buffer_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -608,11 +951,40 @@ static bool replay_buffer_start(void *data)
 	if (!obs_output_initialize_encoders(stream->output, 0))
 		return false;
 
+	/* the previous session may still be writing its last saves */
+	replay_buffer_clear(stream);
+
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+
+	int64_t cache_mb = obs_data_get_int(s, "disk_cache_mb");
+	if (cache_mb > 0) {
+		const char *dir = obs_data_get_string(s, "disk_cache_dir");
+		if (!*dir)
+			dir = obs_data_get_string(s, "directory");
+
+		stream->cache = replay_cache_create(
+			dir, (size_t)cache_mb * (1024 * 1024));
+		stream->max_ram_size =
+			obs_data_get_int(s, "max_ram_mb") * (1024 * 1024);
+
+		if (!stream->cache)
+			warn("Failed to create disk cache, keeping the whole "
+			     "replay buffer in memory");
+	}
 	obs_data_release(s);
 
+	os_atomic_set_bool(&stream->stop_saving, false);
+	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
+						     replay_buffer_mux_thread,
+						     stream) == 0;
+	if (!stream->mux_thread_joinable) {
+		warn("Failed to create mux thread");
+		replay_buffer_clear(stream);
+		return false;
+	}
+
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
 	stream->total_bytes = 0;
@@ -621,45 +993,93 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
-static bool purge_front(struct ffmpeg_muxer *stream)
+static inline bool is_keyframe(const struct encoder_packet *pkt)
 {
-	struct encoder_packet pkt;
-	bool keyframe;
+	return pkt->type == OBS_ENCODER_VIDEO && pkt->keyframe;
+}
 
-	circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
+static inline struct replay_packet *front(struct ffmpeg_muxer *stream)
+{
+	return &stream->head->packets[stream->head_idx];
+}
 
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+static inline bool saving(struct ffmpeg_muxer *stream)
+{
+	return os_atomic_load_long(&stream->active_saves) > 0;
+}
+
+static struct replay_packet *push_packet(struct ffmpeg_muxer *stream)
+{
+	struct replay_chunk *chunk = stream->tail;
+
+	if (!chunk || chunk->num == REPLAY_CHUNK_PACKETS) {
+		chunk = bzalloc(sizeof(*chunk));
+		chunk->refs = 1;
+
+		if (!stream->tail) {
+			stream->head = chunk;
+			stream->spill = chunk;
+		} else {
+			stream->tail->next = chunk;
+			if (stream->spill_idx == REPLAY_CHUNK_PACKETS) {
+				stream->spill = chunk;
+				stream->spill_idx = 0;
+			}
+		}
+
+		stream->tail = chunk;
+	}
+
+	stream->num_packets++;
+	return &chunk->packets[chunk->num++];
+}
+
+static bool purge_front(struct ffmpeg_muxer *stream)
+{
+	struct replay_packet *rp = front(stream);
+	struct replay_chunk *head = stream->head;
+	bool keyframe = is_keyframe(&rp->pkt);
 
 	if (keyframe)
 		stream->keyframes--;
 
-	if (!stream->packets.size) {
-		stream->cur_size = 0;
-		stream->cur_time = 0;
+	if (rp->cached) {
+		stream->num_cached--;
 	} else {
-		struct encoder_packet first;
-		circlebuf_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
+		stream->ram_size -= (int64_t)rp->pkt.size;
+		if (keyframe)
+			stream->ram_keyframes--;
+
+		advance(&stream->spill, &stream->spill_idx);
 	}
 
-	obs_encoder_packet_release(&pkt);
+	stream->cur_size -= (int64_t)rp->pkt.size;
+
+	/* a save might still be reading the packet, in which case it's
+	 * released along with its chunk */
+	if (!saving(stream))
+		obs_encoder_packet_release(&rp->pkt);
+
+	if (--stream->num_packets == 0) {
+		replay_buffer_free_packets(stream);
+		return keyframe;
+	}
+
+	advance(&stream->head, &stream->head_idx);
+	if (stream->head != head) {
+		os_atomic_inc_long(&stream->head->refs);
+		chunk_release(head);
+	}
+
+	stream->cur_time = front(stream)->pkt.dts_usec;
 	return keyframe;
 }
 
 static inline void purge(struct ffmpeg_muxer *stream)
 {
 	if (purge_front(stream)) {
-		struct encoder_packet pkt;
-
-		for (;;) {
-			circlebuf_peek_front(&stream->packets, &pkt,
-					     sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
-				return;
-
+		while (stream->num_packets && !is_keyframe(&front(stream)->pkt))
 			purge_front(stream);
-		}
 	}
 }
 
@@ -667,7 +1087,7 @@ static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
 				       struct encoder_packet *pkt)
 {
 	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
+		if (!stream->num_packets || stream->keyframes <= 2)
 			return;
 
 		while ((stream->cur_size + (int64_t)pkt->size) >
@@ -675,117 +1095,370 @@ static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
 			purge(stream);
 	}
 
-	if (!stream->packets.size || stream->keyframes <= 2)
+	if (!stream->num_packets || stream->keyframes <= 2)
 		return;
 
 	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
 		purge(stream);
 }
 
-static void insert_packet(struct darray *array, struct encoder_packet *packet,
-			  int64_t video_offset, int64_t *audio_offsets,
-			  int64_t video_dts_offset, int64_t *audio_dts_offsets)
+/* oldest cache position that must not be overwritten */
+static inline uint64_t cache_tail(struct ffmpeg_muxer *stream)
 {
-	struct encoder_packet pkt;
-	DARRAY(struct encoder_packet) packets;
-	packets.da = *array;
+	return stream->num_cached ? front(stream)->cache_pos
+				  : replay_cache_head(stream->cache);
+}
+
+static bool spill_front(struct ffmpeg_muxer *stream)
+{
+	struct replay_packet *rp = &stream->spill->packets[stream->spill_idx];
+	uint64_t pos = replay_cache_head(stream->cache);
+
+	while (rp->pkt.size && !replay_cache_write(stream->cache, rp->pkt.data,
+						   rp->pkt.size,
+						   cache_tail(stream), &pos)) {
+		/* make room by dropping the oldest GOP */
+		if (!stream->num_cached || stream->keyframes <= 2)
+			return false;
+
+		if (!stream->cache_full_warned) {
+			warn("Disk cache is full, dropping the oldest packets");
+			stream->cache_full_warned = true;
+		}
+
+		purge(stream);
+
+		/* the purge may have reached into memory */
+		if (stream->num_cached == stream->num_packets)
+			return false;
+		rp = &stream->spill->packets[stream->spill_idx];
+	}
+
+	struct encoder_packet pkt = rp->pkt;
+	obs_encoder_packet_release(&pkt);
+
+	rp->pkt.data = NULL;
+	rp->cache_pos = pos;
+	rp->cached = true;
+
+	stream->num_cached++;
+	stream->ram_size -= (int64_t)rp->pkt.size;
+	if (is_keyframe(&rp->pkt))
+		stream->ram_keyframes--;
+
+	advance(&stream->spill, &stream->spill_idx);
+	return true;
+}
+
+static void replay_buffer_spill(struct ffmpeg_muxer *stream)
+{
+	/* saves read the cache directly, so nothing may be written to it
+	 * until they're done. the memory tier just grows a bit meanwhile. */
+	if (!stream->cache || saving(stream))
+		return;
+
+	/* always keep the newest GOP in memory, and move at most one GOP
+	 * per packet so catching up after a save doesn't stall anything */
+	if (stream->ram_size <= stream->max_ram_size ||
+	    stream->ram_keyframes <= 1)
+		return;
+
+	do {
+		if (!spill_front(stream) ||
+		    stream->num_cached == stream->num_packets)
+			return;
+	} while (!is_keyframe(&stream->spill->packets[stream->spill_idx].pkt));
+}
+
+/* ------------------------------------------------------------------------ */
+/* saving */
+
+/* walks the packets of a single track within a save */
+struct replay_cursor {
+	struct replay_chunk *chunk;
 	size_t idx;
+	size_t left;
 
-	obs_encoder_packet_ref(&pkt, packet);
+	struct replay_packet *cur;
+	int64_t usec_offset;
+	int64_t dts_offset;
+};
 
-	if (pkt.type == OBS_ENCODER_VIDEO) {
-		pkt.dts_usec -= video_offset;
-		pkt.dts -= video_dts_offset;
-		pkt.pts -= video_dts_offset;
-	} else {
-		pkt.dts_usec -= audio_offsets[pkt.track_idx];
-		pkt.dts -= audio_dts_offsets[pkt.track_idx];
-		pkt.pts -= audio_dts_offsets[pkt.track_idx];
+/* track 0 is video, the rest are the audio tracks */
+#define REPLAY_TRACKS (MAX_AUDIO_MIXES + 1)
+
+static inline size_t packet_track(const struct encoder_packet *pkt)
+{
+	return pkt->type == OBS_ENCODER_VIDEO ? 0 : pkt->track_idx + 1;
+}
+
+static void cursor_next(struct replay_cursor *cursor, size_t track)
+{
+	cursor->cur = NULL;
+
+	while (cursor->left) {
+		struct replay_packet *rp =
+			&cursor->chunk->packets[cursor->idx];
+
+		cursor->left--;
+		if (cursor->left)
+			advance(&cursor->chunk, &cursor->idx);
+
+		if (packet_track(&rp->pkt) == track) {
+			cursor->cur = rp;
+			return;
+		}
+	}
+}
+
+static inline int64_t cursor_dts(const struct replay_cursor *cursor)
+{
+	return cursor->cur->pkt.dts_usec - cursor->usec_offset;
+}
+
+/* every track is already in order within the buffer, so merging them by
+ * timestamp takes a single pass per track */
+static void write_save_packets(struct ffmpeg_muxer *stream,
+			       struct replay_save *save)
+{
+	struct replay_cursor cursors[REPLAY_TRACKS];
+
+	for (size_t i = 0; i < REPLAY_TRACKS; i++) {
+		struct replay_cursor *cursor = &cursors[i];
+
+		cursor->chunk = save->chunk;
+		cursor->idx = save->idx;
+		cursor->left = save->num_packets;
+		cursor_next(cursor, i);
+
+		/* each track starts at 0 */
+		if (cursor->cur) {
+			cursor->usec_offset = cursor->cur->pkt.dts_usec;
+			cursor->dts_offset = cursor->cur->pkt.dts;
+		}
+	}
+
+	for (;;) {
+		struct replay_cursor *next = NULL;
+		size_t track = 0;
+
+		for (size_t i = 0; i < REPLAY_TRACKS; i++) {
+			struct replay_cursor *cursor = &cursors[i];
+			if (cursor->cur &&
+			    (!next || cursor_dts(cursor) < cursor_dts(next))) {
+				next = cursor;
+				track = i;
+			}
+		}
+
+		if (!next)
+			break;
+
+		struct replay_packet *rp = next->cur;
+		struct encoder_packet pkt = rp->pkt;
+
+		pkt.dts_usec -= next->usec_offset;
+		pkt.dts -= next->dts_offset;
+		pkt.pts -= next->dts_offset;
+
+		if (rp->cached && pkt.size)
+			pkt.data = replay_cache_data(stream->cache,
+						     rp->cache_pos);
+
+		if (!write_packet(stream, &pkt))
+			break;
+
+		cursor_next(next, track);
 	}
+}
+
+/* two saves in the same second would otherwise get the same name */
+static void make_path_unique(struct dstr *path)
+{
+	const char *slash = strrchr(path->array, '/');
+	const char *ext = strrchr(path->array, '.');
+	struct dstr unique = {0};
+	size_t base_len;
+
+	if (!os_file_exists(path->array))
+		return;
+
+	if (!ext || (slash && ext < slash))
+		ext = path->array + path->len;
+	base_len = ext - path->array;
 
-	for (idx = packets.num; idx > 0; idx--) {
-		struct encoder_packet *p = packets.array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
+	for (int i = 2;; i++) {
+		dstr_printf(&unique, "%.*s (%d)%s", (int)base_len, path->array,
+			    i, ext);
+		if (!os_file_exists(unique.array))
 			break;
 	}
 
-	da_insert(packets, idx, &pkt);
-	*array = packets.da;
+	dstr_move(path, &unique);
 }
 
-static void *replay_buffer_mux_thread(void *data)
+static bool send_change_file(struct ffmpeg_muxer *stream, const char *path)
 {
-	struct ffmpeg_muxer *stream = data;
+	size_t size = path ? strlen(path) : 0;
+	struct ffm_packet_info info = {.type = FFM_PACKET_CHANGE_FILE,
+				       .size = (uint32_t)size};
 
-	start_pipe(stream, stream->path.array);
+	if (!write_data(stream, (const uint8_t *)&info, sizeof(info)))
+		return false;
+	return !size || write_data(stream, (const uint8_t *)path, size);
+}
+
+static bool replay_buffer_open_file(struct ffmpeg_muxer *stream,
+				    const char *path)
+{
+	/* a muxer still running from the previous save only needs the new
+	 * path, its streams and headers don't change while the output is
+	 * active */
+	if (stream->pipe) {
+		dstr_copy(&stream->path, path);
+		if (send_change_file(stream, path))
+			return true;
+
+		warn("Could not send file '%s' to ffmpeg-mux", path);
+		return false;
+	}
+
+	start_pipe(stream, path);
 
 	if (!stream->pipe) {
 		warn("Failed to create process pipe");
-		goto error;
+		return false;
 	}
 
 	if (!send_headers(stream)) {
 		warn("Could not write headers for file '%s'",
 		     stream->path.array);
-		goto error;
+		return false;
 	}
 
-	for (size_t i = 0; i < stream->mux_packets.num; i++) {
-		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		write_packet(stream, pkt);
-		obs_encoder_packet_release(pkt);
+	return true;
+}
+
+/* the file is complete once this returns.  over shared memory the muxer
+ * can say so and stays around for the next save, over a plain pipe it has
+ * to exit for the parent to know */
+static bool replay_buffer_close_file(struct ffmpeg_muxer *stream)
+{
+#ifdef FFM_SHM_SUPPORTED
+	if (stream->shm) {
+		stream->files_done++;
+		if (send_change_file(stream, NULL) &&
+		    shm_wait_files_done(stream))
+			return true;
+
+		warn("ffmpeg-mux did not finish file '%s'",
+		     stream->path.array);
+		return false;
 	}
+#endif
+
+	stop_pipe(stream);
+	return true;
+}
+
+static void replay_buffer_write(struct ffmpeg_muxer *stream,
+				struct replay_save *save)
+{
+	make_path_unique(&save->path);
+
+	if (!replay_buffer_open_file(stream, save->path.array))
+		goto error;
+
+	write_save_packets(stream, save);
+
+	if (!replay_buffer_close_file(stream))
+		goto error;
+
+	int64_t save_ms =
+		(int64_t)((os_gettime_ns() - save->trigger_ns) / 1000000);
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	stream->last_save_ms = save_ms;
+	pthread_mutex_unlock(&stream->stats_mutex);
 
-	info("Wrote replay buffer to '%s'", stream->path.array);
+	info("Wrote replay buffer to '%s' (%.1f MB from memory, %.1f MB from "
+	     "disk, %" PRId64 " ms, %.2f ms packet stall)",
+	     stream->path.array, (double)save->ram_bytes / 1048576.0,
+	     (double)save->disk_bytes / 1048576.0, save_ms,
+	     (double)save->stall_ns / 1000000.0);
+	goto done;
 
 error:
-	os_process_pipe_destroy(stream->pipe);
-	stream->pipe = NULL;
-	da_free(stream->mux_packets);
-	os_atomic_set_bool(&stream->muxing, false);
-	return NULL;
+	/* the next save starts a new muxer */
+	stop_pipe(stream);
+
+done:
+	/* done with the packets and the cache */
+	chunk_release(save->chunk);
+	os_atomic_dec_long(&stream->active_saves);
+	dstr_free(&save->path);
 }
 
-static void replay_buffer_save(struct ffmpeg_muxer *stream)
+static void *replay_buffer_mux_thread(void *data)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
+	struct ffmpeg_muxer *stream = data;
 
-	da_reserve(stream->mux_packets, num_packets);
+	os_set_thread_name("replay-buffer-mux");
 
-	/* ---------------------------- */
-	/* reorder packets */
-
-	bool found_video = false;
-	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_dts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
-
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = circlebuf_data(&stream->packets, i * size);
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			if (!found_video) {
-				video_offset = pkt->dts_usec;
-				video_dts_offset = pkt->dts;
-				found_video = true;
-			}
-		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
-			}
+	for (;;) {
+		struct replay_save save;
+		bool have_save;
+
+		os_sem_wait(stream->saves_sem);
+
+		pthread_mutex_lock(&stream->saves_mutex);
+		have_save = stream->saves.num > 0;
+		if (have_save) {
+			save = stream->saves.array[0];
+			da_erase(stream->saves, 0);
 		}
+		pthread_mutex_unlock(&stream->saves_mutex);
+
+		if (!have_save) {
+			if (os_atomic_load_bool(&stream->stop_saving))
+				break;
+			continue;
+		}
+
+		replay_buffer_write(stream, &save);
+
+		pthread_mutex_lock(&stream->saves_mutex);
+		if (!stream->saves.num)
+			os_atomic_set_bool(&stream->muxing, false);
+		pthread_mutex_unlock(&stream->saves_mutex);
+	}
+
+	/* the muxer is kept running between saves */
+	stop_pipe(stream);
+	return NULL;
+}
 
-		insert_packet(&stream->mux_packets.da, pkt, video_offset,
-			      audio_offsets, video_dts_offset,
-			      audio_dts_offsets);
+/* takes a reference to the packets currently in the buffer and hands them
+ * to the mux thread, which does all of the actual work */
+static void replay_buffer_save(struct ffmpeg_muxer *stream)
+{
+	struct replay_save save = {0};
+
+	if (!stream->num_packets) {
+		info("Replay buffer is empty, nothing to save");
+		return;
 	}
 
+	save.trigger_ns = os_gettime_ns();
+	save.chunk = stream->head;
+	save.idx = stream->head_idx;
+	save.num_packets = stream->num_packets;
+	save.ram_bytes = stream->ram_size;
+	save.disk_bytes = stream->cur_size - stream->ram_size;
+
+	os_atomic_inc_long(&save.chunk->refs);
+	os_atomic_inc_long(&stream->active_saves);
+
 	/* ---------------------------- */
 	/* generate filename */
 
@@ -797,35 +1470,48 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 
 	char *filename = os_generate_formatted_filename(ext, space, fmt);
 
-	dstr_copy(&stream->path, dir);
-	dstr_replace(&stream->path, "\\", "/");
-	if (dstr_end(&stream->path) != '/')
-		dstr_cat_ch(&stream->path, '/');
-	dstr_cat(&stream->path, filename);
+	dstr_copy(&save.path, dir);
+	dstr_replace(&save.path, "\\", "/");
+	if (dstr_end(&save.path) != '/')
+		dstr_cat_ch(&save.path, '/');
+	dstr_cat(&save.path, filename);
 
 	bfree(filename);
 	obs_data_release(settings);
 
 	/* ---------------------------- */
 
+	save.stall_ns = os_gettime_ns() - save.trigger_ns;
+
+	pthread_mutex_lock(&stream->saves_mutex);
+	da_push_back(stream->saves, &save);
 	os_atomic_set_bool(&stream->muxing, true);
-	stream->mux_thread_joinable = pthread_create(&stream->mux_thread, NULL,
-						     replay_buffer_mux_thread,
-						     stream) == 0;
+	pthread_mutex_unlock(&stream->saves_mutex);
+
+	os_sem_post(stream->saves_sem);
 }
 
 static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
 {
-	if (code) {
-		obs_output_signal_stop(stream->output, code);
-	} else if (stopping(stream)) {
-		obs_output_end_data_capture(stream->output);
-	}
+	bool was_stopping = stopping(stream);
 
 	os_atomic_set_bool(&stream->active, false);
 	os_atomic_set_bool(&stream->sent_headers, false);
 	os_atomic_set_bool(&stream->stopping, false);
-	replay_buffer_clear(stream);
+
+	/* this runs on the encoder thread, so don't wait for queued saves
+	 * to be written. the mux thread keeps its own references to their
+	 * packets, and is joined (and the cache it reads from destroyed) on
+	 * the next start or when the output is destroyed. */
+	replay_buffer_end_saving(stream);
+	replay_buffer_reset(stream);
+	update_buffer_stats(stream);
+
+	if (code) {
+		obs_output_signal_stop(stream->output, code);
+	} else if (was_stopping) {
+		obs_output_end_data_capture(stream->output);
+	}
 }
 
 static void replay_buffer_data(void *data, struct encoder_packet *packet)
@@ -852,24 +1538,22 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 	obs_encoder_packet_ref(&pkt, packet);
 	replay_buffer_purge(stream, &pkt);
 
-	if (!stream->packets.size)
+	if (!stream->num_packets)
 		stream->cur_time = pkt.dts_usec;
 	stream->cur_size += pkt.size;
+	stream->ram_size += pkt.size;
 
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
+	push_packet(stream)->pkt = pkt;
 
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
+	if (is_keyframe(packet)) {
 		stream->keyframes++;
+		stream->ram_keyframes++;
+	}
 
-	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
-		if (os_atomic_load_bool(&stream->muxing))
-			return;
-
-		if (stream->mux_thread_joinable) {
-			pthread_join(stream->mux_thread, NULL);
-			stream->mux_thread_joinable = false;
-		}
+	replay_buffer_spill(stream);
+	update_buffer_stats(stream);
 
+	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
 		stream->save_ts = 0;
 		replay_buffer_save(stream);
 	}
@@ -879,6 +1563,8 @@ static void replay_buffer_defaults(obs_data_t *s)
 {
 	obs_data_set_default_int(s, "max_time_sec", 15);
 	obs_data_set_default_int(s, "max_size_mb", 500);
+	obs_data_set_default_int(s, "max_ram_mb", 256);
+	obs_data_set_default_int(s, "disk_cache_mb", 0);
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
@@ -44,8 +44,6 @@ struct nvenc_encoder {
 
 	AVFrame *vframe;
 
-	DARRAY(uint8_t) buffer;
-
 	uint8_t *header;
 	size_t header_size;
 
@@ -271,7 +269,6 @@ static void nvenc_destroy(void *data)
 	avcodec_close(enc->context);
 	av_frame_unref(enc->vframe);
 	av_frame_free(&enc->vframe);
-	da_free(enc->buffer);
 	bfree(enc->header);
 	bfree(enc->sei);
 
@@ -384,16 +381,17 @@ static bool nvenc_encode(void *data, struct encoder_frame *frame,
 						&enc->header, &enc->header_size,
 						&enc->sei, &enc->sei_size);
 
-			da_copy_array(enc->buffer, new_packet, size);
+			obs_encoder_packet_alloc(enc->encoder, packet, size);
+			memcpy(packet->data, new_packet, size);
 			bfree(new_packet);
 		} else {
-			da_copy_array(enc->buffer, av_pkt.data, av_pkt.size);
+			obs_encoder_packet_alloc(enc->encoder, packet,
+						 av_pkt.size);
+			memcpy(packet->data, av_pkt.data, av_pkt.size);
 		}
 
 		packet->pts = av_pkt.pts;
 		packet->dts = av_pkt.dts;
-		packet->data = enc->buffer.array;
-		packet->size = enc->buffer.num;
 		packet->type = OBS_ENCODER_VIDEO;
 		packet->keyframe = obs_avc_keyframe(packet->data, packet->size);
 		*received_packet = true;
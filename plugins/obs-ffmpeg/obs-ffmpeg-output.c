@@ -679,6 +679,65 @@ static inline void copy_data(AVFrame *pic, const struct video_data *frame,
 	}
 }
 
+static void release_video_buffer(void *opaque, uint8_t *data)
+{
+	video_buffer_release(opaque);
+	UNUSED_PARAMETER(data);
+}
+
+/* wraps the frame's buffer in a refcounted AVFrame so the encoder reads it
+ * in place.  the encoder may keep references to it, the buffer goes back to
+ * the video output once the last one is dropped */
+static AVFrame *wrap_video_frame(struct ffmpeg_output *output,
+				 struct video_data *frame)
+{
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
+	struct ffmpeg_data *data = &output->ff_data;
+	video_buffer_t *buffer;
+	AVFrame *vframe;
+
+#if LIBAVFORMAT_VERSION_MAJOR < 58
+	/* raw pictures are sent as the frame itself */
+	if (data->output->flags & AVFMT_RAWPICTURE)
+		return NULL;
+#endif
+
+	buffer = video_output_retain_frame(obs_output_video(output->output),
+					   frame);
+	if (!buffer)
+		return NULL;
+
+	vframe = av_frame_alloc();
+	if (vframe)
+		vframe->buf[0] = av_buffer_create(
+			frame->data[0],
+			(int)frame->linesize[0] * data->vframe->height,
+			release_video_buffer, buffer, AV_BUFFER_FLAG_READONLY);
+
+	if (!vframe || !vframe->buf[0]) {
+		av_frame_free(&vframe);
+		video_buffer_release(buffer);
+		return NULL;
+	}
+
+	av_frame_copy_props(vframe, data->vframe);
+	vframe->format = data->vframe->format;
+	vframe->width = data->vframe->width;
+	vframe->height = data->vframe->height;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		vframe->data[i] = frame->data[i];
+		vframe->linesize[i] = (int)frame->linesize[i];
+	}
+
+	return vframe;
+#else
+	UNUSED_PARAMETER(output);
+	UNUSED_PARAMETER(frame);
+	return NULL;
+#endif
+}
+
 static void receive_video(void *param, struct video_data *frame)
 {
 	struct ffmpeg_output *output = param;
@@ -689,6 +748,7 @@ static void receive_video(void *param, struct video_data *frame)
 		return;
 
 	AVCodecContext *context = data->video->codec;
+	AVFrame *vframe = NULL;
 	AVPacket packet = {0};
 	int ret = 0, got_packet;
 
@@ -699,13 +759,20 @@ static void receive_video(void *param, struct video_data *frame)
 	if (!data->start_timestamp)
 		data->start_timestamp = frame->timestamp;
 
-	if (!!data->swscale)
+	if (!!data->swscale) {
 		sws_scale(data->swscale, (const uint8_t *const *)frame->data,
 			  (const int *)frame->linesize, 0, data->config.height,
 			  data->vframe->data, data->vframe->linesize);
-	else
-		copy_data(data->vframe, frame, context->height,
-			  context->pix_fmt);
+	} else {
+		vframe = wrap_video_frame(output, frame);
+		if (!vframe)
+			copy_data(data->vframe, frame, context->height,
+				  context->pix_fmt);
+	}
+
+	if (!vframe)
+		vframe = data->vframe;
+
 #if LIBAVFORMAT_VERSION_MAJOR < 58
 	if (data->output->flags & AVFMT_RAWPICTURE) {
 		packet.flags |= AV_PKT_FLAG_KEY;
@@ -720,9 +787,9 @@ static void receive_video(void *param, struct video_data *frame)
 
 	} else {
 #endif
-		data->vframe->pts = data->total_frames;
+		vframe->pts = data->total_frames;
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 40, 101)
-		ret = avcodec_send_frame(context, data->vframe);
+		ret = avcodec_send_frame(context, vframe);
 		if (ret == 0)
 			ret = avcodec_receive_packet(context, &packet);
 
@@ -731,9 +798,12 @@ static void receive_video(void *param, struct video_data *frame)
 		if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN))
 			ret = 0;
 #else
-	ret = avcodec_encode_video2(context, &packet, data->vframe,
-				    &got_packet);
+	ret = avcodec_encode_video2(context, &packet, vframe, &got_packet);
 #endif
+		/* the encoder holds its own references to a wrapped frame */
+		if (vframe != data->vframe)
+			av_frame_free(&vframe);
+
 		if (ret < 0) {
 			blog(LOG_WARNING,
 			     "receive_video: Error encoding "
@@ -56,8 +56,6 @@ struct vaapi_encoder {
 
 	AVFrame *vframe;
 
-	DARRAY(uint8_t) buffer;
-
 	uint8_t *header;
 	size_t header_size;
 
@@ -307,7 +305,6 @@ static void vaapi_destroy(void *data)
 	av_frame_free(&enc->vframe);
 	av_buffer_unref(&enc->vaframes_ref);
 	av_buffer_unref(&enc->vadevice_ref);
-	da_free(enc->buffer);
 	bfree(enc->header);
 	bfree(enc->sei);
 
@@ -455,16 +452,17 @@ static bool vaapi_encode(void *data, struct encoder_frame *frame,
 						&enc->header, &enc->header_size,
 						&enc->sei, &enc->sei_size);
 
-			da_copy_array(enc->buffer, new_packet, size);
+			obs_encoder_packet_alloc(enc->encoder, packet, size);
+			memcpy(packet->data, new_packet, size);
 			bfree(new_packet);
 		} else {
-			da_copy_array(enc->buffer, av_pkt.data, av_pkt.size);
+			obs_encoder_packet_alloc(enc->encoder, packet,
+						 av_pkt.size);
+			memcpy(packet->data, av_pkt.data, av_pkt.size);
 		}
 
 		packet->pts = av_pkt.pts;
 		packet->dts = av_pkt.dts;
-		packet->data = enc->buffer.array;
-		packet->size = enc->buffer.num;
 		packet->type = OBS_ENCODER_VIDEO;
 		packet->keyframe = obs_avc_keyframe(packet->data, packet->size);
 		*received_packet = true;
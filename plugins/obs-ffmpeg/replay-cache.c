@@ -0,0 +1,234 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include "replay-cache.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+struct replay_cache {
+	uint8_t *data;
+	size_t capacity;
+	uint64_t head;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+#ifdef _WIN32
+static bool map_file(struct replay_cache *cache, const char *path)
+{
+	wchar_t *wpath = NULL;
+	LARGE_INTEGER size;
+
+	os_utf8_to_wcs_ptr(path, 0, &wpath);
+	if (!wpath)
+		return false;
+
+	/* the file only needs to live as long as the handle */
+	cache->file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+				  CREATE_NEW,
+				  FILE_ATTRIBUTE_TEMPORARY |
+					  FILE_FLAG_DELETE_ON_CLOSE,
+				  NULL);
+	bfree(wpath);
+
+	if (cache->file == INVALID_HANDLE_VALUE) {
+		cache->file = NULL;
+		blog(LOG_WARNING, "replay-cache: Failed to create '%s' (%lu)",
+		     path, GetLastError());
+		return false;
+	}
+
+	size.QuadPart = (LONGLONG)cache->capacity;
+	cache->mapping = CreateFileMappingW(cache->file, NULL, PAGE_READWRITE,
+					    size.HighPart, size.LowPart, NULL);
+	if (!cache->mapping) {
+		blog(LOG_WARNING, "replay-cache: Failed to allocate %s (%lu)",
+		     path, GetLastError());
+		return false;
+	}
+
+	cache->data = MapViewOfFile(cache->mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+				    cache->capacity);
+	if (!cache->data) {
+		blog(LOG_WARNING, "replay-cache: Failed to map '%s' (%lu)",
+		     path, GetLastError());
+		return false;
+	}
+
+	return true;
+}
+
+static void unmap_file(struct replay_cache *cache)
+{
+	if (cache->data)
+		UnmapViewOfFile(cache->data);
+	if (cache->mapping)
+		CloseHandle(cache->mapping);
+	if (cache->file)
+		CloseHandle(cache->file);
+}
+
+#else
+/* reserves disk blocks for the whole file rather than just setting its
+ * size, which on most filesystems only creates a sparse file */
+static int allocate_file(int fd, off_t size)
+{
+#ifdef __APPLE__
+	fstore_t store = {
+		.fst_flags = F_ALLOCATECONTIG | F_ALLOCATEALL,
+		.fst_posmode = F_PEOFPOSMODE,
+		.fst_length = size,
+	};
+
+	/* contiguous if possible, any free blocks otherwise */
+	if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+			return errno;
+	}
+
+	/* the blocks are reserved past the end of the file, the size still
+	 * has to be set */
+	return ftruncate(fd, size) == 0 ? 0 : errno;
+#else
+	return posix_fallocate(fd, 0, size);
+#endif
+}
+
+static bool map_file(struct replay_cache *cache, const char *path)
+{
+	void *data;
+	int ret;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1) {
+		blog(LOG_WARNING, "replay-cache: Failed to create '%s' (%d)",
+		     path, errno);
+		return false;
+	}
+
+	/* nothing else needs to see the file, and this way it goes away on
+	 * its own if we crash */
+	unlink(path);
+
+	/* allocate up front so a full disk shows up now rather than as a
+	 * SIGBUS in the middle of a spill */
+	ret = allocate_file(fd, (off_t)cache->capacity);
+	if (ret != 0) {
+		blog(LOG_WARNING, "replay-cache: Failed to allocate %s (%d)",
+		     path, ret);
+		close(fd);
+		return false;
+	}
+
+	data = mmap(NULL, cache->capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		blog(LOG_WARNING, "replay-cache: Failed to map '%s' (%d)", path,
+		     errno);
+		return false;
+	}
+
+	cache->data = data;
+	return true;
+}
+
+static void unmap_file(struct replay_cache *cache)
+{
+	if (cache->data)
+		munmap(cache->data, cache->capacity);
+}
+#endif
+
+struct replay_cache *replay_cache_create(const char *dir, size_t size)
+{
+	struct replay_cache *cache;
+	struct dstr path = {0};
+
+	if (!dir || !*dir || !size)
+		return NULL;
+
+	cache = bzalloc(sizeof(*cache));
+	cache->capacity = size;
+
+	dstr_copy(&path, dir);
+	dstr_replace(&path, "\\", "/");
+	if (dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	dstr_catf(&path, ".obs-replay-cache-%llu.tmp",
+		  (unsigned long long)os_gettime_ns());
+
+	if (!map_file(cache, path.array)) {
+		replay_cache_destroy(cache);
+		cache = NULL;
+	} else {
+		blog(LOG_INFO, "replay-cache: Using %d MB disk cache in '%s'",
+		     (int)(size / (1024 * 1024)), dir);
+	}
+
+	dstr_free(&path);
+	return cache;
+}
+
+void replay_cache_destroy(struct replay_cache *cache)
+{
+	if (cache) {
+		unmap_file(cache);
+		bfree(cache);
+	}
+}
+
+bool replay_cache_write(struct replay_cache *cache, const void *data,
+			size_t size, uint64_t tail, uint64_t *pos)
+{
+	uint64_t start = cache->head;
+	size_t offset = (size_t)(start % cache->capacity);
+
+	/* keep entries contiguous, skip the rest of the ring if needed */
+	if (offset + size > cache->capacity)
+		start += cache->capacity - offset;
+
+	if (start + size - tail > cache->capacity)
+		return false;
+
+	memcpy(cache->data + (size_t)(start % cache->capacity), data, size);
+	cache->head = start + size;
+	*pos = start;
+	return true;
+}
+
+uint64_t replay_cache_head(const struct replay_cache *cache)
+{
+	return cache->head;
+}
+
+uint8_t *replay_cache_data(struct replay_cache *cache, uint64_t pos)
+{
+	return cache->data + (size_t)(pos % cache->capacity);
+}
+
+bool replay_cache_contains(const struct replay_cache *cache, const void *data)
+{
+	const uint8_t *ptr = data;
+	return cache && ptr >= cache->data &&
+	       ptr < cache->data + cache->capacity;
+}
+
+size_t replay_cache_capacity(const struct replay_cache *cache)
+{
+	return cache->capacity;
+}
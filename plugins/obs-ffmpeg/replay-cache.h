@@ -0,0 +1,29 @@
+#pragma once
+
+#include <util/c99defs.h>
+
+/* Disk tier of the replay buffer.
+ *
+ * A preallocated file mapped into memory and used as a byte ring. Entries
+ * are addressed by monotonically increasing positions and are never split
+ * across the end of the ring, so every entry can be read straight from the
+ * mapping. The cache doesn't track what's stored in it: the caller passes
+ * the oldest position it still needs when writing. */
+
+struct replay_cache;
+
+struct replay_cache *replay_cache_create(const char *dir, size_t size);
+void replay_cache_destroy(struct replay_cache *cache);
+
+/* copies data into the ring without overwriting anything at or after
+ * tail, returns false if there isn't enough room */
+bool replay_cache_write(struct replay_cache *cache, const void *data,
+			size_t size, uint64_t tail, uint64_t *pos);
+
+/* position the next write will start at (or near, if it has to wrap) */
+uint64_t replay_cache_head(const struct replay_cache *cache);
+
+uint8_t *replay_cache_data(struct replay_cache *cache, uint64_t pos);
+bool replay_cache_contains(const struct replay_cache *cache,
+			   const void *data);
+size_t replay_cache_capacity(const struct replay_cache *cache);
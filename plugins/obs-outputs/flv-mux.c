@@ -180,19 +180,20 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+static inline uint8_t *write_b24(uint8_t *p, uint32_t val)
 {
-	int64_t offset = packet->pts - packet->dts;
-	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
-
-	if (!packet->data || !packet->size)
-		return;
-
-	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
+	p[0] = (uint8_t)(val >> 16);
+	p[1] = (uint8_t)(val >> 8);
+	p[2] = (uint8_t)val;
+	return p + 3;
+}
 
+static uint8_t *flv_tag_header(uint8_t *p, uint8_t type, uint32_t data_size,
+			       int32_t time_ms)
+{
 #ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Video: %lu", time_ms);
+	blog(LOG_DEBUG, "%s: %lu",
+	     type == RTMP_PACKET_TYPE_VIDEO ? "Video" : "Audio", time_ms);
 
 	if (last_time > time_ms)
 		blog(LOG_DEBUG, "Non-monotonic");
@@ -200,52 +201,54 @@ static void flv_video(struct serializer *s, int32_t dts_offset,
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)packet->size + 5);
-	s_wb24(s, time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
-
-	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
-	s_write(s, packet->data, packet->size);
-
-	/* write tag size (starting byte doesn't count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
+	*(p++) = type;
+	p = write_b24(p, data_size);
+	p = write_b24(p, (uint32_t)time_ms);
+	*(p++) = (time_ms >> 24) & 0x7F;
+	return write_b24(p, 0);
 }
 
-static void flv_audio(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+static size_t flv_video_header(uint8_t *header, int32_t dts_offset,
+			       struct encoder_packet *packet, bool is_header)
 {
+	int64_t offset = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+	uint8_t *p;
 
-	if (!packet->data || !packet->size)
-		return;
-
-	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
-
-#ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Audio: %lu", time_ms);
+	p = flv_tag_header(header, RTMP_PACKET_TYPE_VIDEO,
+			   (uint32_t)packet->size + 5, time_ms);
 
-	if (last_time > time_ms)
-		blog(LOG_DEBUG, "Non-monotonic");
+	/* these are the 5 extra bytes mentioned above */
+	*(p++) = packet->keyframe ? 0x17 : 0x27;
+	*(p++) = is_header ? 0 : 1;
+	p = write_b24(p, get_ms_time(packet, offset));
+	return p - header;
+}
 
-	last_time = time_ms;
-#endif
+static size_t flv_audio_header(uint8_t *header, int32_t dts_offset,
+			       struct encoder_packet *packet, bool is_header)
+{
+	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+	uint8_t *p;
 
-	s_wb24(s, (uint32_t)packet->size + 2);
-	s_wb24(s, time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
+	p = flv_tag_header(header, RTMP_PACKET_TYPE_AUDIO,
+			   (uint32_t)packet->size + 2, time_ms);
 
 	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
-	s_write(s, packet->data, packet->size);
+	*(p++) = 0xaf;
+	*(p++) = is_header ? 0 : 1;
+	return p - header;
+}
+
+size_t flv_packet_header(struct encoder_packet *packet, int32_t dts_offset,
+			 uint8_t *header, bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return 0;
 
-	/* write tag size (starting byte doesn't count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
+	return packet->type == OBS_ENCODER_VIDEO
+		       ? flv_video_header(header, dts_offset, packet, is_header)
+		       : flv_audio_header(header, dts_offset, packet, is_header);
 }
 
 void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
@@ -254,12 +257,19 @@ void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 	struct array_output_data data;
 	struct serializer s;
 
+	uint8_t header[FLV_MAX_PACKET_HEADER_SIZE];
+	size_t header_size;
+
 	array_output_serializer_init(&s, &data);
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		flv_video(&s, dts_offset, packet, is_header);
-	else
-		flv_audio(&s, dts_offset, packet, is_header);
+	header_size = flv_packet_header(packet, dts_offset, header, is_header);
+	if (header_size) {
+		s_write(&s, header, header_size);
+		s_write(&s, packet->data, packet->size);
+
+		/* write tag size (starting byte doesn't count) */
+		s_wb32(&s, (uint32_t)serializer_get_pos(&s) - 1);
+	}
 
 	*output = data.bytes.array;
 	*size = data.bytes.num;
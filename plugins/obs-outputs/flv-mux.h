@@ -32,3 +32,13 @@ extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 			  bool write_header, size_t audio_idx);
 extern void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 			   uint8_t **output, size_t *size, bool is_header);
+
+/* FLV tag header plus the codec bytes that precede the packet data */
+#define FLV_MAX_PACKET_HEADER_SIZE (11 + 5)
+
+/* writes the part of the FLV tag that precedes the packet data (the data
+ * itself and the trailing tag size are left to the caller), returns the
+ * header size or 0 if the packet has no data */
+extern size_t flv_packet_header(struct encoder_packet *packet,
+				int32_t dts_offset, uint8_t *header,
+				bool is_header);
@@ -165,6 +165,8 @@ static void HandleClientBW(RTMP *r, const RTMPPacket *packet);
 static int ReadN(RTMP *r, char *buffer, int n);
 static int WriteN(RTMP *r, const char *buffer, int n);
 
+#define RTMP_MAX_SEND_BUFS 64
+
 static void DecodeTEA(AVal *key, AVal *text);
 
 static int HTTP_Post(RTMP *r, RTMPTCmd cmd, const char *buf, int len);
@@ -4034,18 +4036,20 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* Encodes the chunk header of a packet so that it ends right at hend, and
+ * records the first byte of the basic header and the size of the channel id
+ * extension for use in continuation headers.  Returns the header size, or
+ * -1 on failure. */
+static int
+EncodePacketHeader(RTMP *r, RTMPPacket *packet, char *hend, char **header,
+                   char *basic, int *chanSize)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
     int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *hptr, c;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4056,7 +4060,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
             free(r->m_vecChannelsOut);
             r->m_vecChannelsOut = NULL;
             r->m_channelsAllocatedOut = 0;
-            return FALSE;
+            return -1;
         }
         r->m_vecChannelsOut = packets;
         memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
@@ -4082,7 +4086,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     {
         RTMP_Log(RTMP_LOGERROR, "sanity failed!! trying to send header of type: 0x%02x.",
                  (unsigned char)packet->m_headerType);
-        return FALSE;
+        return -1;
     }
 
     nSize = packetSize[packet->m_headerType];
@@ -4090,16 +4094,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     cSize = 0;
     t = packet->m_nTimeStamp - last;
 
-    if (packet->m_body)
-    {
-        header = packet->m_body - nSize;
-        hend = packet->m_body;
-    }
-    else
-    {
-        header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
-    }
+    *header = hend - nSize;
 
     if (packet->m_nChannel > 319)
         cSize = 2;
@@ -4107,17 +4102,17 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
         cSize = 1;
     if (cSize)
     {
-        header -= cSize;
+        *header -= cSize;
         hSize += cSize;
     }
 
     if (nSize > 1 && t >= 0xffffff)
     {
-        header -= 4;
+        *header -= 4;
         hSize += 4;
     }
 
-    hptr = header;
+    hptr = *header;
     c = packet->m_headerType << 6;
     switch (cSize)
     {
@@ -4156,6 +4151,27 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    *basic = c;
+    *chanSize = cSize;
+    return hSize;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    hSize = EncodePacketHeader(r, packet,
+                               packet->m_body ? packet->m_body : hbuf + sizeof(hbuf),
+                               &header, &c, &cSize);
+    if (hSize < 0)
+        return FALSE;
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -4480,6 +4496,50 @@ RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len)
     return rc;
 }
 
+/* Sends up to RTMP_MAX_SEND_BUFS buffers with a single call.  Only for
+ * plain sockets, TLS connections must use RTMPSockBuf_Send. */
+int
+RTMPSockBuf_SendV(RTMPSockBuf *sb, const AVal *bufs, int count)
+{
+    int i;
+#ifdef _WIN32
+    WSABUF wsabufs[RTMP_MAX_SEND_BUFS];
+    DWORD sent = 0;
+#else
+    struct iovec iov[RTMP_MAX_SEND_BUFS];
+    struct msghdr msg;
+#endif
+
+    if (count > RTMP_MAX_SEND_BUFS)
+        count = RTMP_MAX_SEND_BUFS;
+
+    for (i = 0; i < count; i++)
+    {
+#if defined(RTMP_NETSTACK_DUMP)
+        fwrite(bufs[i].av_val, 1, bufs[i].av_len, netstackdump);
+#endif
+#ifdef _WIN32
+        wsabufs[i].buf = bufs[i].av_val;
+        wsabufs[i].len = (ULONG)bufs[i].av_len;
+#else
+        iov[i].iov_base = bufs[i].av_val;
+        iov[i].iov_len = (size_t)bufs[i].av_len;
+#endif
+    }
+
+#ifdef _WIN32
+    if (WSASend(sb->sb_socket, wsabufs, (DWORD)count, &sent, 0, NULL,
+                NULL) == SOCKET_ERROR)
+        return -1;
+    return (int)sent;
+#else
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    return (int)sendmsg(sb->sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+}
+
 int
 RTMPSockBuf_Close(RTMPSockBuf *sb)
 {
@@ -5263,6 +5323,262 @@ fail:
 
 static const AVal av_setDataFrame = AVC("@setDataFrame");
 
+static int
+WriteNV(RTMP *r, AVal *bufs, int count)
+{
+    while (count > 0)
+    {
+        int nBytes = RTMPSockBuf_SendV(&r->m_sb, bufs, count);
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            r->last_error_code = sockerr;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip past whatever was sent */
+        while (count > 0 && nBytes >= bufs->av_len)
+        {
+            nBytes -= bufs->av_len;
+            bufs++;
+            count--;
+        }
+        if (count > 0)
+        {
+            bufs->av_val += nBytes;
+            bufs->av_len -= nBytes;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Sends buffers in order.  Plain sockets get them in a single gathered
+ * write, TLS gets them coalesced into full records, and a custom send
+ * function gets them one at a time. */
+static int
+SendBuffers(RTMP *r, AVal *bufs, int count)
+{
+    int i;
+
+#if defined(CRYPTO) && !defined(NO_SSL)
+    if (r->m_sb.sb_ssl && !(r->m_bCustomSend && r->m_customSendFunc))
+    {
+        char buf[RTMP_BUFFER_CACHE_SIZE];
+        int len = 0;
+
+        for (i = 0; i < count; i++)
+        {
+            const char *ptr = bufs[i].av_val;
+            int n = bufs[i].av_len;
+
+            while (n > 0)
+            {
+                int num = sizeof(buf) - len;
+                if (num > n)
+                    num = n;
+
+                memcpy(buf + len, ptr, num);
+                len += num;
+                ptr += num;
+                n -= num;
+
+                if (len == sizeof(buf))
+                {
+                    if (!WriteN(r, buf, len))
+                        return FALSE;
+                    len = 0;
+                }
+            }
+        }
+
+        return len ? WriteN(r, buf, len) : TRUE;
+    }
+#endif
+
+    if (r->m_bCustomSend && r->m_customSendFunc)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (!WriteN(r, bufs[i].av_val, bufs[i].av_len))
+                return FALSE;
+        }
+        return TRUE;
+    }
+
+    return WriteNV(r, bufs, count);
+}
+
+static int
+AddSendBuffer(RTMP *r, AVal *bufs, int *count, char *val, int len)
+{
+    if (*count == RTMP_MAX_SEND_BUFS)
+    {
+        if (!SendBuffers(r, bufs, *count))
+            return FALSE;
+        *count = 0;
+    }
+
+    bufs[*count].av_val = val;
+    bufs[*count].av_len = len;
+    (*count)++;
+    return TRUE;
+}
+
+/* transports that need the whole packet in one piece go through RTMP_Write */
+static int
+WriteVCopy(RTMP *r, const AVal *bufs, int count, int size, int streamIdx)
+{
+    char *buf = malloc(size + 4);
+    char *ptr = buf;
+    int i, ret;
+
+    if (!buf)
+        return -1;
+
+    for (i = 0; i < count; i++)
+    {
+        memcpy(ptr, bufs[i].av_val, bufs[i].av_len);
+        ptr += bufs[i].av_len;
+    }
+    AMF_EncodeInt32(ptr, buf + size + 4, size);
+
+    ret = RTMP_Write(r, buf, size + 4, streamIdx);
+    free(buf);
+    return ret > 0 ? ret : -1;
+}
+
+int
+RTMP_WriteV(RTMP *r, const AVal *bufs, int count, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    AVal sendBufs[RTMP_MAX_SEND_BUFS];
+    char hbuf[RTMP_MAX_HEADER_SIZE], cont[3];
+    char *header, c;
+    const char *tag;
+    int hSize, cSize, contSize;
+    int nChunkSize, chunkLeft, remaining;
+    int size = 0, numSendBufs = 0;
+    int bufIdx = 0, bufOff = 11;
+    int i;
+
+    if (count < 1 || bufs[0].av_len < 11)
+    {
+        /* FLV pkt too small */
+        return -1;
+    }
+
+    for (i = 0; i < count; i++)
+        size += bufs[i].av_len;
+
+    tag = bufs[0].av_val;
+    packet.m_packetType = tag[0];
+    packet.m_nBodySize = AMF_DecodeInt24(tag + 1);
+    packet.m_nTimeStamp = AMF_DecodeInt24(tag + 4);
+    packet.m_nTimeStamp |= tag[7] << 24;
+
+    if (packet.m_nBodySize != (uint32_t)(size - 11))
+    {
+        RTMP_Log(RTMP_LOGERROR, "%s, FLV tag size mismatch", __FUNCTION__);
+        return -1;
+    }
+
+    if (packet.m_packetType == RTMP_PACKET_TYPE_INFO ||
+            (r->Link.protocol & RTMP_FEATURE_HTTP))
+        return WriteVCopy(r, bufs, count, size, streamIdx);
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        return WriteVCopy(r, bufs, count, size, streamIdx);
+#endif
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+
+    if ((packet.m_packetType == RTMP_PACKET_TYPE_AUDIO
+            || packet.m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
+            !packet.m_nTimeStamp)
+        packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    else
+        packet.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+
+    hSize = EncodePacketHeader(r, &packet, hbuf + sizeof(hbuf), &header, &c,
+                               &cSize);
+    if (hSize < 0)
+        return -1;
+
+    /* continuation chunk header, shared by every chunk after the first */
+    contSize = 1 + cSize;
+    cont[0] = 0xc0 | c;
+    if (cSize)
+    {
+        int tmp = packet.m_nChannel - 64;
+        cont[1] = tmp & 0xff;
+        if (cSize == 2)
+            cont[2] = tmp >> 8;
+    }
+
+    if (!AddSendBuffer(r, sendBufs, &numSendBufs, header, hSize))
+        return -1;
+
+    nChunkSize = r->m_outChunkSize;
+    chunkLeft = nChunkSize;
+    remaining = packet.m_nBodySize;
+
+    while (remaining > 0)
+    {
+        int num;
+
+        while (bufOff == bufs[bufIdx].av_len)
+        {
+            bufIdx++;
+            bufOff = 0;
+        }
+
+        if (!chunkLeft)
+        {
+            if (!AddSendBuffer(r, sendBufs, &numSendBufs, cont, contSize))
+                return -1;
+            chunkLeft = nChunkSize;
+        }
+
+        num = bufs[bufIdx].av_len - bufOff;
+        if (num > chunkLeft)
+            num = chunkLeft;
+
+        if (!AddSendBuffer(r, sendBufs, &numSendBufs,
+                           bufs[bufIdx].av_val + bufOff, num))
+            return -1;
+
+        bufOff += num;
+        chunkLeft -= num;
+        remaining -= num;
+    }
+
+    if (!SendBuffers(r, sendBufs, numSendBufs))
+        return -1;
+
+    /* later headers are compressed against this one, so not keeping it
+     * would desync the stream */
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        r->m_vecChannelsOut[packet.m_nChannel] = malloc(sizeof(RTMPPacket));
+    if (!r->m_vecChannelsOut[packet.m_nChannel])
+        return -1;
+    memcpy(r->m_vecChannelsOut[packet.m_nChannel], &packet, sizeof(RTMPPacket));
+    return size;
+}
+
 int
 RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
 {
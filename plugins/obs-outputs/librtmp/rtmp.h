@@ -529,6 +529,7 @@ extern "C"
 
     int RTMPSockBuf_Fill(RTMPSockBuf *sb);
     int RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len);
+    int RTMPSockBuf_SendV(RTMPSockBuf *sb, const AVal *bufs, int count);
     int RTMPSockBuf_Close(RTMPSockBuf *sb);
 
     int RTMP_SendCreateStream(RTMP *r);
@@ -538,6 +539,12 @@ extern "C"
     void RTMP_DropRequest(RTMP *r, int i, int freeit);
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
+    /* Sends a single FLV tag given as a list of buffers: the first buffer
+     * starts with the 11 byte tag header, the rest of the buffers make up
+     * the tag body, and the trailing tag size is omitted.  The body is
+     * sent without being copied where the transport allows it.  Returns
+     * the number of bytes of the tag that were sent, or -1 on failure. */
+    int RTMP_WriteV(RTMP *r, const AVal *bufs, int count, int streamIdx);
 
 #ifdef USE_HASHSWF
     /* hashswf.c */
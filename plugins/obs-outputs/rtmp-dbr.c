@@ -0,0 +1,471 @@
+#include "rtmp-dbr.h"
+#include <util/bmem.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#endif
+
+#define SEC_TO_NSEC 1000000000ULL
+#define MSEC_TO_NSEC 1000000ULL
+#define MSEC_TO_USEC 1000ULL
+
+#define DBR_TRIGGER_USEC (200ULL * MSEC_TO_USEC)
+#define DBR_MIN_BITRATE 50
+#define MIN_ESTIMATE_DURATION_MS 1000
+#define MAX_ESTIMATE_DURATION_MS 2000
+#define MIN_RTT_WINDOW (10ULL * SEC_TO_NSEC)
+
+static inline long round_bitrate(long bitrate, long step)
+{
+	return bitrate / step * step;
+}
+
+static inline bool rtt_inflated(const struct dbr_controller *dbr)
+{
+	/* the socket buffer is filling up faster than the path drains it */
+	return dbr->rtt_usec && dbr->min_rtt_usec &&
+	       dbr->rtt_usec > dbr->min_rtt_usec * 2 + 20000;
+}
+
+/* ------------------------------------------------------------------------- */
+/* default: lower to the measured throughput once the output buffers more
+ * than DBR_TRIGGER_USEC, then step back up by 10% every 30 seconds.  the
+ * throughput is measured the way it always was, from the time the send
+ * thread spends in send() for each packet */
+
+#define DEFAULT_INC_TIMER (30ULL * SEC_TO_NSEC)
+
+struct default_dbr {
+	uint64_t inc_timeout;
+	long prev_bitrate;
+	long inc_bitrate;
+};
+
+static void *default_create(struct dbr_controller *dbr)
+{
+	struct default_dbr *d = bzalloc(sizeof(*d));
+	d->inc_bitrate = dbr->orig_bitrate / 10;
+	return d;
+}
+
+static long default_update(void *data, struct dbr_controller *dbr,
+			   uint64_t ts, int64_t queue_usec)
+{
+	struct default_dbr *d = data;
+	long new_bitrate;
+
+	if (d->inc_timeout && ts >= d->inc_timeout) {
+		d->inc_timeout = 0;
+		d->prev_bitrate = dbr->cur_bitrate;
+
+		new_bitrate = dbr->cur_bitrate + d->inc_bitrate;
+		if (new_bitrate < dbr->orig_bitrate)
+			d->inc_timeout = ts + DEFAULT_INC_TIMER;
+		return new_bitrate;
+	}
+
+	if ((uint64_t)queue_usec < DBR_TRIGGER_USEC)
+		return 0;
+
+	if (dbr->est_bitrate && dbr->est_bitrate < dbr->cur_bitrate) {
+		new_bitrate = round_bitrate(dbr->est_bitrate, 100);
+		if (new_bitrate < DBR_MIN_BITRATE)
+			new_bitrate = DBR_MIN_BITRATE;
+		dbr_reset_estimate(dbr);
+
+	} else if (d->prev_bitrate) {
+		new_bitrate = d->prev_bitrate;
+
+	} else {
+		return 0;
+	}
+
+	if (new_bitrate == dbr->cur_bitrate)
+		return 0;
+
+	d->prev_bitrate = 0;
+	d->inc_timeout = ts + DEFAULT_INC_TIMER;
+	return new_bitrate;
+}
+
+/* ------------------------------------------------------------------------- */
+/* aimd: once a second, back off multiplicatively on a standing queue or an
+ * inflated round trip time, otherwise creep back up additively */
+
+#define AIMD_INTERVAL (1ULL * SEC_TO_NSEC)
+#define AIMD_DECREASE_PERCENT 85
+#define AIMD_LOW_QUEUE_USEC (50ULL * MSEC_TO_USEC)
+
+struct aimd_dbr {
+	uint64_t next_ts;
+	long step;
+};
+
+static void *aimd_create(struct dbr_controller *dbr)
+{
+	struct aimd_dbr *a = bzalloc(sizeof(*a));
+	a->step = dbr->orig_bitrate / 20;
+	if (a->step < DBR_MIN_BITRATE)
+		a->step = DBR_MIN_BITRATE;
+	return a;
+}
+
+static long aimd_update(void *data, struct dbr_controller *dbr, uint64_t ts,
+			int64_t queue_usec)
+{
+	struct aimd_dbr *a = data;
+	long new_bitrate;
+
+	if (ts < a->next_ts)
+		return 0;
+
+	a->next_ts = ts + AIMD_INTERVAL;
+
+	if ((uint64_t)queue_usec >= DBR_TRIGGER_USEC || rtt_inflated(dbr)) {
+		new_bitrate = dbr->cur_bitrate * AIMD_DECREASE_PERCENT / 100;
+		if (dbr->est_bitrate && dbr->est_bitrate < new_bitrate)
+			new_bitrate = dbr->est_bitrate;
+		dbr_reset_estimate(dbr);
+
+		/* give the encoder and the network time to settle */
+		a->next_ts = ts + AIMD_INTERVAL * 2;
+		return round_bitrate(new_bitrate, 50);
+	}
+
+	if ((uint64_t)queue_usec < AIMD_LOW_QUEUE_USEC &&
+	    dbr->cur_bitrate < dbr->orig_bitrate)
+		return dbr->cur_bitrate + a->step;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* bbr: keep a windowed-max model of the delivery rate. On congestion, drop
+ * below the current delivery rate until the queue drains, then return to
+ * the modelled bottleneck bandwidth; periodically probe for more. Unlike
+ * TCP BBR it never lowers the bitrate just because the encoder produced
+ * less than asked for. */
+
+#define BBR_ROUND (1ULL * SEC_TO_NSEC)
+#define BBR_BW_ROUNDS 10
+#define BBR_PROBE_ROUNDS 8
+#define BBR_PROBE_GAIN 125
+#define BBR_DRAIN_GAIN 75
+#define BBR_DRAINED_USEC (50ULL * MSEC_TO_USEC)
+
+struct bbr_dbr {
+	uint64_t next_ts;
+	long bw[BBR_BW_ROUNDS];
+	size_t bw_idx;
+	size_t round;
+	bool draining;
+};
+
+static void *bbr_create(struct dbr_controller *dbr)
+{
+	UNUSED_PARAMETER(dbr);
+	return bzalloc(sizeof(struct bbr_dbr));
+}
+
+static long bbr_max_bw(const struct bbr_dbr *b)
+{
+	long max_bw = 0;
+	for (size_t i = 0; i < BBR_BW_ROUNDS; i++) {
+		if (b->bw[i] > max_bw)
+			max_bw = b->bw[i];
+	}
+	return max_bw;
+}
+
+static long bbr_update(void *data, struct dbr_controller *dbr, uint64_t ts,
+		       int64_t queue_usec)
+{
+	struct bbr_dbr *b = data;
+	long est = dbr->est_bitrate;
+	bool congested;
+
+	if (ts < b->next_ts)
+		return 0;
+
+	b->next_ts = ts + BBR_ROUND;
+	b->round++;
+
+	if (est) {
+		b->bw[b->bw_idx] = est;
+		b->bw_idx = (b->bw_idx + 1) % BBR_BW_ROUNDS;
+	}
+
+	congested = (uint64_t)queue_usec >= DBR_TRIGGER_USEC ||
+		    rtt_inflated(dbr);
+
+	/* the queue takes a while to drain after backing off, so only back
+	 * off further if the path can't even carry the drain rate */
+	if (b->draining && (!est || est >= dbr->cur_bitrate))
+		congested = false;
+
+	if (congested) {
+		long rate = est && est < dbr->cur_bitrate ? est
+							  : dbr->cur_bitrate;
+
+		/* the old model no longer describes the path */
+		memset(b->bw, 0, sizeof(b->bw));
+		b->bw_idx = 0;
+		if (est) {
+			b->bw[0] = est;
+			b->bw_idx = 1;
+		}
+
+		b->draining = true;
+		b->round = 0;
+		dbr_reset_estimate(dbr);
+		return round_bitrate(rate * BBR_DRAIN_GAIN / 100, 50);
+	}
+
+	if (b->draining) {
+		long max_bw = bbr_max_bw(b);
+
+		if ((uint64_t)queue_usec >= BBR_DRAINED_USEC || !max_bw)
+			return 0;
+
+		b->draining = false;
+		return max_bw > dbr->cur_bitrate ? round_bitrate(max_bw, 50)
+						 : 0;
+	}
+
+	/* only probe when the path keeps up with what is being sent */
+	if (b->round % BBR_PROBE_ROUNDS == 0 && est &&
+	    est >= dbr->cur_bitrate * 9 / 10 &&
+	    dbr->cur_bitrate < dbr->orig_bitrate)
+		return round_bitrate(dbr->cur_bitrate * BBR_PROBE_GAIN / 100,
+				     50);
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const struct dbr_policy_info policies[] = {
+	{
+		.id = DBR_DEFAULT_POLICY,
+		.name = "RTMPStream.DBRPolicy.Default",
+		.frame_estimate = true,
+		.create = default_create,
+		.destroy = bfree,
+		.update = default_update,
+	},
+	{
+		.id = "aimd",
+		.name = "RTMPStream.DBRPolicy.AIMD",
+		.create = aimd_create,
+		.destroy = bfree,
+		.update = aimd_update,
+	},
+	{
+		.id = "bbr",
+		.name = "RTMPStream.DBRPolicy.BBR",
+		.create = bbr_create,
+		.destroy = bfree,
+		.update = bbr_update,
+	},
+};
+
+#define NUM_POLICIES (sizeof(policies) / sizeof(policies[0]))
+
+size_t dbr_policy_count(void)
+{
+	return NUM_POLICIES;
+}
+
+const struct dbr_policy_info *dbr_get_policy(size_t idx)
+{
+	return idx < NUM_POLICIES ? &policies[idx] : NULL;
+}
+
+const struct dbr_policy_info *dbr_find_policy(const char *id)
+{
+	for (size_t i = 0; id && i < NUM_POLICIES; i++) {
+		if (strcmp(policies[i].id, id) == 0)
+			return &policies[i];
+	}
+
+	return NULL;
+}
+
+bool dbr_init(struct dbr_controller *dbr, const char *policy,
+	      long orig_bitrate, long audio_bitrate)
+{
+	dbr_free(dbr);
+
+	dbr->policy = dbr_find_policy(policy);
+	if (!dbr->policy)
+		dbr->policy = dbr_find_policy(DBR_DEFAULT_POLICY);
+
+	dbr->orig_bitrate = orig_bitrate;
+	dbr->audio_bitrate = audio_bitrate;
+	dbr->cur_bitrate = orig_bitrate;
+	dbr->policy_data = dbr->policy->create(dbr);
+
+	return dbr->policy == dbr_find_policy(policy);
+}
+
+void dbr_free(struct dbr_controller *dbr)
+{
+	if (dbr->policy)
+		dbr->policy->destroy(dbr->policy_data);
+
+	circlebuf_free(&dbr->samples);
+	circlebuf_free(&dbr->frames);
+	memset(dbr, 0, sizeof(*dbr));
+}
+
+static inline uint64_t sample_bytes(const struct dbr_sample *sample)
+{
+	return sample->bytes_acked ? sample->bytes_acked : sample->bytes_sent;
+}
+
+void dbr_add_sample(struct dbr_controller *dbr,
+		    const struct dbr_sample *sample)
+{
+	struct dbr_sample front;
+	uint64_t dur;
+
+	if (sample->rtt_usec) {
+		dbr->rtt_usec = sample->rtt_usec;
+
+		if (!dbr->min_rtt_usec ||
+		    sample->rtt_usec <= dbr->min_rtt_usec ||
+		    sample->ts - dbr->min_rtt_ts > MIN_RTT_WINDOW) {
+			dbr->min_rtt_usec = sample->rtt_usec;
+			dbr->min_rtt_ts = sample->ts;
+		}
+	}
+
+	/* the RTT is tracked for every policy, the throughput only for the
+	 * ones that don't measure it per packet */
+	if (!dbr->policy || dbr->policy->frame_estimate)
+		return;
+
+	circlebuf_push_back(&dbr->samples, sample, sizeof(*sample));
+	circlebuf_peek_front(&dbr->samples, &front, sizeof(front));
+
+	dur = (sample->ts - front.ts) / MSEC_TO_NSEC;
+
+	while (dur > MAX_ESTIMATE_DURATION_MS) {
+		circlebuf_pop_front(&dbr->samples, NULL, sizeof(front));
+		circlebuf_peek_front(&dbr->samples, &front, sizeof(front));
+		dur = (sample->ts - front.ts) / MSEC_TO_NSEC;
+	}
+
+	if (dur < MIN_ESTIMATE_DURATION_MS) {
+		dbr->est_bitrate = 0;
+		return;
+	}
+
+	/* bytes per millisecond * 8 = kbps */
+	dbr->est_bitrate =
+		(long)((sample_bytes(sample) - sample_bytes(&front)) * 8 / dur);
+
+	if (dbr->est_bitrate) {
+		dbr->est_bitrate -= dbr->audio_bitrate;
+		if (dbr->est_bitrate < DBR_MIN_BITRATE)
+			dbr->est_bitrate = DBR_MIN_BITRATE;
+	}
+}
+
+void dbr_add_frame(struct dbr_controller *dbr, const struct dbr_frame *frame)
+{
+	struct dbr_frame front;
+	uint64_t dur;
+
+	if (!dbr->policy || !dbr->policy->frame_estimate)
+		return;
+
+	circlebuf_push_back(&dbr->frames, frame, sizeof(*frame));
+	circlebuf_peek_front(&dbr->frames, &front, sizeof(front));
+
+	dbr->frames_size += frame->size;
+
+	dur = (frame->send_end - front.send_beg) / MSEC_TO_NSEC;
+
+	if (dur >= MAX_ESTIMATE_DURATION_MS) {
+		dbr->frames_size -= front.size;
+		circlebuf_pop_front(&dbr->frames, NULL, sizeof(front));
+	}
+
+	dbr->est_bitrate = (dur >= MIN_ESTIMATE_DURATION_MS)
+				   ? (long)(dbr->frames_size * 1000 / dur)
+				   : 0;
+	dbr->est_bitrate *= 8;
+	dbr->est_bitrate /= 1000;
+
+	if (dbr->est_bitrate) {
+		dbr->est_bitrate -= dbr->audio_bitrate;
+		if (dbr->est_bitrate < DBR_MIN_BITRATE)
+			dbr->est_bitrate = DBR_MIN_BITRATE;
+	}
+}
+
+void dbr_reset_estimate(struct dbr_controller *dbr)
+{
+	circlebuf_pop_front(&dbr->samples, NULL, dbr->samples.size);
+	circlebuf_pop_front(&dbr->frames, NULL, dbr->frames.size);
+	dbr->frames_size = 0;
+	dbr->est_bitrate = 0;
+}
+
+bool dbr_update(struct dbr_controller *dbr, uint64_t ts, int64_t queue_usec)
+{
+	long new_bitrate;
+
+	if (!dbr->policy)
+		return false;
+
+	new_bitrate = dbr->policy->update(dbr->policy_data, dbr, ts,
+					  queue_usec);
+	if (!new_bitrate)
+		return false;
+
+	if (new_bitrate > dbr->orig_bitrate)
+		new_bitrate = dbr->orig_bitrate;
+	if (new_bitrate < DBR_MIN_BITRATE)
+		new_bitrate = DBR_MIN_BITRATE;
+
+	/* reconfiguring the encoder isn't free, so don't bother with tiny
+	 * increases unless they get back to the original bitrate */
+	if (new_bitrate > dbr->cur_bitrate &&
+	    new_bitrate < dbr->orig_bitrate &&
+	    new_bitrate - dbr->cur_bitrate < dbr->cur_bitrate / 50)
+		return false;
+
+	if (new_bitrate == dbr->cur_bitrate)
+		return false;
+
+	dbr->cur_bitrate = new_bitrate;
+	return true;
+}
+
+void dbr_get_socket_info(int fd, struct dbr_sample *sample)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+	struct tcp_info info;
+	socklen_t size = sizeof(info);
+
+	memset(&info, 0, sizeof(info));
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &size) != 0)
+		return;
+
+	/* tcpi_bytes_acked only exists since Linux 4.1, older kernels
+	 * return a shorter struct */
+	if (size >= offsetof(struct tcp_info, tcpi_bytes_acked) +
+			    sizeof(info.tcpi_bytes_acked))
+		sample->bytes_acked = info.tcpi_bytes_acked;
+	sample->rtt_usec = info.tcpi_rtt;
+#else
+	UNUSED_PARAMETER(fd);
+	UNUSED_PARAMETER(sample);
+#endif
+}
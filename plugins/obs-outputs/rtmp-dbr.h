@@ -0,0 +1,91 @@
+#pragma once
+
+#include <util/c99defs.h>
+#include <util/circlebuf.h>
+
+/* Dynamic bitrate controller.
+ *
+ * The controller only deals in timestamps, byte counters and bitrates, so
+ * it has no dependency on the output itself and can be driven from
+ * recorded traces as well as from a live socket. All bitrates are in
+ * kbps and refer to the video encoder. */
+
+struct dbr_controller;
+
+struct dbr_sample {
+	uint64_t ts;          /* os_gettime_ns() */
+	uint64_t bytes_sent;  /* total bytes handed to the socket */
+	uint64_t bytes_acked; /* total bytes acked by the peer, 0 if unknown */
+	uint32_t rtt_usec;    /* smoothed round trip time, 0 if unknown */
+};
+
+/* time spent handing a single packet to the socket */
+struct dbr_frame {
+	uint64_t send_beg;
+	uint64_t send_end;
+	size_t size;
+};
+
+struct dbr_policy_info {
+	const char *id;
+	const char *name; /* locale key */
+
+	/* estimate the throughput from the time spent sending each packet
+	 * (dbr_add_frame) rather than from socket samples (dbr_add_sample) */
+	bool frame_estimate;
+
+	void *(*create)(struct dbr_controller *dbr);
+	void (*destroy)(void *data);
+
+	/* returns the desired bitrate, or 0 to keep the current one.
+	 * queue_usec is the duration of the data buffered in the output. */
+	long (*update)(void *data, struct dbr_controller *dbr, uint64_t ts,
+		       int64_t queue_usec);
+};
+
+struct dbr_controller {
+	const struct dbr_policy_info *policy;
+	void *policy_data;
+
+	long orig_bitrate;
+	long audio_bitrate;
+	long cur_bitrate;
+
+	/* throughput estimate minus audio, 0 until enough samples exist */
+	long est_bitrate;
+	struct circlebuf samples;
+	struct circlebuf frames;
+	uint64_t frames_size;
+
+	uint32_t rtt_usec;
+	uint32_t min_rtt_usec;
+	uint64_t min_rtt_ts;
+
+	uint64_t last_decrease_ts;
+};
+
+#define DBR_DEFAULT_POLICY "default"
+
+size_t dbr_policy_count(void);
+const struct dbr_policy_info *dbr_get_policy(size_t idx);
+const struct dbr_policy_info *dbr_find_policy(const char *id);
+
+/* falls back to the default policy and returns false if the requested one
+ * doesn't exist */
+bool dbr_init(struct dbr_controller *dbr, const char *policy,
+	      long orig_bitrate, long audio_bitrate);
+void dbr_free(struct dbr_controller *dbr);
+
+void dbr_add_sample(struct dbr_controller *dbr,
+		    const struct dbr_sample *sample);
+void dbr_add_frame(struct dbr_controller *dbr, const struct dbr_frame *frame);
+
+/* drops the throughput estimate, e.g. after the bitrate was lowered */
+void dbr_reset_estimate(struct dbr_controller *dbr);
+
+/* returns true if cur_bitrate changed and the encoder should be updated */
+bool dbr_update(struct dbr_controller *dbr, uint64_t ts, int64_t queue_usec);
+
+/* fills in bytes_acked and rtt_usec from the socket if the platform can
+ * report them */
+void dbr_get_socket_info(int fd, struct dbr_sample *sample);
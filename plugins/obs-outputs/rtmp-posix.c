@@ -0,0 +1,553 @@
+#ifndef _WIN32
+#include "rtmp-stream.h"
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define HAVE_ZEROCOPY 1
+#else
+#define HAVE_ZEROCOPY 0
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0
+#endif
+
+/* zero-copy only pays for itself once the page pinning and completion
+ * notification are cheaper than the copy they replace */
+#define ZEROCOPY_MIN_SEND_SIZE (32 * 1024)
+#define MIN_NOTSENT_LOWAT (16 * 1024)
+#define IDLE_WAIT_MS 50
+
+struct zerocopy_send {
+	uint32_t id;
+	size_t size;
+	bool zerocopy;
+	bool done;
+};
+
+struct posix_send_state {
+	int fd;
+	bool tls;
+	size_t tls_retry_size;
+	bool zerocopy;
+	uint32_t next_zerocopy_id;
+
+	/* bytes at the start of the ring that were handed to the kernel
+	 * with MSG_ZEROCOPY (or queued behind such a send) and must not be
+	 * overwritten until the kernel reports completion */
+	size_t in_flight;
+	struct circlebuf sends;
+};
+
+static void fatal_sock_shutdown(struct rtmp_stream *stream)
+{
+	close(stream->rtmp.m_sb.sb_socket);
+	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_start = 0;
+	stream->write_buf_len = 0;
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+static inline void release_write_buf(struct rtmp_stream *stream, size_t size)
+{
+	stream->write_buf_start =
+		(stream->write_buf_start + size) % stream->write_buf_size;
+	stream->write_buf_len -= size;
+}
+
+#if HAVE_ZEROCOPY
+static void release_completed_sends(struct rtmp_stream *stream,
+				    struct posix_send_state *state)
+{
+	size_t released = 0;
+
+	while (state->sends.size) {
+		struct zerocopy_send *send = circlebuf_data(&state->sends, 0);
+		if (send->zerocopy && !send->done)
+			break;
+
+		released += send->size;
+		circlebuf_pop_front(&state->sends, NULL, sizeof(*send));
+	}
+
+	if (!released)
+		return;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+	release_write_buf(stream, released);
+	state->in_flight -= released;
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+static void mark_sends_complete(struct posix_send_state *state, uint32_t lo,
+				uint32_t hi)
+{
+	size_t count = state->sends.size / sizeof(struct zerocopy_send);
+
+	for (size_t i = 0; i < count; i++) {
+		struct zerocopy_send *send = circlebuf_data(
+			&state->sends, i * sizeof(struct zerocopy_send));
+
+		if (send->zerocopy && (int32_t)(send->id - lo) >= 0 &&
+		    (int32_t)(hi - send->id) >= 0)
+			send->done = true;
+	}
+}
+
+/* returns false if the error queue held no zero-copy notifications, in
+ * which case POLLERR reported an actual socket error */
+static bool read_zerocopy_completions(struct rtmp_stream *stream,
+				      struct posix_send_state *state)
+{
+	bool found = false;
+
+	for (;;) {
+		char control[128];
+		struct msghdr msg = {0};
+		struct cmsghdr *cm;
+
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(state->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err *serr;
+
+			if (!((cm->cmsg_level == SOL_IP &&
+			       cm->cmsg_type == IP_RECVERR) ||
+			      (cm->cmsg_level == SOL_IPV6 &&
+			       cm->cmsg_type == IPV6_RECVERR)))
+				continue;
+
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_errno != 0 ||
+			    serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			/* the kernel had to copy the data anyway (loopback,
+			 * or a device without scatter-gather), so zero-copy
+			 * is only adding overhead */
+			if (state->zerocopy &&
+			    (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)) {
+				blog(LOG_INFO, "socket_thread_posix: Kernel "
+					       "copied zero-copy send, "
+					       "disabling zero-copy");
+				state->zerocopy = false;
+			}
+
+			mark_sends_complete(state, serr->ee_info,
+					    serr->ee_data);
+			found = true;
+		}
+	}
+
+	if (found)
+		release_completed_sends(stream, state);
+	return found;
+}
+
+static void init_zerocopy(struct rtmp_stream *stream,
+			  struct posix_send_state *state)
+{
+	int one = 1;
+
+	if (!stream->zerocopy)
+		return;
+
+	if (setsockopt(state->fd, SOL_SOCKET, SO_ZEROCOPY, &one,
+		       sizeof(one)) != 0) {
+		blog(LOG_WARNING,
+		     "socket_thread_posix: Zero-copy not supported "
+		     "by the kernel, errno %d",
+		     errno);
+		return;
+	}
+
+	state->zerocopy = true;
+	blog(LOG_INFO, "socket_thread_posix: Zero-copy enabled by user");
+}
+#else
+static inline bool read_zerocopy_completions(struct rtmp_stream *stream,
+					     struct posix_send_state *state)
+{
+	UNUSED_PARAMETER(stream);
+	UNUSED_PARAMETER(state);
+	return false;
+}
+
+static inline void init_zerocopy(struct rtmp_stream *stream,
+				 struct posix_send_state *state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (stream->zerocopy)
+		blog(LOG_WARNING, "socket_thread_posix: Zero-copy not "
+				  "supported on this platform");
+}
+#endif
+
+static void set_notsent_lowat(struct rtmp_stream *stream, int fd)
+{
+#ifdef TCP_NOTSENT_LOWAT
+	/* keep unsent data in our own buffer rather than letting the kernel
+	 * send buffer absorb it, so congestion shows up in write_buf_len and
+	 * frame dropping / dynamic bitrate can react to it */
+	int lowat = (int)(stream->write_buf_size / 4);
+	if (lowat < MIN_NOTSENT_LOWAT)
+		lowat = MIN_NOTSENT_LOWAT;
+
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat,
+		       sizeof(lowat)) != 0)
+		blog(LOG_WARNING,
+		     "socket_thread_posix: Failed to set "
+		     "TCP_NOTSENT_LOWAT, errno %d",
+		     errno);
+#else
+	UNUSED_PARAMETER(stream);
+	UNUSED_PARAMETER(fd);
+#endif
+}
+
+static bool socket_event(struct rtmp_stream *stream, short revents,
+			 struct posix_send_state *state,
+			 uint64_t last_send_time)
+{
+	if ((revents & POLLERR) && !read_zerocopy_completions(stream, state)) {
+		int err_code = 0;
+		socklen_t size = sizeof(err_code);
+
+		getsockopt(state->fd, SOL_SOCKET, SO_ERROR, &err_code, &size);
+		blog(LOG_ERROR,
+		     "socket_thread_posix: Aborting due to "
+		     "socket error %d",
+		     err_code);
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+
+	if (revents & (POLLHUP | POLLNVAL)) {
+		if (last_send_time) {
+			uint32_t diff =
+				(os_gettime_ns() / 1000000) - last_send_time;
+
+			blog(LOG_ERROR,
+			     "socket_thread_posix: Received "
+			     "POLLHUP, %u ms since last send "
+			     "(buffer: %d / %d)",
+			     diff, (int)stream->write_buf_len,
+			     (int)stream->write_buf_size);
+		}
+
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			blog(LOG_ERROR,
+			     "socket_thread_posix: Aborting due "
+			     "to POLLHUP during shutdown, "
+			     "%d bytes lost",
+			     (int)stream->write_buf_len);
+		else
+			blog(LOG_ERROR, "socket_thread_posix: Aborting due "
+					"to POLLHUP");
+
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+
+	if (revents & POLLIN) {
+		char discard[16384];
+
+		for (;;) {
+			ssize_t ret = recv(state->fd, discard, sizeof(discard),
+					   MSG_DONTWAIT);
+			if (ret > 0)
+				continue;
+			if (ret == -1 && (errno == EAGAIN ||
+					  errno == EWOULDBLOCK ||
+					  errno == EINTR))
+				break;
+
+			int err_code = ret == -1 ? errno : 0;
+			blog(LOG_ERROR,
+			     "socket_thread_posix: "
+			     "Socket error, recv() returned "
+			     "%d, errno %d",
+			     (int)ret, err_code);
+			stream->rtmp.last_error_code = err_code;
+			fatal_sock_shutdown(stream);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+enum data_ret { RET_BREAK, RET_FATAL, RET_CONTINUE };
+
+/* on a non-blocking socket the TLS layer reports a full send buffer with its
+ * own codes rather than EAGAIN */
+static inline bool tls_would_block(ssize_t ret)
+{
+#if defined(CRYPTO) && defined(USE_MBEDTLS)
+	return ret == MBEDTLS_ERR_SSL_WANT_WRITE ||
+	       ret == MBEDTLS_ERR_SSL_WANT_READ;
+#else
+	UNUSED_PARAMETER(ret);
+	return false;
+#endif
+}
+
+static enum data_ret write_data(struct rtmp_stream *stream,
+				struct posix_send_state *state,
+				uint64_t *last_send_time,
+				size_t latency_packet_size, int delay_time)
+{
+	bool exit_loop = false;
+	struct iovec iov[2];
+	struct msghdr msg = {0};
+	int flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+	ssize_t ret;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	size_t unsent = stream->write_buf_len - state->in_flight;
+	if (!unsent) {
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		return RET_BREAK;
+	}
+
+	if (stream->low_latency_mode && unsent > latency_packet_size)
+		unsent = latency_packet_size;
+
+	/* send both halves of a wrapped ring in a single call */
+	size_t pos = (stream->write_buf_start + state->in_flight) %
+		     stream->write_buf_size;
+	size_t first = stream->write_buf_size - pos;
+	if (first > unsent)
+		first = unsent;
+
+	iov[0].iov_base = stream->write_buf + pos;
+	iov[0].iov_len = first;
+	iov[1].iov_base = stream->write_buf;
+	iov[1].iov_len = unsent - first;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	/* the producer only ever appends past the unsent data, so the region
+	 * being sent can be read without holding the lock */
+#if HAVE_ZEROCOPY
+	bool zerocopy = state->zerocopy && unsent >= ZEROCOPY_MIN_SEND_SIZE;
+#else
+	const bool zerocopy = false;
+#endif
+
+	if (state->tls) {
+		/* the data has to go through the TLS layer, one piece of the
+		 * ring at a time.  a write the TLS layer couldn't finish has
+		 * to be retried with the same data */
+		size_t size = state->tls_retry_size ? state->tls_retry_size
+						    : iov[0].iov_len;
+
+		ret = RTMPSockBuf_Send(&stream->rtmp.m_sb, iov[0].iov_base,
+				       (int)size);
+		state->tls_retry_size = tls_would_block(ret) ? size : 0;
+	} else {
+		ret = sendmsg(state->fd, &msg,
+			      flags | (zerocopy ? MSG_ZEROCOPY : 0));
+#if HAVE_ZEROCOPY
+		if (ret == -1 && zerocopy && errno == ENOBUFS) {
+			/* out of locked memory for pinned pages, copy
+			 * instead */
+			zerocopy = false;
+			ret = sendmsg(state->fd, &msg, flags);
+		}
+#endif
+	}
+
+	if (ret > 0) {
+		if (zerocopy || state->in_flight) {
+			/* completions release the ring in send order, so
+			 * plain sends queued behind a zero-copy send have to
+			 * wait for it as well */
+			struct zerocopy_send send = {
+				.id = zerocopy ? state->next_zerocopy_id++ : 0,
+				.size = (size_t)ret,
+				.zerocopy = zerocopy,
+			};
+
+			circlebuf_push_back(&state->sends, &send,
+					    sizeof(send));
+
+			pthread_mutex_lock(&stream->write_buf_mutex);
+			state->in_flight += (size_t)ret;
+		} else {
+			pthread_mutex_lock(&stream->write_buf_mutex);
+			release_write_buf(stream, (size_t)ret);
+			os_event_signal(stream->buffer_space_available_event);
+		}
+
+		*last_send_time = os_gettime_ns() / 1000000;
+
+	} else if (state->tls ? tls_would_block(ret)
+			      : ret == -1 && (errno == EAGAIN ||
+					      errno == EWOULDBLOCK)) {
+		return RET_BREAK;
+
+	} else if (!state->tls && ret == -1 && errno == EINTR) {
+		return RET_CONTINUE;
+
+	} else {
+		/* connection closed, or connection was aborted /
+		 * socket closed / etc, that's a fatal error.  the TLS layer
+		 * returns its own error codes rather than setting errno */
+		int err_code = state->tls ? (int)ret : ret == -1 ? errno : 0;
+
+		blog(LOG_ERROR,
+		     "socket_thread_posix: "
+		     "Socket error, send() returned %d, "
+		     "errno %d",
+		     (int)ret, err_code);
+
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return RET_FATAL;
+	}
+
+	/* finish writing for now */
+	if (stream->write_buf_len - state->in_flight <= 1000)
+		exit_loop = true;
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	if (delay_time)
+		os_sleep_ms(delay_time);
+
+	return exit_loop ? RET_BREAK : RET_CONTINUE;
+}
+
+#define LATENCY_FACTOR 20
+
+static inline void socket_thread_posix_internal(struct rtmp_stream *stream)
+{
+	struct posix_send_state state = {0};
+
+	int delay_time;
+	size_t latency_packet_size;
+	uint64_t last_send_time = 0;
+
+	os_set_thread_name("rtmp-stream: socket_thread_posix");
+
+	state.fd = stream->rtmp.m_sb.sb_socket;
+	state.tls = stream->rtmp.m_sb.sb_ssl != NULL;
+
+	set_notsent_lowat(stream, state.fd);
+
+	/* the TLS layer encrypts into its own buffer, so there is nothing for
+	 * zero-copy to save */
+	if (!state.tls)
+		init_zerocopy(stream, &state);
+	else if (stream->zerocopy)
+		blog(LOG_INFO, "socket_thread_posix: Zero-copy is not used "
+			       "for TLS connections");
+
+	if (stream->low_latency_mode) {
+		delay_time = 1000 / LATENCY_FACTOR;
+		latency_packet_size =
+			stream->write_buf_size / (LATENCY_FACTOR - 2);
+	} else {
+		latency_packet_size = stream->write_buf_size;
+		delay_time = 0;
+	}
+
+	for (;;) {
+		size_t queued;
+		size_t unsent;
+
+		pthread_mutex_lock(&stream->write_buf_mutex);
+		queued = stream->write_buf_len;
+		unsent = queued - state.in_flight;
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+
+		if (!queued &&
+		    os_event_try(stream->send_thread_signaled_exit) != EAGAIN) {
+			os_event_reset(stream->send_thread_signaled_exit);
+			break;
+		}
+
+		struct pollfd pfd = {.fd = state.fd, .events = POLLIN};
+		int timeout = 0;
+
+		if (unsent) {
+			/* with TCP_NOTSENT_LOWAT set, POLLOUT is held back
+			 * until the kernel has drained most of what it was
+			 * given, which paces the sends */
+			pfd.events |= POLLOUT;
+			timeout = IDLE_WAIT_MS;
+		} else {
+			/* nothing to send: sleep on the producer rather than
+			 * the socket, waking up periodically to notice the
+			 * connection closing or zero-copy completions */
+			os_event_timedwait(stream->buffer_has_data_event,
+					   state.in_flight ? 1 : IDLE_WAIT_MS);
+		}
+
+		int status = poll(&pfd, 1, timeout);
+		if (status < 0 && errno != EINTR) {
+			blog(LOG_ERROR,
+			     "socket_thread_posix: Aborting due "
+			     "to poll() failure, errno %d",
+			     errno);
+			fatal_sock_shutdown(stream);
+			break;
+		}
+
+		if (status <= 0)
+			continue;
+
+		if (!socket_event(stream, pfd.revents, &state, last_send_time))
+			break;
+
+		if (!(pfd.revents & POLLOUT))
+			continue;
+
+		for (;;) {
+			enum data_ret ret = write_data(stream, &state,
+						       &last_send_time,
+						       latency_packet_size,
+						       delay_time);
+
+			if (ret == RET_FATAL)
+				goto exit_thread;
+			if (ret == RET_BREAK)
+				break;
+		}
+	}
+
+exit_thread:
+	circlebuf_free(&state.sends);
+
+	blog(LOG_INFO, "socket_thread_posix: Normal exit");
+}
+
+void *socket_thread_posix(void *data)
+{
+	struct rtmp_stream *stream = data;
+	socket_thread_posix_internal(stream);
+	return NULL;
+}
+#endif
@@ -30,10 +30,7 @@
 #endif
 
 /* dynamic bitrate coefficients */
-#define DBR_INC_TIMER (30ULL * SEC_TO_NSEC)
-#define DBR_TRIGGER_USEC (200ULL * MSEC_TO_USEC)
-#define MIN_ESTIMATE_DURATION_MS 1000
-#define MAX_ESTIMATE_DURATION_MS 2000
+#define DBR_SAMPLE_INTERVAL (20ULL * MSEC_TO_NSEC)
 
 static const char *rtmp_stream_getname(void *unused)
 {
@@ -125,7 +122,7 @@ static void rtmp_stream_destroy(void *data)
 #ifdef TEST_FRAMEDROPS
 	circlebuf_free(&stream->droptest_info);
 #endif
-	circlebuf_free(&stream->dbr_frames);
+	dbr_free(&stream->dbr);
 	pthread_mutex_destroy(&stream->dbr_mutex);
 
 	os_event_destroy(stream->buffer_space_available_event);
@@ -388,7 +385,18 @@ retry_send:
 		goto retry_send;
 	}
 
-	memcpy(stream->write_buf + stream->write_buf_len, data, len);
+	size_t pos = (stream->write_buf_start + stream->write_buf_len) %
+		     stream->write_buf_size;
+	size_t first = stream->write_buf_size - pos;
+
+	/* write_buf is a ring, the socket thread consumes it from
+	 * write_buf_start without moving the remaining data */
+	if (first >= (size_t)len) {
+		memcpy(stream->write_buf + pos, data, len);
+	} else {
+		memcpy(stream->write_buf + pos, data, first);
+		memcpy(stream->write_buf, data + first, len - first);
+	}
 	stream->write_buf_len += len;
 
 	pthread_mutex_unlock(&stream->write_buf_mutex);
@@ -402,8 +410,9 @@ static int send_packet(struct rtmp_stream *stream,
 		       struct encoder_packet *packet, bool is_header,
 		       size_t idx)
 {
-	uint8_t *data;
-	size_t size;
+	uint8_t header[FLV_MAX_PACKET_HEADER_SIZE];
+	size_t header_size;
+	size_t size = 0;
 	int recv_size = 0;
 	int ret = 0;
 
@@ -423,15 +432,26 @@ static int send_packet(struct rtmp_stream *stream,
 		}
 	}
 
-	flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset, &data,
-		       &size, is_header);
+	/* only the FLV tag header is built here, the packet data is handed
+	 * to librtmp as-is */
+	header_size = flv_packet_header(
+		packet, is_header ? 0 : stream->start_dts_offset, header,
+		is_header);
+	if (header_size) {
+		AVal bufs[2] = {{(char *)header, (int)header_size},
+				{(char *)packet->data, (int)packet->size}};
+
+		/* FLV tag size, including the trailing tag size */
+		size = header_size + packet->size + 4;
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, (int)idx);
-	bfree(data);
+		ret = RTMP_WriteV(&stream->rtmp, bufs, 2, (int)idx);
+	} else {
+		ret = 0;
+	}
 
 	if (is_header)
 		bfree(packet->data);
@@ -530,35 +550,21 @@ static void set_output_error(struct rtmp_stream *stream)
 		obs_output_set_last_error(stream->output, msg);
 }
 
-static void dbr_add_frame(struct rtmp_stream *stream, struct dbr_frame *back)
+static void dbr_add_socket_sample(struct rtmp_stream *stream)
 {
-	struct dbr_frame front;
-	uint64_t dur;
-
-	circlebuf_push_back(&stream->dbr_frames, back, sizeof(*back));
-	circlebuf_peek_front(&stream->dbr_frames, &front, sizeof(front));
-
-	stream->dbr_data_size += back->size;
+	struct dbr_sample sample = {0};
 
-	dur = (back->send_end - front.send_beg) / 1000000;
+	sample.ts = os_gettime_ns();
+	if (sample.ts - stream->dbr_last_sample < DBR_SAMPLE_INTERVAL)
+		return;
 
-	if (dur >= MAX_ESTIMATE_DURATION_MS) {
-		stream->dbr_data_size -= front.size;
-		circlebuf_pop_front(&stream->dbr_frames, NULL, sizeof(front));
-	}
+	stream->dbr_last_sample = sample.ts;
+	sample.bytes_sent = stream->total_bytes_sent;
+	dbr_get_socket_info((int)stream->rtmp.m_sb.sb_socket, &sample);
 
-	stream->dbr_est_bitrate =
-		(dur >= MIN_ESTIMATE_DURATION_MS)
-			? (long)(stream->dbr_data_size * 1000 / dur)
-			: 0;
-	stream->dbr_est_bitrate *= 8;
-	stream->dbr_est_bitrate /= 1000;
-
-	if (stream->dbr_est_bitrate) {
-		stream->dbr_est_bitrate -= stream->audio_bitrate;
-		if (stream->dbr_est_bitrate < 50)
-			stream->dbr_est_bitrate = 50;
-	}
+	pthread_mutex_lock(&stream->dbr_mutex);
+	dbr_add_sample(&stream->dbr, &sample);
+	pthread_mutex_unlock(&stream->dbr_mutex);
 }
 
 static void dbr_set_bitrate(struct rtmp_stream *stream);
@@ -608,8 +614,10 @@ static void *send_thread(void *data)
 			dbr_frame.send_end = os_gettime_ns();
 
 			pthread_mutex_lock(&stream->dbr_mutex);
-			dbr_add_frame(stream, &dbr_frame);
+			dbr_add_frame(&stream->dbr, &dbr_frame);
 			pthread_mutex_unlock(&stream->dbr_mutex);
+
+			dbr_add_socket_sample(stream);
 		}
 	}
 
@@ -650,8 +658,8 @@ static void *send_thread(void *data)
 
 	/* reset bitrate on stop */
 	if (stream->dbr_enabled) {
-		if (stream->dbr_cur_bitrate != stream->dbr_orig_bitrate) {
-			stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
+		if (stream->dbr.cur_bitrate != stream->dbr.orig_bitrate) {
+			stream->dbr.cur_bitrate = stream->dbr.orig_bitrate;
 			dbr_set_bitrate(stream);
 		}
 	}
@@ -842,14 +850,16 @@ static int init_send(struct rtmp_stream *stream)
 			ideal_buffer_size = 131072;
 
 		stream->write_buf_size = ideal_buffer_size;
+		stream->write_buf_start = 0;
+		stream->write_buf_len = 0;
 		stream->write_buf = bmalloc(ideal_buffer_size);
 
 #ifdef _WIN32
 		ret = pthread_create(&stream->socket_thread, NULL,
 				     socket_thread_windows, stream);
 #else
-		warn("New socket loop not supported on this platform");
-		return OBS_OUTPUT_ERROR;
+		ret = pthread_create(&stream->socket_thread, NULL,
+				     socket_thread_posix, stream);
 #endif
 
 		if (ret != 0) {
@@ -1020,6 +1030,7 @@ static bool init_connect(struct rtmp_stream *stream)
 	obs_service_t *service;
 	obs_data_t *settings;
 	const char *bind_ip;
+	const char *dbr_policy;
 	int64_t drop_p;
 	int64_t drop_b;
 	uint32_t caps;
@@ -1058,14 +1069,13 @@ static bool init_connect(struct rtmp_stream *stream)
 	obs_data_t *vsettings = obs_encoder_get_settings(venc);
 	obs_data_t *asettings = obs_encoder_get_settings(aenc);
 
-	circlebuf_free(&stream->dbr_frames);
-	stream->audio_bitrate = (long)obs_data_get_int(asettings, "bitrate");
-	stream->dbr_data_size = 0;
-	stream->dbr_orig_bitrate = (long)obs_data_get_int(vsettings, "bitrate");
-	stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
-	stream->dbr_est_bitrate = 0;
-	stream->dbr_inc_bitrate = stream->dbr_orig_bitrate / 10;
-	stream->dbr_inc_timeout = 0;
+	dbr_policy = obs_data_get_string(settings, OPT_DBR_POLICY);
+	if (!dbr_init(&stream->dbr, dbr_policy,
+		      (long)obs_data_get_int(vsettings, "bitrate"),
+		      (long)obs_data_get_int(asettings, "bitrate")))
+		warn("Unknown dynamic bitrate policy '%s', using default",
+		     dbr_policy);
+	stream->dbr_last_sample = 0;
 	stream->dbr_enabled = obs_data_get_bool(settings, OPT_DYN_BITRATE);
 
 	caps = obs_encoder_get_caps(venc);
@@ -1079,6 +1089,7 @@ static bool init_connect(struct rtmp_stream *stream)
 
 	if (stream->dbr_enabled) {
 		info("Dynamic bitrate enabled.  Dropped frames begone!");
+		info("Dynamic bitrate policy: %s", stream->dbr.policy->id);
 	}
 
 	obs_data_release(vsettings);
@@ -1097,6 +1108,7 @@ static bool init_connect(struct rtmp_stream *stream)
 		obs_data_get_bool(settings, OPT_NEWSOCKETLOOP_ENABLED);
 	stream->low_latency_mode =
 		obs_data_get_bool(settings, OPT_LOWLATENCY_ENABLED);
+	stream->zerocopy = obs_data_get_bool(settings, OPT_ZEROCOPY_ENABLED);
 
 	obs_data_release(settings);
 	return true;
@@ -1218,94 +1230,37 @@ static bool find_first_video_packet(struct rtmp_stream *stream,
 	return false;
 }
 
-static bool dbr_bitrate_lowered(struct rtmp_stream *stream)
-{
-	long prev_bitrate = stream->dbr_prev_bitrate;
-	long est_bitrate = 0;
-	long new_bitrate;
-
-	if (stream->dbr_est_bitrate &&
-	    stream->dbr_est_bitrate < stream->dbr_cur_bitrate) {
-		stream->dbr_data_size = 0;
-		circlebuf_pop_front(&stream->dbr_frames, NULL,
-				    stream->dbr_frames.size);
-		est_bitrate = stream->dbr_est_bitrate / 100 * 100;
-		if (est_bitrate < 50) {
-			est_bitrate = 50;
-		}
-	}
-
-#if 0
-	if (prev_bitrate && est_bitrate) {
-		if (prev_bitrate < est_bitrate) {
-			blog(LOG_INFO, "going back to prev bitrate: "
-					"prev_bitrate (%d) < est_bitrate (%d)",
-					prev_bitrate,
-					est_bitrate);
-			new_bitrate = prev_bitrate;
-		} else {
-			new_bitrate = est_bitrate;
-		}
-		new_bitrate = est_bitrate;
-	} else if (prev_bitrate) {
-		new_bitrate = prev_bitrate;
-		info("going back to prev bitrate");
-
-	} else if (est_bitrate) {
-		new_bitrate = est_bitrate;
-
-	} else {
-		return false;
-	}
-#else
-	if (est_bitrate) {
-		new_bitrate = est_bitrate;
-
-	} else if (prev_bitrate) {
-		new_bitrate = prev_bitrate;
-		info("going back to prev bitrate");
-
-	} else {
-		return false;
-	}
-
-	if (new_bitrate == stream->dbr_cur_bitrate) {
-		return false;
-	}
-#endif
-
-	stream->dbr_prev_bitrate = 0;
-	stream->dbr_cur_bitrate = new_bitrate;
-	stream->dbr_inc_timeout = os_gettime_ns() + DBR_INC_TIMER;
-	info("bitrate decreased to: %ld", stream->dbr_cur_bitrate);
-	return true;
-}
-
 static void dbr_set_bitrate(struct rtmp_stream *stream)
 {
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
 	obs_data_t *settings = obs_encoder_get_settings(vencoder);
 
-	obs_data_set_int(settings, "bitrate", stream->dbr_cur_bitrate);
+	obs_data_set_int(settings, "bitrate", stream->dbr.cur_bitrate);
 	obs_encoder_update(vencoder, settings);
 
 	obs_data_release(settings);
 }
 
-static void dbr_inc_bitrate(struct rtmp_stream *stream)
+static void dbr_update_bitrate(struct rtmp_stream *stream,
+			       int64_t buffer_duration_usec)
 {
-	stream->dbr_prev_bitrate = stream->dbr_cur_bitrate;
-	stream->dbr_cur_bitrate += stream->dbr_inc_bitrate;
-
-	if (stream->dbr_cur_bitrate >= stream->dbr_orig_bitrate) {
-		stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
-		info("bitrate increased to: %ld, done",
-		     stream->dbr_cur_bitrate);
-	} else if (stream->dbr_cur_bitrate < stream->dbr_orig_bitrate) {
-		stream->dbr_inc_timeout = os_gettime_ns() + DBR_INC_TIMER;
-		info("bitrate increased to: %ld, waiting",
-		     stream->dbr_cur_bitrate);
-	}
+	long prev_bitrate = stream->dbr.cur_bitrate;
+	bool bitrate_changed;
+
+	pthread_mutex_lock(&stream->dbr_mutex);
+	bitrate_changed = dbr_update(&stream->dbr, os_gettime_ns(),
+				     buffer_duration_usec);
+	pthread_mutex_unlock(&stream->dbr_mutex);
+
+	if (!bitrate_changed)
+		return;
+
+	debug("buffer_duration_msec: %" PRId64, buffer_duration_usec / 1000);
+	info("bitrate %s to: %ld",
+	     stream->dbr.cur_bitrate < prev_bitrate ? "decreased"
+						     : "increased",
+	     stream->dbr.cur_bitrate);
+	dbr_set_bitrate(stream);
 }
 
 static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
@@ -1319,27 +1274,14 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 	int64_t drop_threshold = pframes ? stream->pframe_drop_threshold_usec
 					 : stream->drop_threshold_usec;
 
-	if (!pframes && stream->dbr_enabled) {
-		if (stream->dbr_inc_timeout) {
-			uint64_t t = os_gettime_ns();
-
-			if (t >= stream->dbr_inc_timeout) {
-				stream->dbr_inc_timeout = 0;
-				dbr_inc_bitrate(stream);
-				dbr_set_bitrate(stream);
-			}
-		}
-	}
-
-	if (num_packets < 5) {
-		if (!pframes)
+	if (num_packets < 5 || !find_first_video_packet(stream, &first)) {
+		if (!pframes && num_packets < 5)
 			stream->congestion = 0.0f;
+		if (!pframes && stream->dbr_enabled)
+			dbr_update_bitrate(stream, 0);
 		return;
 	}
 
-	if (!find_first_video_packet(stream, &first))
-		return;
-
 	/* if the amount of time stored in the buffered packets waiting to be
 	 * sent is higher than threshold, drop frames */
 	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
@@ -1354,23 +1296,8 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 	 * but let's test without dropping frames
 	 * at all first */
 	if (stream->dbr_enabled) {
-		bool bitrate_changed = false;
-
-		if (pframes) {
-			return;
-		}
-
-		if ((uint64_t)buffer_duration_usec >= DBR_TRIGGER_USEC) {
-			pthread_mutex_lock(&stream->dbr_mutex);
-			bitrate_changed = dbr_bitrate_lowered(stream);
-			pthread_mutex_unlock(&stream->dbr_mutex);
-		}
-
-		if (bitrate_changed) {
-			debug("buffer_duration_msec: %" PRId64,
-			      buffer_duration_usec / 1000);
-			dbr_set_bitrate(stream);
-		}
+		if (!pframes)
+			dbr_update_bitrate(stream, buffer_duration_usec);
 		return;
 	}
 
@@ -1451,6 +1378,9 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_bool(defaults, OPT_ZEROCOPY_ENABLED, false);
+	obs_data_set_default_string(defaults, OPT_DBR_POLICY,
+				    DBR_DEFAULT_POLICY);
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -1479,10 +1409,25 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 	}
 	netif_saddr_data_free(&addrs);
 
+	p = obs_properties_add_list(props, OPT_DBR_POLICY,
+				    obs_module_text("RTMPStream.DBRPolicy"),
+				    OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_STRING);
+
+	for (size_t i = 0; i < dbr_policy_count(); i++) {
+		const struct dbr_policy_info *policy = dbr_get_policy(i);
+		obs_property_list_add_string(p, obs_module_text(policy->name),
+					     policy->id);
+	}
+
 	obs_properties_add_bool(props, OPT_NEWSOCKETLOOP_ENABLED,
 				obs_module_text("RTMPStream.NewSocketLoop"));
 	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED,
 				obs_module_text("RTMPStream.LowLatencyMode"));
+#ifdef __linux__
+	obs_properties_add_bool(props, OPT_ZEROCOPY_ENABLED,
+				obs_module_text("RTMPStream.ZeroCopy"));
+#endif
 
 	return props;
 }
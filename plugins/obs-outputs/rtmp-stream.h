@@ -9,6 +9,7 @@
 #include "librtmp/log.h"
 #include "flv-mux.h"
 #include "net-if.h"
+#include "rtmp-dbr.h"
 
 #ifdef _WIN32
 #include <Iphlpapi.h>
@@ -25,12 +26,14 @@
 #define debug(format, ...) do_log(LOG_DEBUG, format, ##__VA_ARGS__)
 
 #define OPT_DYN_BITRATE "dyn_bitrate"
+#define OPT_DBR_POLICY "dbr_policy"
 #define OPT_DROP_THRESHOLD "drop_threshold_ms"
 #define OPT_PFRAME_DROP_THRESHOLD "pframe_drop_threshold_ms"
 #define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
 #define OPT_BIND_IP "bind_ip"
 #define OPT_NEWSOCKETLOOP_ENABLED "new_socket_loop_enabled"
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
+#define OPT_ZEROCOPY_ENABLED "zerocopy_enabled"
 
 //#define TEST_FRAMEDROPS
 //#define TEST_FRAMEDROPS_WITH_BITRATE_SHORTCUTS
@@ -46,12 +49,6 @@ struct droptest_info {
 };
 #endif
 
-struct dbr_frame {
-	uint64_t send_beg;
-	uint64_t send_end;
-	size_t size;
-};
-
 struct rtmp_stream {
 	obs_output_t *output;
 
@@ -101,15 +98,8 @@ struct rtmp_stream {
 #endif
 
 	pthread_mutex_t dbr_mutex;
-	struct circlebuf dbr_frames;
-	size_t dbr_data_size;
-	uint64_t dbr_inc_timeout;
-	long audio_bitrate;
-	long dbr_est_bitrate;
-	long dbr_orig_bitrate;
-	long dbr_prev_bitrate;
-	long dbr_cur_bitrate;
-	long dbr_inc_bitrate;
+	struct dbr_controller dbr;
+	uint64_t dbr_last_sample;
 	bool dbr_enabled;
 
 	RTMP rtmp;
@@ -117,9 +107,11 @@ struct rtmp_stream {
 	bool new_socket_loop;
 	bool low_latency_mode;
 	bool disable_send_window_optimization;
+	bool zerocopy;
 	bool socket_thread_active;
 	pthread_t socket_thread;
 	uint8_t *write_buf;
+	size_t write_buf_start;
 	size_t write_buf_len;
 	size_t write_buf_size;
 	pthread_mutex_t write_buf_mutex;
@@ -131,4 +123,6 @@ struct rtmp_stream {
 
 #ifdef _WIN32
 void *socket_thread_windows(void *data);
+#else
+void *socket_thread_posix(void *data);
 #endif
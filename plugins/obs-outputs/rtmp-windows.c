@@ -6,6 +6,7 @@ static void fatal_sock_shutdown(struct rtmp_stream *stream)
 {
 	closesocket(stream->rtmp.m_sb.sb_socket);
 	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_start = 0;
 	stream->write_buf_len = 0;
 	os_event_signal(stream->buffer_space_available_event);
 }
@@ -162,23 +163,20 @@ static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write,
 	}
 
 	int ret;
-	if (stream->low_latency_mode) {
-		size_t send_len =
-			min(latency_packet_size, stream->write_buf_len);
+	size_t send_len = min(stream->write_buf_len,
+			      stream->write_buf_size - stream->write_buf_start);
 
-		ret = RTMPSockBuf_Send(&stream->rtmp.m_sb,
-				       (const char *)stream->write_buf,
-				       (int)send_len);
-	} else {
-		ret = RTMPSockBuf_Send(&stream->rtmp.m_sb,
-				       (const char *)stream->write_buf,
-				       (int)stream->write_buf_len);
-	}
+	if (stream->low_latency_mode)
+		send_len = min(latency_packet_size, send_len);
+
+	ret = RTMPSockBuf_Send(&stream->rtmp.m_sb,
+			       (const char *)stream->write_buf +
+				       stream->write_buf_start,
+			       (int)send_len);
 
 	if (ret > 0) {
-		if (stream->write_buf_len - ret)
-			memmove(stream->write_buf, stream->write_buf + ret,
-				stream->write_buf_len - ret);
+		stream->write_buf_start = (stream->write_buf_start + ret) %
+					  stream->write_buf_size;
 		stream->write_buf_len -= ret;
 
 		*last_send_time = os_gettime_ns() / 1000000;
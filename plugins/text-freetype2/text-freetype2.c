@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <sys/stat.h>
@@ -48,6 +49,7 @@ static struct obs_source_info freetype2_source_info_v1 = {
 	.get_height = ft2_source_get_height,
 	.video_render = ft2_source_render,
 	.video_tick = ft2_video_tick,
+	.video_get_generation = ft2_source_get_generation,
 	.get_properties = ft2_source_properties,
 	.icon_type = OBS_ICON_TYPE_TEXT,
 };
@@ -69,6 +71,7 @@ static struct obs_source_info freetype2_source_info_v2 = {
 	.get_height = ft2_source_get_height,
 	.video_render = ft2_source_render,
 	.video_tick = ft2_video_tick,
+	.video_get_generation = ft2_source_get_generation,
 	.get_properties = ft2_source_properties,
 	.icon_type = OBS_ICON_TYPE_TEXT,
 };
@@ -135,6 +138,13 @@ static uint32_t ft2_source_get_height(void *data)
 	return srcdata->cy;
 }
 
+static uint64_t ft2_source_get_generation(void *data)
+{
+	struct ft2_source *srcdata = data;
+
+	return (uint64_t)os_atomic_load_long(&srcdata->generation);
+}
+
 static obs_properties_t *ft2_source_properties(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -52,6 +52,9 @@ struct ft2_source {
 
 	gs_texture_t *tex;
 
+	/* bumped whenever the texture or the vertex buffer changes */
+	volatile long generation;
+
 	struct glyph_info *cacheglyphs[num_cache_slots];
 
 	FT_Face font_face;
@@ -81,6 +84,7 @@ void draw_drop_shadow(struct ft2_source *srcdata);
 
 static uint32_t ft2_source_get_width(void *data);
 static uint32_t ft2_source_get_height(void *data);
+static uint64_t ft2_source_get_generation(void *data);
 
 static obs_properties_t *ft2_source_properties(void *unused);
 
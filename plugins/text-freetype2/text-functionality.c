@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include <sys/stat.h>
@@ -94,6 +95,7 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 	srcdata->cy = srcdata->max_h;
 
 	obs_enter_graphics();
+	os_atomic_inc_long(&srcdata->generation);
 	if (srcdata->vbuf != NULL) {
 		gs_vertbuffer_t *tmpvbuf = srcdata->vbuf;
 		srcdata->vbuf = NULL;
@@ -329,6 +331,7 @@ void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs)
 		srcdata->tex = gs_texture_create(
 			texbuf_w, texbuf_h, GS_A8, 1,
 			(const uint8_t **)&srcdata->texbuf, 0);
+		os_atomic_inc_long(&srcdata->generation);
 
 		obs_leave_graphics();
 	}
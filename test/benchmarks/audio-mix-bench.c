@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/audio-mix.h>
+
+/*
+ * Mixes 64 sources into 6 mixes of 8 channels and clamps the result, the
+ * same work the audio thread does per tick, and reports the time per
+ * 1024-frame tick for the mix kernels and for the scalar loops they replaced.
+ */
+
+#define NUM_SOURCES 64
+#define NUM_MIXES 6
+#define NUM_CHANNELS 8
+#define TICK_FRAMES 1024
+#define MIN_RUN_NS 1000000000ULL
+
+typedef float channel_t[TICK_FRAMES];
+
+struct tick_data {
+	channel_t (*sources)[NUM_MIXES][NUM_CHANNELS];
+	channel_t mixes[NUM_MIXES][NUM_CHANNELS];
+};
+
+static void ref_mix_buffer(float *mix, const float *aud, size_t count)
+{
+	const float *end = aud + count;
+
+	while (aud < end)
+		*(mix++) += *(aud++);
+}
+
+static void ref_clamp_buffer(float *data, size_t count)
+{
+	float *end = data + count;
+
+	while (data < end) {
+		float val = *data;
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		*(data++) = val;
+	}
+}
+
+typedef void (*mix_func_t)(float *mix, const float *aud, size_t count);
+typedef void (*clamp_func_t)(float *data, size_t count);
+
+static void run_tick(struct tick_data *data, mix_func_t mix_func,
+		     clamp_func_t clamp_func)
+{
+	memset(data->mixes, 0, sizeof(data->mixes));
+
+	for (size_t src = 0; src < NUM_SOURCES; src++) {
+		for (size_t mix = 0; mix < NUM_MIXES; mix++) {
+			for (size_t ch = 0; ch < NUM_CHANNELS; ch++)
+				mix_func(data->mixes[mix][ch],
+					 data->sources[src][mix][ch],
+					 TICK_FRAMES);
+		}
+	}
+
+	for (size_t mix = 0; mix < NUM_MIXES; mix++) {
+		for (size_t ch = 0; ch < NUM_CHANNELS; ch++)
+			clamp_func(data->mixes[mix][ch], TICK_FRAMES);
+	}
+}
+
+static double bench(const char *name, struct tick_data *data,
+		    mix_func_t mix_func, clamp_func_t clamp_func)
+{
+	uint64_t start = os_gettime_ns();
+	uint64_t ticks = 0;
+	uint64_t elapsed;
+	double ns_per_tick;
+
+	do {
+		run_tick(data, mix_func, clamp_func);
+		ticks++;
+		elapsed = os_gettime_ns() - start;
+	} while (elapsed < MIN_RUN_NS);
+
+	ns_per_tick = (double)elapsed / (double)ticks;
+	printf("%-8s %10.0f ns per %d-frame tick\n", name, ns_per_tick,
+	       TICK_FRAMES);
+	return ns_per_tick;
+}
+
+static void fill_sources(struct tick_data *data)
+{
+	float *samples = &data->sources[0][0][0][0];
+	size_t count = (size_t)NUM_SOURCES * NUM_MIXES * NUM_CHANNELS *
+		       TICK_FRAMES;
+	uint32_t seed = 0x1234567;
+
+	/* loud enough that the sum of every source needs clamping */
+	for (size_t i = 0; i < count; i++) {
+		seed = seed * 1103515245 + 12345;
+		samples[i] = ((float)(seed >> 8) / (float)(1 << 24)) * 0.1f -
+			     0.05f;
+	}
+}
+
+static void mix_kernel(float *mix, const float *aud, size_t count)
+{
+	mix_audio_buffer(mix, aud, count);
+}
+
+static void clamp_kernel(float *data, size_t count)
+{
+	clamp_audio_buffer(data, count);
+}
+
+int main(void)
+{
+	struct tick_data *data = bzalloc(sizeof(*data));
+	channel_t ref_mixes[NUM_MIXES][NUM_CHANNELS];
+	double ref_ns, new_ns;
+	bool match;
+
+	data->sources = bzalloc(sizeof(*data->sources) * NUM_SOURCES);
+	fill_sources(data);
+
+	printf("%d sources x %d mixes x %d channels\n", NUM_SOURCES,
+	       NUM_MIXES, NUM_CHANNELS);
+
+	ref_ns = bench("scalar", data, ref_mix_buffer, ref_clamp_buffer);
+	memcpy(ref_mixes, data->mixes, sizeof(ref_mixes));
+
+	new_ns = bench("kernels", data, mix_kernel, clamp_kernel);
+	match = memcmp(ref_mixes, data->mixes, sizeof(ref_mixes)) == 0;
+
+	printf("speedup: %.2fx\n", ref_ns / new_ns);
+	if (!match)
+		printf("mix output differs from the scalar version\n");
+
+	bfree(data->sources);
+	bfree(data);
+
+	printf("Number of memory leaks: %ld\n", bnum_allocs());
+	return match ? 0 : 1;
+}
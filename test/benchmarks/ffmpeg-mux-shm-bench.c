@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/wait.h>
+#include <util/platform.h>
+#include <ffmpeg-mux/ffmpeg-mux.h>
+#include <ffmpeg-mux/ffmpeg-mux-shm.h>
+
+/*
+ * Moves packets from a parent to a forked child the way obs-ffmpeg-mux.c
+ * feeds ffmpeg-mux, once through a pipe and once through the shared memory
+ * ring, and reports the throughput of both.  The child reads packets like
+ * ffmpeg-mux does: into a buffer from the pipe, in place from the ring
+ * when the payload is contiguous.
+ *
+ *   ffmpeg-mux-shm-bench [total MiB] [packet KiB]
+ */
+
+#define DEFAULT_TOTAL_MIB 4096
+#define DEFAULT_PACKET_KIB 256
+
+static volatile uint8_t payload_sum;
+
+static uint8_t consume_payload(const uint8_t *data, size_t size)
+{
+	/* stands in for libavformat touching the payload */
+	return (uint8_t)(data[0] ^ data[size / 2] ^ data[size - 1]);
+}
+
+static bool read_full(int fd, void *data, size_t size)
+{
+	uint8_t *pos = data;
+
+	while (size) {
+		ssize_t ret = read(fd, pos, size);
+		if (ret <= 0) {
+			if (ret == -1 && errno == EINTR)
+				continue;
+			return false;
+		}
+		pos += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static bool write_full(int fd, const void *data, size_t size)
+{
+	const uint8_t *pos = data;
+
+	while (size) {
+		ssize_t ret = write(fd, pos, size);
+		if (ret <= 0) {
+			if (ret == -1 && errno == EINTR)
+				continue;
+			return false;
+		}
+		pos += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static inline void init_info(struct ffm_packet_info *info, size_t size,
+			     int64_t idx)
+{
+	memset(info, 0, sizeof(*info));
+	info->pts = idx;
+	info->dts = idx;
+	info->size = (uint32_t)size;
+	info->type = FFM_PACKET_VIDEO;
+	info->keyframe = idx % 120 == 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* pipe */
+
+static int pipe_child(int fd, size_t packet_size)
+{
+	uint8_t *buf = malloc(packet_size);
+	struct ffm_packet_info info;
+	uint8_t sum = 0;
+
+	while (read_full(fd, &info, sizeof(info))) {
+		if (info.size > packet_size || !read_full(fd, buf, info.size))
+			return 1;
+		sum ^= consume_payload(buf, info.size);
+	}
+
+	payload_sum = sum;
+	free(buf);
+	return 0;
+}
+
+static double run_pipe(size_t total, size_t packet_size, const uint8_t *data)
+{
+	struct ffm_packet_info info;
+	uint64_t start;
+	int fds[2];
+	int status;
+	pid_t pid;
+
+	if (pipe(fds) != 0)
+		return 0.0;
+
+	pid = fork();
+	if (pid == 0) {
+		close(fds[1]);
+		_exit(pipe_child(fds[0], packet_size));
+	}
+
+	close(fds[0]);
+	start = os_gettime_ns();
+
+	for (size_t sent = 0, i = 0; sent < total; sent += packet_size, i++) {
+		init_info(&info, packet_size, (int64_t)i);
+		if (!write_full(fds[1], &info, sizeof(info)) ||
+		    !write_full(fds[1], data, packet_size))
+			break;
+	}
+
+	close(fds[1]);
+	waitpid(pid, &status, 0);
+	return (double)(os_gettime_ns() - start) / 1e9;
+}
+
+/* ------------------------------------------------------------------------- */
+/* shared memory */
+
+static bool shm_wait(struct ffm_shm *shm, size_t size)
+{
+	size_t target = size < shm->capacity ? size : (size_t)shm->capacity;
+
+	for (;;) {
+		if (ffm_shm_wait_data(shm, target, FFM_SHM_WAIT_MS) >= target)
+			return true;
+		if (ffm_shm_load32(&shm->writer_closed))
+			return ffm_shm_available(shm) >= target;
+	}
+}
+
+static bool shm_read(struct ffm_shm *shm, uint8_t *data, size_t size)
+{
+	while (size) {
+		size_t n;
+
+		if (!shm_wait(shm, size))
+			return false;
+
+		n = ffm_shm_read_some(shm, data, size);
+		data += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+static int shm_child(struct ffm_shm *shm, size_t packet_size)
+{
+	uint8_t *buf = malloc(packet_size);
+	struct ffm_packet_info info;
+	uint8_t sum = 0;
+
+	while (shm_read(shm, (uint8_t *)&info, sizeof(info))) {
+		uint8_t *payload;
+
+		if (info.size > packet_size || !shm_wait(shm, info.size))
+			return 1;
+
+		payload = ffm_shm_peek(shm, info.size);
+		if (payload) {
+			sum ^= consume_payload(payload, info.size);
+			ffm_shm_consume(shm, info.size);
+		} else {
+			if (!shm_read(shm, buf, info.size))
+				return 1;
+			sum ^= consume_payload(buf, info.size);
+		}
+	}
+
+	ffm_shm_close_reader(shm);
+	payload_sum = sum;
+	free(buf);
+	return 0;
+}
+
+static bool shm_write(struct ffm_shm *shm, const uint8_t *data, size_t size)
+{
+	while (size) {
+		size_t written = ffm_shm_write_some(shm, data, size);
+		data += written;
+		size -= written;
+
+		if (!size)
+			break;
+		if (ffm_shm_load32(&shm->reader_closed))
+			return false;
+		ffm_shm_wait_space(shm, FFM_SHM_WAIT_MS);
+	}
+
+	return true;
+}
+
+static double run_shm(size_t total, size_t packet_size, const uint8_t *data)
+{
+	size_t size = ffm_shm_total_size(FFM_SHM_DATA_SIZE);
+	struct ffm_packet_info info;
+	struct ffm_shm *shm;
+	uint64_t start;
+	int status;
+	pid_t pid;
+	int fd;
+
+	fd = (int)syscall(SYS_memfd_create, "ffmpeg-mux-shm-bench", 0);
+	if (fd == -1 || ftruncate(fd, (off_t)size) != 0)
+		return 0.0;
+
+	shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return 0.0;
+
+	ffm_shm_init(shm, FFM_SHM_DATA_SIZE);
+
+	pid = fork();
+	if (pid == 0)
+		_exit(shm_child(shm, packet_size));
+
+	start = os_gettime_ns();
+
+	for (size_t sent = 0, i = 0; sent < total; sent += packet_size, i++) {
+		init_info(&info, packet_size, (int64_t)i);
+		if (!shm_write(shm, (const uint8_t *)&info, sizeof(info)) ||
+		    !shm_write(shm, data, packet_size))
+			break;
+	}
+
+	ffm_shm_close_writer(shm);
+	waitpid(pid, &status, 0);
+
+	double seconds = (double)(os_gettime_ns() - start) / 1e9;
+	munmap(shm, size);
+	return seconds;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+	size_t total_mib = argc > 1 ? strtoul(argv[1], NULL, 10)
+				    : DEFAULT_TOTAL_MIB;
+	size_t packet_kib = argc > 2 ? strtoul(argv[2], NULL, 10)
+				     : DEFAULT_PACKET_KIB;
+	size_t total = total_mib * 1024 * 1024;
+	size_t packet_size = packet_kib * 1024;
+	uint8_t *data;
+	double pipe_sec, shm_sec;
+
+	if (!total || !packet_size) {
+		fprintf(stderr, "usage: %s [total MiB] [packet KiB]\n",
+			argv[0]);
+		return 1;
+	}
+
+	data = malloc(packet_size);
+	for (size_t i = 0; i < packet_size; i++)
+		data[i] = (uint8_t)(i * 31);
+
+	printf("moving %zu MiB in %zu KiB packets\n", total_mib, packet_kib);
+
+	pipe_sec = run_pipe(total, packet_size, data);
+	shm_sec = run_shm(total, packet_size, data);
+
+	printf("pipe:          %7.2f GB/s\n",
+	       pipe_sec > 0.0 ? (double)total / pipe_sec / 1e9 : 0.0);
+	printf("shared memory: %7.2f GB/s\n",
+	       shm_sec > 0.0 ? (double)total / shm_sec / 1e9 : 0.0);
+
+	free(data);
+	return 0;
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <obs-output-interleave.h>
+
+/*
+ * Feeds an hour of synthetic packets from 60 fps video and six 48 kHz audio
+ * tracks through the output interleaving queue, the way interleave_packets
+ * does once an output has started, and reports the time spent.  The same
+ * packets are also run through the sorted array the queue replaced, and the
+ * two have to send packets in the same order.
+ */
+
+#define DURATION_USEC (60LL * 60LL * 1000000LL)
+#define VIDEO_FPS 60
+#define AUDIO_TRACKS 6
+#define AUDIO_RATE 48000
+#define AUDIO_FRAMES 1024
+
+/* video packets come out of the encoder this long after audio packets with
+ * the same timestamp, which is what makes the queue deep */
+#define VIDEO_LATENCY_USEC 2000000LL
+
+struct sent_packet {
+	int64_t dts_usec;
+	size_t track;
+};
+
+struct interleave_state {
+	int64_t highest_video_ts;
+	int64_t highest_audio_ts;
+	DARRAY(struct sent_packet) sent;
+};
+
+static inline void set_higher_ts(struct interleave_state *state,
+				 const struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		if (state->highest_video_ts < packet->dts_usec)
+			state->highest_video_ts = packet->dts_usec;
+	} else {
+		if (state->highest_audio_ts < packet->dts_usec)
+			state->highest_audio_ts = packet->dts_usec;
+	}
+}
+
+static inline bool has_higher_opposing_ts(struct interleave_state *state,
+					  const struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		return state->highest_audio_ts > packet->dts_usec;
+	else
+		return state->highest_video_ts > packet->dts_usec;
+}
+
+static inline void add_sent(struct interleave_state *state,
+			    const struct encoder_packet *packet)
+{
+	struct sent_packet *sent = da_push_back_new(state->sent);
+	sent->dts_usec = packet->dts_usec;
+	sent->track = interleave_queue_track(packet);
+}
+
+/* ------------------------------------------------------------------------- */
+/* sorted array, as used before the interleaving queue */
+
+static void run_array(const struct encoder_packet *packets, size_t count,
+		      struct interleave_state *state)
+{
+	DARRAY(struct encoder_packet) queue;
+	da_init(queue);
+
+	for (size_t i = 0; i < count; i++) {
+		const struct encoder_packet *packet = &packets[i];
+		size_t idx;
+
+		for (idx = 0; idx < queue.num; idx++) {
+			struct encoder_packet *cur = queue.array + idx;
+
+			if (packet->dts_usec == cur->dts_usec &&
+			    packet->type == OBS_ENCODER_VIDEO)
+				break;
+			else if (packet->dts_usec < cur->dts_usec)
+				break;
+		}
+
+		da_insert(queue, idx, packet);
+		set_higher_ts(state, packet);
+
+		if (has_higher_opposing_ts(state, queue.array)) {
+			add_sent(state, queue.array);
+			da_erase(queue, 0);
+		}
+	}
+
+	da_free(queue);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void run_queue(const struct encoder_packet *packets, size_t count,
+		      struct interleave_state *state)
+{
+	struct interleave_queue queue = {0};
+
+	for (size_t i = 0; i < count; i++) {
+		const struct encoder_packet *packet = &packets[i];
+		struct interleaved_packet *first;
+
+		interleave_queue_push(&queue, packet);
+		set_higher_ts(state, packet);
+
+		first = interleave_queue_first(&queue);
+		if (has_higher_opposing_ts(state, &first->packet)) {
+			struct encoder_packet out;
+			interleave_queue_pop(&queue, &out);
+			add_sent(state, &out);
+		}
+	}
+
+	interleave_queue_free(&queue);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct pending_packet {
+	int64_t arrival_usec;
+	struct encoder_packet packet;
+};
+
+static int compare_arrival(const void *a_val, const void *b_val)
+{
+	const struct pending_packet *a = a_val;
+	const struct pending_packet *b = b_val;
+
+	if (a->arrival_usec != b->arrival_usec)
+		return a->arrival_usec < b->arrival_usec ? -1 : 1;
+	if (a->packet.type != b->packet.type)
+		return a->packet.type == OBS_ENCODER_VIDEO ? 1 : -1;
+	return (int)a->packet.track_idx - (int)b->packet.track_idx;
+}
+
+static void add_packet(struct pending_packet *pending,
+		       enum obs_encoder_type type, size_t track, int64_t dts,
+		       int64_t arrival)
+{
+	pending->arrival_usec = arrival;
+	pending->packet.type = type;
+	pending->packet.track_idx = track;
+	pending->packet.dts_usec = dts;
+}
+
+static struct encoder_packet *generate_packets(size_t *count)
+{
+	size_t video_count = (size_t)(DURATION_USEC * VIDEO_FPS / 1000000LL);
+	size_t audio_count = (size_t)(DURATION_USEC * AUDIO_RATE /
+				      AUDIO_FRAMES / 1000000LL);
+	size_t total = video_count + audio_count * AUDIO_TRACKS;
+	struct pending_packet *pending;
+	struct encoder_packet *packets;
+	size_t idx = 0;
+
+	pending = bmalloc(sizeof(*pending) * total);
+
+	for (size_t i = 0; i < video_count; i++) {
+		int64_t dts = (int64_t)i * 1000000LL / VIDEO_FPS;
+		add_packet(&pending[idx++], OBS_ENCODER_VIDEO, 0, dts,
+			   dts + VIDEO_LATENCY_USEC);
+	}
+
+	for (size_t track = 0; track < AUDIO_TRACKS; track++) {
+		for (size_t i = 0; i < audio_count; i++) {
+			int64_t dts = (int64_t)i * AUDIO_FRAMES * 1000000LL /
+				      AUDIO_RATE;
+			add_packet(&pending[idx++], OBS_ENCODER_AUDIO, track,
+				   dts, dts);
+		}
+	}
+
+	qsort(pending, total, sizeof(*pending), compare_arrival);
+
+	packets = bmalloc(sizeof(*packets) * total);
+	for (size_t i = 0; i < total; i++)
+		packets[i] = pending[i].packet;
+
+	bfree(pending);
+	*count = total;
+	return packets;
+}
+
+int main(void)
+{
+	struct interleave_state array_state = {0};
+	struct interleave_state queue_state = {0};
+	struct encoder_packet *packets;
+	uint64_t array_ns, queue_ns, start;
+	size_t count;
+	bool match;
+
+	packets = generate_packets(&count);
+	printf("%zu packets: 1 hour of %d fps video and %d audio tracks, "
+	       "%lld ms video latency\n",
+	       count, VIDEO_FPS, AUDIO_TRACKS,
+	       VIDEO_LATENCY_USEC / 1000LL);
+
+	/* reserved up front so only the interleaving itself is timed */
+	da_reserve(array_state.sent, count);
+	da_reserve(queue_state.sent, count);
+
+	start = os_gettime_ns();
+	run_array(packets, count, &array_state);
+	array_ns = os_gettime_ns() - start;
+
+	start = os_gettime_ns();
+	run_queue(packets, count, &queue_state);
+	queue_ns = os_gettime_ns() - start;
+
+	printf("sorted array:     %8.1f ms\n", (double)array_ns / 1000000.0);
+	printf("interleave queue: %8.1f ms\n", (double)queue_ns / 1000000.0);
+
+	match = array_state.sent.num == queue_state.sent.num;
+	for (size_t i = 0; match && i < array_state.sent.num; i++) {
+		struct sent_packet *a = &array_state.sent.array[i];
+		struct sent_packet *b = &queue_state.sent.array[i];
+
+		match = a->dts_usec == b->dts_usec && a->track == b->track;
+	}
+
+	if (!match)
+		printf("packets were sent in a different order\n");
+
+	da_free(array_state.sent);
+	da_free(queue_state.sent);
+	bfree(packets);
+
+	printf("Number of memory leaks: %ld\n", bnum_allocs());
+	return match ? 0 : 1;
+}
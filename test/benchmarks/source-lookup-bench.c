@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+
+/*
+ * Looks up random source names with obs_get_source_by_name(), which uses
+ * the name index, and with a walk over the source list comparing names,
+ * which is what the lookup did before the index.  Also times
+ * obs_scene_find_source() on a scene holding every source as an item.
+ */
+
+#define MIN_RUN_NS 500000000ULL
+#define NAME_COUNT 4096
+
+/* every source has its own audio mix buffers, so 2000 is already ~450 MB */
+static const size_t source_counts[] = {10, 100, 500, 2000};
+
+struct walk_data {
+	const char *name;
+	obs_source_t *source;
+};
+
+static bool walk_cb(void *param, obs_source_t *source)
+{
+	struct walk_data *data = param;
+
+	if (strcmp(obs_source_get_name(source), data->name) == 0) {
+		data->source = obs_source_get_ref(source);
+		return false;
+	}
+
+	return true;
+}
+
+static obs_source_t *walk_lookup(const char *name)
+{
+	struct walk_data data = {name, NULL};
+	obs_enum_scenes(walk_cb, &data);
+	return data.source;
+}
+
+static obs_source_t *index_lookup(const char *name)
+{
+	return obs_get_source_by_name(name);
+}
+
+typedef obs_source_t *(*lookup_func_t)(const char *name);
+
+static double bench_lookup(lookup_func_t lookup, char **names)
+{
+	uint64_t start = os_gettime_ns();
+	uint64_t lookups = 0;
+	uint64_t elapsed;
+
+	do {
+		for (size_t i = 0; i < NAME_COUNT; i++) {
+			obs_source_t *source = lookup(names[i]);
+			if (!source)
+				printf("'%s' not found\n", names[i]);
+			obs_source_release(source);
+		}
+		lookups += NAME_COUNT;
+		elapsed = os_gettime_ns() - start;
+	} while (elapsed < MIN_RUN_NS);
+
+	return (double)elapsed / (double)lookups;
+}
+
+static double bench_find(obs_scene_t *scene, char **names)
+{
+	uint64_t start = os_gettime_ns();
+	uint64_t lookups = 0;
+	uint64_t elapsed;
+
+	do {
+		for (size_t i = 0; i < NAME_COUNT; i++) {
+			if (!obs_scene_find_source(scene, names[i]))
+				printf("'%s' not in the scene\n", names[i]);
+		}
+		lookups += NAME_COUNT;
+		elapsed = os_gettime_ns() - start;
+	} while (elapsed < MIN_RUN_NS);
+
+	return (double)elapsed / (double)lookups;
+}
+
+static void run(size_t count)
+{
+	DARRAY(obs_scene_t *) scenes = {0};
+	char *names[NAME_COUNT];
+	obs_scene_t *parent;
+	uint32_t seed = 0x1234567;
+	double walk_ns, index_ns, find_ns;
+	char name[64];
+
+	parent = obs_scene_create("lookup parent");
+
+	for (size_t i = 0; i < count; i++) {
+		obs_scene_t *scene;
+
+		snprintf(name, sizeof(name), "source %zu", i);
+		scene = obs_scene_create(name);
+		obs_scene_add(parent, obs_scene_get_source(scene));
+		da_push_back(scenes, &scene);
+	}
+
+	for (size_t i = 0; i < NAME_COUNT; i++) {
+		seed = seed * 1103515245 + 12345;
+		snprintf(name, sizeof(name), "source %zu",
+			 (size_t)(seed >> 8) % count);
+		names[i] = bstrdup(name);
+	}
+
+	walk_ns = bench_lookup(walk_lookup, names);
+	index_ns = bench_lookup(index_lookup, names);
+	find_ns = bench_find(parent, names);
+
+	printf("%7zu %12.0f ns %9.0f ns %12.0f ns\n", count, walk_ns,
+	       index_ns, find_ns);
+
+	for (size_t i = 0; i < NAME_COUNT; i++)
+		bfree(names[i]);
+	for (size_t i = 0; i < scenes.num; i++)
+		obs_scene_release(scenes.array[i]);
+	obs_scene_release(parent);
+	da_free(scenes);
+}
+
+int main(void)
+{
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "obs_startup failed\n");
+		return 1;
+	}
+
+	printf("sources    list walk     index    scene find\n");
+
+	for (size_t i = 0;
+	     i < sizeof(source_counts) / sizeof(source_counts[0]); i++)
+		run(source_counts[i]);
+
+	obs_shutdown();
+
+	printf("Number of memory leaks: %ld\n", bnum_allocs());
+	return 0;
+}
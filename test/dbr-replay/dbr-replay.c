@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <rtmp-dbr.h>
+
+/*
+ * Replays a bandwidth trace through the dynamic bitrate controller of
+ * obs-outputs, for every policy or the one given with --policy.
+ *
+ * The simulation follows rtmp_output with dynamic bitrate enabled: the
+ * encoder queues a video packet every frame at the current bitrate plus
+ * audio packets, the send thread hands them to a socket buffer that blocks
+ * when full, and the link drains the socket buffer at the rate from the
+ * trace.  The controller gets the same inputs as in the output: the time
+ * spent sending each packet, socket samples every 20 ms with bytes acked
+ * and RTT, and an update with the queued duration on every video packet.
+ *
+ * A trace is a text file of "<seconds> <kbps>" lines, each holding the
+ * link rate for that long; lines starting with # are ignored.  Without one
+ * the built-in trace steps through 8, 3, 1.5, 5 and 8 Mbps for 96 seconds
+ * each.
+ */
+
+#define MSEC_TO_NSEC 1000000ULL
+#define SEC_TO_NSEC 1000000000ULL
+
+#define TICK_NSEC (1ULL * MSEC_TO_NSEC)
+#define SAMPLE_INTERVAL (20ULL * MSEC_TO_NSEC)
+#define VIDEO_FPS 60
+#define AUDIO_RATE 48000
+#define AUDIO_FRAMES 1024
+#define SOCKET_BUFFER_SIZE (256 * 1024)
+
+struct trace_step {
+	uint64_t duration;
+	long kbps;
+};
+
+struct sim_packet {
+	uint64_t dts;
+	size_t size;
+	bool video;
+};
+
+struct options {
+	const char *trace;
+	const char *policy;
+	long bitrate;
+	long audio_bitrate;
+	uint32_t rtt_msec;
+	bool verbose;
+};
+
+static struct options opts = {
+	.bitrate = 6000,
+	.audio_bitrate = 160,
+	.rtt_msec = 40,
+};
+
+static DARRAY(struct trace_step) trace;
+
+struct result {
+	uint64_t duration;
+	uint64_t video_bytes;
+	uint64_t possible_bytes;
+	double queue_sum;
+	uint64_t queue_count;
+	int64_t queue_max;
+	size_t updates;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static bool load_trace(const char *path)
+{
+	char line[256];
+	FILE *file = fopen(path, "r");
+
+	if (!file) {
+		fprintf(stderr, "failed to open trace '%s'\n", path);
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		struct trace_step step;
+		double seconds;
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%lf %ld", &seconds, &step.kbps) != 2 ||
+		    seconds <= 0.0 || step.kbps <= 0) {
+			fprintf(stderr, "invalid trace line: %s", line);
+			fclose(file);
+			return false;
+		}
+
+		step.duration = (uint64_t)(seconds * (double)SEC_TO_NSEC);
+		da_push_back(trace, &step);
+	}
+
+	fclose(file);
+	return trace.num > 0;
+}
+
+static void default_trace(void)
+{
+	static const long rates[] = {8000, 3000, 1500, 5000, 8000};
+
+	for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+		struct trace_step step = {96ULL * SEC_TO_NSEC, rates[i]};
+		da_push_back(trace, &step);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct sim {
+	struct dbr_controller dbr;
+	struct circlebuf queue;
+	struct result result;
+
+	uint64_t ts;
+	uint64_t next_video_ts;
+	uint64_t next_audio_ts;
+	uint64_t last_video_dts;
+	uint64_t last_sample_ts;
+
+	/* packet currently being handed to the socket */
+	struct sim_packet sending;
+	size_t sending_left;
+	struct dbr_frame frame;
+
+	size_t socket_fill;
+	double link_credit;
+	uint64_t bytes_sent;
+	uint64_t bytes_acked;
+};
+
+static void push_packet(struct sim *sim, bool video, size_t size)
+{
+	struct sim_packet packet = {sim->ts, size, video};
+	circlebuf_push_back(&sim->queue, &packet, sizeof(packet));
+
+	if (video)
+		sim->last_video_dts = sim->ts;
+}
+
+static int64_t queued_usec(struct sim *sim)
+{
+	size_t count = sim->queue.size / sizeof(struct sim_packet);
+
+	/* same as check_to_drop_frames: the time between the first queued
+	 * video packet and the newest one */
+	if (count < 5)
+		return 0;
+
+	for (size_t i = 0; i < count; i++) {
+		struct sim_packet *packet = circlebuf_data(
+			&sim->queue, i * sizeof(struct sim_packet));
+		if (packet->video)
+			return (int64_t)(sim->last_video_dts - packet->dts) /
+			       1000;
+	}
+
+	return 0;
+}
+
+static void encode(struct sim *sim)
+{
+	if (sim->ts >= sim->next_audio_ts) {
+		size_t size = (size_t)(opts.audio_bitrate * 1000 / 8 *
+				       AUDIO_FRAMES / AUDIO_RATE);
+		push_packet(sim, false, size);
+		sim->next_audio_ts += SEC_TO_NSEC * AUDIO_FRAMES / AUDIO_RATE;
+	}
+
+	if (sim->ts >= sim->next_video_ts) {
+		size_t size = (size_t)(sim->dbr.cur_bitrate * 1000 / 8 /
+				       VIDEO_FPS);
+		int64_t queue_usec;
+		long prev_bitrate = sim->dbr.cur_bitrate;
+
+		push_packet(sim, true, size);
+		sim->next_video_ts += SEC_TO_NSEC / VIDEO_FPS;
+
+		queue_usec = queued_usec(sim);
+		sim->result.queue_sum += (double)queue_usec;
+		sim->result.queue_count++;
+		if (queue_usec > sim->result.queue_max)
+			sim->result.queue_max = queue_usec;
+
+		if (dbr_update(&sim->dbr, sim->ts, queue_usec)) {
+			sim->result.updates++;
+			if (opts.verbose)
+				printf("  %8.3f s: bitrate %s to %ld "
+				       "(queue %lld ms)\n",
+				       (double)sim->ts / (double)SEC_TO_NSEC,
+				       sim->dbr.cur_bitrate < prev_bitrate
+					       ? "decreased"
+					       : "increased",
+				       sim->dbr.cur_bitrate,
+				       (long long)(queue_usec / 1000));
+		}
+	}
+}
+
+static void send_packets(struct sim *sim)
+{
+	for (;;) {
+		size_t space = SOCKET_BUFFER_SIZE - sim->socket_fill;
+		size_t size;
+
+		if (!sim->sending_left) {
+			if (!sim->queue.size)
+				return;
+
+			circlebuf_pop_front(&sim->queue, &sim->sending,
+					    sizeof(sim->sending));
+			sim->sending_left = sim->sending.size;
+			sim->frame.send_beg = sim->ts;
+			sim->frame.size = sim->sending.size;
+		}
+
+		/* send() blocks until all of it fits in the socket buffer */
+		size = sim->sending_left < space ? sim->sending_left : space;
+		sim->socket_fill += size;
+		sim->sending_left -= size;
+		sim->bytes_sent += size;
+
+		if (sim->sending_left)
+			return;
+
+		sim->frame.send_end = sim->ts;
+		dbr_add_frame(&sim->dbr, &sim->frame);
+	}
+}
+
+static void drain_link(struct sim *sim, long kbps)
+{
+	size_t size;
+
+	sim->link_credit += (double)kbps * 1000.0 / 8.0 *
+			    ((double)TICK_NSEC / (double)SEC_TO_NSEC);
+
+	size = (size_t)sim->link_credit;
+	if (size > sim->socket_fill) {
+		size = sim->socket_fill;
+		/* an idle link doesn't save up capacity */
+		sim->link_credit = 0.0;
+	} else {
+		sim->link_credit -= (double)size;
+	}
+
+	sim->socket_fill -= size;
+	sim->bytes_acked += size;
+}
+
+static void add_socket_sample(struct sim *sim, long kbps)
+{
+	struct dbr_sample sample = {0};
+	uint64_t queue_usec;
+
+	if (sim->ts - sim->last_sample_ts < SAMPLE_INTERVAL)
+		return;
+
+	/* data sitting in the socket buffer shows up as RTT */
+	queue_usec = (uint64_t)sim->socket_fill * 8 * 1000 / (uint64_t)kbps;
+
+	sample.ts = sim->ts;
+	sample.bytes_sent = sim->bytes_sent;
+	sample.bytes_acked = sim->bytes_acked;
+	sample.rtt_usec = (uint32_t)(opts.rtt_msec * 1000 + queue_usec);
+
+	sim->last_sample_ts = sim->ts;
+	dbr_add_sample(&sim->dbr, &sample);
+}
+
+static void run_policy(const struct dbr_policy_info *policy)
+{
+	struct sim sim = {0};
+	uint64_t step_end = 0;
+
+	dbr_init(&sim.dbr, policy->id, opts.bitrate, opts.audio_bitrate);
+
+	if (opts.verbose)
+		printf("%s:\n", policy->id);
+
+	for (size_t i = 0; i < trace.num; i++) {
+		long kbps = trace.array[i].kbps;
+		long video_kbps = kbps - opts.audio_bitrate;
+
+		step_end += trace.array[i].duration;
+
+		if (video_kbps > opts.bitrate)
+			video_kbps = opts.bitrate;
+		if (video_kbps > 0)
+			sim.result.possible_bytes +=
+				(uint64_t)video_kbps * 1000 / 8 *
+				trace.array[i].duration / SEC_TO_NSEC;
+
+		for (; sim.ts < step_end; sim.ts += TICK_NSEC) {
+			uint64_t acked = sim.bytes_acked;
+
+			encode(&sim);
+			send_packets(&sim);
+			drain_link(&sim, kbps);
+			add_socket_sample(&sim, kbps);
+
+			sim.result.video_bytes += sim.bytes_acked - acked;
+		}
+	}
+
+	/* audio is delivered at a fixed rate, count video only */
+	sim.result.duration = sim.ts;
+	sim.result.video_bytes -= (uint64_t)opts.audio_bitrate * 1000 / 8 *
+				  sim.ts / SEC_TO_NSEC;
+
+	printf("%-8s delivered %5llu kbps of a possible %5llu, "
+	       "queue mean %4.0f ms max %5lld ms, %zu updates\n",
+	       policy->id,
+	       (unsigned long long)(sim.result.video_bytes * 8 * SEC_TO_NSEC /
+				    1000 / sim.result.duration),
+	       (unsigned long long)(sim.result.possible_bytes * 8 *
+				    SEC_TO_NSEC / 1000 /
+				    sim.result.duration),
+	       sim.result.queue_count ? sim.result.queue_sum /
+						(double)sim.result.queue_count /
+						1000.0
+				      : 0.0,
+	       (long long)(sim.result.queue_max / 1000), sim.result.updates);
+
+	dbr_free(&sim.dbr);
+	circlebuf_free(&sim.queue);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool parse_args(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--verbose") == 0) {
+			opts.verbose = true;
+		} else if (val && strcmp(arg, "--trace") == 0) {
+			opts.trace = val;
+			i++;
+		} else if (val && strcmp(arg, "--policy") == 0) {
+			opts.policy = val;
+			i++;
+		} else if (val && strcmp(arg, "--bitrate") == 0) {
+			opts.bitrate = atol(val);
+			i++;
+		} else if (val && strcmp(arg, "--audio-bitrate") == 0) {
+			opts.audio_bitrate = atol(val);
+			i++;
+		} else if (val && strcmp(arg, "--rtt") == 0) {
+			opts.rtt_msec = (uint32_t)atoi(val);
+			i++;
+		} else {
+			return false;
+		}
+	}
+
+	return opts.bitrate > 0 && opts.audio_bitrate >= 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (!parse_args(argc, argv)) {
+		fprintf(stderr,
+			"usage: %s [--trace file] [--policy id] "
+			"[--bitrate kbps] [--audio-bitrate kbps]\n"
+			"\t[--rtt ms] [--verbose]\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (opts.trace) {
+		if (!load_trace(opts.trace))
+			return 1;
+	} else {
+		default_trace();
+	}
+
+	if (opts.policy) {
+		const struct dbr_policy_info *policy =
+			dbr_find_policy(opts.policy);
+		if (!policy) {
+			fprintf(stderr, "unknown policy '%s'\n", opts.policy);
+			da_free(trace);
+			return 1;
+		}
+
+		run_policy(policy);
+	} else {
+		for (size_t i = 0; i < dbr_policy_count(); i++)
+			run_policy(dbr_get_policy(i));
+	}
+
+	da_free(trace);
+	return 0;
+}
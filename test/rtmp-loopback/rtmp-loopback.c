@@ -0,0 +1,1017 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+/*
+ * Streams synthetic video and audio through the rtmp_output of obs-outputs
+ * into a minimal RTMP server on the loopback interface, and reports the
+ * throughput and the latency of each packet from the encoder to the server.
+ *
+ * The encoders stamp every packet with the time it was encoded, the server
+ * reads the stamp back out of the FLV body when the message arrives.  Use
+ * it to compare the socket loops:
+ *
+ *   rtmp-loopback --seconds 30 --bitrate 50000
+ *   rtmp-loopback --seconds 30 --bitrate 50000 --new-socket-loop
+ *   rtmp-loopback --seconds 30 --bitrate 50000 --new-socket-loop --zerocopy
+ *
+ * The graphics module, libobs data and module paths can be changed with
+ * --graphics-module, --data-path and --module-path/--module-data-path when
+ * running from a build directory.
+ */
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define FPS 60
+#define KEYINT (FPS * 2)
+#define AUDIO_RATE 48000
+#define AUDIO_FRAMES 1024
+#define AUDIO_PACKET_SIZE 384
+
+#define STAMP_SIZE 16
+
+#define RTMP_HANDSHAKE_SIZE 1536
+#define RTMP_MAX_CSID 64
+#define RTMP_OUT_CHUNK_SIZE 4096
+
+#define RTMP_MSG_SET_CHUNK_SIZE 1
+#define RTMP_MSG_WINDOW_ACK_SIZE 5
+#define RTMP_MSG_SET_PEER_BW 6
+#define RTMP_MSG_AUDIO 8
+#define RTMP_MSG_VIDEO 9
+#define RTMP_MSG_AMF0_COMMAND 20
+
+struct options {
+	int seconds;
+	int bitrate;
+	bool new_socket_loop;
+	bool low_latency;
+	bool zerocopy;
+	const char *graphics_module;
+	const char *data_path;
+	const char *module_path;
+	const char *module_data_path;
+};
+
+static struct options opts = {
+	.seconds = 10,
+	.bitrate = 6000,
+	.graphics_module = "libobs-opengl",
+};
+
+/* ------------------------------------------------------------------------- */
+/* stamps */
+
+static void write_stamp(uint8_t *data)
+{
+	/* hex digits, so the stamp can never contain an annex-b start code */
+	char stamp[STAMP_SIZE + 1];
+	snprintf(stamp, sizeof(stamp), "%016llx",
+		 (unsigned long long)os_gettime_ns());
+	memcpy(data, stamp, STAMP_SIZE);
+}
+
+static bool read_stamp(const uint8_t *data, uint64_t *ts)
+{
+	char stamp[STAMP_SIZE + 1];
+	char *end;
+
+	memcpy(stamp, data, STAMP_SIZE);
+	stamp[STAMP_SIZE] = 0;
+
+	*ts = strtoull(stamp, &end, 16);
+	return end == stamp + STAMP_SIZE;
+}
+
+/* ------------------------------------------------------------------------- */
+/* encoders */
+
+static const uint8_t video_header[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x42,
+				       0x00, 0x1f, 0xac, 0x34, 0xc8, 0x14,
+				       0x00, 0x00, 0x00, 0x01, 0x68, 0xce,
+				       0x3c, 0x80};
+static const uint8_t audio_header[] = {0x12, 0x10};
+
+struct loopback_encoder {
+	DARRAY(uint8_t) packet;
+	size_t packet_size;
+	bool video;
+};
+
+static const char *loopback_video_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Loopback Video";
+}
+
+static const char *loopback_audio_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Loopback Audio";
+}
+
+static void *loopback_video_create(obs_data_t *settings, obs_encoder_t *enc)
+{
+	struct loopback_encoder *le = bzalloc(sizeof(*le));
+	UNUSED_PARAMETER(settings);
+	UNUSED_PARAMETER(enc);
+
+	le->video = true;
+	le->packet_size = (size_t)opts.bitrate * 1000 / 8 / FPS;
+	if (le->packet_size < 5 + STAMP_SIZE)
+		le->packet_size = 5 + STAMP_SIZE;
+	return le;
+}
+
+static void *loopback_audio_create(obs_data_t *settings, obs_encoder_t *enc)
+{
+	struct loopback_encoder *le = bzalloc(sizeof(*le));
+	UNUSED_PARAMETER(settings);
+	UNUSED_PARAMETER(enc);
+
+	le->packet_size = AUDIO_PACKET_SIZE;
+	return le;
+}
+
+static void loopback_encoder_destroy(void *data)
+{
+	struct loopback_encoder *le = data;
+	da_free(le->packet);
+	bfree(le);
+}
+
+static bool loopback_video_encode(void *data, struct encoder_frame *frame,
+				  struct encoder_packet *packet,
+				  bool *received_packet)
+{
+	struct loopback_encoder *le = data;
+	bool keyframe = frame->pts % KEYINT == 0;
+
+	da_resize(le->packet, le->packet_size);
+	memset(le->packet.array, 0xab, le->packet.num);
+
+	le->packet.array[0] = 0x00;
+	le->packet.array[1] = 0x00;
+	le->packet.array[2] = 0x00;
+	le->packet.array[3] = 0x01;
+	le->packet.array[4] = keyframe ? 0x65 : 0x41;
+	write_stamp(le->packet.array + 5);
+
+	packet->data = le->packet.array;
+	packet->size = le->packet.num;
+	packet->type = OBS_ENCODER_VIDEO;
+	packet->pts = frame->pts;
+	packet->dts = frame->pts;
+	packet->keyframe = keyframe;
+	*received_packet = true;
+	return true;
+}
+
+static bool loopback_audio_encode(void *data, struct encoder_frame *frame,
+				  struct encoder_packet *packet,
+				  bool *received_packet)
+{
+	struct loopback_encoder *le = data;
+
+	da_resize(le->packet, le->packet_size);
+	memset(le->packet.array, 0xab, le->packet.num);
+	write_stamp(le->packet.array);
+
+	packet->data = le->packet.array;
+	packet->size = le->packet.num;
+	packet->type = OBS_ENCODER_AUDIO;
+	packet->pts = frame->pts;
+	packet->dts = frame->pts;
+	*received_packet = true;
+	return true;
+}
+
+static size_t loopback_audio_frame_size(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return AUDIO_FRAMES;
+}
+
+static bool loopback_video_extra_data(void *data, uint8_t **extra_data,
+				      size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	*extra_data = (uint8_t *)video_header;
+	*size = sizeof(video_header);
+	return true;
+}
+
+static bool loopback_audio_extra_data(void *data, uint8_t **extra_data,
+				      size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	*extra_data = (uint8_t *)audio_header;
+	*size = sizeof(audio_header);
+	return true;
+}
+
+static struct obs_encoder_info loopback_video_info = {
+	.id = "loopback_video",
+	.type = OBS_ENCODER_VIDEO,
+	.codec = "h264",
+	.get_name = loopback_video_name,
+	.create = loopback_video_create,
+	.destroy = loopback_encoder_destroy,
+	.encode = loopback_video_encode,
+	.get_extra_data = loopback_video_extra_data,
+};
+
+static struct obs_encoder_info loopback_audio_info = {
+	.id = "loopback_audio",
+	.type = OBS_ENCODER_AUDIO,
+	.codec = "AAC",
+	.get_name = loopback_audio_name,
+	.create = loopback_audio_create,
+	.destroy = loopback_encoder_destroy,
+	.encode = loopback_audio_encode,
+	.get_frame_size = loopback_audio_frame_size,
+	.get_extra_data = loopback_audio_extra_data,
+};
+
+/* ------------------------------------------------------------------------- */
+/* service */
+
+static struct dstr service_url = {0};
+
+static const char *loopback_service_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Loopback";
+}
+
+static void *loopback_service_create(obs_data_t *settings,
+				     obs_service_t *service)
+{
+	UNUSED_PARAMETER(settings);
+	UNUSED_PARAMETER(service);
+	return &service_url;
+}
+
+static void loopback_service_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static const char *loopback_service_url(void *data)
+{
+	struct dstr *url = data;
+	return url->array;
+}
+
+static const char *loopback_service_key(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return "loopback";
+}
+
+static struct obs_service_info loopback_service_info = {
+	.id = "loopback_service",
+	.get_name = loopback_service_name,
+	.create = loopback_service_create,
+	.destroy = loopback_service_destroy,
+	.get_url = loopback_service_url,
+	.get_key = loopback_service_key,
+};
+
+/* ------------------------------------------------------------------------- */
+/* sink, just enough of an RTMP server to accept a publish */
+
+struct chunk_stream {
+	uint32_t timestamp;
+	uint32_t length;
+	uint8_t type;
+	uint32_t stream_id;
+	bool extended;
+	DARRAY(uint8_t) body;
+};
+
+struct sink {
+	int listen_fd;
+	int fd;
+	pthread_t thread;
+	bool thread_created;
+
+	struct chunk_stream streams[RTMP_MAX_CSID];
+	uint32_t in_chunk_size;
+	bool publishing;
+
+	uint64_t bytes;
+	uint64_t first_ts;
+	uint64_t last_ts;
+	DARRAY(uint64_t) video_latency;
+	DARRAY(uint64_t) audio_latency;
+	bool failed;
+};
+
+static bool recv_all(struct sink *sink, void *data, size_t size)
+{
+	uint8_t *pos = data;
+
+	while (size) {
+		ssize_t ret = recv(sink->fd, pos, size, 0);
+		if (ret == 0)
+			return false;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		pos += ret;
+		size -= (size_t)ret;
+		sink->bytes += (uint64_t)ret;
+	}
+
+	return true;
+}
+
+static bool send_all(struct sink *sink, const void *data, size_t size)
+{
+	const uint8_t *pos = data;
+
+	while (size) {
+		ssize_t ret = send(sink->fd, pos, size, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		pos += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static inline uint32_t rb24(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+}
+
+static inline uint32_t rb32(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 24) | rb24(data + 1);
+}
+
+static bool sink_handshake(struct sink *sink)
+{
+	uint8_t c0c1[1 + RTMP_HANDSHAKE_SIZE];
+	uint8_t s0s1s2[1 + RTMP_HANDSHAKE_SIZE * 2] = {0};
+	uint8_t c2[RTMP_HANDSHAKE_SIZE];
+
+	if (!recv_all(sink, c0c1, sizeof(c0c1)))
+		return false;
+
+	s0s1s2[0] = 3;
+	for (size_t i = 9; i < 1 + RTMP_HANDSHAKE_SIZE; i++)
+		s0s1s2[i] = (uint8_t)rand();
+	memcpy(s0s1s2 + 1 + RTMP_HANDSHAKE_SIZE, c0c1 + 1,
+	       RTMP_HANDSHAKE_SIZE);
+
+	if (!send_all(sink, s0s1s2, sizeof(s0s1s2)))
+		return false;
+	return recv_all(sink, c2, sizeof(c2));
+}
+
+/* ------------------------------------------------------------------------- */
+/* AMF0 writing */
+
+struct amf_writer {
+	DARRAY(uint8_t) data;
+};
+
+static void amf_number(struct amf_writer *w, double val)
+{
+	uint8_t out[9] = {0x00};
+	uint64_t bits;
+
+	memcpy(&bits, &val, sizeof(bits));
+	for (int i = 0; i < 8; i++)
+		out[1 + i] = (uint8_t)(bits >> (56 - i * 8));
+
+	da_push_back_array(w->data, out, sizeof(out));
+}
+
+static void amf_raw_string(struct amf_writer *w, const char *str)
+{
+	size_t len = strlen(str);
+	da_push_back(w->data, &(uint8_t){(uint8_t)(len >> 8)});
+	da_push_back(w->data, &(uint8_t){(uint8_t)len});
+	da_push_back_array(w->data, (const uint8_t *)str, len);
+}
+
+static void amf_string(struct amf_writer *w, const char *str)
+{
+	da_push_back(w->data, &(uint8_t){0x02});
+	amf_raw_string(w, str);
+}
+
+static void amf_null(struct amf_writer *w)
+{
+	da_push_back(w->data, &(uint8_t){0x05});
+}
+
+static void amf_object_begin(struct amf_writer *w)
+{
+	da_push_back(w->data, &(uint8_t){0x03});
+}
+
+static void amf_object_end(struct amf_writer *w)
+{
+	static const uint8_t end[] = {0x00, 0x00, 0x09};
+	da_push_back_array(w->data, end, sizeof(end));
+}
+
+static void amf_prop_string(struct amf_writer *w, const char *name,
+			    const char *val)
+{
+	amf_raw_string(w, name);
+	amf_string(w, val);
+}
+
+static void amf_prop_number(struct amf_writer *w, const char *name, double val)
+{
+	amf_raw_string(w, name);
+	amf_number(w, val);
+}
+
+/* ------------------------------------------------------------------------- */
+/* messages */
+
+static bool send_message(struct sink *sink, uint8_t csid, uint8_t type,
+			 uint32_t stream_id, const uint8_t *body, size_t size)
+{
+	uint8_t header[12];
+
+	if (size > RTMP_OUT_CHUNK_SIZE)
+		return false;
+
+	header[0] = csid;
+	header[1] = header[2] = header[3] = 0;
+	header[4] = (uint8_t)(size >> 16);
+	header[5] = (uint8_t)(size >> 8);
+	header[6] = (uint8_t)size;
+	header[7] = type;
+	header[8] = (uint8_t)stream_id;
+	header[9] = (uint8_t)(stream_id >> 8);
+	header[10] = (uint8_t)(stream_id >> 16);
+	header[11] = (uint8_t)(stream_id >> 24);
+
+	return send_all(sink, header, sizeof(header)) &&
+	       send_all(sink, body, size);
+}
+
+static bool send_control(struct sink *sink, uint8_t type, uint32_t val,
+			 size_t size)
+{
+	uint8_t body[5] = {(uint8_t)(val >> 24), (uint8_t)(val >> 16),
+			   (uint8_t)(val >> 8), (uint8_t)val, 2};
+	return send_message(sink, 2, type, 0, body, size);
+}
+
+static bool send_command(struct sink *sink, struct amf_writer *w,
+			 uint32_t stream_id)
+{
+	bool success = send_message(sink, 3, RTMP_MSG_AMF0_COMMAND, stream_id,
+				    w->data.array, w->data.num);
+	da_free(w->data);
+	return success;
+}
+
+static bool on_connect(struct sink *sink, double txn)
+{
+	struct amf_writer w = {0};
+
+	if (!send_control(sink, RTMP_MSG_WINDOW_ACK_SIZE, 2500000, 4) ||
+	    !send_control(sink, RTMP_MSG_SET_PEER_BW, 2500000, 5) ||
+	    !send_control(sink, RTMP_MSG_SET_CHUNK_SIZE, RTMP_OUT_CHUNK_SIZE,
+			  4))
+		return false;
+
+	amf_string(&w, "_result");
+	amf_number(&w, txn);
+	amf_object_begin(&w);
+	amf_prop_string(&w, "fmsVer", "FMS/3,0,1,123");
+	amf_prop_number(&w, "capabilities", 31.0);
+	amf_object_end(&w);
+	amf_object_begin(&w);
+	amf_prop_string(&w, "level", "status");
+	amf_prop_string(&w, "code", "NetConnection.Connect.Success");
+	amf_prop_string(&w, "description", "Connection succeeded.");
+	amf_prop_number(&w, "objectEncoding", 0.0);
+	amf_object_end(&w);
+	return send_command(sink, &w, 0);
+}
+
+static bool on_create_stream(struct sink *sink, double txn)
+{
+	struct amf_writer w = {0};
+
+	amf_string(&w, "_result");
+	amf_number(&w, txn);
+	amf_null(&w);
+	amf_number(&w, 1.0);
+	return send_command(sink, &w, 0);
+}
+
+static bool on_publish(struct sink *sink)
+{
+	struct amf_writer w = {0};
+
+	amf_string(&w, "onStatus");
+	amf_number(&w, 0.0);
+	amf_null(&w);
+	amf_object_begin(&w);
+	amf_prop_string(&w, "level", "status");
+	amf_prop_string(&w, "code", "NetStream.Publish.Start");
+	amf_prop_string(&w, "description", "Publishing.");
+	amf_object_end(&w);
+
+	sink->publishing = true;
+	return send_command(sink, &w, 1);
+}
+
+static bool handle_command(struct sink *sink, const uint8_t *body,
+			   size_t size)
+{
+	char name[64];
+	size_t len;
+	uint64_t bits = 0;
+	double txn = 0.0;
+
+	if (size < 3 || body[0] != 0x02)
+		return true;
+
+	len = ((size_t)body[1] << 8) | body[2];
+	if (len >= sizeof(name) || 3 + len + 9 > size)
+		return true;
+
+	memcpy(name, body + 3, len);
+	name[len] = 0;
+
+	if (body[3 + len] == 0x00) {
+		for (size_t i = 0; i < 8; i++)
+			bits = (bits << 8) | body[3 + len + 1 + i];
+		memcpy(&txn, &bits, sizeof(txn));
+	}
+
+	if (strcmp(name, "connect") == 0)
+		return on_connect(sink, txn);
+	if (strcmp(name, "createStream") == 0)
+		return on_create_stream(sink, txn);
+	if (strcmp(name, "publish") == 0)
+		return on_publish(sink);
+	return true;
+}
+
+static void add_latency(struct sink *sink, bool video, const uint8_t *stamp)
+{
+	uint64_t now = os_gettime_ns();
+	uint64_t ts;
+
+	if (!read_stamp(stamp, &ts) || ts > now)
+		return;
+
+	if (!sink->first_ts)
+		sink->first_ts = now;
+	sink->last_ts = now;
+
+	if (video)
+		da_push_back(sink->video_latency, &(uint64_t){now - ts});
+	else
+		da_push_back(sink->audio_latency, &(uint64_t){now - ts});
+}
+
+static bool handle_message(struct sink *sink, struct chunk_stream *cs)
+{
+	const uint8_t *body = cs->body.array;
+	size_t size = cs->body.num;
+
+	switch (cs->type) {
+	case RTMP_MSG_SET_CHUNK_SIZE:
+		if (size >= 4)
+			sink->in_chunk_size = rb32(body) & 0x7fffffff;
+		break;
+
+	case RTMP_MSG_AMF0_COMMAND:
+		return handle_command(sink, body, size);
+
+	case RTMP_MSG_VIDEO:
+		/* flv tag header, avc packet header, nal size, nal header */
+		if (size >= 10 + STAMP_SIZE && body[1] == 1)
+			add_latency(sink, true, body + 10);
+		break;
+
+	case RTMP_MSG_AUDIO:
+		if (size >= 2 + STAMP_SIZE && body[1] == 1)
+			add_latency(sink, false, body + 2);
+		break;
+	}
+
+	return true;
+}
+
+static bool read_chunk(struct sink *sink)
+{
+	static const size_t header_sizes[] = {11, 7, 3, 0};
+	uint8_t basic;
+	uint8_t header[11];
+	struct chunk_stream *cs;
+	size_t fmt, csid, remaining, chunk;
+
+	if (!recv_all(sink, &basic, 1))
+		return false;
+
+	fmt = basic >> 6;
+	csid = basic & 0x3f;
+	if (csid < 2 || csid >= RTMP_MAX_CSID) {
+		fprintf(stderr, "sink: unsupported chunk stream id\n");
+		return false;
+	}
+
+	cs = &sink->streams[csid];
+	if (!recv_all(sink, header, header_sizes[fmt]))
+		return false;
+
+	if (fmt <= 2) {
+		uint32_t ts = rb24(header);
+		cs->extended = ts == 0xffffff;
+		cs->timestamp = ts;
+	}
+	if (fmt <= 1) {
+		cs->length = rb24(header + 3);
+		cs->type = header[6];
+	}
+	if (fmt == 0)
+		cs->stream_id = header[7] | (header[8] << 8) |
+				(header[9] << 16) |
+				((uint32_t)header[10] << 24);
+
+	if (cs->extended) {
+		uint8_t ext[4];
+		if (!recv_all(sink, ext, sizeof(ext)))
+			return false;
+		cs->timestamp = rb32(ext);
+	}
+
+	remaining = cs->length - cs->body.num;
+	chunk = remaining < sink->in_chunk_size ? remaining
+						: sink->in_chunk_size;
+
+	da_resize(cs->body, cs->body.num + chunk);
+	if (!recv_all(sink, cs->body.array + cs->body.num - chunk, chunk))
+		return false;
+
+	if (cs->body.num == cs->length) {
+		bool success = handle_message(sink, cs);
+		da_resize(cs->body, 0);
+		return success;
+	}
+
+	return true;
+}
+
+static void *sink_thread(void *data)
+{
+	struct sink *sink = data;
+
+	os_set_thread_name("rtmp-loopback: sink");
+
+	sink->fd = accept(sink->listen_fd, NULL, NULL);
+	if (sink->fd == -1) {
+		sink->failed = true;
+		return NULL;
+	}
+
+	sink->in_chunk_size = 128;
+
+	if (!sink_handshake(sink)) {
+		fprintf(stderr, "sink: handshake failed\n");
+		sink->failed = true;
+		return NULL;
+	}
+
+	while (read_chunk(sink))
+		;
+
+	return NULL;
+}
+
+static bool sink_start(struct sink *sink, int *port)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t addr_len = sizeof(addr);
+
+	sink->fd = -1;
+	sink->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sink->listen_fd == -1)
+		return false;
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(sink->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sink->listen_fd, 1) ||
+	    getsockname(sink->listen_fd, (struct sockaddr *)&addr, &addr_len))
+		return false;
+
+	*port = ntohs(addr.sin_port);
+
+	if (pthread_create(&sink->thread, NULL, sink_thread, sink) != 0)
+		return false;
+
+	sink->thread_created = true;
+	return true;
+}
+
+static void sink_stop(struct sink *sink)
+{
+	if (sink->fd != -1)
+		shutdown(sink->fd, SHUT_RDWR);
+	if (sink->listen_fd != -1)
+		shutdown(sink->listen_fd, SHUT_RDWR);
+	if (sink->thread_created)
+		pthread_join(sink->thread, NULL);
+	if (sink->fd != -1)
+		close(sink->fd);
+	if (sink->listen_fd != -1)
+		close(sink->listen_fd);
+
+	for (size_t i = 0; i < RTMP_MAX_CSID; i++)
+		da_free(sink->streams[i].body);
+}
+
+/* ------------------------------------------------------------------------- */
+/* results */
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t *)a;
+	uint64_t val_b = *(const uint64_t *)b;
+	return val_a < val_b ? -1 : (val_a > val_b ? 1 : 0);
+}
+
+static void print_latency(const char *name, uint64_t *samples, size_t num)
+{
+	uint64_t total = 0;
+
+	if (!num) {
+		printf("%s: no packets received\n", name);
+		return;
+	}
+
+	qsort(samples, num, sizeof(*samples), compare_u64);
+	for (size_t i = 0; i < num; i++)
+		total += samples[i];
+
+	printf("%s: %zu packets, latency avg %.3f ms, p50 %.3f ms, "
+	       "p99 %.3f ms, max %.3f ms\n",
+	       name, num, (double)total / (double)num / 1000000.0,
+	       (double)samples[num / 2] / 1000000.0,
+	       (double)samples[num * 99 / 100] / 1000000.0,
+	       (double)samples[num - 1] / 1000000.0);
+}
+
+static void print_results(struct sink *sink, obs_output_t *output)
+{
+	double seconds = (double)(sink->last_ts - sink->first_ts) / 1e9;
+
+	printf("socket loop: %s%s%s\n",
+	       opts.new_socket_loop ? "new" : "default",
+	       opts.low_latency ? ", low latency" : "",
+	       opts.zerocopy ? ", zero-copy" : "");
+	printf("received: %.2f MB in %.2f s, %.2f MB/s (target %.2f MB/s)\n",
+	       (double)sink->bytes / 1000000.0, seconds,
+	       seconds > 0.0 ? (double)sink->bytes / 1000000.0 / seconds
+			     : 0.0,
+	       (double)opts.bitrate / 8000.0);
+
+	print_latency("video", sink->video_latency.array,
+		      sink->video_latency.num);
+	print_latency("audio", sink->audio_latency.array,
+		      sink->audio_latency.num);
+
+	printf("dropped frames: %d of %d\n",
+	       obs_output_get_frames_dropped(output),
+	       obs_output_get_total_frames(output));
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool parse_args(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--new-socket-loop") == 0) {
+			opts.new_socket_loop = true;
+		} else if (strcmp(arg, "--low-latency") == 0) {
+			opts.low_latency = true;
+		} else if (strcmp(arg, "--zerocopy") == 0) {
+			opts.zerocopy = true;
+		} else if (val && strcmp(arg, "--seconds") == 0) {
+			opts.seconds = atoi(val);
+			i++;
+		} else if (val && strcmp(arg, "--bitrate") == 0) {
+			opts.bitrate = atoi(val);
+			i++;
+		} else if (val && strcmp(arg, "--graphics-module") == 0) {
+			opts.graphics_module = val;
+			i++;
+		} else if (val && strcmp(arg, "--data-path") == 0) {
+			opts.data_path = val;
+			i++;
+		} else if (val && strcmp(arg, "--module-path") == 0) {
+			opts.module_path = val;
+			i++;
+		} else if (val && strcmp(arg, "--module-data-path") == 0) {
+			opts.module_data_path = val;
+			i++;
+		} else {
+			return false;
+		}
+	}
+
+	return opts.seconds > 0 && opts.bitrate > 0;
+}
+
+static bool reset_obs(void)
+{
+	struct obs_video_info ovi = {0};
+	struct obs_audio_info oai = {0};
+
+	if (opts.data_path)
+		obs_add_data_path(opts.data_path);
+
+	ovi.graphics_module = opts.graphics_module;
+	ovi.fps_num = FPS;
+	ovi.fps_den = 1;
+	ovi.base_width = ovi.output_width = WIDTH;
+	ovi.base_height = ovi.output_height = HEIGHT;
+	ovi.output_format = VIDEO_FORMAT_NV12;
+	ovi.colorspace = VIDEO_CS_709;
+	ovi.range = VIDEO_RANGE_PARTIAL;
+	ovi.adapter = 0;
+	ovi.gpu_conversion = true;
+	ovi.scale_type = OBS_SCALE_BICUBIC;
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS) {
+		fprintf(stderr, "failed to reset video with '%s'\n",
+			opts.graphics_module);
+		return false;
+	}
+
+	oai.samples_per_sec = AUDIO_RATE;
+	oai.speakers = SPEAKERS_STEREO;
+	return obs_reset_audio(&oai);
+}
+
+static int run(void)
+{
+	struct sink sink = {0};
+	obs_service_t *service = NULL;
+	obs_encoder_t *venc = NULL;
+	obs_encoder_t *aenc = NULL;
+	obs_output_t *output = NULL;
+	obs_data_t *settings;
+	int port;
+	int ret = 1;
+
+	if (opts.module_path) {
+		const char *data_path = opts.module_data_path
+						 ? opts.module_data_path
+						 : opts.module_path;
+		obs_add_module_path(opts.module_path, data_path);
+	}
+	obs_load_all_modules();
+
+	obs_register_encoder(&loopback_video_info);
+	obs_register_encoder(&loopback_audio_info);
+	obs_register_service(&loopback_service_info);
+
+	if (!sink_start(&sink, &port)) {
+		fprintf(stderr, "failed to start the sink\n");
+		goto fail;
+	}
+
+	dstr_printf(&service_url, "rtmp://127.0.0.1:%d/live", port);
+
+	service = obs_service_create("loopback_service", "loopback", NULL,
+				     NULL);
+	/* the new socket loop sizes its buffer from the encoder bitrate */
+	settings = obs_data_create();
+	obs_data_set_int(settings, "bitrate", opts.bitrate);
+	venc = obs_video_encoder_create("loopback_video", "video", settings,
+					NULL);
+	obs_data_release(settings);
+	aenc = obs_audio_encoder_create("loopback_audio", "audio", NULL, 0,
+					NULL);
+
+	settings = obs_data_create();
+	obs_data_set_bool(settings, "new_socket_loop_enabled",
+			  opts.new_socket_loop);
+	obs_data_set_bool(settings, "low_latency_mode_enabled",
+			  opts.low_latency);
+	obs_data_set_bool(settings, "zerocopy_enabled", opts.zerocopy);
+	output = obs_output_create("rtmp_output", "loopback", settings, NULL);
+	obs_data_release(settings);
+
+	if (!service || !venc || !aenc || !output) {
+		fprintf(stderr, "failed to create the output, is obs-outputs "
+				"loaded?\n");
+		goto fail;
+	}
+
+	obs_encoder_set_video(venc, obs_get_video());
+	obs_encoder_set_audio(aenc, obs_get_audio());
+	obs_output_set_video_encoder(output, venc);
+	obs_output_set_audio_encoder(output, aenc, 0);
+	obs_output_set_service(output, service);
+
+	if (!obs_output_start(output)) {
+		fprintf(stderr, "failed to start the output: %s\n",
+			obs_output_get_last_error(output));
+		goto fail;
+	}
+
+	for (int i = 0; i < opts.seconds * 10; i++) {
+		if (sink.failed)
+			break;
+		os_sleep_ms(100);
+	}
+
+	obs_output_stop(output);
+	for (int i = 0; i < 100 && obs_output_active(output); i++)
+		os_sleep_ms(100);
+
+	if (!sink.publishing) {
+		fprintf(stderr, "the output never started publishing\n");
+		goto fail;
+	}
+
+	print_results(&sink, output);
+	ret = 0;
+
+fail:
+	if (output)
+		obs_output_force_stop(output);
+	sink_stop(&sink);
+
+	obs_output_release(output);
+	obs_encoder_release(venc);
+	obs_encoder_release(aenc);
+	obs_service_release(service);
+
+	da_free(sink.video_latency);
+	da_free(sink.audio_latency);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 1;
+
+	if (!parse_args(argc, argv)) {
+		fprintf(stderr,
+			"usage: %s [--seconds n] [--bitrate kbps] "
+			"[--new-socket-loop] [--low-latency] [--zerocopy]\n"
+			"\t[--graphics-module name] [--data-path path] "
+			"[--module-path path]\n\t[--module-data-path path]\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (!obs_startup("en-US", NULL, NULL)) {
+		fprintf(stderr, "obs_startup failed\n");
+		return 1;
+	}
+
+	if (reset_obs())
+		ret = run();
+
+	obs_shutdown();
+	dstr_free(&service_url);
+
+	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	return ret;
+}
@@ -0,0 +1,127 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <inttypes.h>
+
+/*
+ * Encoded output that takes "delay_ms" to handle every packet and logs how
+ * late packets reached it when it is destroyed.  Start a slow one next to
+ * one with no delay on the same encoders: the normal output's latency should
+ * stay flat while the slow one falls behind and, with "drop" set, drops
+ * frames instead of holding up the encoders once its delivery buffer is
+ * full.
+ */
+
+struct test_output {
+	obs_output_t *output;
+	uint32_t delay_ms;
+
+	int64_t packets;
+	int64_t total_latency_us;
+	int64_t max_latency_us;
+};
+
+static const char *test_output_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Delivery Test Output";
+}
+
+static void test_output_update(void *data, obs_data_t *settings)
+{
+	struct test_output *to = data;
+	bool drop = obs_data_get_bool(settings, "drop");
+
+	to->delay_ms = (uint32_t)obs_data_get_int(settings, "delay_ms");
+	obs_output_set_delivery_buffer(
+		to->output, (uint32_t)obs_data_get_int(settings, "buffer_ms"),
+		drop ? OBS_OUTPUT_OVERFLOW_DROP_TO_KEYFRAME
+		     : OBS_OUTPUT_OVERFLOW_BLOCK);
+}
+
+static void *test_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct test_output *to = bzalloc(sizeof(struct test_output));
+	to->output = output;
+	test_output_update(to, settings);
+	return to;
+}
+
+static void test_output_destroy(void *data)
+{
+	struct test_output *to = data;
+
+	/* the delivery thread may still be draining after stop returns, so
+	 * the counts are only final here */
+	blog(LOG_INFO,
+	     "[test_output: '%s'] %" PRId64 " packets, latency avg %.1f ms, "
+	     "max %.1f ms, %d frames dropped",
+	     obs_output_get_name(to->output), to->packets,
+	     to->packets ? (double)to->total_latency_us / to->packets / 1000.0
+			 : 0.0,
+	     (double)to->max_latency_us / 1000.0,
+	     obs_output_get_frames_dropped(to->output));
+
+	bfree(to);
+}
+
+static bool test_output_start(void *data)
+{
+	struct test_output *to = data;
+
+	if (!obs_output_can_begin_data_capture(to->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(to->output, 0))
+		return false;
+
+	to->packets = 0;
+	to->total_latency_us = 0;
+	to->max_latency_us = 0;
+
+	obs_output_begin_data_capture(to->output, 0);
+	return true;
+}
+
+static void test_output_stop(void *data, uint64_t ts)
+{
+	struct test_output *to = data;
+	obs_output_end_data_capture(to->output);
+	UNUSED_PARAMETER(ts);
+}
+
+static void test_output_packet(void *data, struct encoder_packet *packet)
+{
+	struct test_output *to = data;
+	int64_t latency_us;
+
+	if (!packet)
+		return;
+
+	if (to->delay_ms)
+		os_sleep_ms(to->delay_ms);
+
+	latency_us = (int64_t)(os_gettime_ns() / 1000) - packet->sys_dts_usec;
+	if (latency_us > to->max_latency_us)
+		to->max_latency_us = latency_us;
+	to->total_latency_us += latency_us;
+	to->packets++;
+}
+
+static void test_output_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "delay_ms", 0);
+	obs_data_set_default_int(settings, "buffer_ms", 2000);
+	obs_data_set_default_bool(settings, "drop", true);
+}
+
+struct obs_output_info test_output = {
+	.id = "test_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED,
+	.get_name = test_output_getname,
+	.create = test_output_create,
+	.destroy = test_output_destroy,
+	.start = test_output_start,
+	.stop = test_output_stop,
+	.encoded_packet = test_output_packet,
+	.update = test_output_update,
+	.get_defaults = test_output_defaults,
+};